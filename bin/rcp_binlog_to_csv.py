@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+
+#
+# Converts a binary RaceCapture log (.rcb) into the CSV format that the
+# firmware writes when the SD log format is set to CSV.  See
+# include/logger/binary_log.h for the layout of the binary log.
+#
+
+import optparse
+import struct
+
+class RcpBinaryLogConverter(object):
+    MAGIC = b'RCPB'
+    VERSION = 1
+    RECORD_MARKER = 0xA5
+
+    HEADER = struct.Struct('<4sBBHH')
+    CHANNEL = struct.Struct('<12s8sffHBB')
+
+    TYPE_INT32 = 0
+    TYPE_INT64 = 1
+    TYPE_FLOAT = 2
+    TYPE_DOUBLE = 3
+
+    VALUE_FORMATS = {
+        TYPE_INT32: '<i',
+        TYPE_INT64: '<q',
+        TYPE_FLOAT: '<f',
+        TYPE_DOUBLE: '<d',
+    }
+
+    def __init__(self):
+        self.channels = []
+        self.record_size = 0
+        self.headers = 0
+        self.records = 0
+
+    @staticmethod
+    def _cstr(raw):
+        return raw.split(b'\0', 1)[0].decode('ascii', 'replace')
+
+    @staticmethod
+    def _format_float(value, precision):
+        return '{:.{}f}'.format(value, precision)
+
+    def _read_header(self, data, pos):
+        magic, version, _, count, _ = self.HEADER.unpack_from(data, pos)
+        if magic != self.MAGIC:
+            raise ValueError("Bad header magic at offset {}".format(pos))
+        if version != self.VERSION:
+            raise ValueError("Unsupported log version {}".format(version))
+        pos += self.HEADER.size
+
+        self.channels = []
+        for _ in range(count):
+            label, units, cmin, cmax, rate, precision, ctype = \
+                self.CHANNEL.unpack_from(data, pos)
+            pos += self.CHANNEL.size
+            self.channels.append({
+                'label': self._cstr(label),
+                'units': self._cstr(units),
+                'min': cmin,
+                'max': cmax,
+                'rate': rate,
+                'precision': precision,
+                'fmt': struct.Struct(self.VALUE_FORMATS[ctype]),
+                'float': ctype in (self.TYPE_FLOAT, self.TYPE_DOUBLE),
+            })
+
+        self.record_size = 1 + (count + 7) // 8 + \
+            sum(ch['fmt'].size for ch in self.channels)
+        self.headers += 1
+        return pos
+
+    def _header_line(self):
+        cols = []
+        for ch in self.channels:
+            cols.append('"{}"|"{}"|{}|{}|{}'.format(
+                ch['label'], ch['units'],
+                self._format_float(ch['min'], ch['precision']),
+                self._format_float(ch['max'], ch['precision']),
+                ch['rate']))
+        return ','.join(cols) + '\n'
+
+    def _read_record(self, data, pos):
+        pos += 1
+        mask_len = (len(self.channels) + 7) // 8
+        mask = data[pos:pos + mask_len]
+        pos += mask_len
+
+        cols = []
+        for idx, ch in enumerate(self.channels):
+            value = ch['fmt'].unpack_from(data, pos)[0]
+            pos += ch['fmt'].size
+
+            if not mask[idx // 8] & (1 << (idx % 8)):
+                cols.append('')
+            elif ch['float']:
+                cols.append(self._format_float(value, ch['precision']))
+            else:
+                cols.append(str(value))
+
+        self.records += 1
+        return pos, ','.join(cols) + '\n'
+
+    def convert(self, input_path, output_path):
+        with open(input_path, 'rb') as file_in:
+            data = file_in.read()
+
+        pos = 0
+        with open(output_path, 'w') as file_out:
+            while pos < len(data):
+                if data[pos:pos + len(self.MAGIC)] == self.MAGIC:
+                    pos = self._read_header(data, pos)
+                    file_out.write(self._header_line())
+                elif data[pos] == self.RECORD_MARKER and self.channels:
+                    if pos + self.record_size > len(data):
+                        print("Warning: Truncated record at offset "
+                              "{}".format(pos))
+                        break
+                    pos, line = self._read_record(data, pos)
+                    file_out.write(line)
+                else:
+                    print("Error: Unexpected data at offset {}. "
+                          "Stopping.".format(pos))
+                    break
+
+        print()
+        print("=== Conversion Stats ===")
+        print("   Headers:  {}".format(self.headers))
+        print("   Records:  {}".format(self.records))
+        print()
+
+
+def main():
+    parser = optparse.OptionParser()
+    parser.add_option('-f', '--filename',
+                      dest="log_file",
+                      help="Path of binary log file to convert")
+
+    parser.add_option('-o', '--output',
+                      dest="out_file",
+                      help="Path to output CSV file")
+
+    options, remainder = parser.parse_args()
+
+    if not options.log_file:
+        parser.error("No log file path given")
+
+    if not options.out_file:
+        parser.error("No output file path given")
+
+    RcpBinaryLogConverter().convert(options.log_file, options.out_file)
+
+if __name__ == '__main__':
+    main()
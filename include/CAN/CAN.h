@@ -25,6 +25,7 @@
 #include "cpp_guard.h"
 #include "loggerConfig.h"
 
+#include <stddef.h>
 #include <stdint.h>
 
 CPP_GUARD_BEGIN
@@ -58,6 +59,17 @@ int CAN_set_filter(const uint8_t, const uint8_t id, const uint8_t extended, cons
 int CAN_tx_msg(const uint8_t channel, const CAN_msg *msg, const unsigned int timeoutMs);
 int CAN_rx_msg(CAN_msg *msg, const unsigned int timeoutMs);
 
+/**
+ * Receive every CAN message that is waiting, up to a limit, waiting for
+ * the first one if need be.
+ * @param msgs array to receive the messages into
+ * @param max the number of messages the array holds
+ * @param timeoutMs how long to wait for the first message
+ * @return the number of messages received; 0 on timeout
+ */
+size_t CAN_rx_msgs(CAN_msg *msgs, const size_t max,
+                   const unsigned int timeoutMs);
+
 CPP_GUARD_END
 
 #endif /* CAN_H_ */
@@ -23,6 +23,7 @@
 #define INCLUDE_CAN_CAN_AUX_FILTERQUEUE_H_
 
 #include "CAN.h"
+#include "CAN_filters.h"
 #include <stddef.h>
 
 #define CAN_AUX_FILTERQUEUE_LENGTH 10
@@ -41,6 +42,12 @@ bool CAN_aux_filterqueue_init(void);
  */
 void CAN_aux_filterqueue_configure(uint8_t can_bus, uint32_t low_id_range, uint32_t high_id_range);
 
+/**
+ * Add the configured ID range to the CAN filter plans
+ * @param plans array of CAN_CHANNELS filter plans
+ */
+void CAN_aux_filterqueue_add_rx_filters(struct CAN_filter_plan *plans);
+
 /**
  * Puts a CAN message into the Auxiliary CAN message filterqueue
  * @param msg the CAN message to put
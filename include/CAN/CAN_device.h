@@ -26,15 +26,31 @@
 #include "CAN.h"
 #include "loggerConfig.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 CPP_GUARD_BEGIN
 
+/**
+ * Receive side health of one CAN controller
+ */
+struct CAN_device_health {
+        uint32_t rx_dropped;    /* frames lost to a full receive queue */
+        uint8_t rx_errors;      /* receive error counter */
+        uint8_t tx_errors;      /* transmit error counter */
+        uint8_t last_error;     /* last error code, 0 for none */
+        bool bus_off;
+};
+
 int CAN_device_init(const uint8_t channel, const uint32_t baud, const bool termination_enabled);
 int CAN_device_set_filter(const uint8_t channel, const uint8_t id, const uint8_t extended,
                           const uint32_t filter, const uint32_t mask, const bool enabled);
 int CAN_device_tx_msg(const uint8_t channel, const CAN_msg *msg, const unsigned int timeoutMs);
 int CAN_device_rx_msg(CAN_msg *msg, const unsigned int timeoutMs);
+size_t CAN_device_rx_msgs(CAN_msg *msgs, const size_t max,
+                          const unsigned int timeoutMs);
+int CAN_device_get_health(const uint8_t channel,
+                          struct CAN_device_health *health);
 
 CPP_GUARD_END
 
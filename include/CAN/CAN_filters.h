@@ -0,0 +1,175 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAN_FILTERS_H_
+#define _CAN_FILTERS_H_
+
+#include "CAN.h"
+#include "cpp_guard.h"
+#include "loggerConfig.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+CPP_GUARD_BEGIN
+
+/* Hardware acceptance filters available to each CAN channel */
+#define CAN_FILTER_BANKS 14
+
+/* Largest standard (11 bit) CAN ID */
+#define CAN_STD_ID_MAX 0x7FF
+
+/**
+ * An ID / mask acceptance filter.  Both live in the 29 bit extended ID
+ * space, with standard IDs occupying the top 11 bits; that is how the
+ * controller lays out both kinds of identifier.
+ */
+struct CAN_filter {
+        uint32_t id;
+        uint32_t mask;
+};
+
+/**
+ * The set of acceptance filters planned for one CAN channel.  When more
+ * filters are added than there are banks, the closest pair is widened
+ * into one filter, so the plan always fits and never rejects a frame
+ * that one of its filters accepted.
+ */
+struct CAN_filter_plan {
+        bool accept_all;
+        uint8_t count;
+        struct CAN_filter filters[CAN_FILTER_BANKS];
+};
+
+/**
+ * Reset a plan to accept nothing
+ */
+void CAN_filter_plan_init(struct CAN_filter_plan *plan);
+
+/**
+ * Make a plan accept every frame
+ */
+void CAN_filter_plan_accept_all(struct CAN_filter_plan *plan);
+
+/**
+ * Add a CAN ID and mask, as used by CAN mappings, to a plan.  IDs above
+ * CAN_STD_ID_MAX are treated as extended IDs.  The others are accepted
+ * in both standard and extended frames, since CAN mappings match either.
+ * @param plan the plan to add to
+ * @param can_id the CAN ID to accept
+ * @param can_mask the mask applied to the ID; 0 to match the ID exactly
+ */
+void CAN_filter_plan_add(struct CAN_filter_plan *plan, uint32_t can_id,
+                         uint32_t can_mask);
+
+/**
+ * Add a CAN ID and mask that only come in extended frames to a plan
+ * @param plan the plan to add to
+ * @param can_id the extended CAN ID to accept
+ * @param can_mask the mask applied to the ID; 0 to match the ID exactly
+ */
+void CAN_filter_plan_add_extended(struct CAN_filter_plan *plan,
+                                  uint32_t can_id, uint32_t can_mask);
+
+/**
+ * Add an inclusive range of CAN IDs, in standard or extended frames, to
+ * a plan
+ */
+void CAN_filter_plan_add_range(struct CAN_filter_plan *plan, uint32_t low_id,
+                               uint32_t high_id);
+
+/**
+ * Lay out a filter and mask, as given to CAN_set_filter, the way struct
+ * CAN_filter does.  The drivers program the controller from this.
+ * @param extended true if the filter and mask are 29 bit extended IDs
+ * @param filter the CAN ID to accept
+ * @param mask the ID bits that have to match; 0 accepts every ID
+ */
+struct CAN_filter CAN_filter_layout(bool extended, uint32_t filter,
+                                    uint32_t mask);
+
+/**
+ * Check a CAN message against a plan, the way the controller would
+ * @return true if the plan lets the message through
+ */
+bool CAN_filter_plan_accepts(const struct CAN_filter_plan *plan,
+                             const CAN_msg *msg);
+
+/**
+ * Plan the filters for every CAN channel from the CAN channel mappings,
+ * OBD2 PIDs and the other receivers of CAN messages.
+ * @param plans array of CAN_CHANNELS plans to fill in
+ * @param lc the logger configuration
+ */
+void CAN_filters_build(struct CAN_filter_plan *plans, const LoggerConfig *lc);
+
+/**
+ * Build the filter plans and program them into the CAN controller.
+ * Channels whose filters were set by hand are left alone.
+ * @param lc the logger configuration
+ */
+void CAN_filters_update(const LoggerConfig *lc);
+
+/**
+ * Flag that the filters need to be planned again
+ */
+void CAN_filters_stale(void);
+
+/**
+ * @return true if the filters need to be planned again
+ */
+bool CAN_filters_is_stale(void);
+
+/**
+ * Flag that the filters for a channel are set by hand, or that they are
+ * back to the defaults after the channel was initialized.
+ * @param channel the CAN channel
+ * @param manual true if the filters were set by hand
+ */
+void CAN_filters_set_manual(uint8_t channel, bool manual);
+
+/**
+ * Register a script that reads every CAN message on a channel, as rxCAN
+ * does.  The channel accepts every frame from then on, until the script
+ * receivers are cleared.
+ * @param channel the CAN channel
+ */
+void CAN_filters_add_script_rx(uint8_t channel);
+
+/**
+ * Register a script that reads ISO-TP responses on a CAN ID, as
+ * readIsoTp does.  The filters are planned again the first time an ID
+ * is registered.
+ * @param channel the CAN channel
+ * @param can_id the CAN ID the responses arrive on
+ * @param extended true for a 29 bit CAN ID
+ */
+void CAN_filters_add_script_isotp(uint8_t channel, uint32_t can_id,
+                                  bool extended);
+
+/**
+ * Forget every receiver registered by a script, for when a new script
+ * is loaded.
+ */
+void CAN_filters_clear_script_rx(void);
+
+CPP_GUARD_END
+
+#endif /* _CAN_FILTERS_H_ */
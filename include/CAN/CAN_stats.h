@@ -0,0 +1,123 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAN_STATS_H_
+#define _CAN_STATS_H_
+
+#include "CAN.h"
+#include "cpp_guard.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+CPP_GUARD_BEGIN
+
+/* How often the rates are worked out */
+#define CAN_STATS_WINDOW_MS 1000
+
+/* IDs counted per bus each window, and how many of them are reported */
+#define CAN_STATS_TRACKED_IDS 16
+#define CAN_STATS_TOP_IDS 8
+
+/**
+ * The places a received CAN frame can be dropped
+ */
+enum can_stats_queue {
+        CAN_STATS_QUEUE_RX = 0,         /* driver receive queue */
+        CAN_STATS_QUEUE_AUX,            /* Lua rxCAN queue */
+        CAN_STATS_QUEUE_FILTER,         /* API rxCan queue */
+        CAN_STATS_QUEUES,
+};
+
+struct can_id_rate {
+        uint32_t can_id;
+        uint32_t rate;
+};
+
+/**
+ * Counters for one CAN bus.  Totals count from power up; rates cover
+ * the last complete window.
+ */
+struct can_bus_stats {
+        uint32_t frames;
+        uint32_t bytes;
+        uint32_t frame_rate;
+        uint32_t byte_rate;
+        uint32_t dropped[CAN_STATS_QUEUES];
+        uint8_t rx_errors;
+        uint8_t tx_errors;
+        uint8_t last_error;
+        bool bus_off;
+        uint8_t top_count;
+        struct can_id_rate top[CAN_STATS_TOP_IDS];
+};
+
+/**
+ * Counters for the CAN task itself, over the last complete window
+ */
+struct can_task_stats {
+        uint32_t loops;
+        uint32_t max_loop_ms;
+        uint16_t max_batch;
+};
+
+/**
+ * Clear all of the counters
+ */
+void CAN_stats_init(void);
+
+/**
+ * Count a batch of received frames.  Called only by the CAN task.
+ */
+void CAN_stats_rx(const CAN_msg *msgs, size_t count);
+
+/**
+ * Count a frame dropped because a queue was full
+ */
+void CAN_stats_dropped(uint8_t can_bus, enum can_stats_queue queue);
+
+/**
+ * Count one pass of the CAN task loop
+ * @param batch the number of frames handled
+ * @param ticks how long the frames took to handle
+ */
+void CAN_stats_loop(size_t batch, size_t ticks);
+
+/**
+ * Publish the rates once a window has passed.  Called only by the CAN
+ * task.
+ * @param ticks the current tick count
+ */
+void CAN_stats_update(size_t ticks);
+
+/**
+ * @return the published counters for a bus, or NULL for an invalid bus
+ */
+const struct can_bus_stats* CAN_stats_get_bus(uint8_t can_bus);
+
+/**
+ * @return the published counters for the CAN task
+ */
+const struct can_task_stats* CAN_stats_get_task(void);
+
+CPP_GUARD_END
+
+#endif /* _CAN_STATS_H_ */
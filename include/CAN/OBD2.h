@@ -23,6 +23,7 @@
 
 #include "cpp_guard.h"
 #include "CAN.h"
+#include "isotp.h"
 #include "stddef.h"
 
 CPP_GUARD_BEGIN
@@ -75,6 +76,14 @@ void sequence_next_obd2_query(OBD2Config * obd2_config, uint16_t enabled_obd2_pi
  */
 void update_obd2_channels(CAN_msg *msg, OBD2Config *cfg);
 
+/**
+ * Update the current OBD2 channel values with a multi-frame response
+ * reassembled by ISO-TP
+ * @param tp the complete response
+ * @param cfg the OBD2 configuration containing the channel mapping
+ */
+void update_obd2_isotp_channels(const struct isotp_msg *tp, OBD2Config *cfg);
+
 /**
  * Get the current value matching the specified OBD2 PID.
  * Will return the value for the first matching PID
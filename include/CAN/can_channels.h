@@ -39,11 +39,13 @@ void CAN_state_stale(void);
 bool CAN_is_state_stale(void);
 
 /**
- * Initialize the list of current values
+ * Initialize the list of current values.  Values of mappings that did
+ * not change since the last call are kept.
+ * @param cfg the CAN channel config the values are for
  * @param values the number of values in the list
  * @return true if the initialization was successful
  */
-bool CAN_init_current_values(size_t values);
+bool CAN_init_current_values(const CANChannelConfig *cfg, size_t values);
 
 /**
  * retrieves the current value for the specified channel index
@@ -59,6 +61,18 @@ float CAN_get_current_channel_value(int index);
  */
 void CAN_set_current_channel_value(int index, float value);
 
+/**
+ * Build the index used to route CAN messages to the mappings that match
+ * them.  Must be rebuilt whenever the channel configuration changes.
+ * @param cfg the CAN channel configuration, containing the mappings
+ * @param enabled_mapping_count the number of channel mappings
+ * @return true if the index was built; update_can_channels falls back to
+ * checking every mapping otherwise, with compiled signals if there were
+ * only too many ID masks to index
+ */
+bool CAN_init_dispatch_index(const CANChannelConfig *cfg,
+                             const uint16_t enabled_mapping_count);
+
 /**
  * Apply the CAN message to the current list of of CAN channel mappings.
  * @param msg the CAN message containing the raw data
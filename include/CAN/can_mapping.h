@@ -27,6 +27,20 @@
 
 CPP_GUARD_BEGIN
 
+/**
+ * A CAN mapping reduced to what is needed to pull its value out of a
+ * message: where the bits are, how they are encoded, and a single
+ * scale/offset combining the formula and the units conversion.
+ */
+struct can_signal {
+        float scale;
+        float offset;
+        uint8_t shift;
+        uint8_t length;
+        uint8_t type;
+        bool big_endian;
+};
+
 /**
  * match the can message based on the specified CAN mapping ID and ID mask
  * @param can_msg the CAN message to test
@@ -60,5 +74,32 @@ float canmapping_apply_formula(float value, const CANMapping *mapping);
  */
 float canmapping_extract_value(uint64_t raw_data, const CANMapping *mapping);
 
+/**
+ * Compile a CAN mapping into a signal descriptor
+ * @param signal the descriptor to fill in
+ * @param mapping the mapping to compile
+ */
+void canmapping_compile(struct can_signal *signal, const CANMapping *mapping);
+
+/**
+ * Extract and scale a value using a compiled signal descriptor.  Gives the
+ * same result as canmapping_extract_value followed by the mapping formula
+ * and units conversion, within float rounding.
+ * @param signal the compiled signal descriptor
+ * @param raw_data the raw data of the CAN message
+ * @return the scaled value
+ */
+float canmapping_signal_value(const struct can_signal *signal,
+                              uint64_t raw_data);
+
+/**
+ * Hash everything in the mapping that goes into decoding a value, so
+ * that callers can tell whether a value is still valid for a mapping.
+ * Labels, units and the like are not included.
+ * @param mapping the mapping to hash
+ * @return the hash
+ */
+uint32_t canmapping_hash(const CANMapping *mapping);
+
 CPP_GUARD_END
 #endif /* CAN_MAPPING_H_ */
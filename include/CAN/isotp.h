@@ -0,0 +1,99 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ISOTP_H_
+#define _ISOTP_H_
+
+#include "CAN.h"
+#include "cpp_guard.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+CPP_GUARD_BEGIN
+
+/* Largest message reassembled; longer ones are refused with an overflow */
+#define ISOTP_MAX_PAYLOAD 128
+
+/* Time allowed between consecutive frames (N_Cr) */
+#define ISOTP_RX_TIMEOUT_MS 1000
+
+/* ECU addresses the firmware can listen to at once, besides Lua's */
+#define ISOTP_LISTENERS 3
+
+/**
+ * A complete ISO-TP message, as sent by an ECU
+ */
+struct isotp_msg {
+        uint32_t can_id;
+        uint16_t length;
+        uint8_t can_bus;
+        bool extended;
+        uint8_t data[ISOTP_MAX_PAYLOAD];
+};
+
+/**
+ * Set up the queue used to hand responses to Lua
+ */
+void isotp_init(void);
+
+/**
+ * Stop listening to every ECU address added with isotp_listen()
+ */
+void isotp_clear_listeners(void);
+
+/**
+ * Reassemble multi-frame messages sent on a CAN ID.
+ * @param can_bus the bus the ECU is on
+ * @param rx_id the CAN ID the ECU sends on
+ * @param tx_id the CAN ID the ECU listens on, for flow control
+ * @return true if the address is listened to
+ */
+bool isotp_listen(uint8_t can_bus, uint32_t rx_id, uint32_t tx_id);
+
+/**
+ * Feed a received frame to the reassembly sessions.  Called only by the
+ * CAN task.  Sends flow control when a message starts.
+ * @return a message completed by this frame, for an address added with
+ * isotp_listen(); NULL otherwise.  Only valid until the next call.
+ */
+const struct isotp_msg* isotp_rx_frame(const CAN_msg *msg);
+
+/**
+ * Send a single frame request and wait for the complete response,
+ * single or multi-frame.  Called from the Lua task.
+ * @param can_bus the bus to use
+ * @param tx_id the CAN ID to send the request on
+ * @param rx_id the CAN ID the response arrives on
+ * @param extended true for 29 bit CAN IDs
+ * @param data the request, up to 7 bytes
+ * @param length the request length
+ * @param response filled in with the response
+ * @param timeout_ms how long to wait for the response
+ * @return true if a response arrived
+ */
+bool isotp_request(uint8_t can_bus, uint32_t tx_id, uint32_t rx_id,
+                   bool extended, const uint8_t *data, size_t length,
+                   struct isotp_msg *response, size_t timeout_ms);
+
+CPP_GUARD_END
+
+#endif /* _ISOTP_H_ */
@@ -23,6 +23,7 @@
 #define _SHIFTX_DRV_H_
 
 #include "CAN.h"
+#include "CAN_filters.h"
 
 CPP_GUARD_BEGIN
 
@@ -59,6 +60,13 @@ typedef enum {
  */
 void shiftx_handle_can_rx_msg(const CAN_msg *msg);
 
+/**
+ * Add the CAN IDs the ShiftX sends on to the CAN filter plans.  Nothing
+ * is added until a script has used the ShiftX.
+ * @param plans array of CAN_CHANNELS filter plans
+ */
+void shiftx_add_rx_filters(struct CAN_filter_plan *plans);
+
 /**
  * Retreive a pointer to the current runtime configuration
  * @return pointer to struct of the shiftx_configuration
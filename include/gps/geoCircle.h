@@ -32,10 +32,18 @@ CPP_GUARD_BEGIN
 struct GeoCircle {
         GeoPoint point;
         float radius;
+        /*
+         * Local equirectangular projection around point, precomputed so
+         * that checking a point only takes a few multiplies.
+         */
+        float lon_scale;        /* cos(latitude of point) */
+        float radius_deg_sq;    /* (radius in degrees of latitude)^2 */
 };
 
 /**
- * Creates a new GeoCircle from a point and a radius value.
+ * Creates a new GeoCircle from a point and a radius value.  This is
+ * where the expensive math happens, so create circles once (when the
+ * track is set) and reuse them.
  * @return A new GeoCircle.
  */
 struct GeoCircle gc_createGeoCircle(const GeoPoint gp, const float radius);
@@ -0,0 +1,110 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BINARY_LOG_H_
+#define _BINARY_LOG_H_
+
+#include "channel_config.h"
+#include "cpp_guard.h"
+#include "sampleRecord.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+CPP_GUARD_BEGIN
+
+/*
+ * Binary log file layout.  All values are little endian.
+ *
+ * A log starts with a struct binary_log_header followed by one
+ * struct binary_log_channel per channel.  Each sample then follows as
+ * a fixed width record:
+ *
+ *   uint8_t marker (BINARY_LOG_RECORD_MARKER)
+ *   uint8_t populated[(channel_count + 7) / 8] (bit N set = channel N)
+ *   one raw value per channel, sized by the type of the channel.
+ *
+ * A new header block may appear between records whenever the channel
+ * layout changes.  Readers tell the two apart by the first byte.
+ */
+#define BINARY_LOG_MAGIC		"RCPB"
+#define BINARY_LOG_MAGIC_LEN		4
+#define BINARY_LOG_VERSION		1
+#define BINARY_LOG_RECORD_MARKER	0xA5
+#define BINARY_LOG_MAX_CHANNELS		256
+#define BINARY_LOG_MAX_MASK_LEN		(BINARY_LOG_MAX_CHANNELS / 8)
+
+enum binary_log_type {
+        BINARY_LOG_TYPE_INT32 = 0,
+        BINARY_LOG_TYPE_INT64,
+        BINARY_LOG_TYPE_FLOAT,
+        BINARY_LOG_TYPE_DOUBLE,
+};
+
+struct binary_log_header {
+        char magic[BINARY_LOG_MAGIC_LEN];
+        uint8_t version;
+        uint8_t reserved;
+        uint16_t channel_count;
+        uint16_t record_size;
+} __attribute__((__packed__));
+
+struct binary_log_channel {
+        char label[DEFAULT_LABEL_LENGTH];
+        char units[DEFAULT_UNITS_LENGTH];
+        float min;
+        float max;
+        uint16_t sample_rate;
+        uint8_t precision;
+        uint8_t type;
+} __attribute__((__packed__));
+
+enum binary_log_type binary_log_get_type(const ChannelSample *cs);
+size_t binary_log_type_size(const enum binary_log_type type);
+size_t binary_log_mask_len(const struct sample *s);
+size_t binary_log_record_size(const struct sample *s);
+
+/**
+ * Fills in the header block that precedes the channel descriptions.
+ * @return false if the sample has more channels than the format allows.
+ */
+bool binary_log_init_header(struct binary_log_header *hdr,
+                            const struct sample *s);
+
+void binary_log_init_channel(struct binary_log_channel *ch,
+                             const ChannelSample *cs);
+
+/**
+ * Builds the populated bitmask of a sample.
+ * @param mask The buffer to fill.  Must hold binary_log_mask_len bytes.
+ * @return The number of bytes written to mask.
+ */
+size_t binary_log_populated_mask(const struct sample *s, uint8_t *mask);
+
+/**
+ * @return A pointer to the raw value storage of the channel sample.  Use
+ * binary_log_type_size to know how many bytes to copy from it.
+ */
+const void* binary_log_value_ptr(const ChannelSample *cs);
+
+CPP_GUARD_END
+
+#endif /* _BINARY_LOG_H_ */
@@ -34,6 +34,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "sdcard.h"
+#include "telemetry_backlog.h"
 
 CPP_GUARD_BEGIN
 
@@ -43,19 +44,6 @@ CPP_GUARD_BEGIN
 /* 5 second disconnect timeout */
 #define TELEMETRY_DISCONNECT_TIMEOUT 10
 
-/* Disconnect timeout + extra seconds at 10Hz for tracking samples
- * This is used to calculate the size of the circular buffer
- * for tracking sample byte offsets within buffer file.
- * We add 1 second to the timeout to allow some overhead.
- */
-#define SAMPLE_TRACKING_WINDOW 10 * (TELEMETRY_DISCONNECT_TIMEOUT + 4)
-
-/* maps a tick against a byte offset in a file */
-typedef struct _SampleOffsetMap {
-        uint32_t tick;
-        uint32_t buffer_file_index;
-} SampleOffsetMap;
-
 typedef struct _ConnParams {
         bool always_streaming;
         char * connectionName;
@@ -66,6 +54,7 @@ typedef struct _ConnParams {
         size_t periodicMeta;
         uint32_t connection_timeout;
         xQueueHandle sampleQueue;
+        enum sample_holder holder;
         int max_sample_rate;
         enum led activity_led;
 } ConnParams;
@@ -79,6 +68,7 @@ typedef struct _TelemetryConnParams {
         serial_id_t serial;
         uint32_t connection_timeout;
         xQueueHandle sampleQueue;
+        enum sample_holder holder;
         int max_sample_rate;
         enum led activity_led;
 } TelemetryConnParams;
@@ -88,6 +78,7 @@ typedef struct _BufferingTaskParams {
         char * connectionName;
         size_t periodicMeta;
         xQueueHandle sampleQueue;
+        enum sample_holder holder;
         int max_sample_rate;
 } BufferingTaskParams;
 
@@ -100,16 +91,17 @@ typedef struct _BufferedLoggerMessage {
 typedef struct _CellularState {
         xQueueHandle buffer_queue;
         FIL *buffer_file;
+        FIL *index_file;
+        struct telemetry_backlog backlog;
         char buffer_buffer[BUFFER_BUFFER_SIZE + 1];
         char cell_buffer[BUFFER_SIZE];
-        int32_t read_index;
         bool buffer_file_open;
         bool should_stream;
         bool should_reconnect;
+        /* Set while the connection task reads the buffer queue */
+        volatile bool link_up;
         uint32_t server_tick_echo;
         size_t server_tick_echo_changed_at;
-        SampleOffsetMap sample_offset_map[SAMPLE_TRACKING_WINDOW];
-        size_t sample_offset_map_index;
 } CellularState;
 
 void queueTelemetryRecord(const LoggerMessage *msg);
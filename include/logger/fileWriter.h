@@ -30,7 +30,8 @@
 
 CPP_GUARD_BEGIN
 
-#define FILENAME_LEN 13
+/* Room for ses_NNNN/rc_NNNNN.ext */
+#define FILENAME_LEN 24
 #define FLUSH_INTERVAL_MS 1000
 
 enum writing_status {
@@ -45,9 +46,20 @@ struct logging_status {
         enum writing_status writing_status;
         portTickType flush_tick;
         portTickType last_sample_tick;
+        enum log_file_format format;
+        bool preallocate;
         char name[FILENAME_LEN];
 };
 
+/**
+ * Where the next log file goes.  Kept in a small file on the card so
+ * that we never have to probe for a free name.
+ */
+struct log_index {
+        uint32_t next_log;
+        uint32_t next_session;
+};
+
 
 void startFileWriterTask( int priority );
 portBASE_TYPE queue_logfile_record(const LoggerMessage *msg);
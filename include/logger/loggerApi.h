@@ -28,6 +28,7 @@
 #include "cpp_guard.h"
 #include "jsmn.h"
 #include "sampleRecord.h"
+#include "sample_meta.h"
 #include "serial.h"
 CPP_GUARD_BEGIN
 
@@ -62,13 +63,16 @@ CPP_GUARD_BEGIN
 	API_METHOD("setLapCfg", api_setLapConfig)			\
  API_METHOD("resetLapStats", api_reset_lap_stats) \
 	API_METHOD("setLogfileLevel", api_setLogfileLevel)		\
+	API_METHOD("setMetaHash", api_set_meta_hash)			\
 	API_METHOD("setObd2Cfg", api_setObd2Config)			\
+	API_METHOD("setStreamFmt", api_set_stream_format)		\
 	API_METHOD("setTelemetry", api_set_telemetry)			\
 	API_METHOD("setTrackCfg", api_setTrackConfig)			\
 	API_METHOD("setWifiCfg", api_set_wifi_cfg)			\
 	API_METHOD("sysReset", api_systemReset)				\
 	API_METHOD("txCan", api_tx_can) \
 	API_METHOD("rxCan", api_rx_can) \
+	API_METHOD("getCanStats", api_get_can_stats) \
 
 
 #if VIRTUAL_CHANNEL_SUPPORT == 1
@@ -92,6 +96,14 @@ CPP_GUARD_BEGIN
         API_METHOD("setSdLogCtrlCfg", api_set_auto_logger_cfg) \
 
 
+#if SDCARD_SUPPORT
+#define SD_LOG_METHODS                                  \
+        API_METHOD("getSdLogCfg", api_get_sd_log_cfg)   \
+        API_METHOD("setSdLogCfg", api_set_sd_log_cfg)
+#else
+#define SD_LOG_METHODS
+#endif
+
 #if CAMERA_CONTROL  > 0
 #define CAMERA_CONTROL_METHODS                                  \
     API_METHOD("getCamCtrlCfg", api_get_camera_control_cfg)     \
@@ -160,6 +172,7 @@ CPP_GUARD_BEGIN
 #define API_METHODS                             \
         VIRTUAL_CHANNEL_METHODS                 \
         AUTOLOGGING_METHODS                     \
+        SD_LOG_METHODS                          \
         CAMERA_CONTROL_METHODS                  \
         BASE_API_METHODS                        \
         GPS_API_METHODS                         \
@@ -233,9 +246,14 @@ int api_runScript(struct Serial *serial, const jsmntok_t *json);
 //messages
 void api_sendLogStart(struct Serial *serial);
 void api_sendLogEnd(struct Serial *serial);
+/* sendMeta is one of enum sample_meta_mode */
 void api_send_sample_record(struct Serial *serial,
                             const struct sample *sample,
                             const unsigned int tick, const int sendMeta);
+void api_send_sample_meta(struct Serial *serial, const struct sample *sample,
+                          const enum sample_meta_mode mode);
+int api_set_stream_format(struct Serial *serial, const jsmntok_t *json);
+int api_set_meta_hash(struct Serial *serial, const jsmntok_t *json);
 
 /* Wifi methods */
 int api_get_wifi_cfg(struct Serial *s, const jsmntok_t *json);
@@ -250,6 +268,11 @@ int api_set_active_track(struct Serial *serial, const jsmntok_t *json);
 int api_get_auto_logger_cfg(struct Serial *serial, const jsmntok_t *json);
 int api_set_auto_logger_cfg(struct Serial *serial, const jsmntok_t *json);
 
+#if SDCARD_SUPPORT
+int api_get_sd_log_cfg(struct Serial *serial, const jsmntok_t *json);
+int api_set_sd_log_cfg(struct Serial *serial, const jsmntok_t *json);
+#endif
+
 #if CAMERA_CONTROL
 int api_get_camera_control_cfg(struct Serial *serial, const jsmntok_t *json);
 int api_set_camera_control_cfg(struct Serial *serial, const jsmntok_t *json);
@@ -262,6 +285,7 @@ int api_set_virtual_channel_value(struct Serial *serial, const jsmntok_t *json);
 /* CAN bus tx/rx */
 int api_tx_can(struct Serial *serial, const jsmntok_t *json);
 int api_rx_can(struct Serial *serial, const jsmntok_t *json);
+int api_get_can_stats(struct Serial *serial, const jsmntok_t *json);
 CPP_GUARD_END
 
 #endif /* LOGGERAPI_H_ */
@@ -58,6 +58,8 @@ CPP_GUARD_BEGIN
 #define SAMPLE_5Hz                          (TICK_RATE_HZ / 5)
 #define SAMPLE_1Hz                          (TICK_RATE_HZ / 1)
 #define SAMPLE_DISABLED                     0
+/* Number of standard sample rates above, SAMPLE_DISABLED excluded */
+#define SAMPLE_RATE_COUNT                   9
 
 #define CONFIG_FEATURE_INSTALLED			1
 #define CONFIG_FEATURE_NOT_INSTALLED		0
@@ -525,11 +527,29 @@ typedef struct _ConnectivityConfig {
         struct wifi_cfg wifi;
 } ConnectivityConfig;
 
+/**
+ * Formats the file writer can produce on the SD card.
+ */
+enum log_file_format {
+        LOG_FILE_FORMAT_CSV = 0,
+        LOG_FILE_FORMAT_BINARY,
+        __LOG_FILE_FORMAT_COUNT,
+};
+
 /**
  * Configurations specific to our logging infrastructure.
  */
 struct logging_config {
         enum serial_log_type serial[__SERIAL_COUNT];
+        enum log_file_format file_format;
+        /* Put the logs of each power cycle in their own directory */
+        bool session_dirs;
+        /*
+         * Preallocate log files and write them in whole sector chunks.
+         * Flattens SD latency, but up to a chunk of data sits in RAM
+         * and a log cut short by power loss ends in unused space.
+         */
+        bool preallocate;
 };
 
 typedef struct _LoggerConfig {
@@ -617,6 +637,7 @@ int encodeSampleRate(int sampleRate);
 int decodeSampleRate(int sampleRateCode);
 
 uint8_t filter_background_streaming_mode(uint8_t mode);
+enum log_file_format filter_log_file_format(int format);
 
 PWMConfig * getPwmConfigChannel(int channel);
 char filterPwmOutputMode(int config);
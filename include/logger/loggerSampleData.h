@@ -26,6 +26,7 @@
 #include "loggerConfig.h"
 #include "sampleRecord.h"
 
+#include <stdbool.h>
 #include <stddef.h>
 
 CPP_GUARD_BEGIN
@@ -37,6 +38,11 @@ CPP_GUARD_BEGIN
  */
 int populate_sample_buffer(struct sample *s, size_t logTick);
 
+/**
+ * @return true if any channel of the sample is due at the given tick.
+ */
+bool is_sample_due(const struct sample *s, const size_t logTick);
+
 void init_channel_sample_buffer(LoggerConfig *loggerConfig,
                                 struct sample *s);
 
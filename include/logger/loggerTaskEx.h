@@ -32,6 +32,14 @@ CPP_GUARD_BEGIN
 
 struct sample * get_current_sample(void);
 
+/**
+ * @return How often the logger task had to skip a sample because its
+ * consumers held on to every sample buffer, and how often it kept a
+ * sample from telemetry and callbacks to keep buffers for the file
+ * writer.
+ */
+const struct sample_pool_stats* get_sample_pool_stats(void);
+
 void startLogging();
 void stopLogging();
 
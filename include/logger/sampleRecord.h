@@ -23,6 +23,7 @@
 #define SAMPLERECORD_H_
 
 #include "FreeRTOS.h"
+#include "arena.h"
 #include "channel_config.h"
 #include "cpp_guard.h"
 #include "dateTime.h"
@@ -32,6 +33,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 CPP_GUARD_BEGIN
 
@@ -81,10 +83,97 @@ typedef struct _ChannelSample {
         enum SampleData sampleData;
 }  __attribute__((__packed__,aligned(4))) ChannelSample;
 
+/*
+ * A run of consecutive channel samples that share a schedule slot.
+ */
+struct sample_range {
+        uint16_t first;
+        uint16_t count;
+};
+
+/*
+ * The channel samples that are due every rate ticks.  Its ranges are
+ * ranges[range_first .. range_first + range_count) of the schedule.
+ */
+struct sample_bucket {
+        unsigned short rate;
+        bool populated;
+        uint16_t range_first;
+        uint16_t range_count;
+};
+
+/*
+ * Precomputed by init_channel_sample_buffer so that each tick only
+ * touches the channels that are due.  Buckets are ordered fastest rate
+ * first.  ALWAYS_SAMPLED channels are kept out of the rate buckets and
+ * live in the always bucket, which is taken whenever any bucket is due.
+ * Their rates still get a (possibly empty) bucket so they keep driving
+ * when a sample is taken.
+ */
+struct sample_schedule {
+        /* Bytes allocated for the schedule, buckets and ranges included */
+        size_t size;
+        size_t bucket_count;
+        struct sample_bucket *buckets;
+        struct sample_bucket always;
+        struct sample_range *ranges;
+};
+
+/*
+ * Arena bytes one pooled sample of channels enabled channels needs at
+ * most.  The schedule has no more ranges than channels and no more
+ * buckets than there are sample rates.
+ */
+#define SAMPLE_BUFFER_ARENA_BYTES(channels)                             \
+        (sizeof(ChannelSample[channels]) +                              \
+         sizeof(struct sample_schedule) +                               \
+         sizeof(struct sample_bucket[SAMPLE_RATE_COUNT]) +              \
+         sizeof(struct sample_range[channels]) + 2 * ARENA_ALIGN)
+
+#define SAMPLE_CB_REGISTRY_SIZE	8
+
+/*
+ * Everyone that may hang on to a pooled sample after the logger task has
+ * handed it out.  Each connectivity channel and each sample callback slot
+ * gets its own holder.
+ */
+enum sample_holder {
+        SAMPLE_HOLDER_FILE_WRITER = 0,
+        SAMPLE_HOLDER_TELEMETRY,
+        SAMPLE_HOLDER_CALLBACK = SAMPLE_HOLDER_TELEMETRY + CONNECTIVITY_CHANNELS,
+        SAMPLE_HOLDER_COUNT = SAMPLE_HOLDER_CALLBACK + SAMPLE_CB_REGISTRY_SIZE,
+};
+
 struct sample {
         size_t ticks;
         size_t channel_count;
         ChannelSample *channel_samples;
+        struct sample_schedule *schedule;
+        /*
+         * One flag per sample_holder.  A flag is only ever set by the
+         * logger task and cleared by its holder, so no locking is needed.
+         * NULL for samples that are not part of the logger pool.
+         */
+        volatile bool *holds;
+        /*
+         * Whether holders other than the file writer may take this
+         * sample.  Set by #sample_pool_share before it is handed out.
+         */
+        bool shareable;
+        /*
+         * Where the buffers of the sample come from.  NULL for the heap.
+         * Buffers in an arena are released by resetting the arena.
+         */
+        struct arena *arena;
+        /* The config change the logger pool last set this sample up for */
+        uint32_t config_generation;
+};
+
+struct sample_pool_stats {
+        /* Samples no buffer was free for */
+        uint32_t skipped;
+        /* Samples kept from telemetry and callbacks to spare the pool */
+        uint32_t shed;
 };
 
 typedef struct _LoggerMessage {
@@ -111,6 +200,27 @@ size_t init_sample_buffer(struct sample *s, const size_t count);
  */
 void free_sample_buffer(struct sample *s);
 
+/**
+ * Brings an initialized struct sample up to date with the current
+ * configuration in place.  Only valid while the number of enabled
+ * channels stays the same.
+ * @return false if the sample has to be set up again with
+ * #init_sample_buffer instead.
+ */
+bool update_sample_buffer(struct sample *s);
+
+/**
+ * Allocates storage for one of the buffers of a sample, from its arena
+ * if it has one and from the heap otherwise.
+ */
+void* sample_buffer_alloc(struct sample *s, const size_t size);
+
+/**
+ * Releases storage from #sample_buffer_alloc.  A no-op for samples
+ * backed by an arena.
+ */
+void sample_buffer_free(struct sample *s, void *ptr);
+
 
 /**
  * Gets a sample value by name for the specified sample.
@@ -167,6 +277,55 @@ xQueueHandle create_logger_message_queue();
 portBASE_TYPE send_logger_message(const xQueueHandle queue,
                                   const LoggerMessage * const msg);
 
+/**
+ * Like send_logger_message, but marks the sample as held by the given
+ * holder while it sits in the queue.  The receiver must release it with
+ * release_logger_message once it is done with the sample.
+ */
+portBASE_TYPE send_held_logger_message(const xQueueHandle queue,
+                                       const LoggerMessage * const msg,
+                                       const enum sample_holder holder);
+
+void release_logger_message(const LoggerMessage *lm,
+                            const enum sample_holder holder);
+
+/**
+ * Marks the sample as held by holder.  Only the file writer may hold a
+ * sample that #sample_pool_share did not make shareable.
+ * @return false if the holder may not take the sample, and has to skip it.
+ */
+bool sample_hold(const struct sample *s, const enum sample_holder holder);
+
+/**
+ * Drops the hold on a sample.  Does nothing if the sample no longer holds
+ * the data of the given tick, which happens if the logger task rebuilt
+ * its buffers for a new configuration.
+ */
+void sample_release(const struct sample *s, const enum sample_holder holder,
+                    const size_t ticks);
+
+bool sample_is_held(const struct sample *s);
+
+/**
+ * Picks the sample buffer of the pool to fill next, starting the search
+ * at index start.  Held buffers are never handed out.  If every buffer is
+ * held and a sample is due, the sample is skipped and counted in stats.
+ * @return The buffer to use, or NULL if there is none.
+ */
+struct sample* sample_pool_next(struct sample *pool, const size_t count,
+                                const size_t start, const size_t ticks,
+                                struct sample_pool_stats *stats);
+
+/**
+ * Decides whether telemetry and callbacks may hold s, a buffer of the
+ * pool, on top of the file writer.  They only may as long as they leave
+ * half of the buffers, and at least one, to the file writer alone, so
+ * that a stalled link can't starve the log.  Withheld samples count in
+ * stats.
+ */
+void sample_pool_share(const struct sample *pool, const size_t count,
+                       struct sample *s, struct sample_pool_stats *stats);
+
 CPP_GUARD_END
 
 #endif /* SAMPLERECORD_H_ */
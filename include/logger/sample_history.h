@@ -0,0 +1,90 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SAMPLE_HISTORY_H_
+#define _SAMPLE_HISTORY_H_
+
+#include "cpp_guard.h"
+#include "sampleRecord.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+CPP_GUARD_BEGIN
+
+/*
+ * A short history of the samples taken while we are not logging, so
+ * that a log that is started by the auto logger also has the moments
+ * leading up to its trigger.  The history lives in RAM only.  Each
+ * sample is kept as a compact record of its tick, its populated mask
+ * and the raw values of just the populated channels.  The oldest
+ * records are dropped to make room for new ones, and all of them once
+ * a sample with a different channel layout comes in.
+ *
+ * The RAM for it is sized from the channels, the sample rate and the
+ * pre-trigger time, capped at SAMPLE_HISTORY_MAX_SIZE of the board.  It
+ * is only taken from the heap once the first sample comes in.
+ *
+ * The logger task adds samples and freezes the history when logging
+ * starts.  The file writer then drains it into the new log ahead of
+ * the live samples.
+ */
+
+void sample_history_init(void);
+
+/**
+ * Sizes the history to hold the given number of seconds of samples
+ * like s taken at sample_rate.  Any history we had is dropped and its
+ * memory freed.  A length of 0 disables the history.
+ */
+void sample_history_configure(const struct sample *s, const size_t seconds,
+                              const int sample_rate);
+
+/**
+ * Adds a sample to the history.  Never blocks; the sample is skipped if
+ * the history is busy or frozen.
+ */
+void sample_history_add(const struct sample *s, const uint32_t tick);
+
+/**
+ * Stops the history from taking new samples until the next reset.
+ */
+void sample_history_freeze(void);
+
+/**
+ * Drops all history and starts taking samples again.
+ */
+void sample_history_reset(void);
+
+/**
+ * Takes the oldest sample out of the history and writes it into s.
+ * s must have the same channel layout as the samples that were added.
+ * Channels that were not populated are marked as such.
+ * @param tick Set to the tick the sample was taken at.
+ * @return false if there is no more history.
+ */
+bool sample_history_next(struct sample *s, uint32_t *tick);
+
+size_t sample_history_count(void);
+
+CPP_GUARD_END
+
+#endif /* _SAMPLE_HISTORY_H_ */
@@ -0,0 +1,82 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SAMPLE_META_H_
+#define _SAMPLE_META_H_
+
+#include "cpp_guard.h"
+#include "sampleRecord.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+CPP_GUARD_BEGIN
+
+/*
+ * Channel meta data (the "meta" array of labels, units, limits,
+ * precision and rates) only changes with the configuration, yet it is
+ * sent on every connect and periodically after that.  So we serialize
+ * it once per configuration change and keep it along with a hash of
+ * its content.  Peers that have cached the meta for a hash can tell us
+ * so with the setMetaHash API call, after which we send them just the
+ * hash as "mh" in place of the "meta" array.
+ */
+enum sample_meta_mode {
+        SAMPLE_META_NONE = 0,
+        SAMPLE_META_FULL,
+        SAMPLE_META_HASH,
+};
+
+struct sample_meta {
+        /* The JSON array, without the "meta" key.  Not NUL terminated */
+        const char *json;
+        size_t len;
+        uint32_t hash;
+};
+
+void sample_meta_init(void);
+
+/**
+ * Marks the cached meta data as stale.  Call whenever the channel
+ * configuration changes.
+ */
+void sample_meta_invalidate(void);
+
+/**
+ * Locks the meta cache and gets the meta data for the channels of the
+ * given sample, rebuilding it first if it is stale.  Every successful
+ * call must be paired with #sample_meta_release.
+ * @return The meta data, or NULL if it could not be built.  The cache
+ * is not held in that case.
+ */
+const struct sample_meta* sample_meta_acquire(const struct sample *s);
+
+void sample_meta_release(void);
+
+/**
+ * @param hash Set to the meta hash for the channels of the sample.
+ * @return false if the meta data could not be built.
+ */
+bool sample_meta_get_hash(const struct sample *s, uint32_t *hash);
+
+CPP_GUARD_END
+
+#endif /* _SAMPLE_META_H_ */
@@ -0,0 +1,128 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SAMPLE_STREAM_H_
+#define _SAMPLE_STREAM_H_
+
+#include "cpp_guard.h"
+#include "sampleRecord.h"
+#include "sample_meta.h"
+#include "serial.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+CPP_GUARD_BEGIN
+
+/*
+ * Binary sample stream framing.  All values are little endian.
+ *
+ * A connection starts out streaming JSON samples.  The peer may switch
+ * it to one of the binary formats with the setStreamFmt API call.  In
+ * the binary formats channel meta data is still sent as a JSON
+ * {"meta":[...],"mh":hash} message, or just {"mh":hash} once the peer
+ * has told us it holds that meta (see sample_meta.h).  Each sample is
+ * sent as a frame:
+ *
+ *   uint8_t  sync (SAMPLE_STREAM_SYNC)
+ *   uint16_t length of the payload
+ *   payload:
+ *     uint8_t  flags (SAMPLE_STREAM_FLAG_*)
+ *     uint32_t tick
+ *     uint16_t channel_count
+ *     uint8_t  populated[(channel_count + 7) / 8] (bit N set = channel N)
+ *     one value per populated channel
+ *   uint8_t  XOR of all payload bytes
+ *
+ * SAMPLE_STREAM_FORMAT_BINARY sends the raw value of each channel
+ * (int32, int64, float or double; see binary_log_get_type).
+ *
+ * SAMPLE_STREAM_FORMAT_BINARY_DELTA sends each value as a zigzag
+ * varint.  Float and double channels are first scaled to integers by
+ * 10^precision, which is the same resolution the JSON stream has.  Key
+ * frames carry the scaled values, all other frames carry the difference
+ * to the last value sent for that channel.  A key frame resets the last
+ * value of every channel it does not carry to 0.
+ */
+#define SAMPLE_STREAM_SYNC		0xA5
+#define SAMPLE_STREAM_FLAG_VARINT	(1 << 0)
+#define SAMPLE_STREAM_FLAG_KEY		(1 << 1)
+#define SAMPLE_STREAM_KEY_INTERVAL	50
+#define SAMPLE_STREAM_MAX_STREAMS	4
+
+enum sample_stream_format {
+        SAMPLE_STREAM_FORMAT_JSON = 0,
+        SAMPLE_STREAM_FORMAT_BINARY,
+        SAMPLE_STREAM_FORMAT_BINARY_DELTA,
+        __SAMPLE_STREAM_FORMAT_COUNT,
+};
+
+struct sample_stream {
+        struct Serial *serial;
+        enum sample_stream_format format;
+        size_t frames_since_key;
+        size_t last_count;
+        int64_t *last_values;
+        /* Meta the peer says it has cached, see sample_meta.h */
+        bool peer_has_meta;
+        uint32_t peer_meta_hash;
+};
+
+/**
+ * Attaches a stream to a connection so that the peer can negotiate the
+ * sample format.  The stream starts out as JSON.
+ * @return false if there is no free stream slot.
+ */
+bool sample_stream_attach(struct sample_stream *ss, struct Serial *serial);
+
+void sample_stream_detach(struct sample_stream *ss);
+
+/**
+ * Puts the stream back to JSON and forgets the meta data the peer had.
+ * Call this whenever a new peer connects.
+ */
+void sample_stream_reset(struct sample_stream *ss);
+
+/**
+ * @return The stream attached to the serial port, or NULL if none.
+ */
+struct sample_stream* sample_stream_find(const struct Serial *serial);
+
+bool sample_stream_set_format(struct sample_stream *ss,
+                              const enum sample_stream_format format);
+
+/**
+ * Records that the peer has cached the meta data with the given hash.
+ * While that matches our meta, only the hash is sent in its place.
+ */
+void sample_stream_set_peer_meta(struct sample_stream *ss,
+                                 const uint32_t hash);
+
+/**
+ * Sends a sample in the format negotiated on the stream, including the
+ * message terminator.
+ */
+void sample_stream_send(struct sample_stream *ss, const struct sample *s,
+                        const uint32_t tick, const bool send_meta);
+
+CPP_GUARD_END
+
+#endif /* _SAMPLE_STREAM_H_ */
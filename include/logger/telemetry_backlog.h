@@ -0,0 +1,114 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TELEMETRY_BACKLOG_H_
+#define _TELEMETRY_BACKLOG_H_
+
+#include "cpp_guard.h"
+#include "ff.h"
+#include "sampleRecord.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+CPP_GUARD_BEGIN
+
+/*
+ * The telemetry backlog is a fixed size circular store of the JSON
+ * sample records that are waiting to go out over cellular.  The data
+ * file is split into segments that are reused in order, so when the
+ * backlog is full we drop the oldest segment instead of the whole
+ * backlog.
+ *
+ * Within a segment the ticks of the records are consecutive, so the
+ * record for a tick is found with a bit of arithmetic.  The end offset
+ * of every record is kept in a separate index file, letting us resume
+ * right after the last tick the server acknowledged.
+ */
+#define TELEMETRY_BACKLOG_SEGMENTS		8
+#define TELEMETRY_BACKLOG_SEGMENT_SIZE		(128 * 1024)
+#define TELEMETRY_BACKLOG_SEGMENT_RECORDS	2048
+/* Max size of a single record, meta included */
+#define TELEMETRY_BACKLOG_RECORD_MAX		(16 * 1024)
+
+struct telemetry_backlog_segment {
+        /* Order the segments were started in.  0 if the segment is empty */
+        uint32_t seq;
+        /* Bytes of record data in the segment */
+        uint32_t used;
+        /* Tick of the first record.  The rest follow consecutively */
+        uint32_t first_tick;
+        uint32_t records;
+};
+
+struct telemetry_backlog {
+        FIL *data;
+        FIL *index;
+        struct telemetry_backlog_segment segments[TELEMETRY_BACKLOG_SEGMENTS];
+        uint32_t seq;
+        size_t write_seg;
+        size_t read_seg;
+        uint32_t read_offset;
+        /* Number of segments dropped before they were sent */
+        uint32_t dropped;
+};
+
+void telemetry_backlog_init(struct telemetry_backlog *bl, FIL *data,
+                            FIL *index);
+
+FRESULT telemetry_backlog_append(struct telemetry_backlog *bl,
+                                 const struct sample *sample,
+                                 const uint32_t tick, const bool send_meta);
+
+FRESULT telemetry_backlog_sync(struct telemetry_backlog *bl);
+
+FRESULT telemetry_backlog_read(struct telemetry_backlog *bl, char *buf,
+                               const size_t len, size_t *read);
+
+bool telemetry_backlog_seek_tick(struct telemetry_backlog *bl,
+                                 const uint32_t tick);
+
+uint32_t telemetry_backlog_pending(const struct telemetry_backlog *bl);
+
+/*
+ * Bookkeeping behind the calls above.  These do no I/O and are
+ * exposed for testing.
+ */
+uint32_t telemetry_backlog_begin_record(struct telemetry_backlog *bl,
+                                        const uint32_t tick);
+
+uint32_t telemetry_backlog_end_record(struct telemetry_backlog *bl,
+                                      const uint32_t end);
+
+bool telemetry_backlog_next_read(struct telemetry_backlog *bl,
+                                 uint32_t *offset, uint32_t *len);
+
+void telemetry_backlog_advance_read(struct telemetry_backlog *bl,
+                                    const uint32_t len);
+
+bool telemetry_backlog_find_tick(const struct telemetry_backlog *bl,
+                                 const uint32_t tick, size_t *seg,
+                                 uint32_t *index_offset);
+
+CPP_GUARD_END
+
+#endif /* _TELEMETRY_BACKLOG_H_ */
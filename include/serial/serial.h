@@ -52,14 +52,17 @@ typedef bool config_func_t(void *cfg_cb_arg, const size_t bits,
                            const size_t parity, const size_t stop_bits,
                            const size_t baud);
 
+struct Serial;
+
 /**
- * The callback that gets fired when a user sends a character to the
- * serial buffer.  Typically used to set interrupt flags so that the
- * data can get sent out.
- * @param queue Handle for the queue with data to send.
- * @param post_tx_arg User provided argument as defined in serial_reate.
+ * The callback that gets fired when a user writes data to the serial
+ * buffer.  It is invoked once per write (or once per buffer full of a
+ * larger write), not per character.  Typically used to set interrupt
+ * flags or otherwise kick the driver so that the data can get sent out.
+ * @param s The Serial device with data to send.
+ * @param post_tx_arg User provided argument as defined in serial_create.
  */
-typedef void post_tx_func_t(xQueueHandle queue, void *post_tx_arg);
+typedef void post_tx_func_t(struct Serial *s, void *post_tx_arg);
 
 enum serial_log_type {
         SERIAL_LOG_TYPE_NONE   = 0,
@@ -67,8 +70,6 @@ enum serial_log_type {
         SERIAL_LOG_TYPE_BINARY = 2,
 };
 
-struct Serial;
-
 void serial_destroy(struct Serial *s);
 
 void serial_close(struct Serial* s);
@@ -108,6 +109,11 @@ int serial_read_c_wait(struct Serial *s, char *c, const size_t delay);
 
 int serial_read_c(struct Serial *s, char* c);
 
+int serial_peek_c(struct Serial *s, char *c);
+
+int serial_read_buff_wait(struct Serial *s, char *buf, const size_t len,
+                          const size_t delay);
+
 int serial_read_byte(struct Serial *serial, uint8_t *b, const size_t delay);
 
 int serial_read_line(struct Serial *s, char *l, const size_t len);
@@ -126,9 +132,28 @@ int serial_write_s_wait(struct Serial *s, const char *l, const size_t delay);
 
 int serial_write_s(struct Serial *s, const char *l);
 
-xQueueHandle serial_get_rx_queue(struct Serial *s);
+void serial_batch_begin(struct Serial *s);
+
+void serial_batch_end(struct Serial *s);
+
+/*
+ * Driver side of the Serial buffers.  Each buffer has exactly one
+ * producer and one consumer, so only the driver that owns the device
+ * may call these.  Pass a NULL woken pointer from task context, or a
+ * pointer to the ISR's higher priority task woken flag from an ISR.
+ */
+size_t serial_rx_put(struct Serial *s, const void *data, const size_t len,
+                     portBASE_TYPE *woken);
+
+size_t serial_tx_get(struct Serial *s, void *data, const size_t len,
+                     portBASE_TYPE *woken);
+
+size_t serial_tx_pending(const struct Serial *s);
+
+const void* serial_tx_dma_read_init(struct Serial *s, size_t *avail);
 
-xQueueHandle serial_get_tx_queue(struct Serial *s);
+void serial_tx_dma_read_fini(struct Serial *s, size_t read,
+                             portBASE_TYPE *woken);
 
 enum serial_ioctl_status {
         SERIAL_IOCTL_STATUS_OK = 0,
@@ -28,6 +28,7 @@
 #include "stddef.h"
 #include "versionInfo.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 
 CPP_GUARD_BEGIN
@@ -77,14 +78,25 @@ typedef struct _Track {
         };
 } Track;
 
+/*
+ * Indexes of the tracks ordered by the latitude of their start point.
+ * Lets a lookup only consider the tracks within a latitude band around
+ * a location instead of all of them.  Built whenever tracks are flashed.
+ */
+struct track_index {
+        size_t count;
+        uint16_t order[MAX_TRACK_COUNT];
+};
+
 typedef struct _Tracks {
         VersionInfo versionInfo;
         size_t count;
         Track tracks[MAX_TRACK_COUNT];
+        struct track_index index;
 } Tracks;
 
 void initialize_tracks();
-int flash_tracks(const Tracks *source, size_t rawSize);
+int flash_tracks(Tracks *source, size_t rawSize);
 enum track_add_result add_track(const Track *track, const size_t index,
                                 enum track_add_mode mode);
 int flash_default_tracks(void);
@@ -122,6 +134,22 @@ GeoPoint getSectorGeoPointAtIndex(const Track *t, const int index);
 
 int areGeoPointsEqual(const GeoPoint a, const GeoPoint b);
 
+/**
+ * Sorts the tracks into the track index.  Called by #flash_tracks.
+ */
+void tracks_build_index(Tracks *tracks);
+
+/**
+ * @return true if the track index matches the tracks, false otherwise.
+ */
+bool tracks_index_valid(const Tracks *tracks);
+
+/**
+ * @return The position of the first entry in the track index whose start
+ *         point latitude is not less than the given latitude.
+ */
+size_t tracks_index_lower_bound(const Tracks *tracks, const float latitude);
+
 CPP_GUARD_END
 
 #endif /* TRACKS_H_ */
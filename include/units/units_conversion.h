@@ -22,6 +22,10 @@
 #ifndef UNITS_CONVERSION_H_
 #define UNITS_CONVERSION_H_
 
+#include "cpp_guard.h"
+
+CPP_GUARD_BEGIN
+
 #define UNITS_CONVERSION_COUNT 19
 
 enum unit_conversions {
@@ -70,4 +74,16 @@ enum unit_conversions {
  **/
 float convert_units(enum unit_conversions id, const float value);
 
+/**
+ * Get the linear form of a units conversion, such that
+ * converted = value * scale + offset
+ * @param id the units conversion id; invalid ids give the identity
+ * @param scale set to the scale of the conversion
+ * @param offset set to the offset of the conversion
+ **/
+void units_conversion_affine(enum unit_conversions id, float *scale,
+                             float *offset);
+
+CPP_GUARD_END
+
 #endif /* UNITS_CONVERSION_H_ */
@@ -0,0 +1,65 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include "cpp_guard.h"
+#include <stddef.h>
+#include <stdint.h>
+
+CPP_GUARD_BEGIN
+
+/* Every allocation is rounded up to, and aligned on, this many bytes */
+#define ARENA_ALIGN	8
+
+/*
+ * A fixed block of memory that is handed out front to back and only
+ * ever given back as a whole.  Meant for state that gets rebuilt from
+ * scratch on every reconfiguration, so that it never has to go through
+ * (and fragment) the heap.
+ */
+struct arena {
+        uint8_t *buff;
+        size_t size;
+        size_t used;
+};
+
+void arena_init(struct arena *a, void *buff, const size_t size);
+
+/**
+ * Releases everything handed out by the arena.  Anything still pointing
+ * into it is invalid after this.
+ */
+void arena_reset(struct arena *a);
+
+/**
+ * @return size bytes aligned for any type, or NULL if the arena can't
+ * fit them.
+ */
+void* arena_alloc(struct arena *a, const size_t size);
+
+size_t arena_bytes_used(const struct arena *a);
+size_t arena_bytes_free(const struct arena *a);
+
+CPP_GUARD_END
+
+#endif /* _ARENA_H_ */
@@ -0,0 +1,63 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SPSC_RING_BUFF_H__
+#define __SPSC_RING_BUFF_H__
+
+#include "cpp_guard.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+CPP_GUARD_BEGIN
+
+struct spsc_ring_buff;
+
+struct spsc_ring_buff* spsc_ring_buff_create(const size_t cap);
+void spsc_ring_buff_destroy(struct spsc_ring_buff *rb);
+size_t spsc_ring_buff_capacity(const struct spsc_ring_buff *rb);
+
+/* Safe to call from either side */
+size_t spsc_ring_buff_bytes_free(const struct spsc_ring_buff *rb);
+size_t spsc_ring_buff_bytes_used(const struct spsc_ring_buff *rb);
+
+/* Producer side only */
+size_t spsc_ring_buff_write(struct spsc_ring_buff *rb, const void *data,
+                            size_t size);
+void* spsc_ring_buff_dma_write_init(struct spsc_ring_buff *rb,
+                                    size_t *avail);
+void spsc_ring_buff_dma_write_fini(struct spsc_ring_buff *rb,
+                                   const size_t written);
+
+/* Consumer side only */
+void spsc_ring_buff_clear(struct spsc_ring_buff *rb);
+size_t spsc_ring_buff_get(struct spsc_ring_buff *rb, void *buff,
+                          size_t size);
+size_t spsc_ring_buff_peek(const struct spsc_ring_buff *rb, void *buff,
+                           size_t size);
+const void* spsc_ring_buff_dma_read_init(struct spsc_ring_buff *rb,
+                                         size_t *avail);
+void spsc_ring_buff_dma_read_fini(struct spsc_ring_buff *rb,
+                                  const size_t read);
+
+CPP_GUARD_END
+
+#endif /* __SPSC_RING_BUFF_H__ */
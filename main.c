@@ -45,6 +45,7 @@
 #include "messaging.h"
 #include "panic.h"
 #include "printk.h"
+#include "sample_meta.h"
 #include "task.h"
 #include "usb_comm.h"
 #include "wifi.h"
@@ -79,6 +80,7 @@ void setupTask(void *param)
 #endif
         initialize_tracks();
         initialize_logger_config();
+        sample_meta_init();
 
         InitLoggerHardware();
         initMessaging();
@@ -21,6 +21,7 @@
 
 #include "FreeRTOS.h"
 #include "led.h"
+#include "macros.h"
 #include "mem_mang.h"
 #include "panic.h"
 #include "printk.h"
@@ -77,6 +78,7 @@ struct dma_info {
         size_t buff_size;               /* Size of the buffer */
         volatile uint8_t* buff;         /* Base address of buffer */
         volatile uint8_t* volatile ptr; /* Tail/Head pointer of the buffer */
+        size_t pending;                 /* Bytes in the Tx transfer */
 };
 
 static volatile struct usart_info {
@@ -368,7 +370,7 @@ static bool _config_cb(void *cfg_cb_arg, const size_t bits,
         return true;
 }
 
-static void _char_tx_cb(xQueueHandle queue, void *post_tx_arg)
+static void _char_tx_cb(struct Serial *s, void *post_tx_arg)
 {
         volatile struct usart_info *ui = post_tx_arg;
         if (!ui->dma_tx.stream)
@@ -412,17 +414,14 @@ static bool init_usart_serial(const uart_id_t uart_id, USART_TypeDef *usart,
                 ui->dma_rx.stream = dma_rx_stream;
         }
 
-        uint8_t* dma_tx_buff = NULL;
+        /*
+         * Tx DMA reads straight out of the Serial buffer, so it needs no
+         * buffer of its own.  The size here caps a single transfer so that
+         * space is handed back to writers in reasonable chunks.
+         */
         if (dma_tx_stream && dma_tx_buff_size) {
-                dma_tx_buff = malloc(dma_tx_buff_size);
-                if (!dma_tx_buff) {
-                        pr_error(LOG_PFX "DMA Tx Buff Malloc failure!\r\n");
-                        return false;
-                }
-
                 ui->dma_tx.buff_size = dma_tx_buff_size;
-                ui->dma_tx.buff = dma_tx_buff;
-                ui->dma_tx.ptr = dma_tx_buff;
+                ui->dma_tx.pending = 0;
                 ui->dma_tx.channel = dma_tx_channel;
                 ui->dma_tx.stream = dma_tx_stream;
         }
@@ -450,7 +449,7 @@ void usart_device_config(const uart_id_t id, const size_t bits,
 static void usart_generic_irq_handler(volatile struct usart_info *ui)
 {
         USART_TypeDef *usart = ui->usart;
-        signed portCHAR cChar;
+        uint8_t cChar;
         portBASE_TYPE xTaskWoken = pdFALSE;
 
         if (SET == USART_GetITStatus(usart, USART_IT_TXE)) {
@@ -458,19 +457,15 @@ static void usart_generic_irq_handler(volatile struct usart_info *ui)
                  * The interrupt was caused by the TX becoming empty.
                  * Are there any more characters to transmit?
                  */
-                xQueueHandle tx_queue = serial_get_tx_queue(ui->serial);
-                if (pdTRUE == xQueueReceiveFromISR(tx_queue, &cChar,
-                                                   &xTaskWoken)) {
+                if (serial_tx_get(ui->serial, &cChar, 1, &xTaskWoken)) {
                         /*
-                         * A character was retrieved from the queue so
-                         * can be sent to the USART. Casting to uint8_t
-                         * here to avoid issues when SendData casts the
-                         * value to a uint16_t (sign extension).
+                         * A character was retrieved from the buffer so
+                         * can be sent to the USART.
                          */
-                        USART_SendData(usart, (uint8_t) cChar);
+                        USART_SendData(usart, cChar);
                 } else {
                         /*
-                         * Queue empty, nothing to send so turn off the
+                         * Buffer empty, nothing to send so turn off the
                          * Tx interrupt.
                          */
                         USART_ITConfig(usart, USART_IT_TXE, DISABLE);
@@ -497,8 +492,7 @@ static void usart_generic_irq_handler(volatile struct usart_info *ui)
                  * to avoid any casting issues from uint16_t
                  */
                 cChar = (uint8_t) USART_ReceiveData(usart);
-                xQueueHandle rx_queue = serial_get_rx_queue(ui->serial);
-                if (!xQueueSendFromISR(rx_queue, &cChar, &xTaskWoken))
+                if (!serial_rx_put(ui->serial, &cChar, 1, &xTaskWoken))
                         ui->char_dropped = true;
         } else if (ore_set) {
                 /*
@@ -551,16 +545,17 @@ static bool dma_rx_isr(volatile struct usart_info *ui)
         volatile uint8_t* const buff = ui->dma_rx.buff;
         volatile uint8_t* const edge = buff + ui->dma_rx.buff_size;
         volatile uint8_t* const head = dma_counter ? edge - dma_counter : buff;
-        xQueueHandle queue = serial_get_rx_queue(ui->serial);
         portBASE_TYPE task_awoke = pdFALSE;
 
+        /* At most two runs; one up to the edge and one after the wrap */
         while (tail != head) {
-                uint8_t val = *tail;
-                if (!xQueueSendFromISR(queue, &val, &task_awoke))
+                volatile uint8_t* const end = head > tail ? head : edge;
+                const size_t len = end - tail;
+                if (serial_rx_put(ui->serial, (const void*) tail, len,
+                                  &task_awoke) < len)
                         ui->char_dropped = true;
 
-                if (++tail >= edge)
-                        tail = buff;
+                tail = end < edge ? end : buff;
         }
 
         ui->dma_rx.ptr = head;
@@ -600,40 +595,31 @@ static bool dma_tx_isr(volatile struct usart_info* ui,
 {
         /*
          * Check that we are able to queue up data to send via DMA.
-         * If head is NULL, then a transfer is in progress. Else we
+         * If bytes are pending, then a transfer is in progress. Else we
          * can come past here if we are the Transfer complete IT.
          */
-        if (!is_dma_tc_it && NULL == ui->dma_tx.ptr)
+        if (!is_dma_tc_it && ui->dma_tx.pending)
                 return false;
 
         DMA_Cmd(ui->dma_tx.stream, DISABLE);
 
         /*
-         * If here we are done transferring, see if there is anything
-         * else in the Tx queue that needs to be sent. If so, copy it
-         * into the buffer.
+         * If here we are done transferring.  Release what was sent back
+         * to the Serial buffer, then point the DMA straight at the next
+         * contiguous run of data in that buffer (if any).  No copying.
          */
-        volatile uint8_t* head = ui->dma_tx.buff;
-        volatile uint8_t* const edge = ui->dma_tx.buff + ui->dma_tx.buff_size;
-        xQueueHandle queue = serial_get_tx_queue(ui->serial);
         portBASE_TYPE task_awoke = pdFALSE;
-        uint32_t bytes = 0;
-        for (; head < edge; ++head, ++bytes) {
-                uint8_t var;
-                if (!xQueueReceiveFromISR(queue, &var, &task_awoke))
-                        break;
+        serial_tx_dma_read_fini(ui->serial, ui->dma_tx.pending, &task_awoke);
 
-                *head = var;
-        }
+        size_t avail;
+        const void *data = serial_tx_dma_read_init(ui->serial, &avail);
+        ui->dma_tx.pending = MIN(avail, ui->dma_tx.buff_size);
 
-        if (bytes) {
+        if (ui->dma_tx.pending) {
                 /* Then we have data to transfer */
-                ui->dma_tx.ptr = NULL;
-                ui->dma_tx.stream->NDTR = bytes;
+                ui->dma_tx.stream->M0AR = (uint32_t) data;
+                ui->dma_tx.stream->NDTR = ui->dma_tx.pending;
                 DMA_Cmd(ui->dma_tx.stream, ENABLE);
-        } else {
-                /* No data to send.  Set our pointer to beginning */
-                ui->dma_tx.ptr = ui->dma_tx.buff;
         }
 
         return task_awoke;
@@ -32,8 +32,11 @@
 #include <usbd_desc.h>
 #include <usbd_usr.h>
 
-/* STIEG: Make this device support buffered Tx */
-#define USB_TX_BUF_CAP	1
+/*
+ * Tx is drained synchronously by _post_tx, so this only needs to be big
+ * enough that a typical write goes out in one vcp_tx call.
+ */
+#define USB_TX_BUF_CAP	128
 #define USB_RX_BUF_CAP	512
 
 static struct Serial *usb_serial;
@@ -41,16 +44,19 @@ USB_OTG_CORE_HANDLE USB_OTG_dev __attribute__ ((aligned (4)));
 
 
 /**
- * Called after the serial device transmits a character.  Since we don't support
- * buffered tx yet, we simply de-queue the character and send it on its way. Yes
- * its a hack but its the way it was.
+ * Called after data is written to the serial device.  Since we don't support
+ * buffered tx yet, we hand each contiguous run of pending data straight to
+ * the VCP and send it on its way.
  */
-static void _post_tx(xQueueHandle q, void *arg)
+static void _post_tx(struct Serial *s, void *arg)
 {
-        char c;
+        size_t len;
+        const void *data;
 
-        while (xQueueReceive(q, &c, 0))
-                vcp_tx((uint8_t*) &c, 1);
+        while ((data = serial_tx_dma_read_init(s, &len)) && len) {
+                vcp_tx((uint8_t*) data, len);
+                serial_tx_dma_read_fini(s, len, NULL);
+        }
 }
 
 int USB_CDC_device_init(const int priority, usb_device_data_rx_isr_cb_t* cb)
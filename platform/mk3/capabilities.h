@@ -95,6 +95,11 @@
 
 //logging
 #define LOG_BUFFER_SIZE			8192
+/*
+ * Most RAM the auto logger pre-trigger history may take from the heap.
+ * 0 disables the history.
+ */
+#define SAMPLE_HISTORY_MAX_SIZE		(1024 * 8)
 
 //system info
 #define DEVICE_NAME    "RCP_MK3"
@@ -20,9 +20,12 @@
  */
 
 #include "CAN_device.h"
+#include "CAN_filters.h"
 #include "FreeRTOS.h"
+#include "macros.h"
 #include "printk.h"
-#include "queue.h"
+#include "semphr.h"
+#include "spsc_ring_buff.h"
 #include "stm32f4xx_can.h"
 #include "stm32f4xx_gpio.h"
 #include "stm32f4xx_misc.h"
@@ -35,12 +38,22 @@
 
 #define _LOG_PFX  "[CAN device] "
 
-static xQueueHandle can_rx_queue = NULL;
-
 #define CAN_FILTER_COUNT	13
 #define CAN_IRQ_PRIORITY	5
 #define CAN_IRQ_SUB_PRIORITY	0
-#define CAN_QUEUE_LENGTH	10
+#define CAN_RX_RING_MSGS	32
+#define CAN_DEVICE_CHANNELS	2
+
+/*
+ * Each bus ISR is the only writer of its own ring and the CAN task is
+ * the only reader, so no locking is needed.  The ISR only signals the
+ * task when it is actually waiting for frames.
+ */
+static struct spsc_ring_buff *can_rx_ring[CAN_DEVICE_CHANNELS];
+static xSemaphoreHandle can_rx_signal = NULL;
+static volatile bool can_rx_waiting;
+static volatile uint32_t can_rx_dropped[CAN_DEVICE_CHANNELS];
+static size_t can_rx_next_bus;
 
 //For 168MHz clock
 /*       BS1 BS2 SJW Pre
@@ -63,11 +76,20 @@ static const u8 can_baud_sjw[] =
 static const u8 can_baud_pre[] = { 20, 16, 12, 6, 2 };
 static const u32 can_baud_rate[] = { 100000, 125000, 250000, 500000, 1000000 };
 
-static bool init_queue()
+static bool init_rx()
 {
-        if (!can_rx_queue)
-                can_rx_queue = xQueueCreate(CAN_QUEUE_LENGTH, sizeof(CAN_msg));
-        return can_rx_queue != NULL;
+        for (size_t i = 0; i < CAN_DEVICE_CHANNELS; ++i) {
+                if (!can_rx_ring[i])
+                        can_rx_ring[i] = spsc_ring_buff_create(
+                                CAN_RX_RING_MSGS * sizeof(CAN_msg));
+                if (!can_rx_ring[i])
+                        return false;
+        }
+
+        if (!can_rx_signal)
+                can_rx_signal = xSemaphoreCreateBinary();
+
+        return can_rx_signal != NULL;
 }
 
 static void init_GPIO_CAN(GPIO_TypeDef * GPIOx, uint32_t gpio_pins)
@@ -211,7 +233,7 @@ int CAN_device_init(const uint8_t channel, const uint32_t baud, const bool termi
         pr_info_int(channel);
         pr_info_int_msg(" with baud rate ", baud);
 
-        if (!init_queue()) {
+        if (!init_rx()) {
                 pr_info(_LOG_PFX "CAN init queue failed\r\n");
                 return 0;
         }
@@ -263,11 +285,15 @@ int CAN_device_set_filter(const uint8_t channel, const uint8_t id, const uint8_t
         CAN_filter_init_structure.CAN_FilterActivation =
                 enabled ? ENABLE : DISABLE;
 
-        const size_t shift = extended ? 3 : 21;
-        CAN_filter_init_structure.CAN_FilterIdHigh = (filter << shift) >> 16;
-        CAN_filter_init_structure.CAN_FilterMaskIdHigh = (mask << shift) >> 16;
-        CAN_filter_init_structure.CAN_FilterIdLow = (uint16_t) filter;
-        CAN_filter_init_structure.CAN_FilterMaskIdLow = (uint16_t) mask;
+        /* The filter layout holds the register bits [31:03] */
+        const struct CAN_filter layout =
+                CAN_filter_layout(extended, filter, mask);
+        const uint32_t id_reg = layout.id << 3;
+        const uint32_t mask_reg = layout.mask << 3;
+        CAN_filter_init_structure.CAN_FilterIdHigh = id_reg >> 16;
+        CAN_filter_init_structure.CAN_FilterMaskIdHigh = mask_reg >> 16;
+        CAN_filter_init_structure.CAN_FilterIdLow = (uint16_t) id_reg;
+        CAN_filter_init_structure.CAN_FilterMaskIdLow = (uint16_t) mask_reg;
 
         CAN_FilterInit(&CAN_filter_init_structure);
 
@@ -327,14 +353,75 @@ int CAN_device_tx_msg(const uint8_t channel, const CAN_msg * msg, const unsigned
         return status == CAN_TxStatus_Ok;
 }
 
-int CAN_device_rx_msg(CAN_msg * msg, const unsigned int timeout_ms)
+static size_t drain_rx_rings(CAN_msg *msgs, const size_t max)
 {
-        if (pdTRUE == xQueueReceive(can_rx_queue, msg, msToTicks(timeout_ms))) {
-                return 1;
-        } else {
-                pr_debug(_LOG_PFX "timeout rx CAN msg\r\n");
+        size_t count = 0;
+
+        /* Rotate the starting bus so a busy bus can't starve the other */
+        for (size_t i = 0; i < CAN_DEVICE_CHANNELS && count < max; ++i) {
+                const size_t bus = (can_rx_next_bus + i) % CAN_DEVICE_CHANNELS;
+                struct spsc_ring_buff *rb = can_rx_ring[bus];
+                const size_t avail =
+                        spsc_ring_buff_bytes_used(rb) / sizeof(CAN_msg);
+                const size_t take = MIN(avail, max - count);
+
+                spsc_ring_buff_get(rb, msgs + count, take * sizeof(CAN_msg));
+                count += take;
+        }
+
+        can_rx_next_bus = (can_rx_next_bus + 1) % CAN_DEVICE_CHANNELS;
+        return count;
+}
+
+size_t CAN_device_rx_msgs(CAN_msg *msgs, const size_t max,
+                          const unsigned int timeout_ms)
+{
+        if (!can_rx_signal) {
+                /* Not initialized yet; behave like a timeout */
+                delayMs(timeout_ms);
                 return 0;
         }
+
+        size_t count = drain_rx_rings(msgs, max);
+        if (count)
+                return count;
+
+        /*
+         * Clear any stale wakeup, ask the ISR for one and look again in
+         * case a frame arrived in between.
+         */
+        xSemaphoreTake(can_rx_signal, 0);
+        can_rx_waiting = true;
+        count = drain_rx_rings(msgs, max);
+        if (!count && pdTRUE == xSemaphoreTake(can_rx_signal,
+                                               msToTicks(timeout_ms)))
+                count = drain_rx_rings(msgs, max);
+
+        can_rx_waiting = false;
+        if (!count)
+                pr_debug(_LOG_PFX "timeout rx CAN msg\r\n");
+
+        return count;
+}
+
+int CAN_device_rx_msg(CAN_msg * msg, const unsigned int timeout_ms)
+{
+        return CAN_device_rx_msgs(msg, 1, timeout_ms) == 1;
+}
+
+int CAN_device_get_health(const uint8_t channel,
+                          struct CAN_device_health *health)
+{
+        if (channel >= CAN_DEVICE_CHANNELS)
+                return 0;
+
+        CAN_TypeDef* chan = channel == 0 ? CAN1 : CAN2;
+        health->rx_dropped = can_rx_dropped[channel];
+        health->rx_errors = CAN_GetReceiveErrorCounter(chan);
+        health->tx_errors = CAN_GetLSBTransmitErrorCounter(chan);
+        health->last_error = CAN_GetLastErrorCode(chan) >> 4;
+        health->bus_off = SET == CAN_GetFlagStatus(chan, CAN_FLAG_BOF);
+        return 1;
 }
 
 static void process_can_irq_rx(uint8_t can_bus, CAN_TypeDef* can_x, uint8_t fifo_number)
@@ -351,7 +438,18 @@ static void process_can_irq_rx(uint8_t can_bus, CAN_TypeDef* can_x, uint8_t fifo
         memcpy(can_msg.data, rx_msg.Data, rx_msg.DLC);
         can_msg.dataLength = rx_msg.DLC;
 
-        xQueueSendFromISR(can_rx_queue, &can_msg, &task_woken_by_rx);
+        /* Frames are dropped, never split, when the ring is full */
+        struct spsc_ring_buff *rb = can_rx_ring[can_bus];
+        if (spsc_ring_buff_bytes_free(rb) >= sizeof(can_msg))
+                spsc_ring_buff_write(rb, &can_msg, sizeof(can_msg));
+        else
+                ++can_rx_dropped[can_bus];
+
+        if (!can_rx_waiting)
+                return;
+
+        can_rx_waiting = false;
+        xSemaphoreGiveFromISR(can_rx_signal, &task_woken_by_rx);
         portEND_SWITCHING_ISR(task_woken_by_rx);
 }
 
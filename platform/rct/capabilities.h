@@ -59,6 +59,8 @@
 
 /* Logging Buffer Size (in 1K Blocks) */
 #define LOG_BUFFER_SIZE	            (1024 * 3)
+/* No SD card, so no pre-trigger history to keep */
+#define SAMPLE_HISTORY_MAX_SIZE     0
 
 /* Rx Max Message length */
 #define RX_MAX_MSG_LEN	            768
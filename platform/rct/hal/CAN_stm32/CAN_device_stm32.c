@@ -20,6 +20,7 @@
  */
 
 #include "CAN_device.h"
+#include "CAN_filters.h"
 #include "FreeRTOS.h"
 #include "led.h"
 #include "mod_string.h"
@@ -37,6 +38,7 @@
 #define _LOG_PFX  "[CAN device] "
 
 static xQueueHandle can_rx_queue;
+static volatile uint32_t can_rx_dropped;
 
 #define CAN_FILTER_COUNT	13
 #define CAN_IRQ_PRIORITY 	5
@@ -213,11 +215,15 @@ int CAN_device_set_filter(const uint8_t channel, const uint8_t id, const uint8_t
         CAN_FilterInitStructure.CAN_FilterActivation =
                 enabled ? ENABLE : DISABLE;
 
-        const size_t shift = extended ? 3 : 21;
-        CAN_FilterInitStructure.CAN_FilterIdHigh = (filter << shift) >> 16;
-        CAN_FilterInitStructure.CAN_FilterMaskIdHigh = (mask << shift) >> 16;
-        CAN_FilterInitStructure.CAN_FilterIdLow = (uint16_t) filter;
-        CAN_FilterInitStructure.CAN_FilterMaskIdLow = (uint16_t) mask;
+        /* The filter layout holds the register bits [31:03] */
+        const struct CAN_filter layout =
+                CAN_filter_layout(extended, filter, mask);
+        const uint32_t id_reg = layout.id << 3;
+        const uint32_t mask_reg = layout.mask << 3;
+        CAN_FilterInitStructure.CAN_FilterIdHigh = id_reg >> 16;
+        CAN_FilterInitStructure.CAN_FilterMaskIdHigh = mask_reg >> 16;
+        CAN_FilterInitStructure.CAN_FilterIdLow = (uint16_t) id_reg;
+        CAN_FilterInitStructure.CAN_FilterMaskIdLow = (uint16_t) mask_reg;
 
         CAN_FilterInit(&CAN_FilterInitStructure);
 
@@ -289,6 +295,35 @@ int CAN_device_rx_msg(CAN_msg * msg, const unsigned int timeoutMs)
         }
 }
 
+size_t CAN_device_rx_msgs(CAN_msg *msgs, const size_t max,
+                          const unsigned int timeoutMs)
+{
+        if (!max || !CAN_device_rx_msg(msgs, timeoutMs))
+                return 0;
+
+        /* Take whatever else is already waiting */
+        size_t count = 1;
+        while (count < max &&
+               pdTRUE == xQueueReceive(can_rx_queue, msgs + count, 0))
+                ++count;
+
+        return count;
+}
+
+int CAN_device_get_health(const uint8_t channel,
+                          struct CAN_device_health *health)
+{
+        if (channel != 0)
+                return 0;
+
+        health->rx_dropped = can_rx_dropped;
+        health->rx_errors = CAN_GetReceiveErrorCounter(CAN1);
+        health->tx_errors = CAN_GetLSBTransmitErrorCounter(CAN1);
+        health->last_error = CAN_GetLastErrorCode(CAN1) >> 4;
+        health->bus_off = SET == CAN_GetFlagStatus(CAN1, CAN_FLAG_BOF);
+        return 1;
+}
+
 void CAN_device_isr(void)
 {
         if (CAN_GetITStatus(CAN1, CAN_IT_FMP0) != RESET) {
@@ -305,7 +340,9 @@ void CAN_device_isr(void)
                 memcpy(can_msg.data, rx_msg.Data, rx_msg.DLC);
                 can_msg.dataLength = rx_msg.DLC;
 
-                xQueueSendFromISR(can_rx_queue, &can_msg, &task_woken_by_rx);
+                if (pdTRUE != xQueueSendFromISR(can_rx_queue, &can_msg,
+                                                &task_woken_by_rx))
+                        ++can_rx_dropped;
                 portEND_SWITCHING_ISR(task_woken_by_rx);
         }
 }
@@ -43,7 +43,6 @@
 
 static struct {
         uint8_t USB_Rx_Buffer[VIRTUAL_COM_PORT_DATA_SIZE];
-        uint8_t USB_Tx_Buffer[VIRTUAL_COM_PORT_DATA_SIZE];
         struct Serial *serial;
         usb_device_data_rx_isr_cb_t* rx_isr_cb;
 } usb_state;
@@ -119,18 +118,16 @@ int USB_CDC_is_initialized()
 static void usb_handle_transfer(void)
 {
         portBASE_TYPE hpta = false;
-        xQueueHandle queue = serial_get_tx_queue(usb_state.serial);
-        uint8_t *buff = usb_state.USB_Tx_Buffer;
-        size_t len = 0;
-
-        for (; len < VIRTUAL_COM_PORT_DATA_SIZE; ++len)
-                if (!xQueueReceiveFromISR(queue, buff + len, &hpta))
-                        break;
+        size_t len;
+        const void *data = serial_tx_dma_read_init(usb_state.serial, &len);
+        if (len > VIRTUAL_COM_PORT_DATA_SIZE)
+                len = VIRTUAL_COM_PORT_DATA_SIZE;
 
         /* Check if we actually have something to send */
         if (len) {
-                UserToPMABufferCopy(usb_state.USB_Tx_Buffer,
-                                    ENDP1_TXADDR, len);
+                /* Copy straight out of the Serial buffer into the PMA */
+                UserToPMABufferCopy((uint8_t*) data, ENDP1_TXADDR, len);
+                serial_tx_dma_read_fini(usb_state.serial, len, &hpta);
                 SetEPTxCount(ENDP1, len);
                 SetEPTxValid(ENDP1);
         }
@@ -146,14 +143,11 @@ void EP1_IN_Callback (void)
 void EP3_OUT_Callback(void)
 {
         portBASE_TYPE hpta = false;
-        xQueueHandle queue = serial_get_rx_queue(usb_state.serial);
         uint8_t *buff = usb_state.USB_Rx_Buffer;
 
         /* Get the received data buffer and clear the counter */
         const size_t len = USB_SIL_Read(EP3_OUT, buff);
-
-        for (size_t i = 0; i < len; ++i)
-                xQueueSendFromISR(queue, buff + i, &hpta);
+        serial_rx_put(usb_state.serial, buff, len, &hpta);
 
         /*
          * STIEG HACK
@@ -80,6 +80,9 @@ $(RCP_SRC)/CAN/CAN_task.c \
 $(RCP_SRC)/CAN/CAN_dispatcher.c \
 $(RCP_SRC)/CAN/CAN_aux_queue.c \
 $(RCP_SRC)/CAN/CAN_aux_filterqueue.c \
+$(RCP_SRC)/CAN/CAN_filters.c \
+$(RCP_SRC)/CAN/CAN_stats.c \
+$(RCP_SRC)/CAN/isotp.c \
 $(RCP_SRC)/CAN/can_mapping.c \
 $(RCP_SRC)/CAN/can_channels.c \
 $(RCP_SRC)/GPIO/GPIO.c \
@@ -117,6 +120,7 @@ $(RCP_SRC)/lap_stats/lap_stats.c \
 $(RCP_SRC)/launch_control.c \
 $(RCP_SRC)/logger/auto_control.c \
 $(RCP_SRC)/logger/auto_logger.c \
+$(RCP_SRC)/logger/binary_log.c \
 $(RCP_SRC)/logger/camera_control.c \
 $(RCP_SRC)/logger/channel_config.c \
 $(RCP_SRC)/logger/connectivityTask.c \
@@ -131,6 +135,9 @@ $(RCP_SRC)/logger/loggerHardware.c \
 $(RCP_SRC)/logger/loggerSampleData.c \
 $(RCP_SRC)/logger/loggerTaskEx.c \
 $(RCP_SRC)/logger/sampleRecord.c \
+$(RCP_SRC)/logger/sample_history.c \
+$(RCP_SRC)/logger/sample_meta.c \
+$(RCP_SRC)/logger/sample_stream.c \
 $(RCP_SRC)/logger/versionInfo.c \
 $(RCP_SRC)/logging/printk.c \
 $(RCP_SRC)/lua/luaBaseBinding.c \
@@ -155,12 +162,14 @@ $(RCP_SRC)/units/units_conversion.c \
 $(RCP_SRC)/usart/usart.c \
 $(RCP_SRC)/usb_comm/usb_comm.c \
 $(RCP_SRC)/util/FreeRTOS-openocd.c \
+$(RCP_SRC)/util/arena.c \
 $(RCP_SRC)/util/byteswap.c \
 $(RCP_SRC)/util/convert.c \
 $(RCP_SRC)/util/linear_interpolate.c \
 $(RCP_SRC)/util/modp_numtoa.c \
 $(RCP_SRC)/util/panic.c \
 $(RCP_SRC)/util/ring_buffer.c \
+$(RCP_SRC)/util/spsc_ring_buff.c \
 $(RCP_SRC)/util/str_util.c \
 $(RCP_SRC)/util/taskUtil.c \
 $(RCP_SRC)/util/ts_ring_buff.c \
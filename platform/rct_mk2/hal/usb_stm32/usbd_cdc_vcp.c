@@ -71,7 +71,7 @@ static volatile bool vcp_configured = false;
 /* Locks */
 static xSemaphoreHandle _lock;
 
-static xQueueHandle rx_queue;
+static struct Serial *rx_serial;
 static usb_device_data_rx_isr_cb_t* rx_isr_cb;
 
 static volatile bool connected = false;
@@ -99,7 +99,7 @@ void vcp_setup(struct Serial* s, usb_device_data_rx_isr_cb_t* cb)
 {
         vSemaphoreCreateBinary(_lock);
         xSemaphoreTake(_lock, portMAX_DELAY);
-        rx_queue = serial_get_rx_queue(s);
+        rx_serial = s;
         rx_isr_cb = cb;
 }
 
@@ -249,8 +249,7 @@ static uint16_t VCP_DataRx (uint8_t* Buf, uint32_t Len)
         portBASE_TYPE hptw = false;
 
         reinit_if_needed();
-        while(Len--)
-                xQueueSendFromISR(rx_queue, Buf++, &hptw);
+        serial_rx_put(rx_serial, Buf, Len, &hptw);
 
         if (rx_isr_cb)
                 hptw |= rx_isr_cb();
@@ -22,6 +22,7 @@
 
 #include "CAN.h"
 #include "CAN_device.h"
+#include "CAN_filters.h"
 #include "loggerConfig.h"
 #include "printk.h"
 #include "led.h"
@@ -44,12 +45,17 @@ int CAN_init(LoggerConfig *loggerConfig)
 
 int CAN_init_port(const uint8_t port, const uint32_t baud, const bool termination_enabled)
 {
+        /* Device init resets the filters to accept all; plan them again */
+        CAN_filters_set_manual(port, false);
+        CAN_filters_stale();
         return CAN_device_init(port, baud, termination_enabled);
 }
 
 int CAN_set_filter(const uint8_t channel, const uint8_t id, const uint8_t extended,
                    const uint32_t filter, const uint32_t mask, const bool enabled)
 {
+        /* Filters set by hand take over from the automatic ones */
+        CAN_filters_set_manual(channel, true);
         return CAN_device_set_filter(channel, id, extended, filter,
                                      mask, enabled);
 }
@@ -69,3 +75,12 @@ int CAN_rx_msg(CAN_msg *msg, const unsigned int timeoutMs)
                 led_toggle(LED_CAN);
         return rc;
 }
+
+size_t CAN_rx_msgs(CAN_msg *msgs, const size_t max,
+                   const unsigned int timeoutMs)
+{
+        const size_t count = CAN_device_rx_msgs(msgs, max, timeoutMs);
+        if (count)
+                led_toggle(LED_CAN);
+        return count;
+}
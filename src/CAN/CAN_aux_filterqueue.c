@@ -19,6 +19,7 @@
  * this code. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "CAN_aux_filterqueue.h"
+#include "CAN_stats.h"
 #include "capabilities.h"
 #include "printk.h"
 #include "taskUtil.h"
@@ -45,6 +46,18 @@ void CAN_aux_filterqueue_configure(uint8_t new_can_bus, uint32_t new_low_id_rang
         can_bus = new_can_bus;
         low_id_range = new_low_id_range;
         high_id_range = new_high_id_range;
+        CAN_filters_stale();
+}
+
+void CAN_aux_filterqueue_add_rx_filters(struct CAN_filter_plan *plans)
+{
+        /* Nothing to add until a script sets a range */
+        if (0 == low_id_range && 0 == high_id_range)
+                return;
+
+        if (can_bus < CAN_CHANNELS)
+                CAN_filter_plan_add_range(plans + can_bus, low_id_range,
+                                          high_id_range);
 }
 
 bool CAN_aux_filterqueue_put_msg(CAN_msg * can_msg)
@@ -60,6 +73,8 @@ bool CAN_aux_filterqueue_put_msg(CAN_msg * can_msg)
         /* add to queue with no delay */
         if (pdTRUE == xQueueSend(can_aux_filterqueue, can_msg, 0))
                 return true;
+
+        CAN_stats_dropped(can_bus, CAN_STATS_QUEUE_FILTER);
         return false;
 }
 
@@ -19,6 +19,7 @@
  * this code. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "CAN_aux_queue.h"
+#include "CAN_stats.h"
 #include "capabilities.h"
 #include "printk.h"
 #include "taskUtil.h"
@@ -48,6 +49,8 @@ bool CAN_aux_queue_put_msg(CAN_msg * can_msg)
         /* add to queue with no delay */
         if (pdTRUE == xQueueSend(can_aux_queue[can_bus], can_msg, 0))
                 return true;
+
+        CAN_stats_dropped(can_bus, CAN_STATS_QUEUE_AUX);
         return false;
 }
 
@@ -0,0 +1,409 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CAN_aux_filterqueue.h"
+#include "CAN_device.h"
+#include "CAN_filters.h"
+#include "capabilities.h"
+#include "printk.h"
+#include "shiftx_drv.h"
+#include <string.h>
+
+#define _LOG_PFX "[CAN filters] "
+
+#define CAN_EXT_ID_MASK 0x1FFFFFFF
+#define CAN_STD_ID_SHIFT 18
+
+/* ISO-TP response IDs a script can read per channel before taking all */
+#define CAN_SCRIPT_ISOTP_IDS 4
+
+struct script_isotp_id {
+        uint32_t can_id;
+        bool extended;
+};
+
+static struct {
+        bool stale;
+        bool manual[CAN_CHANNELS];
+
+        /* Receivers registered by the Lua script as it runs */
+        bool script_rx_all[CAN_CHANNELS];
+        uint8_t script_isotp_count[CAN_CHANNELS];
+        struct script_isotp_id script_isotp[CAN_CHANNELS][CAN_SCRIPT_ISOTP_IDS];
+} filter_state;
+
+void CAN_filter_plan_init(struct CAN_filter_plan *plan)
+{
+        memset(plan, 0, sizeof(*plan));
+}
+
+void CAN_filter_plan_accept_all(struct CAN_filter_plan *plan)
+{
+        plan->accept_all = true;
+        plan->count = 0;
+}
+
+static bool filter_covers(const struct CAN_filter *outer,
+                          const struct CAN_filter *inner)
+{
+        return (outer->mask & inner->mask) == outer->mask &&
+                (inner->id & outer->mask) == outer->id;
+}
+
+static struct CAN_filter merge_filters(const struct CAN_filter *a,
+                                       const struct CAN_filter *b)
+{
+        struct CAN_filter merged;
+        merged.mask = a->mask & b->mask & ~(a->id ^ b->id);
+        merged.id = a->id & merged.mask;
+        return merged;
+}
+
+static int mask_bits(uint32_t mask)
+{
+        int bits = 0;
+        for (; mask; mask &= mask - 1)
+                ++bits;
+        return bits;
+}
+
+static void add_filter(struct CAN_filter_plan *plan, struct CAN_filter filter)
+{
+        if (plan->accept_all)
+                return;
+
+        filter.id &= filter.mask;
+        for (size_t i = 0; i < plan->count; ++i)
+                if (filter_covers(plan->filters + i, &filter))
+                        return;
+
+        if (plan->count < CAN_FILTER_BANKS) {
+                plan->filters[plan->count++] = filter;
+                return;
+        }
+
+        /*
+         * Out of banks.  Widen whichever pair (the new filter included)
+         * loses the fewest mask bits when merged into one.
+         */
+        struct CAN_filter *candidates[CAN_FILTER_BANKS + 1];
+        for (size_t i = 0; i < CAN_FILTER_BANKS; ++i)
+                candidates[i] = plan->filters + i;
+        candidates[CAN_FILTER_BANKS] = &filter;
+
+        size_t best_a = 0;
+        size_t best_b = 1;
+        int best_bits = -1;
+        for (size_t a = 0; a < CAN_FILTER_BANKS; ++a) {
+                for (size_t b = a + 1; b <= CAN_FILTER_BANKS; ++b) {
+                        const struct CAN_filter merged =
+                                merge_filters(candidates[a], candidates[b]);
+                        const int bits = mask_bits(merged.mask);
+                        if (bits > best_bits) {
+                                best_bits = bits;
+                                best_a = a;
+                                best_b = b;
+                        }
+                }
+        }
+
+        plan->filters[best_a] = merge_filters(candidates[best_a],
+                                              candidates[best_b]);
+        if (best_b < CAN_FILTER_BANKS)
+                plan->filters[best_b] = filter;
+}
+
+void CAN_filter_plan_add_extended(struct CAN_filter_plan *plan,
+                                  uint32_t can_id, uint32_t can_mask)
+{
+        const struct CAN_filter filter = {
+                .id = can_id & CAN_EXT_ID_MASK,
+                .mask = (can_mask ? can_mask : CAN_EXT_ID_MASK) &
+                        CAN_EXT_ID_MASK,
+        };
+
+        add_filter(plan, filter);
+}
+
+void CAN_filter_plan_add(struct CAN_filter_plan *plan, uint32_t can_id,
+                         uint32_t can_mask)
+{
+        if (can_id > CAN_STD_ID_MAX) {
+                CAN_filter_plan_add_extended(plan, can_id, can_mask);
+                return;
+        }
+
+        const struct CAN_filter filter = {
+                .id = can_id << CAN_STD_ID_SHIFT,
+                .mask = ((can_mask ? can_mask : CAN_STD_ID_MAX) &
+                         CAN_STD_ID_MAX) << CAN_STD_ID_SHIFT,
+        };
+        add_filter(plan, filter);
+
+        /*
+         * Nothing says the ID won't come in an extended frame, which the
+         * controller lays out differently.  One filter for all extended
+         * IDs this small spares us a bank per ID.
+         */
+        if (can_mask) {
+                CAN_filter_plan_add_extended(plan, can_id, can_mask);
+        } else {
+                const struct CAN_filter small_ext = {
+                        .id = 0,
+                        .mask = CAN_EXT_ID_MASK & ~CAN_STD_ID_MAX,
+                };
+                add_filter(plan, small_ext);
+        }
+}
+
+void CAN_filter_plan_add_range(struct CAN_filter_plan *plan, uint32_t low_id,
+                               uint32_t high_id)
+{
+        if (low_id > high_id)
+                return;
+
+        /* standard part of the range; drop low bits until both ends agree */
+        if (low_id <= CAN_STD_ID_MAX) {
+                const uint32_t high = high_id < CAN_STD_ID_MAX ?
+                        high_id : CAN_STD_ID_MAX;
+                uint32_t mask = CAN_STD_ID_MAX;
+                while ((low_id ^ high) & mask)
+                        mask = (mask << 1) & CAN_STD_ID_MAX;
+
+                const struct CAN_filter filter = {
+                        .id = (low_id & mask) << CAN_STD_ID_SHIFT,
+                        .mask = mask << CAN_STD_ID_SHIFT,
+                };
+                add_filter(plan, filter);
+
+                /* The same IDs in extended frames */
+                const struct CAN_filter ext_filter = {
+                        .id = low_id & mask,
+                        .mask = mask | (CAN_EXT_ID_MASK & ~CAN_STD_ID_MAX),
+                };
+                add_filter(plan, ext_filter);
+                low_id = CAN_STD_ID_MAX + 1;
+        }
+
+        if (high_id <= CAN_STD_ID_MAX)
+                return;
+
+        /* extended part of the range */
+        uint32_t mask = CAN_EXT_ID_MASK;
+        while ((low_id ^ high_id) & mask)
+                mask = (mask << 1) & CAN_EXT_ID_MASK;
+
+        const struct CAN_filter filter = {
+                .id = low_id & mask,
+                .mask = mask,
+        };
+        add_filter(plan, filter);
+}
+
+bool CAN_filter_plan_accepts(const struct CAN_filter_plan *plan,
+                             const CAN_msg *msg)
+{
+        if (plan->accept_all)
+                return true;
+
+        const uint32_t id = msg->isExtendedAddress ?
+                msg->addressValue & CAN_EXT_ID_MASK :
+                (msg->addressValue & CAN_STD_ID_MAX) << CAN_STD_ID_SHIFT;
+
+        for (size_t i = 0; i < plan->count; ++i)
+                /* unmasked ID bits are don't care, set or not */
+                if (!((id ^ plan->filters[i].id) & plan->filters[i].mask))
+                        return true;
+
+        return false;
+}
+
+struct CAN_filter CAN_filter_layout(const bool extended, const uint32_t filter,
+                                    const uint32_t mask)
+{
+        const struct CAN_filter layout = {
+                .id = extended ? filter & CAN_EXT_ID_MASK :
+                        (filter & CAN_STD_ID_MAX) << CAN_STD_ID_SHIFT,
+                .mask = extended ? mask & CAN_EXT_ID_MASK :
+                        (mask & CAN_STD_ID_MAX) << CAN_STD_ID_SHIFT,
+        };
+        return layout;
+}
+
+static struct CAN_filter_plan* plan_for_bus(struct CAN_filter_plan *plans,
+                                            const uint8_t can_bus)
+{
+        return can_bus < CAN_CHANNELS ? plans + can_bus : NULL;
+}
+
+static void add_mapping(struct CAN_filter_plan *plans,
+                        const CANMapping *mapping)
+{
+        struct CAN_filter_plan *plan = plan_for_bus(plans,
+                                                    mapping->can_channel);
+        if (!plan)
+                return;
+
+        /* A CAN ID of 0 matches everything on the bus */
+        if (0 == mapping->can_id) {
+                CAN_filter_plan_accept_all(plan);
+                return;
+        }
+
+        CAN_filter_plan_add(plan, mapping->can_id, mapping->can_mask);
+}
+
+void CAN_filters_build(struct CAN_filter_plan *plans, const LoggerConfig *lc)
+{
+        for (size_t i = 0; i < CAN_CHANNELS; ++i)
+                CAN_filter_plan_init(plans + i);
+
+        const CANChannelConfig *ccc = &lc->can_channel_cfg;
+        if (ccc->enabled)
+                for (size_t i = 0; i < ccc->enabled_mappings; ++i)
+                        add_mapping(plans, &ccc->can_channels[i].mapping);
+
+        const OBD2Config *oc = &lc->OBD2Configs;
+        if (oc->enabled)
+                for (size_t i = 0; i < oc->enabledPids; ++i)
+                        add_mapping(plans, &oc->pids[i].mapping);
+
+        shiftx_add_rx_filters(plans);
+        CAN_aux_filterqueue_add_rx_filters(plans);
+
+        for (size_t i = 0; i < CAN_CHANNELS; ++i) {
+                if (filter_state.script_rx_all[i])
+                        CAN_filter_plan_accept_all(plans + i);
+
+                for (size_t j = 0; j < filter_state.script_isotp_count[i]; ++j) {
+                        const struct script_isotp_id *rx =
+                                filter_state.script_isotp[i] + j;
+                        if (rx->extended)
+                                CAN_filter_plan_add_extended(plans + i,
+                                                             rx->can_id, 0);
+                        else
+                                CAN_filter_plan_add(plans + i, rx->can_id, 0);
+                }
+
+                /* Nothing to listen for; keep bus activity visible */
+                if (0 == plans[i].count)
+                        CAN_filter_plan_accept_all(plans + i);
+        }
+}
+
+static void apply_plan(const uint8_t channel,
+                       const struct CAN_filter_plan *plan)
+{
+        if (plan->accept_all) {
+                CAN_device_set_filter(channel, 0, 1, 0, 0, true);
+                for (size_t i = 1; i < CAN_FILTER_BANKS; ++i)
+                        CAN_device_set_filter(channel, i, 0, 0, 0, false);
+                return;
+        }
+
+        for (size_t i = 0; i < CAN_FILTER_BANKS; ++i) {
+                const struct CAN_filter *filter = plan->filters + i;
+                CAN_device_set_filter(channel, i, 1, filter->id, filter->mask,
+                                      i < plan->count);
+        }
+}
+
+void CAN_filters_update(const LoggerConfig *lc)
+{
+        static struct CAN_filter_plan plans[CAN_CHANNELS];
+
+        filter_state.stale = false;
+        if (!lc->CanConfig.enabled)
+                return;
+
+        CAN_filters_build(plans, lc);
+        for (size_t i = 0; i < CAN_CHANNELS; ++i) {
+                if (filter_state.manual[i])
+                        continue;
+
+                apply_plan(i, plans + i);
+                if (plans[i].accept_all) {
+                        pr_info_int_msg(_LOG_PFX "Accepting all on CAN ", i);
+                } else {
+                        pr_info_int_msg(_LOG_PFX "Hardware filters on CAN ", i);
+                        pr_info_int_msg(_LOG_PFX "Filters used: ",
+                                        plans[i].count);
+                }
+        }
+}
+
+void CAN_filters_stale(void)
+{
+        filter_state.stale = true;
+}
+
+bool CAN_filters_is_stale(void)
+{
+        return filter_state.stale;
+}
+
+void CAN_filters_set_manual(uint8_t channel, bool manual)
+{
+        if (channel < CAN_CHANNELS)
+                filter_state.manual[channel] = manual;
+}
+
+void CAN_filters_add_script_rx(const uint8_t channel)
+{
+        if (channel >= CAN_CHANNELS || filter_state.script_rx_all[channel])
+                return;
+
+        filter_state.script_rx_all[channel] = true;
+        CAN_filters_stale();
+}
+
+void CAN_filters_add_script_isotp(const uint8_t channel, const uint32_t can_id,
+                                  const bool extended)
+{
+        if (channel >= CAN_CHANNELS)
+                return;
+
+        const uint8_t count = filter_state.script_isotp_count[channel];
+        struct script_isotp_id *ids = filter_state.script_isotp[channel];
+        for (size_t i = 0; i < count; ++i)
+                if (ids[i].can_id == can_id && ids[i].extended == extended)
+                        return;
+
+        /* Out of room; the script gets the whole bus instead */
+        if (count >= CAN_SCRIPT_ISOTP_IDS) {
+                CAN_filters_add_script_rx(channel);
+                return;
+        }
+
+        ids[count].can_id = can_id;
+        ids[count].extended = extended;
+        filter_state.script_isotp_count[channel] = count + 1;
+        CAN_filters_stale();
+}
+
+void CAN_filters_clear_script_rx(void)
+{
+        memset(filter_state.script_rx_all, 0,
+               sizeof(filter_state.script_rx_all));
+        memset(filter_state.script_isotp_count, 0,
+               sizeof(filter_state.script_isotp_count));
+        CAN_filters_stale();
+}
@@ -0,0 +1,184 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CAN_device.h"
+#include "CAN_stats.h"
+#include "capabilities.h"
+#include "macros.h"
+#include "taskUtil.h"
+#include <string.h>
+
+struct id_count {
+        uint32_t can_id;
+        uint32_t count;
+};
+
+/* What is counted on one bus during the current window */
+struct bus_window {
+        uint32_t frames;
+        uint32_t bytes;
+        uint8_t id_count;
+        struct id_count ids[CAN_STATS_TRACKED_IDS];
+};
+
+static struct can_bus_stats bus_stats[CAN_CHANNELS];
+static struct bus_window bus_windows[CAN_CHANNELS];
+static struct can_task_stats task_stats;
+static struct can_task_stats task_window;
+static size_t window_start;
+
+void CAN_stats_init(void)
+{
+        memset(bus_stats, 0, sizeof(bus_stats));
+        memset(bus_windows, 0, sizeof(bus_windows));
+        memset(&task_stats, 0, sizeof(task_stats));
+        memset(&task_window, 0, sizeof(task_window));
+        window_start = getCurrentTicks();
+}
+
+/*
+ * Space saving count of the busiest IDs: once the table is full a new ID
+ * takes over the slot, and the count, of the least seen one.  The
+ * busiest IDs always survive, with their counts over-estimated by no
+ * more than the count they took over.
+ */
+static void count_id(struct bus_window *w, const uint32_t can_id)
+{
+        struct id_count *min = NULL;
+
+        for (size_t i = 0; i < w->id_count; ++i) {
+                struct id_count *ic = w->ids + i;
+                if (ic->can_id == can_id) {
+                        ++ic->count;
+                        return;
+                }
+                if (!min || ic->count < min->count)
+                        min = ic;
+        }
+
+        if (w->id_count < CAN_STATS_TRACKED_IDS) {
+                min = w->ids + w->id_count++;
+                min->count = 0;
+        }
+
+        min->can_id = can_id;
+        ++min->count;
+}
+
+void CAN_stats_rx(const CAN_msg *msgs, const size_t count)
+{
+        for (size_t i = 0; i < count; ++i) {
+                const CAN_msg *msg = msgs + i;
+                if (msg->can_bus >= CAN_CHANNELS)
+                        continue;
+
+                struct can_bus_stats *bs = bus_stats + msg->can_bus;
+                struct bus_window *w = bus_windows + msg->can_bus;
+
+                ++bs->frames;
+                bs->bytes += msg->dataLength;
+                ++w->frames;
+                w->bytes += msg->dataLength;
+                count_id(w, msg->addressValue);
+        }
+}
+
+void CAN_stats_dropped(const uint8_t can_bus, const enum can_stats_queue queue)
+{
+        if (can_bus < CAN_CHANNELS && queue < CAN_STATS_QUEUES)
+                ++bus_stats[can_bus].dropped[queue];
+}
+
+void CAN_stats_loop(const size_t batch, const size_t ticks)
+{
+        const uint32_t ms = ticksToMs(ticks);
+
+        ++task_window.loops;
+        if (ms > task_window.max_loop_ms)
+                task_window.max_loop_ms = ms;
+        if (batch > task_window.max_batch)
+                task_window.max_batch = batch;
+}
+
+static uint32_t per_second(const uint32_t count, const uint32_t ms)
+{
+        return (uint32_t) ((uint64_t) count * 1000 / ms);
+}
+
+static void publish_bus(const uint8_t can_bus, const uint32_t ms)
+{
+        struct can_bus_stats *bs = bus_stats + can_bus;
+        struct bus_window *w = bus_windows + can_bus;
+
+        bs->frame_rate = per_second(w->frames, ms);
+        bs->byte_rate = per_second(w->bytes, ms);
+
+        /* Busiest first */
+        for (size_t i = 1; i < w->id_count; ++i) {
+                const struct id_count ic = w->ids[i];
+                size_t j = i;
+                for (; j && w->ids[j - 1].count < ic.count; --j)
+                        w->ids[j] = w->ids[j - 1];
+                w->ids[j] = ic;
+        }
+
+        const uint8_t top = MIN(w->id_count, CAN_STATS_TOP_IDS);
+        for (size_t i = 0; i < top; ++i) {
+                bs->top[i].can_id = w->ids[i].can_id;
+                bs->top[i].rate = per_second(w->ids[i].count, ms);
+        }
+        bs->top_count = top;
+
+        struct CAN_device_health health;
+        if (CAN_device_get_health(can_bus, &health)) {
+                bs->dropped[CAN_STATS_QUEUE_RX] = health.rx_dropped;
+                bs->rx_errors = health.rx_errors;
+                bs->tx_errors = health.tx_errors;
+                bs->last_error = health.last_error;
+                bs->bus_off = health.bus_off;
+        }
+
+        memset(w, 0, sizeof(*w));
+}
+
+void CAN_stats_update(const size_t ticks)
+{
+        const uint32_t ms = ticksToMs(ticks - window_start);
+        if (ms < CAN_STATS_WINDOW_MS)
+                return;
+
+        for (size_t i = 0; i < CAN_CHANNELS; ++i)
+                publish_bus(i, ms);
+
+        task_stats = task_window;
+        memset(&task_window, 0, sizeof(task_window));
+        window_start = ticks;
+}
+
+const struct can_bus_stats* CAN_stats_get_bus(const uint8_t can_bus)
+{
+        return can_bus < CAN_CHANNELS ? bus_stats + can_bus : NULL;
+}
+
+const struct can_task_stats* CAN_stats_get_task(void)
+{
+        return &task_stats;
+}
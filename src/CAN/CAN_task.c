@@ -35,15 +35,22 @@
 #include "capabilities.h"
 #include "can_mapping.h"
 #include "can_channels.h"
+#include "isotp.h"
 #include "CAN_aux_queue.h"
 #include "CAN_aux_filterqueue.h"
 #include "CAN_dispatcher.h"
+#include "CAN_filters.h"
+#include "CAN_stats.h"
 
 #define _LOG_PFX                        "[CAN_Task] "
 
 #define CAN_TASK_STACK                  128
 #define CAN_TASK_FEATURED_DISABLED_MS   2000
 #define CAN_RX_DELAY                    50
+#define CAN_RX_BATCH                    16
+
+/* Kept off the task stack, which is small */
+static CAN_msg rx_msgs[CAN_RX_BATCH];
 
 static void CAN_task(void *parameters)
 {
@@ -55,17 +62,24 @@ static void CAN_task(void *parameters)
         CAN_aux_queue_init();
 #endif
         CAN_aux_filterqueue_init();
+        CAN_stats_init();
+        isotp_init();
         while(1) {
                 uint16_t enabled_mapping_count = 0;
                 uint16_t enabled_obd2_pids_count = 0;
                 bool success;
 
                 uint16_t new_enabled_mapping_count = ccc->enabled_mappings;
-                success = CAN_init_current_values(new_enabled_mapping_count);
+                success = CAN_init_current_values(ccc, new_enabled_mapping_count);
                 enabled_mapping_count = success ? new_enabled_mapping_count : 0;
                 if (!success)
                         pr_error_int_msg("Failed to create buffer for CAN channels; size ", new_enabled_mapping_count);
 
+                if (!CAN_init_dispatch_index(ccc, enabled_mapping_count))
+                        pr_warning(_LOG_PFX "CAN dispatch index unavailable\r\n");
+
+                CAN_filters_update(lc);
+
                 uint16_t new_enabled_obd2_pids_count = oc->enabledPids;
                 success = OBD2_init_current_values(oc);
                 enabled_obd2_pids_count = success ? new_enabled_obd2_pids_count : 0;
@@ -73,26 +87,43 @@ static void CAN_task(void *parameters)
                         pr_error_int_msg("Failed to create buffer for OBD2 channels; size ", new_enabled_obd2_pids_count);
 
                 while(! (CAN_is_state_stale() || OBD2_is_state_stale())) {
-                        CAN_msg msg;
-                        int result = CAN_rx_msg(&msg, CAN_RX_DELAY );
+                        if (CAN_filters_is_stale())
+                                CAN_filters_update(lc);
 
-                        if (result) {
-                                if (ccc->enabled)
-                                        update_can_channels(&msg, ccc, enabled_mapping_count);
+                        const size_t count = CAN_rx_msgs(rx_msgs, CAN_RX_BATCH,
+                                                         CAN_RX_DELAY);
+                        const size_t start_ticks = getCurrentTicks();
+                        CAN_stats_rx(rx_msgs, count);
 
-                                if (oc->enabled)
-                                        update_obd2_channels(&msg, oc);
+                        /* Hand the whole batch to each consumer in turn */
+                        for (size_t i = 0; i < count; ++i) {
+                                const struct isotp_msg *tp = isotp_rx_frame(rx_msgs + i);
+                                if (tp && oc->enabled)
+                                        update_obd2_isotp_channels(tp, oc);
+                        }
 
-                                can_dispatch_message(&msg);
+                        if (ccc->enabled)
+                                for (size_t i = 0; i < count; ++i)
+                                        update_can_channels(rx_msgs + i, ccc, enabled_mapping_count);
 
+                        if (oc->enabled)
+                                for (size_t i = 0; i < count; ++i)
+                                        update_obd2_channels(rx_msgs + i, oc);
+
+                        for (size_t i = 0; i < count; ++i) {
+                                can_dispatch_message(rx_msgs + i);
 #if CAN_AUX_QUEUE_SUPPORT == 1
-                                CAN_aux_queue_put_msg(&msg);
+                                CAN_aux_queue_put_msg(rx_msgs + i);
 #endif
-                                CAN_aux_filterqueue_put_msg(&msg);
+                                CAN_aux_filterqueue_put_msg(rx_msgs + i);
                         }
+
                         if (oc->enabled)
                                 sequence_next_obd2_query(oc, enabled_obd2_pids_count);
 
+                        const size_t ticks = getCurrentTicks();
+                        CAN_stats_loop(count, ticks - start_ticks);
+                        CAN_stats_update(ticks);
                 }
                 delayMs(CAN_TASK_FEATURED_DISABLED_MS);
         }
@@ -26,11 +26,45 @@
 #include "printk.h"
 #include <string.h>
 
+/* Distinct ID masks the dispatch index can track before giving up */
+#define CAN_MASK_GROUPS 8
+
+/* reference from a bus / CAN ID key to the mapping it feeds */
+struct can_mapping_ref {
+        struct can_signal signal;
+        uint32_t can_id;
+        uint16_t index;
+        uint8_t can_bus;
+};
+
+/* mappings sharing an ID mask are stored contiguously */
+struct can_mask_group {
+        uint32_t mask;
+        uint16_t start;
+        uint16_t count;
+};
+
+/*
+ * Index from received frames to the mappings that can match them.
+ * Wildcard mappings (CAN ID of 0) occupy the first linear_count refs
+ * in mapping order.  The rest are sorted by mask group, bus and ID.
+ * With more masks than groups every mapping goes in the linear list.
+ */
+struct can_dispatch_index {
+        struct can_mapping_ref *refs;
+        uint16_t linear_count;
+        uint8_t group_count;
+        struct can_mask_group groups[CAN_MASK_GROUPS];
+};
 
 /* manages the running state of the CAN channels*/
 struct CANState {
         /* CAN bus channels current channel values */
         float * CAN_current_values;
+        size_t value_count;
+
+        /* dispatch index over the enabled mappings; NULL refs if unavailable */
+        struct can_dispatch_index index;
 
         /* flag to indicate if state is stale */
         bool stale;
@@ -38,6 +72,57 @@ struct CANState {
 
 static struct CANState can_state = {0};
 
+/*
+ * State for each mapping slot, in one block from the heap.  The block
+ * only ever grows, so reconfiguring with as many mappings as before or
+ * fewer never goes to the heap.
+ */
+static struct can_mapping_ref *can_mapping_refs;
+static float *can_current_values;
+/* Tells which mapping produced each of the current values */
+static uint32_t *can_value_mapping_hashes;
+static size_t can_slot_count;
+
+static void free_dispatch_index(struct can_dispatch_index *index)
+{
+        memset(index, 0, sizeof(*index));
+}
+
+static bool reserve_can_slots(const size_t count)
+{
+        if (count <= can_slot_count)
+                return true;
+
+        const size_t slot_size = sizeof(struct can_mapping_ref) +
+                sizeof(float) + sizeof(uint32_t);
+        struct can_mapping_ref *refs = portMalloc(slot_size * count);
+        if (!refs)
+                return false;
+
+        /* Values and hashes carry over, the refs are rebuilt anyway */
+        float *values = (float *) (refs + count);
+        uint32_t *hashes = (uint32_t *) (values + count);
+        memset(values, 0, sizeof(float[count]));
+        memset(hashes, 0, sizeof(uint32_t[count]));
+        if (can_slot_count) {
+                memcpy(values, can_current_values,
+                       sizeof(float[can_slot_count]));
+                memcpy(hashes, can_value_mapping_hashes,
+                       sizeof(uint32_t[can_slot_count]));
+        }
+
+        free_dispatch_index(&can_state.index);
+        if (can_state.CAN_current_values)
+                can_state.CAN_current_values = values;
+        portFree(can_mapping_refs);
+
+        can_mapping_refs = refs;
+        can_current_values = values;
+        can_value_mapping_hashes = hashes;
+        can_slot_count = count;
+        return true;
+}
+
 void CAN_state_stale(void)
 {
         can_state.stale = true;
@@ -48,20 +133,34 @@ bool CAN_is_state_stale(void)
         return can_state.stale;
 }
 
-bool CAN_init_current_values(size_t values)
+bool CAN_init_current_values(const CANChannelConfig *cfg, size_t values)
 {
-        if (can_state.CAN_current_values != NULL)
-                portFree(can_state.CAN_current_values);
+        can_state.stale = false;
 
-        values = MAX(1, values);
-        size_t size = sizeof(float[values]);
-        can_state.CAN_current_values = portMalloc(size);
+        if (values > CONFIG_CAN_MAPPINGS || !reserve_can_slots(values)) {
+                can_state.CAN_current_values = NULL;
+                return false;
+        }
 
-        if (can_state.CAN_current_values != NULL)
-                memset(can_state.CAN_current_values, 0, size);
+        /*
+         * A slot keeps its value across a config change as long as its
+         * mapping stayed the same, so that the channel doesn't drop to 0
+         * until the next frame.  Any other slot starts over.
+         */
+        const bool had_values = can_state.CAN_current_values != NULL;
+        for (size_t i = 0; i < can_slot_count; ++i) {
+                const uint32_t hash = i < values ?
+                        canmapping_hash(&cfg->can_channels[i].mapping) : 0;
 
-        can_state.stale = false;
-        return can_state.CAN_current_values != NULL;
+                if (!had_values || hash != can_value_mapping_hashes[i])
+                        can_current_values[i] = 0;
+
+                can_value_mapping_hashes[i] = hash;
+        }
+
+        can_state.value_count = values;
+        can_state.CAN_current_values = can_current_values;
+        return true;
 }
 
 float CAN_get_current_channel_value(int index)
@@ -78,8 +177,181 @@ void CAN_set_current_channel_value(int index, float value)
         can_state.CAN_current_values[index] = value;
 }
 
+static int compare_ref(const struct can_mapping_ref *ref,
+                       const uint8_t can_bus, const uint32_t can_id)
+{
+        if (ref->can_bus != can_bus)
+                return ref->can_bus < can_bus ? -1 : 1;
+        if (ref->can_id != can_id)
+                return ref->can_id < can_id ? -1 : 1;
+        return 0;
+}
+
+static int find_mask_group(struct can_dispatch_index *index,
+                           const uint32_t mask)
+{
+        for (int i = 0; i < index->group_count; ++i)
+                if (index->groups[i].mask == mask)
+                        return i;
+
+        if (index->group_count >= CAN_MASK_GROUPS)
+                return -1;
+
+        struct can_mask_group *group = index->groups + index->group_count;
+        group->mask = mask;
+        group->start = 0;
+        group->count = 0;
+        return index->group_count++;
+}
+
+bool CAN_init_dispatch_index(const CANChannelConfig *cfg,
+                             const uint16_t enabled_mapping_count)
+{
+        struct can_dispatch_index *index = &can_state.index;
+        free_dispatch_index(index);
+
+        if (enabled_mapping_count == 0)
+                return true;
+
+        if (enabled_mapping_count > CONFIG_CAN_MAPPINGS ||
+            !reserve_can_slots(enabled_mapping_count))
+                return false;
+
+        /* First pass sizes the linear list and the mask groups */
+        bool linear = false;
+        for (size_t i = 0; i < enabled_mapping_count; ++i) {
+                const CANMapping *mapping = &cfg->can_channels[i].mapping;
+
+                if (mapping->can_id == 0) {
+                        index->linear_count++;
+                        continue;
+                }
+
+                const int group = find_mask_group(index, mapping->can_mask);
+                if (group < 0) {
+                        pr_warning("[CAN] Too many CAN ID masks to index\r\n");
+                        linear = true;
+                        break;
+                }
+
+                index->groups[group].count++;
+        }
+
+        /* Still decode from compiled signals, just without the lookup */
+        if (linear) {
+                index->linear_count = enabled_mapping_count;
+                index->group_count = 0;
+        }
+
+        index->refs = can_mapping_refs;
+
+        uint16_t start = index->linear_count;
+        for (size_t g = 0; g < index->group_count; ++g) {
+                index->groups[g].start = start;
+                start += index->groups[g].count;
+                index->groups[g].count = 0;
+        }
+
+        uint16_t linear_count = 0;
+        for (size_t i = 0; i < enabled_mapping_count; ++i) {
+                const CANMapping *mapping = &cfg->can_channels[i].mapping;
+                struct can_mapping_ref ref = {
+                        .can_id = mapping->can_id,
+                        .index = i,
+                        .can_bus = mapping->can_channel,
+                };
+                canmapping_compile(&ref.signal, mapping);
+
+                if (linear || mapping->can_id == 0) {
+                        index->refs[linear_count++] = ref;
+                        continue;
+                }
+
+                /* Insertion sort within the group; only done on reconfig */
+                struct can_mask_group *group = index->groups +
+                        find_mask_group(index, mapping->can_mask);
+                struct can_mapping_ref *refs = index->refs + group->start;
+                size_t pos = group->count++;
+
+                for (; pos > 0 && compare_ref(refs + pos - 1, ref.can_bus,
+                                              ref.can_id) > 0; --pos)
+                        refs[pos] = refs[pos - 1];
+
+                refs[pos] = ref;
+        }
+
+        return !linear;
+}
+
+static void update_can_channel(const CAN_msg *msg, const CANMapping *mapping,
+                               const size_t index)
+{
+        float value;
+        /* map the CAN message to the value */
+        if (canmapping_map_value(&value, msg, mapping))
+                CAN_set_current_channel_value(index, value);
+}
+
+static void update_indexed_can_channel(const CAN_msg *msg,
+                                       const CANChannelConfig *cfg,
+                                       const struct can_mapping_ref *ref)
+{
+        const CANMapping *mapping = &cfg->can_channels[ref->index].mapping;
+
+        /*
+         * the index already matched bus and ID, except in the linear
+         * list; this checks the rest
+         */
+        if (!canmapping_match_id(msg, mapping))
+                return;
+
+        CAN_set_current_channel_value(ref->index,
+                                      canmapping_signal_value(&ref->signal,
+                                                              msg->data64));
+}
+
+static void update_indexed_can_channels(const CAN_msg *msg,
+                                        const CANChannelConfig *cfg)
+{
+        const struct can_dispatch_index *index = &can_state.index;
+
+        for (size_t i = 0; i < index->linear_count; ++i) {
+                const struct can_mapping_ref *ref = index->refs + i;
+                if (ref->can_bus == msg->can_bus)
+                        update_indexed_can_channel(msg, cfg, ref);
+        }
+
+        for (size_t g = 0; g < index->group_count; ++g) {
+                const struct can_mask_group *group = index->groups + g;
+                const struct can_mapping_ref *refs = index->refs + group->start;
+                const uint32_t can_id = group->mask ?
+                        msg->addressValue & group->mask : msg->addressValue;
+
+                /* lower bound of the bus / masked ID key */
+                size_t lo = 0;
+                size_t hi = group->count;
+                while (lo < hi) {
+                        const size_t mid = (lo + hi) / 2;
+                        if (compare_ref(refs + mid, msg->can_bus, can_id) < 0)
+                                lo = mid + 1;
+                        else
+                                hi = mid;
+                }
+
+                for (; lo < group->count &&
+                     0 == compare_ref(refs + lo, msg->can_bus, can_id); ++lo)
+                        update_indexed_can_channel(msg, cfg, refs + lo);
+        }
+}
+
 void update_can_channels(CAN_msg *msg, CANChannelConfig *cfg, uint16_t enabled_mapping_count)
 {
+        if (can_state.index.refs != NULL) {
+                update_indexed_can_channels(msg, cfg);
+                return;
+        }
+
+        /* No compiled signals available; check every mapping */
         for (size_t i = 0; i < enabled_mapping_count; i++) {
                 CANMapping *mapping = &cfg->can_channels[i].mapping;
 
@@ -87,12 +359,6 @@ void update_can_channels(CAN_msg *msg, CANChannelConfig *cfg, uint16_t enabled_m
                 if (msg->can_bus != mapping->can_channel)
                         continue;
 
-                float value;
-                /* map the CAN message to the value */
-                bool result = canmapping_map_value(&value, msg, mapping);
-                if (!result)
-                        continue;
-
-                CAN_set_current_channel_value(i, value);
+                update_can_channel(msg, mapping, i);
         }
 }
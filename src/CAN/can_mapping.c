@@ -22,6 +22,11 @@
 #include "byteswap.h"
 #include "units_conversion.h"
 #include "panic.h"
+#include <stddef.h>
+#include <string.h>
+
+#define FNV_OFFSET_BASIS	2166136261u
+#define FNV_PRIME		16777619u
 
 float canmapping_extract_value(uint64_t raw_data, const CANMapping *mapping)
 {
@@ -121,3 +126,90 @@ bool canmapping_map_value(float *value, const CAN_msg *can_msg, const CANMapping
         *value = convert_units(mapping->conversion_filter_id, *value);
         return true;
 }
+
+void canmapping_compile(struct can_signal *signal, const CANMapping *mapping)
+{
+        uint8_t offset = mapping->offset;
+        uint8_t length = mapping->length;
+
+        if (! mapping->bit_mode) {
+                length *= 8;
+                offset *= 8;
+        }
+
+        signal->length = length;
+        signal->big_endian = mapping->big_endian;
+        signal->shift = mapping->big_endian ? 64 - offset - length : offset;
+        signal->type = mapping->type;
+
+        /* fold (value * multiplier / divider + adder) and the units conversion */
+        float scale = mapping->multiplier;
+        if (mapping->divider)
+                scale /= mapping->divider;
+
+        float unit_scale;
+        float unit_offset;
+        units_conversion_affine(mapping->conversion_filter_id, &unit_scale,
+                                &unit_offset);
+
+        signal->scale = scale * unit_scale;
+        signal->offset = mapping->adder * unit_scale + unit_offset;
+}
+
+float canmapping_signal_value(const struct can_signal *signal,
+                              uint64_t raw_data)
+{
+        /* values are at most 32 bits wide, as with canmapping_extract_value */
+        const uint8_t length = signal->length > 32 ? 32 : signal->length;
+        const uint32_t bitmask = length == 32 ? UINT32_MAX : (1UL << length) - 1;
+
+        if (signal->big_endian)
+                raw_data = swap_uint64(raw_data);
+
+        const uint32_t raw_value = (uint32_t) (raw_data >> signal->shift) & bitmask;
+        float value;
+
+        switch (signal->type) {
+        case CANMappingType_unsigned:
+                value = (float) raw_value;
+                break;
+        case CANMappingType_signed:
+        {
+                /* sign extend from the top bit of the field */
+                const uint32_t sign = 1UL << (length - 1);
+                value = (float) (int32_t) ((raw_value ^ sign) - sign);
+                break;
+        }
+        case CANMappingType_IEEE754:
+                memcpy(&value, &raw_value, sizeof(value));
+                break;
+        case CANMappingType_sign_magnitude:
+        {
+                const uint32_t sign = 1UL << (length - 1);
+                value = raw_value < sign ? (float) raw_value :
+                        -(float) (raw_value & (sign - 1));
+                break;
+        }
+        default:
+                /* We reached an invalid enum */
+                panic(PANIC_CAUSE_UNREACHABLE);
+                return 0;
+        }
+
+        return value * signal->scale + signal->offset;
+}
+
+/* 32 bit FNV-1a.  The channel config is left out, it doesn't decode */
+uint32_t canmapping_hash(const CANMapping *mapping)
+{
+        const uint8_t *p = (const uint8_t *) &mapping->can_id;
+        const size_t len = sizeof(*mapping) - offsetof(CANMapping, can_id);
+        uint32_t hash = FNV_OFFSET_BASIS;
+
+        for (size_t i = 0; i < len; ++i) {
+                hash ^= p[i];
+                hash *= FNV_PRIME;
+        }
+
+        return hash;
+}
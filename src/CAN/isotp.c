@@ -0,0 +1,280 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CAN.h"
+#include "FreeRTOS.h"
+#include "capabilities.h"
+#include "isotp.h"
+#include "macros.h"
+#include "queue.h"
+#include "semphr.h"
+#include "taskUtil.h"
+#include <string.h>
+
+#define ISOTP_PCI_SINGLE                0x0
+#define ISOTP_PCI_FIRST                 0x1
+#define ISOTP_PCI_CONSECUTIVE           0x2
+
+#define ISOTP_FC_CONTINUE               0x30
+#define ISOTP_FC_OVERFLOW               0x32
+
+#define ISOTP_SINGLE_MAX                7
+#define ISOTP_FIRST_DATA                6
+#define ISOTP_CONSECUTIVE_DATA          7
+#define ISOTP_PADDING                   0x55
+#define ISOTP_TX_TIMEOUT_MS             10
+
+/* reassembly state for one ECU address */
+struct isotp_session {
+        /* where flow control frames are sent */
+        uint32_t tx_id;
+
+        /* when the last frame of the message arrived */
+        size_t timestamp;
+
+        uint16_t received;
+        uint8_t next_seq;
+        bool listening;
+        bool receiving;
+
+        /* the message being reassembled; its can_id is the address */
+        struct isotp_msg msg;
+};
+
+static struct isotp_session sessions[ISOTP_LISTENERS];
+
+#if CAN_AUX_QUEUE_SUPPORT == 1
+/*
+ * Armed by the Lua task for one request at a time, filled by the CAN
+ * task.  Both only touch the session while holding lua_lock.
+ */
+static struct isotp_session lua_session;
+static volatile bool lua_listening;
+static xQueueHandle lua_queue;
+static xSemaphoreHandle lua_lock;
+#endif
+
+void isotp_init(void)
+{
+#if CAN_AUX_QUEUE_SUPPORT == 1
+        if (!lua_queue)
+                lua_queue = xQueueCreate(1, sizeof(struct isotp_msg));
+        if (!lua_lock)
+                lua_lock = xSemaphoreCreateMutex();
+#endif
+}
+
+void isotp_clear_listeners(void)
+{
+        memset(sessions, 0, sizeof(sessions));
+}
+
+bool isotp_listen(const uint8_t can_bus, const uint32_t rx_id,
+                  const uint32_t tx_id)
+{
+        struct isotp_session *free_session = NULL;
+
+        for (size_t i = 0; i < ISOTP_LISTENERS; ++i) {
+                struct isotp_session *s = sessions + i;
+                if (!s->listening) {
+                        if (!free_session)
+                                free_session = s;
+                        continue;
+                }
+                if (s->msg.can_bus == can_bus && s->msg.can_id == rx_id)
+                        return true;
+        }
+
+        if (!free_session)
+                return false;
+
+        memset(free_session, 0, sizeof(*free_session));
+        free_session->msg.can_bus = can_bus;
+        free_session->msg.can_id = rx_id;
+        free_session->tx_id = tx_id;
+        free_session->listening = true;
+        return true;
+}
+
+static void send_flow_control(const struct isotp_session *s,
+                              const CAN_msg *msg, const uint8_t status)
+{
+        CAN_msg fc;
+        fc.addressValue = s->tx_id;
+        fc.isExtendedAddress = msg->isExtendedAddress;
+        fc.dataLength = CAN_MSG_SIZE;
+        memset(fc.data, ISOTP_PADDING, sizeof(fc.data));
+
+        /* no block size limit and no separation time: send it all */
+        fc.data[0] = status;
+        fc.data[1] = 0;
+        fc.data[2] = 0;
+        CAN_tx_msg(msg->can_bus, &fc, 0);
+}
+
+/**
+ * @return true if the frame completed a message
+ */
+static bool session_rx(struct isotp_session *s, const CAN_msg *msg)
+{
+        const uint8_t pci = msg->data[0];
+        s->msg.extended = msg->isExtendedAddress;
+
+        switch (pci >> 4) {
+        case ISOTP_PCI_SINGLE: {
+                const uint8_t length = pci & 0x0F;
+                if (!length || length > ISOTP_SINGLE_MAX)
+                        return false;
+
+                s->receiving = false;
+                s->msg.length = length;
+                memcpy(s->msg.data, msg->data + 1, length);
+                return true;
+        }
+        case ISOTP_PCI_FIRST: {
+                const uint16_t length = (pci & 0x0F) << 8 | msg->data[1];
+                s->receiving = false;
+                if (length <= ISOTP_SINGLE_MAX)
+                        return false;
+
+                if (length > ISOTP_MAX_PAYLOAD) {
+                        send_flow_control(s, msg, ISOTP_FC_OVERFLOW);
+                        return false;
+                }
+
+                s->msg.length = length;
+                memcpy(s->msg.data, msg->data + 2, ISOTP_FIRST_DATA);
+                s->received = ISOTP_FIRST_DATA;
+                s->next_seq = 1;
+                s->timestamp = getCurrentTicks();
+                s->receiving = true;
+                send_flow_control(s, msg, ISOTP_FC_CONTINUE);
+                return false;
+        }
+        case ISOTP_PCI_CONSECUTIVE: {
+                if (!s->receiving)
+                        return false;
+
+                /* a lost or late frame spoils the whole message */
+                if ((pci & 0x0F) != s->next_seq ||
+                    isTimeoutMs(s->timestamp, ISOTP_RX_TIMEOUT_MS)) {
+                        s->receiving = false;
+                        return false;
+                }
+
+                const size_t take = MIN(ISOTP_CONSECUTIVE_DATA,
+                                        s->msg.length - s->received);
+                memcpy(s->msg.data + s->received, msg->data + 1, take);
+                s->received += take;
+                s->next_seq = (s->next_seq + 1) & 0x0F;
+                s->timestamp = getCurrentTicks();
+
+                if (s->received < s->msg.length)
+                        return false;
+
+                s->receiving = false;
+                return true;
+        }
+        default:
+                return false;
+        }
+}
+
+static bool is_session_msg(const struct isotp_session *s, const CAN_msg *msg)
+{
+        return s->msg.can_bus == msg->can_bus &&
+               s->msg.can_id == msg->addressValue;
+}
+
+#if CAN_AUX_QUEUE_SUPPORT == 1
+static void lua_session_rx(const CAN_msg *msg)
+{
+        /* cheap check first; most frames arrive with no request out */
+        if (!lua_listening)
+                return;
+
+        xSemaphoreTake(lua_lock, portMAX_DELAY);
+        if (lua_listening && is_session_msg(&lua_session, msg) &&
+            session_rx(&lua_session, msg))
+                xQueueSend(lua_queue, &lua_session.msg, 0);
+        xSemaphoreGive(lua_lock);
+}
+#endif
+
+const struct isotp_msg* isotp_rx_frame(const CAN_msg *msg)
+{
+#if CAN_AUX_QUEUE_SUPPORT == 1
+        lua_session_rx(msg);
+#endif
+
+        for (size_t i = 0; i < ISOTP_LISTENERS; ++i) {
+                struct isotp_session *s = sessions + i;
+                if (!s->listening || !is_session_msg(s, msg))
+                        continue;
+
+                /* single frames are left to the caller */
+                if (ISOTP_PCI_SINGLE == msg->data[0] >> 4)
+                        return NULL;
+
+                return session_rx(s, msg) ? &s->msg : NULL;
+        }
+        return NULL;
+}
+
+bool isotp_request(const uint8_t can_bus, const uint32_t tx_id,
+                   const uint32_t rx_id, const bool extended,
+                   const uint8_t *data, const size_t length,
+                   struct isotp_msg *response, const size_t timeout_ms)
+{
+#if CAN_AUX_QUEUE_SUPPORT == 1
+        if (!lua_queue || !lua_lock || !length || length > ISOTP_SINGLE_MAX)
+                return false;
+
+        xSemaphoreTake(lua_lock, portMAX_DELAY);
+        memset(&lua_session, 0, sizeof(lua_session));
+        lua_session.msg.can_bus = can_bus;
+        lua_session.msg.can_id = rx_id;
+        lua_session.tx_id = tx_id;
+        xQueueReset(lua_queue);
+        lua_listening = true;
+        xSemaphoreGive(lua_lock);
+
+        CAN_msg msg;
+        msg.addressValue = tx_id;
+        msg.isExtendedAddress = extended;
+        msg.dataLength = CAN_MSG_SIZE;
+        memset(msg.data, ISOTP_PADDING, sizeof(msg.data));
+        msg.data[0] = length;
+        memcpy(msg.data + 1, data, length);
+
+        const bool result =
+                CAN_tx_msg(can_bus, &msg, ISOTP_TX_TIMEOUT_MS) &&
+                pdTRUE == xQueueReceive(lua_queue, response,
+                                        msToTicks(timeout_ms));
+
+        xSemaphoreTake(lua_lock, portMAX_DELAY);
+        lua_listening = false;
+        xSemaphoreGive(lua_lock);
+        return result;
+#else
+        return false;
+#endif
+}
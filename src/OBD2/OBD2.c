@@ -23,13 +23,14 @@
 #include "FreeRTOS.h"
 #include "OBD2.h"
 #include "loggerConfig.h"
+#include "mem_mang.h"
 #include "printk.h"
 #include "task.h"
 #include "taskUtil.h"
-#include "mem_mang.h"
 #include <string.h>
 #include "stdutil.h"
 #include "can_mapping.h"
+#include "isotp.h"
 
 #define _LOG_PFX                        "[OBD2] "
 #define OBD2_11BIT_PID_RESPONSE         0x7E8
@@ -47,6 +48,27 @@
 #define OBD2_MODE_ENHANCED_DATA         0x22
 #define OBD2_TIMEOUT_DISABLE_THRESHOLD  10
 
+/* at most six PIDs fit in a mode 01 request */
+#define OBD2_MAX_PIDS_PER_QUERY         6
+#define OBD2_MAX_PENDING_QUERIES        4
+/* requests sent to one ECU before waiting for its answers */
+#define OBD2_ECU_PIPELINE_DEPTH         2
+/* bytes after the mode byte in a reassembled response */
+#define OBD2_MAX_PACKED_RESPONSE        (ISOTP_MAX_PAYLOAD - 1)
+#define OBD2_MODE1_PID_LENGTHS          0x60
+/* data bytes in a single frame, after the length byte */
+#define OBD2_SINGLE_FRAME_MAX           7
+
+/* data bytes returned for each mode 01 PID, per SAE J1979 */
+static const uint8_t mode1_pid_lengths[OBD2_MODE1_PID_LENGTHS] = {
+        /* 0x00 */ 4, 4, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1,
+        /* 0x10 */ 2, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2,
+        /* 0x20 */ 4, 2, 2, 2, 4, 4, 4, 4, 4, 4, 4, 4, 1, 1, 1, 1,
+        /* 0x30 */ 1, 2, 2, 1, 4, 4, 4, 4, 4, 4, 4, 4, 2, 2, 2, 2,
+        /* 0x40 */ 4, 4, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 4,
+        /* 0x50 */ 4, 1, 1, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2, 2, 1,
+};
+
 enum obd2_channel_status {
         OBD2_CHANNEL_STATUS_NO_DATA = 0,
         OBD2_CHANNEL_STATUS_DATA_RECEIVED,
@@ -66,27 +88,51 @@ struct OBD2ChannelState {
         /* PID associated with OBD2 channel */
         uint16_t pid;
 
+        /* mode the PID is queried with */
+        uint8_t mode;
+
         /* number of timeouts seen on this channel */
         uint8_t timeout_count;
 
+        /* canmapping_hash of the mapping that decoded current_value */
+        uint32_t mapping_hash;
+
+        /* the mapping compiled for decoding responses */
+        struct can_signal signal;
+
+        /* where the 8 bytes the signal decodes from start in the response */
+        uint8_t window;
+
         /* indicates status of channel */
         enum obd2_channel_status channel_status;
 };
 
+/* an OBD2 request waiting for its response */
+struct OBD2Query {
+        /* when the request was sent */
+        size_t timestamp;
+
+        /* the CAN ID the response will arrive on */
+        uint32_t can_id;
+
+        /* the channels whose PIDs were requested */
+        uint16_t channels[OBD2_MAX_PIDS_PER_QUERY];
+        uint8_t count;
+
+        bool pending;
+};
+
 /* manages the running state of OBD2 queries */
 struct OBD2State {
         /* points to a dynamically created array of OBD2ChannelState structs */
         struct OBD2ChannelState * current_channel_states;
 
-        /* holds the last query timestamp, for determining OBD2 query timeouts */
-        size_t last_obd2_query_timestamp;
+        /* the requests awaiting responses */
+        struct OBD2Query queries[OBD2_MAX_PENDING_QUERIES];
 
         /* holds the timestamp of the last OBDII response */
         size_t last_obd2_response_timestamp;
 
-        /* the index of the current OBD2 PID we're querying */
-        uint16_t current_obd2_pid_index;
-
         /**
          * the max sample rate across all of the channels;
          * will set the time base for the fastest PID querying
@@ -128,10 +174,47 @@ struct OBD2State {
          */
         uint32_t pid_query_delay;
 
+        /**
+         * requests allowed outstanding per ECU; drops to 1 if the ECU
+         * loses pipelined requests
+         */
+        uint8_t pipeline_depth;
+
+        /**
+         * indicates if mode 01 PIDs may be packed into one request; cleared
+         * if the ECU does not answer them all
+         */
+        bool multi_pid;
+
 };
 
 static struct OBD2State obd2_state = {0};
 
+/* From the heap, and only grown when more PIDs are enabled than before */
+static struct OBD2ChannelState *obd2_channel_states;
+static size_t obd2_channel_state_count;
+
+static bool reserve_channel_states(const size_t count)
+{
+        if (count <= obd2_channel_state_count)
+                return true;
+
+        struct OBD2ChannelState *states =
+                portMalloc(sizeof(struct OBD2ChannelState[count]));
+        if (!states)
+                return false;
+
+        memset(states, 0, sizeof(struct OBD2ChannelState[count]));
+        if (obd2_channel_state_count)
+                memcpy(states, obd2_channel_states, sizeof(
+                               struct OBD2ChannelState[obd2_channel_state_count]));
+
+        portFree(obd2_channel_states);
+        obd2_channel_states = states;
+        obd2_channel_state_count = count;
+        return true;
+}
+
 
 void OBD2_state_stale(void)
 {
@@ -186,18 +269,74 @@ static int OBD2_request_PID(uint8_t bus, uint32_t pid, uint8_t mode, bool is_29_
         return CAN_tx_msg(bus, &msg, timeout);
 }
 
+/**
+ * Sends a request for several mode 01 PIDs in one frame.
+ * @param bus the CAN bus to use
+ * @param pids the PIDs to request
+ * @param count the number of PIDs, up to OBD2_MAX_PIDS_PER_QUERY
+ * @param timeout the timeout in ms for sending the OBD2 request
+ */
+static int OBD2_request_PIDs(uint8_t bus, const uint8_t *pids, size_t count,
+                             bool is_29_bit, size_t timeout)
+{
+        CAN_msg msg;
+        msg.addressValue = is_29_bit ? OBD2_29BIT_PID_REQUEST : OBD2_11BIT_PID_REQUEST;
+        memset(msg.data, 0x55, sizeof(msg.data));
+        msg.data[0] = count + 1;
+        msg.data[1] = OBD2_MODE_SHOW_CURRENT_DATA;
+        memcpy(msg.data + 2, pids, count);
+        msg.dataLength = 8;
+        msg.isExtendedAddress = is_29_bit;
+        return CAN_tx_msg(bus, &msg, timeout);
+}
+
+/**
+ * @return the CAN ID an ECU listens on for requests addressed to it alone,
+ * given the ID it responds on.  Used for ISO-TP flow control.
+ */
+static uint32_t obd2_physical_request_id(uint32_t response_id)
+{
+        /* 29 bit: 0x18DAF1xx answers 0x18DAxxF1 */
+        if ((response_id & 0x1FFF0000) == 0x18DA0000)
+                return (response_id & 0x1FFF0000) |
+                        (response_id & 0xFF) << 8 | (response_id >> 8 & 0xFF);
+
+        /* 11 bit: 0x7E8 answers 0x7E0 */
+        return response_id - 8;
+}
+
+/*
+ * Mappings address a response as though it were a single frame, with
+ * the length in byte 0.  Those reaching past 8 bytes decode from a
+ * later window of the reassembled response instead; the offset is moved
+ * to match.
+ * @return the start of the window in the single frame layout
+ */
+static uint8_t mapping_window(CANMapping *mapping)
+{
+        const size_t unit = mapping->bit_mode ? 1 : 8;
+        const size_t end = (mapping->offset + mapping->length) * unit;
+        if (end <= 64)
+                return 0;
+
+        const uint8_t window = (end - 64 + 7) / 8;
+        mapping->offset -= mapping->bit_mode ? window * 8 : window;
+        return window;
+}
+
 bool OBD2_init_current_values(OBD2Config *obd2_config)
 {
         pr_info(_LOG_PFX "Init current values\r\n");
         uint16_t obd2_channel_count = obd2_config->enabledPids;
 
-        /* free any previously created channel states */
-        if (obd2_state.current_channel_states != NULL)
-                portFree(obd2_state.current_channel_states);
+        /* drop any previous channel states */
+        const size_t prev_channel_count = obd2_state.current_channel_states ?
+                obd2_state.channel_count : 0;
+        obd2_state.current_channel_states = NULL;
 
-        /* start the querying from the first PID */
-        obd2_state.current_obd2_pid_index = 0;
-        obd2_state.last_obd2_query_timestamp = 0;
+        memset(obd2_state.queries, 0, sizeof(obd2_state.queries));
+        obd2_state.pipeline_depth = OBD2_ECU_PIPELINE_DEPTH;
+        obd2_state.multi_pid = true;
         obd2_state.squelched_count = 0;
         obd2_state.query_latency = 0;
         obd2_state.is_active = false;
@@ -214,28 +353,55 @@ bool OBD2_init_current_values(OBD2Config *obd2_config)
         pr_debug_int_msg(_LOG_PFX " Max OBD2 sample rate: ", obd2_state.max_sample_rate);
 
         if (obd2_channel_count == 0) {
-                /* if no OBD2 channels are enabled, don't malloc */
-                obd2_state.current_channel_states = NULL;
+                /* if no OBD2 channels are enabled, nothing to track */
                 obd2_state.is_stale = false;
                 return true;
         }
 
-        /* malloc the collection of OBD2 channels */
-        size_t size = sizeof(struct OBD2ChannelState[obd2_channel_count]);
-        obd2_state.current_channel_states = portMalloc(size);
-
-        if (obd2_state.current_channel_states == NULL) {
+        if (obd2_channel_count > CONFIG_OBD2_CHANNELS ||
+            !reserve_channel_states(obd2_channel_count)) {
                 pr_error_int_msg(_LOG_PFX " Failed to init OBD2ChannelState with count ", obd2_channel_count);
                 /* whoops */
                 return false;
         }
+        obd2_state.current_channel_states = obd2_channel_states;
 
         /* set our current PIDs */
+        isotp_clear_listeners();
         for (size_t i = 0; i < obd2_channel_count; i++) {
+                const CANMapping *mapping = &obd2_config->pids[i].mapping;
+                if (!obd2_config->pids[i].passive &&
+                    !isotp_listen(mapping->can_channel, mapping->can_id,
+                                  obd2_physical_request_id(mapping->can_id)))
+                        pr_warning_int_msg(_LOG_PFX "No ISO-TP session for ", mapping->can_id);
+
+                const PidConfig *pid_cfg = obd2_config->pids + i;
+                const uint32_t hash = canmapping_hash(mapping);
                 struct OBD2ChannelState *state = &obd2_state.current_channel_states[i];
-                state->pid = obd2_config->pids[i].pid;
-                state->channel_status = OBD2_CHANNEL_STATUS_NO_DATA;
+                state->sequencer_count = 0;
                 state->timeout_count = 0;
+                CANMapping windowed = *mapping;
+                state->window = mapping_window(&windowed);
+                canmapping_compile(&state->signal, &windowed);
+
+                /*
+                 * A PID that stays put keeps its value across the change.
+                 * It gets another chance if it was squelched though, the
+                 * squelch count starts over.
+                 */
+                if (i < prev_channel_count &&
+                    state->pid == (uint16_t) pid_cfg->pid &&
+                    state->mode == pid_cfg->mode &&
+                    state->mapping_hash == hash) {
+                        if (state->channel_status == OBD2_CHANNEL_STATUS_SQUELCHED)
+                                state->channel_status = OBD2_CHANNEL_STATUS_NO_DATA;
+                        continue;
+                }
+
+                state->pid = pid_cfg->pid;
+                state->mode = pid_cfg->mode;
+                state->mapping_hash = hash;
+                state->channel_status = OBD2_CHANNEL_STATUS_NO_DATA;
                 state->current_value = 0.0;
         }
 
@@ -258,48 +424,183 @@ void OBD2_set_current_channel_value(int index, float value)
         obd2_state.current_channel_states[index].current_value = value;
 }
 
-void sequence_next_obd2_query(OBD2Config * obd2_config, uint16_t enabled_obd2_pids_count)
+/**
+ * @return the number of data bytes a PID returns if it can be packed with
+ * others into one request; 0 if it can't be
+ */
+static size_t packable_length(const PidConfig *pid_cfg)
 {
-        /* no PIDs, no query... */
-        if (enabled_obd2_pids_count == 0)
-                return;
+        if (pid_cfg->passive || pid_cfg->mode != OBD2_MODE_SHOW_CURRENT_DATA ||
+            pid_cfg->pid >= OBD2_MODE1_PID_LENGTHS)
+                return 0;
 
-        bool is_obd2_timeout = obd2_state.last_obd2_query_timestamp > 0 &&
-                               isTimeoutMs(obd2_state.last_obd2_query_timestamp, OBD2_PID_DEFAULT_TIMEOUT_MS);
+        return mode1_pid_lengths[pid_cfg->pid];
+}
 
-        size_t current_pid_index = obd2_state.current_obd2_pid_index;
+static bool is_channel_pending(size_t index)
+{
+        for (size_t i = 0; i < OBD2_MAX_PENDING_QUERIES; i++) {
+                const struct OBD2Query *query = obd2_state.queries + i;
+                if (!query->pending)
+                        continue;
 
-        if (is_obd2_timeout) {
-                /* check for timeout and squelch current PID if needed */
-                struct OBD2ChannelState *state = &obd2_state.current_channel_states[current_pid_index];
-                pr_debug_int_msg(_LOG_PFX "Timeout requesting PID ", state->pid);
+                for (size_t c = 0; c < query->count; c++)
+                        if (query->channels[c] == index)
+                                return true;
+        }
+        return false;
+}
+
+static size_t pending_count(uint32_t can_id, bool any_id)
+{
+        size_t count = 0;
+        for (size_t i = 0; i < OBD2_MAX_PENDING_QUERIES; i++) {
+                const struct OBD2Query *query = obd2_state.queries + i;
+                if (query->pending && (any_id || query->can_id == can_id))
+                        count++;
+        }
+        return count;
+}
+
+static struct OBD2Query * free_query(void)
+{
+        for (size_t i = 0; i < OBD2_MAX_PENDING_QUERIES; i++) {
+                if (!obd2_state.queries[i].pending)
+                        return obd2_state.queries + i;
+        }
+        return NULL;
+}
+
+static void channel_timeout(struct OBD2ChannelState *state)
+{
+        pr_debug_int_msg(_LOG_PFX "Timeout requesting PID ", state->pid);
+
+        state->timeout_count++;
+        if (state->timeout_count < OBD2_TIMEOUT_DISABLE_THRESHOLD ||
+            state->channel_status == OBD2_CHANNEL_STATUS_SQUELCHED)
+                return;
+
+        state->channel_status = OBD2_CHANNEL_STATUS_SQUELCHED;
+        pr_info_int_msg(_LOG_PFX "Excessive timeouts, squelching PID ", state->pid);
+        obd2_state.squelched_count++;
+        /**
+         * if all channels end up being squelched, then we should just reset OBD2 config
+         * This accounts for cases where there's a complete disconnect and a reset is needed
+         */
+        if (obd2_state.squelched_count == obd2_state.channel_count) {
+                pr_info(_LOG_PFX "all channels timed out, resetting OBD2 state\r\n");
+                obd2_state.is_stale = true;
+        }
+}
+
+static void check_query_timeouts(void)
+{
+        for (size_t i = 0; i < OBD2_MAX_PENDING_QUERIES; i++) {
+                struct OBD2Query *query = obd2_state.queries + i;
+                if (!query->pending ||
+                    !isTimeoutMs(query->timestamp, OBD2_PID_DEFAULT_TIMEOUT_MS))
+                        continue;
 
                 /* only start counting timeouts if we've ever received data */
                 if (obd2_state.is_active) {
-                        state->timeout_count++;
-                        if (state->timeout_count >= OBD2_TIMEOUT_DISABLE_THRESHOLD) {
-                                state->channel_status = OBD2_CHANNEL_STATUS_SQUELCHED;
-                                pr_info_int_msg(_LOG_PFX "Excessive timeouts, squelching PID ", state->pid);
-                                obd2_state.squelched_count++;
-                                /**
-                                 * if all channels end up being squelched, then we should just reset OBD2 config
-                                 * This accounts for cases where there's a complete disconnect and a reset is needed
-                                 */
-                                if (obd2_state.squelched_count == obd2_state.channel_count) {
-                                        pr_info(_LOG_PFX "all channels timed out, resetting OBD2 state\r\n");
-                                        obd2_state.is_stale = true;
-                                }
-                        }
+                        /*
+                         * ECUs that can't take packed or pipelined
+                         * requests tend to ignore them; fall back to
+                         * asking one PID at a time.
+                         */
+                        if (query->count > 1)
+                                obd2_state.multi_pid = false;
+                        if (pending_count(query->can_id, false) > 1)
+                                obd2_state.pipeline_depth = 1;
+
+                        for (size_t c = 0; c < query->count; c++)
+                                channel_timeout(obd2_state.current_channel_states +
+                                                query->channels[c]);
                 }
                 /*if we have timed out and we're not active, then we should try auto-detecting 29 or 11 bit OBDII */
                 else {
                         obd2_state.is_29bit_obd2 = !obd2_state.is_29bit_obd2;
                         pr_info_int_msg(_LOG_PFX "Trying OBDII bit mode ", obd2_state.is_29bit_obd2 ? 29 : 11);
                 }
+                query->pending = false;
+        }
+}
+
+/**
+ * @return how overdue a channel is for querying, or 0 if it is not due or
+ * can't be queried now
+ */
+static uint16_t due_factor(OBD2Config *obd2_config, size_t index)
+{
+        const struct OBD2ChannelState *state = obd2_state.current_channel_states + index;
+        const uint16_t sample_rate =
+                decodeSampleRate(obd2_config->pids[index].mapping.channel_cfg.sampleRate);
+
+        if (!sample_rate || state->channel_status == OBD2_CHANNEL_STATUS_SQUELCHED ||
+            state->sequencer_count < obd2_state.max_sample_rate ||
+            is_channel_pending(index))
+                return 0;
+
+        return state->sequencer_count / sample_rate;
+}
+
+static void add_query_channel(struct OBD2Query *query, size_t index)
+{
+        query->channels[query->count++] = index;
+        obd2_state.current_channel_states[index].sequencer_count = 0;
+}
+
+/**
+ * Fill the rest of a mode 01 request with the most due PIDs answered by
+ * the same ECU, as long as the answer can still be reassembled.
+ */
+static void pack_query(OBD2Config *obd2_config, struct OBD2Query *query,
+                       uint16_t enabled_obd2_pids_count)
+{
+        const PidConfig *first = obd2_config->pids + query->channels[0];
+        size_t budget = OBD2_MAX_PACKED_RESPONSE - 1 - packable_length(first);
+
+        while (query->count < OBD2_MAX_PIDS_PER_QUERY) {
+                uint16_t highest_timeout_factor = 0;
+                int most_due_pid_index = -1;
+
+                for (size_t i = 0; i < enabled_obd2_pids_count; i++) {
+                        const PidConfig *pid_cfg = obd2_config->pids + i;
+                        const size_t length = packable_length(pid_cfg);
+                        if (!length || length + 1 > budget ||
+                            pid_cfg->mapping.can_id != first->mapping.can_id ||
+                            pid_cfg->mapping.can_channel != first->mapping.can_channel)
+                                continue;
+
+                        const uint16_t factor = due_factor(obd2_config, i);
+                        if (factor > highest_timeout_factor) {
+                                highest_timeout_factor = factor;
+                                most_due_pid_index = i;
+                        }
+                }
+
+                if (most_due_pid_index < 0)
+                        return;
+
+                add_query_channel(query, most_due_pid_index);
+                budget -= packable_length(obd2_config->pids + most_due_pid_index) + 1;
         }
+}
 
-        /* if a query is active and not timed out, exit now */
-        if (obd2_state.last_obd2_query_timestamp != 0 && !is_obd2_timeout)
+void sequence_next_obd2_query(OBD2Config * obd2_config, uint16_t enabled_obd2_pids_count)
+{
+        /* no PIDs, no query... */
+        if (enabled_obd2_pids_count == 0)
+                return;
+
+        check_query_timeouts();
+
+        /*
+         * Until an ECU has answered, query one PID at a time so the bit
+         * mode can be detected.
+         */
+        struct OBD2Query *query = free_query();
+        if (!query || (!obd2_state.is_active && pending_count(0, true)))
                 return;
 
         /* Check for a configured delay */
@@ -312,7 +613,8 @@ void sequence_next_obd2_query(OBD2Config * obd2_config, uint16_t enabled_obd2_pi
          *
          * Whichever PID has the highest count *above* the max configured
          * OBDII sample rate wins and is selected for querying. once this happens
-         * the counter is reset to 0.
+         * the counter is reset to 0.  Other due mode 01 PIDs for the same
+         * ECU are then packed into the same request, most due first.
          *
          * The result causes channels to be proportionately queried based on the
          * configured sample rate.
@@ -327,103 +629,247 @@ void sequence_next_obd2_query(OBD2Config * obd2_config, uint16_t enabled_obd2_pi
          * Channel 1 is selected for PID querying approx. 1/50 the rate of channel 3
          * Channel 2 is selected for PID querying approx. 1/2 the rate of channel 3
          * Channel 3 is selected for PID querying approx. every time
+         *
+         * Responses are matched to requests by PID, so up to
+         * pipeline_depth requests may be outstanding for each ECU.
          */
 
+        for (size_t i = 0; i < enabled_obd2_pids_count; i++) {
+                struct OBD2ChannelState *state = &obd2_state.current_channel_states[i];
+                if (state->channel_status == OBD2_CHANNEL_STATUS_SQUELCHED ||
+                    is_channel_pending(i))
+                        continue;
+
+                state->sequencer_count +=
+                        decodeSampleRate(obd2_config->pids[i].mapping.channel_cfg.sampleRate);
+        }
+
         uint16_t highest_timeout_factor = 0;
 
         /* tracks which PID should be scheduled next */
         int most_due_pid_index = -1;
 
         for (size_t i = 0; i < enabled_obd2_pids_count; i++) {
-                struct OBD2ChannelState *state = &obd2_state.current_channel_states[i];
-                if (state->channel_status == OBD2_CHANNEL_STATUS_SQUELCHED)
-                        /* if channel is squelched then skip */
+                const uint32_t can_id = obd2_config->pids[i].mapping.can_id;
+                if (pending_count(can_id, false) >= obd2_state.pipeline_depth)
                         continue;
 
-                uint16_t timeout = state->sequencer_count;
-                uint16_t sample_rate = decodeSampleRate(obd2_config->pids[i].mapping.channel_cfg.sampleRate);
-                timeout += sample_rate;
-
-                /**
-                 * select the channel if:
-                 * 1. the timeout has reached the trigger point
-                 * 2. the timeout has taken the longest amount of time to reach the trigger point */
-                uint16_t timeout_factor = timeout / sample_rate;
-                if (timeout >= obd2_state.max_sample_rate && timeout_factor > highest_timeout_factor) {
+                const uint16_t timeout_factor = due_factor(obd2_config, i);
+                if (timeout_factor > highest_timeout_factor) {
                         highest_timeout_factor = timeout_factor;
                         most_due_pid_index = i;
                 }
-                state->sequencer_count = timeout;
         }
 
         if (most_due_pid_index < 0)
                 /* no PID was selected, give up */
                 return;
 
-        current_pid_index = most_due_pid_index;
-        obd2_state.current_channel_states[current_pid_index].sequencer_count = 0;
+        PidConfig * pid_cfg = &obd2_config->pids[most_due_pid_index];
+        query->count = 0;
+        query->can_id = pid_cfg->mapping.can_id;
+        add_query_channel(query, most_due_pid_index);
+
+        if (obd2_state.is_active && obd2_state.multi_pid && packable_length(pid_cfg))
+                pack_query(obd2_config, query, enabled_obd2_pids_count);
+
+        int pid_request_result;
+        if (query->count > 1) {
+                uint8_t pids[OBD2_MAX_PIDS_PER_QUERY];
+                for (size_t i = 0; i < query->count; i++)
+                        pids[i] = obd2_config->pids[query->channels[i]].pid;
+
+                pid_request_result = OBD2_request_PIDs(pid_cfg->mapping.can_channel, pids, query->count,
+                                                       obd2_state.is_29bit_obd2, OBD2_PID_REQUEST_TIMEOUT_MS);
+        } else {
+                pid_request_result = pid_cfg->passive || OBD2_request_PID(pid_cfg->mapping.can_channel, pid_cfg->pid, pid_cfg->mode, obd2_state.is_29bit_obd2, OBD2_PID_REQUEST_TIMEOUT_MS);
+        }
 
-        PidConfig * pid_cfg = &obd2_config->pids[current_pid_index];
-        int pid_request_result = pid_cfg->passive || OBD2_request_PID(pid_cfg->mapping.can_channel, pid_cfg->pid, pid_cfg->mode, obd2_state.is_29bit_obd2, OBD2_PID_REQUEST_TIMEOUT_MS);
         if (pid_request_result) {
-                obd2_state.last_obd2_query_timestamp = getCurrentTicks();
+                query->timestamp = getCurrentTicks();
+                query->pending = true;
         } else {
                 pr_debug_int_msg("Timeout sending PID request ", pid_cfg->pid);
         }
-        obd2_state.current_obd2_pid_index = current_pid_index;
 }
 
-void update_obd2_channels(CAN_msg *msg, OBD2Config *cfg)
+/**
+ * Pick the 8 bytes of a response a channel decodes from.
+ * @param msg the response, laid out as a single frame
+ * @param payload the whole response, starting with the mode byte
+ * @param length the length of the payload
+ * @param window the offset of the bytes in the single frame layout
+ */
+static uint64_t response_window(const CAN_msg *msg, const uint8_t *payload,
+                                size_t length, uint8_t window)
 {
-        uint16_t current_pid_index = obd2_state.current_obd2_pid_index;
-        PidConfig *pid_config = &cfg->pids[current_pid_index];
-        struct OBD2ChannelState *channel_state = &obd2_state.current_channel_states[current_pid_index];
+        if (!window)
+                return msg->data64;
+
+        /* byte n of the single frame layout is byte n - 1 of the payload */
+        uint64_t raw = 0;
+        const size_t start = window - 1;
+        if (start < length)
+                memcpy(&raw, payload + start, MIN(sizeof(raw), length - start));
+        return raw;
+}
 
-        /* Did we get an OBDII PID we were waiting for? */
+static void set_channel_value(size_t index, const CAN_msg *msg,
+                              const uint8_t *payload, size_t length,
+                              OBD2Config *cfg)
+{
+        if (!canmapping_match_id(msg, &cfg->pids[index].mapping))
+                return;
 
-        uint8_t mode = pid_config->mode;
+        struct OBD2ChannelState *channel_state = obd2_state.current_channel_states + index;
+        const uint64_t raw = response_window(msg, payload, length,
+                                             channel_state->window);
+        OBD2_set_current_channel_value(index,
+                                       canmapping_signal_value(&channel_state->signal,
+                                                               raw));
+        channel_state->channel_status = OBD2_CHANNEL_STATUS_DATA_RECEIVED;
+        channel_state->timeout_count = 0;
+}
 
-        /* valid OBD2 request timestamp? */
-        if (obd2_state.last_obd2_query_timestamp &&
+/**
+ * Match a response against a single PID request
+ * @param msg the response, laid out as a single frame
+ * @param payload the whole response, starting with the mode byte
+ * @param length the length of the payload
+ */
+static bool update_single_pid(const struct OBD2Query *query, const CAN_msg *msg,
+                              const uint8_t *payload, size_t length,
+                              OBD2Config *cfg)
+{
+        const size_t index = query->channels[0];
+        const PidConfig *pid_config = &cfg->pids[index];
+        uint8_t mode = pid_config->mode;
 
-            /* is this CAN message an OBD2 PID response */
-            (msg->addressValue == pid_config->mapping.can_id) &&
+        /* does the returned mode + response offeset match the one expected in the current query? ? */
+        if (msg->data[1] != mode + OBD2_MODE_RESPONSE_OFFSET)
+                return false;
 
-            /* does the returned mode + response offeset match the one expected in the current query? ? */
-            msg->data[1] == mode + OBD2_MODE_RESPONSE_OFFSET &&
+        if (
+                /* does the 1 byte or 2 byte response match the current query? enhanced mode = 2 byte PID*/
+                (msg->data[2] == pid_config->pid && msg->data[1] == OBD2_MODE_SHOW_CURRENT_DATA + OBD2_MODE_RESPONSE_OFFSET) ||
 
-            (
+                /* or does it match match on miscellaneous modes */
+                (mode == OBD2_MODE_REQUEST_TROUBLE_CODES) ||
+                (mode == OBD2_MODE_CLEAR_TROUBLE_CODES) ||
+                (mode == OBD2_MODE_O2_SENSOR_MONITOR) ||
+                (mode == OBD2_MODE_BODY_INFO) ||
 
-                    /* does the 1 byte or 2 byte response match the current query? enhanced mode = 2 byte PID*/
-                    (msg->data[2] == pid_config->pid && msg->data[1] == OBD2_MODE_SHOW_CURRENT_DATA + OBD2_MODE_RESPONSE_OFFSET) ||
+                /* otherwise account for special mode with multi-byte PIDs (e.g. 0x22) */
+                ((msg->data[2] * 256 + msg->data[3]) == pid_config->pid && msg->data[1] == mode + OBD2_MODE_RESPONSE_OFFSET)
 
-                    /* or does it match match on miscellaneous modes */
-                    (mode == OBD2_MODE_REQUEST_TROUBLE_CODES) ||
-                    (mode == OBD2_MODE_CLEAR_TROUBLE_CODES) ||
-                    (mode == OBD2_MODE_O2_SENSOR_MONITOR) ||
-                    (mode == OBD2_MODE_BODY_INFO) ||
+        ) {
+                set_channel_value(index, msg, payload, length, cfg);
+                return true;
+        }
+        return false;
+}
 
-                    /* otherwise account for special mode with multi-byte PIDs (e.g. 0x22) */
-                    ((msg->data[2] * 256 + msg->data[3]) == pid_config->pid && msg->data[1] == mode + OBD2_MODE_RESPONSE_OFFSET)
+/**
+ * Match a response against a packed mode 01 request.  Each PID in the
+ * response is handed to its channel as if it had been answered alone.
+ * @param msg the response, laid out as a single frame
+ * @param payload the whole response, starting with the mode byte
+ * @param length the length of the payload
+ */
+static bool update_packed_pids(const struct OBD2Query *query, const CAN_msg *msg,
+                               const uint8_t *payload, size_t length,
+                               OBD2Config *cfg)
+{
+        if (payload[0] != OBD2_MODE_SHOW_CURRENT_DATA + OBD2_MODE_RESPONSE_OFFSET)
+                return false;
 
-            )
-           ) {
-                float value;
-                bool result = canmapping_map_value(&value, msg, &pid_config->mapping);
-                if (result) {
-                        OBD2_set_current_channel_value(current_pid_index, value);
-                        channel_state->channel_status = OBD2_CHANNEL_STATUS_DATA_RECEIVED;
-                        channel_state->timeout_count = 0;
+        size_t found = 0;
+
+        for (size_t pos = 1; pos < length;) {
+                const uint8_t pid = payload[pos];
+                const size_t pid_length = pid < OBD2_MODE1_PID_LENGTHS ? mode1_pid_lengths[pid] : 0;
+                if (!pid_length || pos + 1 + pid_length > length)
+                        break;
+
+                for (size_t c = 0; c < query->count; c++) {
+                        const size_t index = query->channels[c];
+                        if (cfg->pids[index].pid != pid)
+                                continue;
+
+                        CAN_msg single = *msg;
+                        single.data[0] = pid_length + 2;
+                        memcpy(single.data + 2, payload + pos, pid_length + 1);
+                        set_channel_value(index, &single, single.data + 1,
+                                          single.data[0], cfg);
+                        found++;
+                        break;
                 }
+                pos += pid_length + 1;
+        }
+
+        if (!found)
+                return false;
+
+        /* the ECU only answered part of the request */
+        if (found < query->count)
+                obd2_state.multi_pid = false;
+
+        return true;
+}
+
+static void update_queries(const CAN_msg *msg, const uint8_t *payload,
+                           size_t length, OBD2Config *cfg)
+{
+        /* Did we get an OBDII PID we were waiting for? */
+        for (size_t i = 0; i < OBD2_MAX_PENDING_QUERIES; i++) {
+                struct OBD2Query *query = obd2_state.queries + i;
+
+                /* is this CAN message a response to this request? */
+                if (!query->pending || msg->addressValue != query->can_id)
+                        continue;
+
+                const bool matched = query->count > 1 ?
+                                     update_packed_pids(query, msg, payload, length, cfg) :
+                                     update_single_pid(query, msg, payload, length, cfg);
+                if (!matched)
+                        continue;
+
                 /* Save our latency */
-                obd2_state.query_latency = ticksToMs(getCurrentTicks() - obd2_state.last_obd2_query_timestamp);
+                obd2_state.query_latency = ticksToMs(getCurrentTicks() - query->timestamp);
                 obd2_state.is_active = true;
                 /* PID request is complete */
-                obd2_state.last_obd2_query_timestamp = 0;
+                query->pending = false;
                 obd2_state.last_obd2_response_timestamp = getCurrentTicks();
+                return;
         }
 }
 
+void update_obd2_channels(CAN_msg *msg, OBD2Config *cfg)
+{
+        /* the pieces of multi-frame responses go through ISO-TP */
+        if (msg->data[0] > OBD2_SINGLE_FRAME_MAX)
+                return;
+
+        update_queries(msg, msg->data + 1, msg->data[0], cfg);
+}
+
+void update_obd2_isotp_channels(const struct isotp_msg *tp, OBD2Config *cfg)
+{
+        /*
+         * Mappings address the response as though it were a single
+         * frame, so present its start that way.
+         */
+        CAN_msg msg;
+        msg.addressValue = tp->can_id;
+        msg.can_bus = tp->can_bus;
+        msg.isExtendedAddress = tp->extended;
+        msg.dataLength = CAN_MSG_SIZE;
+        msg.data[0] = MIN(tp->length, OBD2_SINGLE_FRAME_MAX);
+        memcpy(msg.data + 1, tp->data, OBD2_SINGLE_FRAME_MAX);
+
+        update_queries(&msg, tp->data, tp->length, cfg);
+}
+
 bool OBD2_get_value_for_pid(uint16_t pid, float *value)
 {
         struct OBD2ChannelState *states = obd2_state.current_channel_states;
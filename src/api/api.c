@@ -203,6 +203,14 @@ static int dispatch_api(struct Serial *serial, const char * apiMsgName, const js
 
         const api_t * api = apis;
         int res = API_ERROR_UNSPECIFIED;
+
+        /*
+         * Responses are built from many small writes.  Collect them and
+         * hand them to the Serial device in large chunks.  The tx lock
+         * of the Serial device is only taken per chunk, so a handler
+         * that blocks doesn't hold up other writers to it.
+         */
+        serial_batch_begin(serial);
         while (api->cmd != NULL) {
                 if (strcmp(api->cmd, apiMsgName) == 0) {
                         res = api->func(serial, apiPayload);
@@ -217,6 +225,7 @@ static int dispatch_api(struct Serial *serial, const char * apiMsgName, const js
                 json_sendResult(serial, apiMsgName, res);
         }
         put_crlf(serial);
+        serial_batch_end(serial);
         return res;
 }
 
@@ -239,12 +248,18 @@ static int execute_api(struct Serial * serial, const jsmntok_t *json)
 
 int process_api(struct Serial *serial, char *buffer, size_t bufferSize)
 {
+        /*
+         * The last token is reserved as the zeroed terminator that the
+         * jsmn_find_* helpers stop on.  Only that one needs clearing, the
+         * parser fills in every token before it.
+         */
         jsmn_init(&g_jsonParser);
-        memset(g_json_tok, 0, sizeof(jsmntok_t) * JSON_TOKENS);
-
-        const int r = jsmn_parse(&g_jsonParser, buffer, g_json_tok, JSON_TOKENS);
-        if (JSMN_SUCCESS == r)
+        const int r = jsmn_parse(&g_jsonParser, buffer, g_json_tok,
+                                 JSON_TOKENS - 1);
+        if (JSMN_SUCCESS == r) {
+                memset(g_json_tok + g_jsonParser.toknext, 0, sizeof(jsmntok_t));
                 return execute_api(serial, g_json_tok);
+        }
 
         pr_warning("API Parsing Error: \"");
         pr_warning(buffer);
@@ -46,25 +46,57 @@
 #include "loggerConfig.h"
 #include "printk.h"
 #include "tracks.h"
+#include <math.h>
+#include <stdbool.h>
+
+/*
+ * Degrees of latitude spanned by MAX_DIST_FROM_SF, with a bit of slack
+ * for float error.  Any track whose start point is further away in
+ * latitude alone can't be within MAX_DIST_FROM_SF of us.
+ */
+#define MAX_LAT_FROM_SF (1.01f * MAX_DIST_FROM_SF * 180.0f / \
+                         ((float) M_PI * GP_EARTH_RADIUS_M))
+
+static bool isCloser(const Track *track, const GeoPoint *location, float *dist)
+{
+        // XXX: inaccurate but fast.  Good enough for now.
+        GeoPoint startPoint = getStartPoint(track);
+        float track_distance = distPythag(&startPoint, location);
+
+        if (track_distance >= *dist)
+                return false;
+
+        *dist = track_distance;
+        return true;
+}
 
 static const Track* findClosestTrack(const Tracks *tracks, const GeoPoint *location)
 {
         float dist = MAX_DIST_FROM_SF;
         const Track *best = NULL;
 
-        for (unsigned i = 0; i < tracks->count; ++i) {
-                const Track *track = &(tracks->tracks[i]);
+        if (!tracks_index_valid(tracks)) {
+                for (unsigned i = 0; i < tracks->count; ++i) {
+                        const Track *track = &(tracks->tracks[i]);
+                        if (isCloser(track, location, &dist))
+                                best = track;
+                }
+
+                return best;
+        }
 
-                // XXX: inaccurate but fast.  Good enough for now.
-                GeoPoint startPoint = getStartPoint(track);
-                float track_distance = distPythag(&startPoint, location);
+        /* Only the tracks within our latitude band can be close enough */
+        const float maxLat = location->latitude + MAX_LAT_FROM_SF;
+        size_t pos = tracks_index_lower_bound(tracks,
+                                              location->latitude - MAX_LAT_FROM_SF);
 
-                if (track_distance >= dist)
-                        continue;
+        for (; pos < tracks->index.count; ++pos) {
+                const Track *track = tracks->tracks + tracks->index.order[pos];
+                if (getStartPoint(track).latitude > maxLat)
+                        break;
 
-                // If here then we have a new best.  Set it accordingly
-                dist = track_distance;
-                best = track;
+                if (isCloser(track, location, &dist))
+                        best = track;
         }
 
         return best;
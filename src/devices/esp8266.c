@@ -1012,17 +1012,25 @@ static bool send_data_cb(struct at_rsp *rsp, void *up)
                  * until the send operation was successful. Issue #807
                  */
                 struct Serial *s = state.ati->sb->serial;
-                xQueueHandle q = serial_get_tx_queue(ti->serial);
                 bool underrun = false;
 
-                for (; ti->sent < ti->len; ++ti->sent) {
-                        char c;
-                        if (!xQueueReceive(q, &c, 0)) {
+                while (ti->sent < ti->len) {
+                        size_t avail;
+                        const char *data =
+                                serial_tx_dma_read_init(ti->serial, &avail);
+                        avail = MIN(avail, ti->len - ti->sent);
+
+                        if (!avail) {
                                 underrun = true;
-                                c = INVALID_CHAR; /* Invalid UTF-8 Byte */
+                                /* Invalid UTF-8 Byte */
+                                serial_write_c(s, INVALID_CHAR);
+                                ++ti->sent;
+                                continue;
                         }
 
-                        serial_write_c(s, c);
+                        serial_write_buff(s, data, avail);
+                        serial_tx_dma_read_fini(ti->serial, avail, NULL);
+                        ti->sent += avail;
                 }
 
                 if (underrun)
@@ -297,7 +297,7 @@ static const char* channel_get_name(const size_t chan_id)
         return _serial_names[chan_id];
 }
 
-static void _tx_char_cb(xQueueHandle queue, void *post_tx_arg)
+static void _tx_char_cb(struct Serial *s, void *post_tx_arg)
 {
         cmd_set_check(CHECK_DATA);
 }
@@ -479,13 +479,14 @@ static void rx_data_cb(int chan_id, size_t len, const char* data)
                 return;
         }
 
-        xQueueHandle q = serial_get_rx_queue(ch->serial);
-        bool data_dropped = false;
-        for (size_t i = 0; i < len && !data_dropped; ++i)
-                if (!xQueueSend(q, data + i, RX_DATA_TIMEOUT_TICKS))
-                        data_dropped = true;
+        size_t put = serial_rx_put(ch->serial, data, len, NULL);
+        if (put < len) {
+                /* Give the reader a moment to make room */
+                vTaskDelay(RX_DATA_TIMEOUT_TICKS);
+                put += serial_rx_put(ch->serial, data + put, len - put, NULL);
+        }
 
-        if (data_dropped)
+        if (put < len)
                 pr_warning(LOG_PFX "Rx Buffer Overflow Detected\r\n");
 
         cmd_set_check(CHECK_DATA);
@@ -536,8 +537,7 @@ static void check_data()
                         continue;
 
                 /* If the size is 0, nothing to send */
-                xQueueHandle q = serial_get_tx_queue(ch->serial);
-                const size_t size = uxQueueMessagesWaiting(q);
+                const size_t size = serial_tx_pending(serial);
                 if (0 == size)
                         continue;
 
@@ -47,6 +47,12 @@
 
 static struct shiftx_configuration shiftx_config = {1, 0xE3600, 0, 0, 51, true};
 
+/*
+ * Set once a script has talked to the ShiftX.  Until then we don't ask
+ * the CAN filters to let its messages through.
+ */
+static bool in_use;
+
 static struct {
         bool received;
         uint8_t id;
@@ -58,13 +64,40 @@ struct shiftx_configuration * shiftx_get_config(void)
         return &shiftx_config;
 }
 
+static void mark_in_use(void)
+{
+        if (in_use)
+                return;
+
+        in_use = true;
+        CAN_filters_stale();
+}
+
+static bool send_msg(const CAN_msg *msg)
+{
+        mark_in_use();
+        return CAN_tx_msg(shiftx_config.can_bus, msg, DEFAULT_CAN_TIMEOUT);
+}
+
+static bool send_config(void)
+{
+        CAN_msg msg;
+        msg.data[0] = shiftx_config.brightness;
+        msg.data[1] = shiftx_config.auto_brightness_scaling;
+        msg.data[2] = shiftx_config.orientation_inverted;
+        msg.addressValue = shiftx_config.base_address + CONFIG_MESSAGE_OFFSET;
+        msg.isExtendedAddress = true;
+        msg.dataLength = 3;
+        return CAN_tx_msg(shiftx_config.can_bus, &msg, DEFAULT_CAN_TIMEOUT);
+}
+
 void shiftx_handle_can_rx_msg(const CAN_msg *msg)
 {
         if (msg == NULL) return;
 
         if (msg->addressValue == shiftx_config.base_address + ANNOUNCEMENT_OFFSET) {
                 pr_info_int_msg(_LOG_PFX "Received configuration message for base address: ", msg->addressValue);
-                shiftx_update_config();
+                send_config();
         }
 
         if (msg->addressValue == shiftx_config.base_address + NOTIFICATION_BUTTON_STATE_OFFSET) {
@@ -96,16 +129,22 @@ void shiftx_handle_can_rx_msg(const CAN_msg *msg)
         }
 }
 
+void shiftx_add_rx_filters(struct CAN_filter_plan *plans)
+{
+        if (!in_use || shiftx_config.can_bus >= CAN_CHANNELS)
+                return;
+
+        struct CAN_filter_plan *plan = plans + shiftx_config.can_bus;
+        CAN_filter_plan_add_extended(plan, shiftx_config.base_address +
+                                     ANNOUNCEMENT_OFFSET, 0);
+        CAN_filter_plan_add_extended(plan, shiftx_config.base_address +
+                                     NOTIFICATION_BUTTON_STATE_OFFSET, 0);
+}
+
 bool shiftx_update_config(void)
 {
-        CAN_msg msg;
-        msg.data[0] = shiftx_config.brightness;
-        msg.data[1] = shiftx_config.auto_brightness_scaling;
-        msg.data[2] = shiftx_config.orientation_inverted;
-        msg.addressValue = shiftx_config.base_address + CONFIG_MESSAGE_OFFSET;
-        msg.isExtendedAddress = true;
-        msg.dataLength = 3;
-        return CAN_tx_msg(shiftx_config.can_bus, &msg, DEFAULT_CAN_TIMEOUT);
+        mark_in_use();
+        return send_config();
 }
 
 bool shiftx_set_discrete_led(uint8_t led_index, uint8_t leds_to_set, struct shiftx_led_params led_params)
@@ -120,7 +159,7 @@ bool shiftx_set_discrete_led(uint8_t led_index, uint8_t leds_to_set, struct shif
         msg.addressValue = shiftx_config.base_address + CONFIG_MESSAGE_SET_DISCRETE_LED_OFFSET;
         msg.isExtendedAddress = true;
         msg.dataLength = 6;
-        return CAN_tx_msg(shiftx_config.can_bus, &msg, DEFAULT_CAN_TIMEOUT);
+        return send_msg(&msg);
 }
 
 bool shiftx_set_display(uint8_t digit_index, uint8_t ascii)
@@ -131,6 +170,7 @@ bool shiftx_set_display(uint8_t digit_index, uint8_t ascii)
         msg.addressValue = shiftx_config.base_address + CONFIG_MESSAGE_SET_DISPLAY_OFFSET;
         msg.isExtendedAddress = true;
         msg.dataLength = 2;
+        mark_in_use();
         return CAN_tx_msg(1, &msg, DEFAULT_CAN_TIMEOUT);
 }
 
@@ -146,7 +186,7 @@ bool shiftx_config_linear_graph(rendering_style_t rendering_style, linear_style_
         msg.addressValue = shiftx_config.base_address + CONFIG_MESSAGE_CONFIGURE_LINEAR_GRAPH_OFFSET;
         msg.isExtendedAddress = true;
         msg.dataLength = 6;
-        return CAN_tx_msg(shiftx_config.can_bus, &msg, DEFAULT_CAN_TIMEOUT);
+        return send_msg(&msg);
 }
 
 bool shiftx_set_linear_threshold(uint8_t threshold_id, uint8_t segment_length, uint16_t threshold, struct shiftx_led_params led_params)
@@ -163,7 +203,7 @@ bool shiftx_set_linear_threshold(uint8_t threshold_id, uint8_t segment_length, u
         msg.addressValue = shiftx_config.base_address + CONFIG_MESSAGE_SET_LINEAR_THRESHOLD_OFFSET;
         msg.isExtendedAddress = true;
         msg.dataLength = 8;
-        return CAN_tx_msg(shiftx_config.can_bus, &msg, DEFAULT_CAN_TIMEOUT);
+        return send_msg(&msg);
 }
 
 bool shiftx_update_linear_graph(uint16_t value)
@@ -174,7 +214,7 @@ bool shiftx_update_linear_graph(uint16_t value)
         msg.addressValue = shiftx_config.base_address + CONFIG_MESSAGE_UPDATE_LINEAR_GRAPH_VALUE_OFFSET;
         msg.isExtendedAddress = true;
         msg.dataLength = 2;
-        return CAN_tx_msg(shiftx_config.can_bus, &msg, DEFAULT_CAN_TIMEOUT);
+        return send_msg(&msg);
 }
 
 bool shiftx_set_alert_threshold(uint8_t alert_id, uint8_t threshold_id, uint16_t threshold, struct shiftx_led_params led_params)
@@ -191,7 +231,7 @@ bool shiftx_set_alert_threshold(uint8_t alert_id, uint8_t threshold_id, uint16_t
         msg.addressValue = shiftx_config.base_address + CONFIG_MESSAGE_SET_ALERT_THRESHOLD_OFFSET;
         msg.isExtendedAddress = true;
         msg.dataLength = 8;
-        return CAN_tx_msg(shiftx_config.can_bus, &msg, DEFAULT_CAN_TIMEOUT);
+        return send_msg(&msg);
 }
 
 bool shiftx_set_alert(uint8_t alert_id, struct shiftx_led_params led_params)
@@ -205,7 +245,7 @@ bool shiftx_set_alert(uint8_t alert_id, struct shiftx_led_params led_params)
         msg.addressValue = shiftx_config.base_address + CONFIG_MESSAGE_SET_ALERT_OFFSET;
         msg.isExtendedAddress = true;
         msg.dataLength = 5;
-        return CAN_tx_msg(shiftx_config.can_bus, &msg, DEFAULT_CAN_TIMEOUT);
+        return send_msg(&msg);
 }
 
 bool shiftx_update_alert(uint8_t alert_id, uint16_t value)
@@ -217,7 +257,7 @@ bool shiftx_update_alert(uint8_t alert_id, uint16_t value)
         msg.addressValue = shiftx_config.base_address + CONFIG_MESSAGE_UPDATE_ALERT_VALUE_OFFSET;
         msg.isExtendedAddress = true;
         msg.dataLength = 3;
-        return CAN_tx_msg(shiftx_config.can_bus, &msg, DEFAULT_CAN_TIMEOUT);
+        return send_msg(&msg);
 }
 
 bool shiftx_rx_button_press(uint8_t * button_id, uint8_t * state)
@@ -24,20 +24,34 @@
 #include "geopoint.h"
 #include "tracks.h"
 #include "printk.h"
+#include <math.h>
+
+/* Meters per degree of latitude */
+#define METERS_PER_DEGREE ((float) M_PI * GP_EARTH_RADIUS_M / 180.0f)
+
 struct GeoCircle gc_createGeoCircle(const GeoPoint gp, const float r)
 {
         struct GeoCircle gc;
+        const float r_deg = r / METERS_PER_DEGREE;
 
         gc.point = gp;
         gc.radius = r;
+        gc.lon_scale = cosf(gp.latitude * ((float) M_PI / 180.0f));
+        gc.radius_deg_sq = r_deg * r_deg;
 
         return gc;
 }
 
 bool gc_isPointInGeoCircle(const GeoPoint * point, const struct GeoCircle gc)
 {
-        float dist = distPythag(point, &(gc.point));
-        return  dist <= gc.radius;
+        /*
+         * Same flat earth approximation as distPythag, but with the
+         * projection precomputed and without the sqrt.
+         */
+        const float dLat = point->latitude - gc.point.latitude;
+        const float dLon = (point->longitude - gc.point.longitude) * gc.lon_scale;
+
+        return dLat * dLat + dLon * dLon <= gc.radius_deg_sq;
 }
 
 bool gc_isValidGeoCircle(const struct GeoCircle gc)
@@ -551,33 +551,40 @@ void jsmn_decode_string(char* dst, const char* src, size_t len)
  */
 void jsmn_encode_write_string(struct Serial* serial, const char* str)
 {
-        while(*str) {
+        /* Runs of characters that need no escaping go out in one write */
+        const char *run = str;
+        for (; *str; ++str) {
+                const char *esc;
                 switch(*str) {
                 case '\b':
-                        serial_write_s(serial, "\\b");
+                        esc = "\\b";
                         break;
                 case '\f':
-                        serial_write_s(serial, "\\f");
+                        esc = "\\f";
                         break;
                 case '\n':
-                        serial_write_s(serial, "\\n");
+                        esc = "\\n";
                         break;
                 case '\r':
-                        serial_write_s(serial, "\\r");
+                        esc = "\\r";
                         break;
                 case '\t':
-                        serial_write_s(serial, "\\t");
+                        esc = "\\t";
                         break;
                 case '"':
-                        serial_write_s(serial, "\\\"");
+                        esc = "\\\"";
                         break;
                 case '\\':
-                        serial_write_s(serial, "\\\\");
+                        esc = "\\\\";
                         break;
                 default:
-                        serial_write_c(serial, *str);
-                        break;
+                        continue;
                 }
-                ++str;
+
+                serial_write_buff(serial, run, str - run);
+                serial_write_s(serial, esc);
+                run = str + 1;
         }
+
+        serial_write_buff(serial, run, str - run);
 }
@@ -53,6 +53,7 @@ void auto_logger_reset_config(struct auto_logger_config* cfg)
         cfg->enabled = true;
         strcpy(cfg->channel, DEFAULT_AUTO_LOGGER_CHANNEL);
         auto_control_reset_trigger(&cfg->start, &cfg->stop);
+        cfg->pre_trigger = 0;
 }
 
 void auto_logger_get_config(struct auto_logger_config* cfg,
@@ -63,7 +64,8 @@ void auto_logger_get_config(struct auto_logger_config* cfg,
         json_bool(serial, "en", cfg->enabled, true);
         json_string(serial, "channel", cfg->channel, true);
         get_auto_control_trigger(serial, &cfg->start, "start", true);
-        get_auto_control_trigger(serial, &cfg->stop, "stop", false);
+        get_auto_control_trigger(serial, &cfg->stop, "stop", true);
+        json_uint(serial, "pretrig", cfg->pre_trigger, false);
         json_objEnd(serial, more);
 }
 
@@ -74,6 +76,7 @@ bool auto_logger_set_config(struct auto_logger_config* cfg,
         jsmn_exists_set_val_string(json, "channel", cfg->channel, DEFAULT_LABEL_LENGTH, true);
         set_auto_control_trigger(&cfg->start, "start", json);
         set_auto_control_trigger(&cfg->stop, "stop", json);
+        jsmn_exists_set_val_uint8(json, "pretrig", &cfg->pre_trigger, NULL);
         return true;
 }
 
@@ -0,0 +1,130 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "binary_log.h"
+#include "loggerConfig.h"
+#include <string.h>
+
+enum binary_log_type binary_log_get_type(const ChannelSample *cs)
+{
+        switch(cs->sampleData) {
+        case SampleData_LongLong:
+        case SampleData_LongLong_Noarg:
+                return BINARY_LOG_TYPE_INT64;
+        case SampleData_Float:
+        case SampleData_Float_Noarg:
+                return BINARY_LOG_TYPE_FLOAT;
+        case SampleData_Double:
+        case SampleData_Double_Noarg:
+                return BINARY_LOG_TYPE_DOUBLE;
+        case SampleData_Int:
+        case SampleData_Int_Noarg:
+        default:
+                return BINARY_LOG_TYPE_INT32;
+        }
+}
+
+size_t binary_log_type_size(const enum binary_log_type type)
+{
+        switch(type) {
+        case BINARY_LOG_TYPE_INT64:
+        case BINARY_LOG_TYPE_DOUBLE:
+                return 8;
+        case BINARY_LOG_TYPE_INT32:
+        case BINARY_LOG_TYPE_FLOAT:
+        default:
+                return 4;
+        }
+}
+
+size_t binary_log_mask_len(const struct sample *s)
+{
+        return (s->channel_count + 7) / 8;
+}
+
+size_t binary_log_record_size(const struct sample *s)
+{
+        size_t size = 1 + binary_log_mask_len(s);
+        const ChannelSample *cs = s->channel_samples;
+
+        for (size_t i = 0; i < s->channel_count; ++i, ++cs)
+                size += binary_log_type_size(binary_log_get_type(cs));
+
+        return size;
+}
+
+bool binary_log_init_header(struct binary_log_header *hdr,
+                            const struct sample *s)
+{
+        memset(hdr, 0, sizeof(struct binary_log_header));
+        if (s->channel_count > BINARY_LOG_MAX_CHANNELS)
+                return false;
+
+        memcpy(hdr->magic, BINARY_LOG_MAGIC, BINARY_LOG_MAGIC_LEN);
+        hdr->version = BINARY_LOG_VERSION;
+        hdr->channel_count = s->channel_count;
+        hdr->record_size = binary_log_record_size(s);
+        return true;
+}
+
+void binary_log_init_channel(struct binary_log_channel *ch,
+                             const ChannelSample *cs)
+{
+        const ChannelConfig *cfg = cs->cfg;
+
+        memset(ch, 0, sizeof(struct binary_log_channel));
+        strncpy(ch->label, cfg->label, DEFAULT_LABEL_LENGTH - 1);
+        strncpy(ch->units, cfg->units, DEFAULT_UNITS_LENGTH - 1);
+        ch->min = cfg->min;
+        ch->max = cfg->max;
+        ch->sample_rate = decodeSampleRate(cfg->sampleRate);
+        ch->precision = cfg->precision;
+        ch->type = binary_log_get_type(cs);
+}
+
+size_t binary_log_populated_mask(const struct sample *s, uint8_t *mask)
+{
+        const size_t len = binary_log_mask_len(s);
+        const ChannelSample *cs = s->channel_samples;
+
+        memset(mask, 0, len);
+        for (size_t i = 0; i < s->channel_count; ++i, ++cs) {
+                if (cs->populated)
+                        mask[i / 8] |= 1 << (i % 8);
+        }
+
+        return len;
+}
+
+const void* binary_log_value_ptr(const ChannelSample *cs)
+{
+        switch(binary_log_get_type(cs)) {
+        case BINARY_LOG_TYPE_INT64:
+                return &cs->valueLongLong;
+        case BINARY_LOG_TYPE_FLOAT:
+                return &cs->valueFloat;
+        case BINARY_LOG_TYPE_DOUBLE:
+                return &cs->valueDouble;
+        case BINARY_LOG_TYPE_INT32:
+        default:
+                return &cs->valueInt;
+        }
+}
@@ -37,6 +37,7 @@
 #include "printk.h"
 #include "queue.h"
 #include "sampleRecord.h"
+#include "sample_stream.h"
 #include "serial.h"
 #include "cellular.h"
 #include "stdint.h"
@@ -72,13 +73,17 @@
 #define HARD_INIT_RETRY_THRESHOLD 5
 
 #define TELEMETRY_BUFFER_FILENAME "tele.buf"
+#define TELEMETRY_INDEX_FILENAME "tele.idx"
 #define TELEMETRY_BUFFER_FILE_RETRY_MS 1000
 
 #define BUFFERED_CHUNK_SIZE 7000
 #define BUFFERED_CHUNK_WAIT 1000
-#define BUFFERED_MAX_SIZE 1024 * 1000
 
 static xQueueHandle g_sampleQueue[CONNECTIVITY_CHANNELS] = CONNECTIVITY_TASK_INIT;
+/* Queues without a task would only pin sample buffers */
+static bool g_sampleQueueActive[CONNECTIVITY_CHANNELS];
+/* Neither would samples queued for a link that is down */
+static volatile bool g_sampleQueueLinked[CONNECTIVITY_CHANNELS];
 
 #if BLUETOOTH_SUPPORT
 static char bluetooth_buffer[BUFFER_SIZE];
@@ -88,16 +93,15 @@ static char bluetooth_buffer[BUFFER_SIZE];
 static CellularState cellular_state = {
         .buffer_queue = NULL,
         .buffer_file = NULL,
+        .index_file = NULL,
         .buffer_buffer = {},
         .cell_buffer = {},
-        .read_index = 0,
         .buffer_file_open = false,
         .should_reconnect = false,
         .should_stream = false,
+        .link_up = false,
         .server_tick_echo = 0,
         .server_tick_echo_changed_at = 0,
-        .sample_offset_map = {0},
-        .sample_offset_map_index = 0
 };
 
 bool cellular_telemetry_buffering_enabled(void)
@@ -116,48 +120,6 @@ void cellular_update_last_server_tick_echo(uint32_t server_tick_echo)
                 cellular_state.server_tick_echo_changed_at = getCurrentTicks();
         cellular_state.server_tick_echo = server_tick_echo;
 }
-
-/* reset the sample offset map circular buffer */
-static void cellular_reset_buffer_offset_map(void)
-{
-        memset(cellular_state.sample_offset_map, 0, SAMPLE_TRACKING_WINDOW * sizeof(SampleOffsetMap));
-}
-
-/* get an offset by the specified tick */
-static bool cellular_get_buffer_offset_by_tick(uint32_t tick, uint32_t *offset)
-{
-        SampleOffsetMap *map = cellular_state.sample_offset_map;
-        for (size_t i = 0; i < SAMPLE_TRACKING_WINDOW; i++) {
-                if (map->tick == tick) {
-                        *offset = map->buffer_file_index;
-                        return true;
-                }
-                map++;
-        }
-        return false;
-}
-
-/* store an offset into the circular buffer using the tick as a 'key' */
-static void cellular_add_buffer_offset_tick(uint32_t tick, uint32_t offset)
-{
-        int32_t index = cellular_state.sample_offset_map_index;
-        index++;
-        index = index >= SAMPLE_TRACKING_WINDOW ? 0 : index;
-        cellular_state.sample_offset_map[index].buffer_file_index = offset;
-        cellular_state.sample_offset_map[index].tick = tick;
-        cellular_state.sample_offset_map_index = index;
-}
-
-/* A cheap way to extract a value from the json sample string */
-static bool get_tick_from_sample_string(char * sample_string, uint32_t *tick)
-{
-        char * tick_string = strstr(sample_string,"{\"s\":{\"t\":");
-        if (tick_string) {
-                *tick = atoi(tick_string + 10);
-                return true;
-        }
-        return false;
-}
 #endif
 
 static size_t trimBuffer(char *buffer, size_t count)
@@ -203,14 +165,59 @@ int process_rx_buffer(struct Serial *serial, char *buffer, size_t *rxCount)
 
 void queueTelemetryRecord(const LoggerMessage *msg)
 {
-        for (size_t i = 0; i < CONNECTIVITY_CHANNELS; i++)
-                send_logger_message(g_sampleQueue[i], msg);
+        for (size_t i = 0; i < CONNECTIVITY_CHANNELS; i++) {
+                if (!g_sampleQueueActive[i])
+                        continue;
+
+                /* Start and Stop messages always go through */
+                if (msg->sample && !g_sampleQueueLinked[i])
+                        continue;
+
+                send_held_logger_message(g_sampleQueue[i], msg,
+                                         SAMPLE_HOLDER_TELEMETRY + i);
+        }
+}
+
+static void set_sample_queue_linked(const enum sample_holder holder,
+                                    const bool linked)
+{
+        g_sampleQueueLinked[holder - SAMPLE_HOLDER_TELEMETRY] = linked;
 }
 
+#if BLUETOOTH_SUPPORT
+/*
+ * Waits for up to timeout ticks while the link is down, keeping track of
+ * logging starting or stopping and releasing any samples that were queued
+ * before the link went down.  Those would otherwise pin the sample buffers
+ * of the logger task until we reconnect.
+ */
+static void drain_unlinked_queue(xQueueHandle queue,
+                                 const enum sample_holder holder,
+                                 bool *logging_enabled,
+                                 const portTickType timeout)
+{
+        const size_t start = getCurrentTicks();
+        portTickType wait = timeout;
+        LoggerMessage msg;
+
+        while (receive_logger_message(queue, &msg, wait)) {
+                if (LoggerMessageType_Start == msg.type)
+                        *logging_enabled = true;
+                else if (LoggerMessageType_Stop == msg.type)
+                        *logging_enabled = false;
+
+                release_logger_message(&msg, holder);
+
+                const size_t elapsed = getCurrentTicks() - start;
+                wait = elapsed < timeout ? timeout - elapsed : 0;
+        }
+}
+#endif
+
 #if BLUETOOTH_SUPPORT
 
 static void create_bluetooth_connection_task(int16_t priority,
-                xQueueHandle sampleQueue,
+                const size_t channel,
                 enum led activity_led)
 {
         ConnParams *params = portMalloc(sizeof(ConnParams));
@@ -221,7 +228,8 @@ static void create_bluetooth_connection_task(int16_t priority,
         params->disconnect = &bt_disconnect;
         params->init_connection = &bt_init_connection;
         params->serial = SERIAL_BLUETOOTH;
-        params->sampleQueue = sampleQueue;
+        params->sampleQueue = g_sampleQueue[channel];
+        params->holder = SAMPLE_HOLDER_TELEMETRY + channel;
         params->always_streaming = true;
         params->max_sample_rate = SAMPLE_50Hz;
         params->activity_led = activity_led;
@@ -230,22 +238,25 @@ static void create_bluetooth_connection_task(int16_t priority,
         static const signed portCHAR task_name[] = "Bluetooth Task ";
         xTaskCreate(bluetooth_connectivity_task, task_name, TELEMETRY_STACK_SIZE,
                     params, priority, NULL );
+        g_sampleQueueActive[channel] = true;
 }
 #endif
 
 #if CELLULAR_SUPPORT
 static void create_cellular_connection_tasks(int16_t priority,
-                xQueueHandle sampleQueue,
+                const size_t channel,
                 enum led activity_led)
 {
         cellular_state.buffer_file = pvPortMalloc(sizeof(FIL));
+        cellular_state.index_file = pvPortMalloc(sizeof(FIL));
         cellular_state.buffer_queue = xQueueCreate(CELLULAR_TELEMETRY_BUFFER_QUEUE_DEPTH, sizeof(BufferedLoggerMessage));
 
         {
                 BufferingTaskParams * params = (BufferingTaskParams *)portMalloc(sizeof(BufferingTaskParams));
                 params->connectionName = "TelemBuffer";
                 params->periodicMeta = 0;
-                params->sampleQueue = sampleQueue;
+                params->sampleQueue = g_sampleQueue[channel];
+                params->holder = SAMPLE_HOLDER_TELEMETRY + channel;
                 params->always_streaming = false;
                 params->max_sample_rate = SAMPLE_10Hz;
 
@@ -265,6 +276,7 @@ static void create_cellular_connection_tasks(int16_t priority,
                 params->init_connection = &cellular_init_connection;
                 params->serial = SERIAL_TELEMETRY;
                 params->sampleQueue = cellular_state.buffer_queue;
+                params->holder = SAMPLE_HOLDER_TELEMETRY + channel;
                 params->always_streaming = false;
                 params->max_sample_rate = SAMPLE_10Hz;
                 params->activity_led = activity_led;
@@ -275,6 +287,10 @@ static void create_cellular_connection_tasks(int16_t priority,
                 xTaskCreate(cellular_connectivity_task, task_name, CELLULAR_TELEMETRY_STACK_SIZE,
                             params, priority, NULL );
         }
+
+        g_sampleQueueActive[channel] = true;
+        /* The buffering task keeps filling the backlog while disconnected */
+        set_sample_queue_linked(SAMPLE_HOLDER_TELEMETRY + channel, true);
 }
 #endif
 
@@ -303,7 +319,7 @@ void startConnectivityTask(int16_t priority)
                 const uint8_t cellEnabled = getWorkingLoggerConfig()->ConnectivityConfigs.cellularConfig.cellEnabled;
                 if (cellEnabled)
                         create_cellular_connection_tasks(priority,
-                                                         g_sampleQueue[1], LED_TELEMETRY);
+                                                         1, LED_TELEMETRY);
 #else
 #if BLUETOOTH_SUPPORT
                 const uint8_t cellEnabled = false;
@@ -315,8 +331,7 @@ void startConnectivityTask(int16_t priority)
                         enum led activity_led = led_available(LED_BLUETOOTH) ? LED_BLUETOOTH : LED_TELEMETRY;
                         activity_led = cellEnabled && activity_led == LED_TELEMETRY ? LED_UNKNOWN : activity_led;
 
-                        create_bluetooth_connection_task(priority,
-                                                         g_sampleQueue[0],
+                        create_bluetooth_connection_task(priority, 0,
                                                          activity_led);
 
                 }
@@ -358,6 +373,9 @@ void bluetooth_connectivity_task(void *params)
         deviceConfig.buffer = bluetooth_buffer;
         deviceConfig.length = BUFFER_SIZE;
 
+        struct sample_stream stream;
+        sample_stream_attach(&stream, serial);
+
         const LoggerConfig *logger_config = getWorkingLoggerConfig();
 
         bool logging_enabled = false;
@@ -374,9 +392,14 @@ void bluetooth_connectivity_task(void *params)
                                      logger_config->ConnectivityConfigs.telemetryConfig.backgroundStreaming ||
                                      connParams->always_streaming;
 
+                set_sample_queue_linked(connParams->holder, false);
+                drain_unlinked_queue(sampleQueue, connParams->holder,
+                                     &logging_enabled, 0);
+
                 while (should_stream && connParams->init_connection(&deviceConfig, &connected_at, &last_tick, hard_init) != DEVICE_INIT_SUCCESS) {
                         pr_info(_LOG_PFX "not connected. retrying\r\n");
-                        vTaskDelay(INIT_DELAY);
+                        drain_unlinked_queue(sampleQueue, connParams->holder,
+                                             &logging_enabled, INIT_DELAY);
                         connect_retries++;
                         if (connect_retries > HARD_INIT_RETRY_THRESHOLD) {
                                 pr_info(_LOG_PFX " Too many connection attempts\r\n");
@@ -388,6 +411,8 @@ void bluetooth_connectivity_task(void *params)
                         GPS_set_UTC_time(connected_at);
 
                 serial_flush(serial);
+                sample_stream_reset(&stream);
+                set_sample_queue_linked(connParams->holder, true);
                 rx_buffer_count = 0;
                 size_t bad_message_count = 0;
                 uint32_t tick = 0;
@@ -440,9 +465,7 @@ void bluetooth_connectivity_task(void *params)
                                         const int send_meta = msg.needs_meta || tick == 0 ||
                                                               (connParams->periodicMeta &&
                                                                (tick % METADATA_SAMPLE_INTERVAL == 0));
-                                        api_send_sample_record(serial, msg.sample, tick, send_meta);
-
-                                        put_crlf(serial);
+                                        sample_stream_send(&stream, msg.sample, tick, send_meta);
                                         tick++;
                                         break;
                                 }
@@ -450,6 +473,7 @@ void bluetooth_connectivity_task(void *params)
                                         pr_info_int_msg(_LOG_PFX "Unknown logger message type ", msg.type);
                                         break;
                                 }
+                                release_logger_message(&msg, connParams->holder);
                         }
                         /*//////////////////////////////////////////////////////////
                         // Process any pending API events
@@ -534,8 +558,6 @@ void cellular_buffering_task(void *params)
                 while (1) {
                         if (!cellular_state.buffer_file_open && isTimeoutMs(last_open_buffer_attempt, re_open_buffer_file_timeout)) {
                                 last_open_buffer_attempt = getCurrentTicks();
-                                cellular_reset_buffer_offset_map();
-                                cellular_state.read_index = 0;
                                 fs_lock();
                                 bool fs_good = sdcard_fs_mounted();
                                 if (!fs_good) {
@@ -551,14 +573,24 @@ void cellular_buffering_task(void *params)
                                         bool sd_write_validated = test_sd(NULL, 1, 0, 1);
                                         if (sd_write_validated) {
                                                 FRESULT fopen_rc = f_open(cellular_state.buffer_file, TELEMETRY_BUFFER_FILENAME, FA_READ | FA_WRITE | FA_CREATE_ALWAYS);
+                                                if (FR_OK == fopen_rc) {
+                                                        fopen_rc = f_open(cellular_state.index_file, TELEMETRY_INDEX_FILENAME, FA_READ | FA_WRITE | FA_CREATE_ALWAYS);
+                                                        if (FR_OK != fopen_rc)
+                                                                f_close(cellular_state.buffer_file);
+                                                }
                                                 if (FR_OK == fopen_rc) {
                                                         FRESULT truncate_rc = f_truncate(cellular_state.buffer_file);
                                                         if (FR_OK == truncate_rc) {
+                                                                telemetry_backlog_init(&cellular_state.backlog,
+                                                                                       cellular_state.buffer_file,
+                                                                                       cellular_state.index_file);
                                                                 cellular_state.buffer_file_open = true;
                                                                 /* try to connect immediately on the first re-attempt*/
                                                                 re_open_buffer_file_timeout = 0;
                                                                 buffer_file_open_retries = 0;
                                                         } else {
+                                                                f_close(cellular_state.buffer_file);
+                                                                f_close(cellular_state.index_file);
                                                                 if (!buffer_file_open_retries)
                                                                         pr_info_int_msg(_LOG_PFX "Error truncating telemetry buffer file: ", truncate_rc);
                                                         }
@@ -591,6 +623,7 @@ void cellular_buffering_task(void *params)
                         // Process a pending message from logger task, if exists
                         ////////////////////////////////////////////////////////////*/
                         if (pdFALSE != res) {
+                                bool handed_off = false;
                                 switch(msg.type) {
                                 case LoggerMessageType_Start: {
                                         logging_enabled = true;
@@ -621,26 +654,21 @@ void cellular_buffering_task(void *params)
                                                 goto BUFFER_DONE;
                                         }
 
-                                        DWORD file_size = f_size(cellular_state.buffer_file);
-
-                                        if (file_size > BUFFERED_MAX_SIZE) {
-                                                pr_info_int_msg(_LOG_PFX "Max buffer size exceeded, resetting: ", BUFFERED_MAX_SIZE);
-                                                fs_failed = true;
-                                                goto BUFFER_DONE;
-                                        }
-
-                                        FRESULT fseek_res = f_lseek(cellular_state.buffer_file, file_size);
-                                        if (FR_OK != fseek_res) {
-                                                pr_error_int_msg(_LOG_PFX "Failed to seek to end of buffer: ", fseek_res);
+                                        const uint32_t dropped = cellular_state.backlog.dropped;
+                                        FRESULT append_res = telemetry_backlog_append(&cellular_state.backlog,
+                                                                                      msg.sample, tick, send_meta);
+                                        if (FR_OK != append_res) {
+                                                pr_error_int_msg(_LOG_PFX "Failed to append to buffer: ", append_res);
                                                 fs_failed = true;
                                                 goto BUFFER_DONE;
                                         }
 
-                                        fs_write_sample_record(cellular_state.buffer_file, msg.sample, tick, send_meta);
+                                        if (dropped != cellular_state.backlog.dropped)
+                                                pr_info(_LOG_PFX "Telemetry backlog full, dropped oldest samples\r\n");
 
                                         if (tick % TELEMETRY_BUFFER_FILE_SYNC_INTERVAL == 0) {
                                                 pr_debug_int_msg(_LOG_PFX "Flushing buffer file: ", tick);
-                                                FRESULT fsync_res = f_sync(cellular_state.buffer_file);
+                                                FRESULT fsync_res = telemetry_backlog_sync(&cellular_state.backlog);
                                                 if (FR_OK != fsync_res) {
                                                         pr_error_int_msg(_LOG_PFX "Failed to sync buffer file: ", fsync_res);
                                                         fs_failed = true;
@@ -651,6 +679,7 @@ void cellular_buffering_task(void *params)
 BUFFER_DONE:
                                         if (fs_failed ) {
                                                 f_close(cellular_state.buffer_file);
+                                                f_close(cellular_state.index_file);
                                                 cellular_state.buffer_file_open = false;
                                         }
                                         fs_unlock();
@@ -659,7 +688,14 @@ BUFFER_DONE:
                                         buffer_msg.sample = msg.sample;
                                         buffer_msg.ticks = msg.ticks;
                                         buffer_msg.needs_meta = msg.needs_meta;
-                                        xQueueSend(cellular_state.buffer_queue, &buffer_msg, 0);
+                                        /*
+                                         * Our hold moves along with the message.  Nobody
+                                         * reads the queue while the link is down, the
+                                         * backlog already has the sample.
+                                         */
+                                        if (cellular_state.link_up)
+                                                handed_off = xQueueSend(cellular_state.buffer_queue,
+                                                                        &buffer_msg, 0);
 
                                         tick++;
                                         break;
@@ -668,6 +704,8 @@ BUFFER_DONE:
                                         pr_info_int_msg(_LOG_PFX "Unknown logger message type ", msg.type);
                                         break;
                                 }
+                                if (!handed_off)
+                                        release_logger_message(&msg, connParams->holder);
                         }
                 }
         }
@@ -683,6 +721,19 @@ static void queue_cellular_api_event(const struct api_event * api_event, void *
         }
 }
 
+/*
+ * Releases the samples handed to us before the link went down, they would
+ * otherwise pin the sample buffers of the logger task until we reconnect.
+ */
+static void release_buffered_samples(xQueueHandle queue,
+                                     const enum sample_holder holder)
+{
+        BufferedLoggerMessage msg;
+
+        while (xQueueReceive(queue, &msg, 0))
+                sample_release(msg.sample, holder, msg.ticks);
+}
+
 void cellular_connectivity_task(void *params)
 {
         size_t rx_buffer_count = 0;
@@ -701,6 +752,9 @@ void cellular_connectivity_task(void *params)
         deviceConfig.buffer = cellular_state.cell_buffer;
         deviceConfig.length = BUFFER_SIZE;
 
+        struct sample_stream stream;
+        sample_stream_attach(&stream, serial);
+
         xQueueHandle api_event_queue = xQueueCreate(API_EVENT_QUEUE_DEPTH, sizeof(struct api_event));
         api_event_create_callback(queue_cellular_api_event, api_event_queue);
 
@@ -713,12 +767,15 @@ void cellular_connectivity_task(void *params)
                 uint32_t last_tick = 0;
 
                 led_disable(connParams->activity_led);
+                cellular_state.link_up = false;
+                release_buffered_samples(sampleQueue, connParams->holder);
                 delayMs(INIT_DELAY);
                 if (!cellular_state.should_stream)
                         continue;
 
                 while (connParams->init_connection(&deviceConfig, &connected_at, &last_tick, hard_init) != DEVICE_INIT_SUCCESS) {
                         pr_info(_LOG_PFX "not connected. retrying\r\n");
+                        release_buffered_samples(sampleQueue, connParams->holder);
                         vTaskDelay(INIT_DELAY);
                         connect_retries++;
                         if (connect_retries > HARD_INIT_RETRY_THRESHOLD) {
@@ -731,32 +788,32 @@ void cellular_connectivity_task(void *params)
                         GPS_set_UTC_time(connected_at);
 
                 serial_flush(serial);
+                sample_stream_reset(&stream);
                 rx_buffer_count = 0;
                 size_t bad_api_msg_count = 0;
                 cellular_state.should_reconnect = false;
 
-                uint32_t file_offset = 0;
-                if(cellular_get_buffer_offset_by_tick(last_tick, &file_offset)) {
-                        cellular_state.read_index = file_offset;
-                        cellular_state.server_tick_echo = last_tick;
-                } else {
+                fs_lock();
+                const bool resumed = cellular_state.buffer_file_open &&
+                        telemetry_backlog_seek_tick(&cellular_state.backlog, last_tick);
+                const uint32_t backlog_size = cellular_state.buffer_file_open ?
+                        telemetry_backlog_pending(&cellular_state.backlog) : 0;
+                fs_unlock();
+
+                if (!resumed)
                         pr_info_int_msg(_LOG_PFX "could not find precise location in buffer file for tick: ", last_tick);
-                }
 
                 cellular_state.server_tick_echo = 0;
                 cellular_state.server_tick_echo_changed_at = getCurrentTicks();
 
                 hard_init = false;
 
-                fs_lock();
-                int32_t backlog_size = f_size(cellular_state.buffer_file) - cellular_state.read_index;
-                fs_unlock();
-
                 if ( backlog_size > 0) {
                         pr_info_int_msg(_LOG_PFX "Telemetry backlog: ", backlog_size);
                 }
 
                 bool needs_meta = true;
+                cellular_state.link_up = true;
                 while (cellular_state.should_stream) {
                         if ( cellular_state.should_reconnect )
                                 break; /*break out and trigger the re-connection if needed */
@@ -773,44 +830,44 @@ void cellular_connectivity_task(void *params)
                         // Process a pending message from logger task, if exists
                         ////////////////////////////////////////////////////////////*/
                         if (pdFALSE != res) {
-                                if (cellular_state.should_stream && should_sample(msg.ticks, max_telem_rate)) {
+                                /* Skip samples rebuilt for a new configuration */
+                                const bool stale = msg.ticks != msg.sample->ticks;
+                                if (!stale && cellular_state.should_stream && should_sample(msg.ticks, max_telem_rate)) {
 
                                         led_toggle(connParams->activity_led);
 
                                         if (!current_buffering_enabled) {
                                                 /* Fall back to non-buffered sample streaming */
-                                                api_send_sample_record(serial, msg.sample, msg.ticks, needs_meta || msg.needs_meta);
+                                                sample_stream_send(&stream, msg.sample, msg.ticks, needs_meta || msg.needs_meta);
                                                 needs_meta = false;
-                                                put_crlf(serial);
                                         } else {
-                                                /* Stream buffered samples, catching up with the tail of the file as needed */
-                                                int32_t start_index = cellular_state.read_index;
+                                                /* Stream buffered samples, catching up with the tail of the backlog as needed */
+                                                size_t chunk_sent = 0;
                                                 while (true) {
-                                                        char * read_string = NULL;
+                                                        size_t read = 0;
                                                         fs_lock();
-                                                        FRESULT fseek_res = f_lseek(cellular_state.buffer_file, cellular_state.read_index);
-                                                        read_string = f_gets(cellular_state.buffer_buffer, BUFFER_BUFFER_SIZE, cellular_state.buffer_file);
+                                                        const FRESULT read_res = cellular_state.buffer_file_open ?
+                                                                telemetry_backlog_read(&cellular_state.backlog,
+                                                                                       cellular_state.buffer_buffer,
+                                                                                       BUFFER_BUFFER_SIZE, &read) :
+                                                                FR_OK;
                                                         fs_unlock();
 
-                                                        if (FR_OK != fseek_res) {
-                                                                pr_error_int_msg("Error reading telemetry buffer, aborting ", fseek_res);
+                                                        if (FR_OK != read_res) {
+                                                                pr_error_int_msg("Error reading telemetry buffer, aborting ", read_res);
                                                                 break;
                                                         }
 
-                                                        if (read_string == NULL || strlen(read_string) == 0)
+                                                        if (read == 0)
                                                                 break;
 
-                                                        serial_write_s(serial, read_string);
-                                                        cellular_state.read_index += strlen(read_string);
-
-                                                        uint32_t tick = 0;
-                                                        if(get_tick_from_sample_string(read_string, &tick)) {
-                                                                cellular_add_buffer_offset_tick(tick, cellular_state.read_index);
-                                                        }
+                                                        cellular_state.buffer_buffer[read] = '\0';
+                                                        serial_write_s(serial, cellular_state.buffer_buffer);
 
-                                                        if (cellular_state.read_index - start_index > BUFFERED_CHUNK_SIZE) {
+                                                        chunk_sent += read;
+                                                        if (chunk_sent > BUFFERED_CHUNK_SIZE) {
                                                                 delayMs(BUFFERED_CHUNK_WAIT);
-                                                                start_index = cellular_state.read_index;
+                                                                chunk_sent = 0;
 
                                                                 /* here we're catching up on a lot of buffered data,
                                                                  * so reset the timestamp so we don't time out
@@ -821,6 +878,7 @@ void cellular_connectivity_task(void *params)
                                                 }
                                         }
                                 }
+                                sample_release(msg.sample, connParams->holder, msg.ticks);
                         }
 
                         /*//////////////////////////////////////////////////////////
@@ -20,6 +20,7 @@
  */
 
 
+#include "binary_log.h"
 #include "fileWriter.h"
 #include "led.h"
 #include "loggerHardware.h"
@@ -29,34 +30,200 @@
 #include "printk.h"
 #include "ring_buffer.h"
 #include "sampleRecord.h"
+#include "sample_history.h"
 #include "sdcard.h"
 #include "task.h"
 #include "taskUtil.h"
 #include "test.h"
 #include "logger.h"
+#include <ctype.h>
 #include <stdbool.h>
-#include <string.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define _LOG_PFX "[fileWriter] "
 #define ERROR_SLEEP_DELAY_MS	500
 #define FILE_BUFFER_SIZE	1024
+/* Whole sectors only, so FatFs writes them straight to the card */
+#define LOG_CHUNK_SIZE		(8 * 512)
+#define LOG_PREALLOC_SIZE	(4 * 1024 * 1024)
 #define FILE_WRITER_STACK_SIZE	512
 #define LOG_PFX	"[fileWriter] "
-#define MAX_LOG_FILE_INDEX	99999
+#define LOG_FILE_PREFIX		"rc_"
+#define LOG_INDEX_FILE		"rc_index.txt"
+#define LOG_SESSION_PREFIX	"ses_"
 #define WRITE_FAIL	EOF
 
 static FIL *g_logfile;
 static xQueueHandle g_LoggerMessage_queue;
 static struct ring_buff *file_buff;
 
+/*
+ * Staging for preallocated log files.  Data is handed to FatFs one
+ * whole, sector aligned chunk at a time, into clusters that were
+ * allocated up front, so neither partial sector read-modify-writes nor
+ * FAT updates land on the hot path.
+ */
+static struct {
+        bool active;
+        char *buff;
+        size_t len;
+        /* Bytes of log data in the file */
+        uint32_t data_size;
+        /* Bytes allocated to the file */
+        uint32_t alloc_size;
+} chunk;
+
+/* Session directory this boot is logging into, if any */
+static struct {
+        bool active;
+        uint32_t next_log;
+        char dir[FILENAME_LEN];
+} session;
+
 static void error_led(const bool on)
 {
         led_set(LED_ERROR, on);
 }
 
+/**
+ * @return The allocation that covers need, growing alloc in steps of
+ * LOG_PREALLOC_SIZE.
+ */
+TESTABLE_STATIC uint32_t prealloc_size(const uint32_t alloc,
+                                       const uint32_t need)
+{
+        if (need <= alloc)
+                return alloc;
+
+        const uint32_t steps = (need - alloc + LOG_PREALLOC_SIZE - 1) /
+                LOG_PREALLOC_SIZE;
+        return alloc + steps * LOG_PREALLOC_SIZE;
+}
+
+/**
+ * Grows the cluster chain of the log file so that it covers need
+ * bytes.  Seeking past the end of a file open for writing stretches
+ * it, and on a fresh card the new clusters are contiguous.  Caller must
+ * hold the fs lock.
+ */
+static FRESULT preallocate(const uint32_t need)
+{
+        const uint32_t size = prealloc_size(chunk.alloc_size, need);
+        if (size == chunk.alloc_size)
+                return FR_OK;
+
+        FRESULT res = f_lseek(g_logfile, size);
+        chunk.alloc_size = f_size(g_logfile);
+        if (FR_OK == res)
+                res = f_lseek(g_logfile, chunk.data_size);
+
+        if (FR_OK == res && chunk.alloc_size < need)
+                res = FR_DENIED;
+
+        return res;
+}
+
+static FRESULT write_chunk(void)
+{
+        if (!chunk.len)
+                return FR_OK;
+
+        unsigned int written = 0;
+        fs_lock();
+        FRESULT res = preallocate(chunk.data_size + chunk.len);
+        if (FR_OK == res)
+                res = f_write(g_logfile, chunk.buff, chunk.len, &written);
+        fs_unlock();
+
+        chunk.data_size += written;
+        chunk.len -= written;
+        memmove(chunk.buff, chunk.buff + written, chunk.len);
+
+        if (FR_OK == res && chunk.len)
+                res = FR_DENIED;
+
+        if (FR_OK != res) {
+                pr_debug_int_msg(_LOG_PFX "chunk write failed with "
+                                 "status: ", (int) res);
+                error_led(true);
+        }
+
+        return res;
+}
+
+static FRESULT append_chunk_data(const char *data, size_t len)
+{
+        while (len) {
+                const size_t copy = MIN(LOG_CHUNK_SIZE - chunk.len, len);
+                memcpy(chunk.buff + chunk.len, data, copy);
+                chunk.len += copy;
+                data += copy;
+                len -= copy;
+
+                if (LOG_CHUNK_SIZE == chunk.len) {
+                        const FRESULT res = write_chunk();
+                        if (FR_OK != res)
+                                return res;
+                }
+        }
+
+        return FR_OK;
+}
+
+/**
+ * Sets up the chunked write mode for a newly created log file.  Falls
+ * back to the regular buffered writes if we can't get the memory or
+ * the initial allocation.
+ */
+static void start_chunked_file(void)
+{
+        chunk.active = false;
+        chunk.len = 0;
+        chunk.data_size = 0;
+        chunk.alloc_size = 0;
+
+        if (!chunk.buff)
+                chunk.buff = portMalloc(LOG_CHUNK_SIZE);
+
+        if (!chunk.buff) {
+                pr_warning(_LOG_PFX "No memory for chunked writes\r\n");
+                return;
+        }
+
+        fs_lock();
+        const FRESULT res = preallocate(LOG_PREALLOC_SIZE);
+        fs_unlock();
+
+        if (FR_OK != res) {
+                pr_warning_int_msg(_LOG_PFX "Failed to preallocate log "
+                                   "file: ", res);
+                return;
+        }
+
+        chunk.active = true;
+}
+
+/**
+ * Writes out the last partial chunk and gives back the part of the
+ * allocation we did not use.
+ */
+static void finish_chunked_file(void)
+{
+        write_chunk();
+
+        fs_lock();
+        if (FR_OK == f_lseek(g_logfile, chunk.data_size))
+                f_truncate(g_logfile);
+        fs_unlock();
+}
+
 static FRESULT flush_file_buffer(void)
 {
+        /* Chunks go out as they fill up, never partially */
+        if (chunk.active)
+                return FR_OK;
+
         while(true) {
                 size_t available = 0;
                 const void* buff =
@@ -80,21 +247,22 @@ static FRESULT flush_file_buffer(void)
         }
 }
 
-static FRESULT append_file_buffer(const char *str)
+static FRESULT append_file_data(const void *data, size_t len)
 {
-        if (!str)
-                return FR_OK;
-
+        const char *ptr = data;
         FRESULT res = FR_OK;
-        size_t len = strlen(str);
+
+        if (chunk.active)
+                return append_chunk_data(ptr, len);
+
         while(len) {
                 const size_t write_len =
                         MIN(ring_buffer_bytes_free(file_buff), len);
-                ring_buffer_put(file_buff, str, write_len);
-                str += write_len;
+                ring_buffer_put(file_buff, ptr, write_len);
+                ptr += write_len;
                 len -= write_len;
 
-                /* If not at end of string, more to write.  Flush */
+                /* If not at end of data, more to write.  Flush */
                 if (len > 0)
                         res = flush_file_buffer();
         }
@@ -102,9 +270,18 @@ static FRESULT append_file_buffer(const char *str)
         return res;
 }
 
+static FRESULT append_file_buffer(const char *str)
+{
+        if (!str)
+                return FR_OK;
+
+        return append_file_data(str, strlen(str));
+}
+
 portBASE_TYPE queue_logfile_record(const LoggerMessage * const msg)
 {
-        return send_logger_message(g_LoggerMessage_queue, msg);
+        return send_held_logger_message(g_LoggerMessage_queue, msg,
+                                        SAMPLE_HOLDER_FILE_WRITER);
 }
 
 static void appendQuotedString(const char *s)
@@ -218,6 +395,62 @@ static int write_samples_data(const LoggerMessage *msg)
         return flush_file_buffer();
 }
 
+static int write_binary_header(const LoggerMessage *msg)
+{
+        const struct sample *s = msg->sample;
+        struct binary_log_header hdr;
+
+        if (!binary_log_init_header(&hdr, s)) {
+                pr_warning(_LOG_PFX "Too many channels for binary log\r\n");
+                return WRITE_FAIL;
+        }
+
+        append_file_data(&hdr, sizeof(hdr));
+
+        const ChannelSample *cs = s->channel_samples;
+        for (size_t i = 0; i < s->channel_count; ++i, ++cs) {
+                struct binary_log_channel ch;
+                binary_log_init_channel(&ch, cs);
+                append_file_data(&ch, sizeof(ch));
+        }
+
+        return flush_file_buffer();
+}
+
+/**
+ * Writes the sample as a fixed width binary record.  Values are copied
+ * raw out of the ChannelSample, so no number formatting happens here.
+ */
+static int write_binary_data(const LoggerMessage *msg)
+{
+        const struct sample *s = msg->sample;
+        const ChannelSample *cs = s->channel_samples;
+
+        if (NULL == cs) {
+                pr_warning(_LOG_PFX "null sample record\r\n");
+                return WRITE_FAIL;
+        }
+
+        const uint8_t marker = BINARY_LOG_RECORD_MARKER;
+        uint8_t mask[BINARY_LOG_MAX_MASK_LEN];
+        const size_t mask_len = binary_log_populated_mask(s, mask);
+
+        append_file_data(&marker, sizeof(marker));
+        append_file_data(mask, mask_len);
+
+        for (size_t i = 0; i < s->channel_count; ++i, ++cs) {
+                const size_t size =
+                        binary_log_type_size(binary_log_get_type(cs));
+                append_file_data(binary_log_value_ptr(cs), size);
+        }
+
+        /*
+         * Unlike the CSV writer we don't flush on every record.  The ring
+         * buffer gets flushed whenever it fills up and by flush_logfile.
+         */
+        return FR_OK;
+}
+
 static enum writing_status open_existing_log_file(struct logging_status *ls)
 {
         pr_debug_str_msg(_LOG_PFX "Opening log file ", ls->name);
@@ -229,40 +462,258 @@ static enum writing_status open_existing_log_file(struct logging_status *ls)
         if (FR_OK != rc)
                 return WRITING_INACTIVE;
 
-        // Seek to the end so we append instead of overwriting
+        /*
+         * Seek to the end so we append instead of overwriting.  A
+         * preallocated file ends where our data does, not at its size.
+         */
         fs_lock();
-        rc = f_lseek(g_logfile, f_size(g_logfile));
+        if (chunk.active) {
+                chunk.alloc_size = f_size(g_logfile);
+                rc = f_lseek(g_logfile, chunk.data_size);
+        } else {
+                rc = f_lseek(g_logfile, f_size(g_logfile));
+        }
         fs_unlock();
 
         return rc == FR_OK ? WRITING_ACTIVE : WRITING_INACTIVE;
 }
 
-static enum writing_status open_new_log_file(struct logging_status *ls)
+/**
+ * Parses the index out of a name like rc_12.log or ses_3.  FAT short
+ * names come back upper case, so the prefix match ignores case.
+ * @return The index, or -1 if the name does not match.
+ */
+TESTABLE_STATIC long log_name_index(const char *name, const char *prefix)
 {
-        pr_debug(_LOG_PFX "Opening new log file\r\n");
+        for (; *prefix; ++prefix, ++name)
+                if (toupper((int) *name) != toupper((int) *prefix))
+                        return -1;
 
-        int i;
+        if (!isdigit((int) *name))
+                return -1;
 
-        for (i = 0; i < MAX_LOG_FILE_INDEX; i++) {
-                char buf[12];
-                modp_itoa10(i, buf);
+        char *end;
+        const long idx = strtol(name, &end, 10);
+        return *end == '\0' || *end == '.' ? idx : -1;
+}
 
-                strcpy(ls->name, "rc_");
-                strcat(ls->name, buf);
-                strcat(ls->name, ".log");
+/**
+ * Parses the contents of the log index file: the next log index
+ * followed by the next session index.
+ */
+TESTABLE_STATIC bool parse_log_index(const char *str,
+                                     struct log_index *li)
+{
+        char *end;
+        const unsigned long log = strtoul(str, &end, 10);
+        if (end == str)
+                return false;
+
+        str = end;
+        const unsigned long session = strtoul(str, &end, 10);
+        if (end == str)
+                return false;
+
+        li->next_log = log;
+        li->next_session = session;
+        return true;
+}
 
-                fs_lock();
-                const FRESULT res = f_open(g_logfile, ls->name, FA_WRITE | FA_CREATE_NEW);
-                fs_unlock();
+/* Caller must hold the fs lock.  Uses g_logfile, so no log may be open */
+static bool read_log_index(struct log_index *li)
+{
+        if (FR_OK != f_open(g_logfile, LOG_INDEX_FILE, FA_READ))
+                return false;
 
-                if ( FR_OK == res )
-                        return WRITING_ACTIVE;
+        char buf[24];
+        const bool res = f_gets(buf, sizeof(buf), g_logfile) &&
+                parse_log_index(buf, li);
+        f_close(g_logfile);
 
-                fs_lock();
-                f_close(g_logfile);
-                fs_unlock();
+        return res;
+}
+
+/* Caller must hold the fs lock.  Uses g_logfile, so no log may be open */
+static void write_log_index(const struct log_index *li)
+{
+        if (FR_OK != f_open(g_logfile, LOG_INDEX_FILE,
+                            FA_WRITE | FA_CREATE_ALWAYS)) {
+                pr_warning(_LOG_PFX "Failed to save log index\r\n");
+                return;
+        }
+
+        char buf[12];
+        modp_uitoa10(li->next_log, buf);
+        f_puts(buf, g_logfile);
+        f_puts(" ", g_logfile);
+        modp_uitoa10(li->next_session, buf);
+        f_puts(buf, g_logfile);
+        f_puts("\n", g_logfile);
+        f_close(g_logfile);
+}
+
+/**
+ * Rebuilds the log index from what is on the card.  Only needed when
+ * the index file is missing or stale, for instance after the card was
+ * used with older firmware.  Caller must hold the fs lock.
+ */
+static void scan_log_index(struct log_index *li)
+{
+        DIR dir;
+        FILINFO fno;
+
+        pr_info(_LOG_PFX "Rebuilding log index\r\n");
+        li->next_log = 0;
+        li->next_session = 0;
+
+        memset(&fno, 0, sizeof(fno));
+        if (FR_OK != f_opendir(&dir, "/"))
+                return;
+
+        while (FR_OK == f_readdir(&dir, &fno) && fno.fname[0]) {
+                const long log = log_name_index(fno.fname, LOG_FILE_PREFIX);
+                if (log >= (long) li->next_log)
+                        li->next_log = log + 1;
+
+                const long session = (fno.fattrib & AM_DIR) ?
+                        log_name_index(fno.fname, LOG_SESSION_PREFIX) : -1;
+                if (session >= (long) li->next_session)
+                        li->next_session = session + 1;
+        }
+
+        f_closedir(&dir);
+}
+
+static void build_log_name(char *name, const char *dir, const uint32_t idx,
+                           const char *ext)
+{
+        char buf[12];
+
+        name[0] = '\0';
+        if (dir) {
+                strcpy(name, dir);
+                strcat(name, "/");
+        }
+
+        modp_uitoa10(idx, buf);
+        strcat(name, LOG_FILE_PREFIX);
+        strcat(name, buf);
+        strcat(name, ext);
+}
+
+/**
+ * Creates the session directory for this boot.  Caller must hold the
+ * fs lock.
+ */
+static bool start_session(struct log_index *li, const bool rescanned)
+{
+        char buf[12];
+        modp_uitoa10(li->next_session, buf);
+        strcpy(session.dir, LOG_SESSION_PREFIX);
+        strcat(session.dir, buf);
+
+        const FRESULT res = f_mkdir(session.dir);
+        if (FR_EXIST == res && !rescanned) {
+                /* Stale index.  Find out what is really on the card */
+                scan_log_index(li);
+                return start_session(li, true);
         }
 
+        if (FR_OK != res) {
+                pr_warning_int_msg(_LOG_PFX "Failed to create session "
+                                   "directory: ", res);
+                return false;
+        }
+
+        li->next_session++;
+        session.active = true;
+        session.next_log = 0;
+        return true;
+}
+
+/**
+ * Creates a new log file.  The next free index comes from the log index
+ * file, so this is a single create however many logs the card holds.
+ * Caller must hold the fs lock.
+ */
+static FRESULT create_log_file(struct logging_status *ls, const char *ext)
+{
+        const bool session_dirs =
+                getWorkingLoggerConfig()->logging_cfg.session_dirs;
+        struct log_index li;
+        bool rescanned = false;
+
+        if (!read_log_index(&li)) {
+                scan_log_index(&li);
+                rescanned = true;
+        }
+
+        if (session_dirs && !session.active &&
+            !start_session(&li, rescanned)) {
+                write_log_index(&li);
+                return FR_DENIED;
+        }
+
+        while (true) {
+                if (session_dirs) {
+                        build_log_name(ls->name, session.dir,
+                                       session.next_log, ext);
+                } else {
+                        build_log_name(ls->name, NULL, li.next_log, ext);
+                }
+
+                const FRESULT res = f_open(g_logfile, ls->name,
+                                           FA_WRITE | FA_CREATE_NEW);
+                if (FR_OK == res) {
+                        if (session_dirs) {
+                                session.next_log++;
+                        } else {
+                                li.next_log++;
+                        }
+
+                        write_log_index(&li);
+                        return FR_OK;
+                }
+
+                /* Only a stale index is worth another try */
+                if (rescanned || (FR_EXIST != res && FR_NO_PATH != res))
+                        return res;
+
+                rescanned = true;
+                if (session_dirs) {
+                        /* Card was swapped under us.  Start over */
+                        session.active = false;
+                        scan_log_index(&li);
+                        if (!start_session(&li, true)) {
+                                write_log_index(&li);
+                                return res;
+                        }
+                } else {
+                        scan_log_index(&li);
+                }
+        }
+}
+
+static enum writing_status open_new_log_file(struct logging_status *ls)
+{
+        pr_debug(_LOG_PFX "Opening new log file\r\n");
+
+        const char *ext = LOG_FILE_FORMAT_BINARY == ls->format ?
+                          ".rcb" : ".log";
+
+        fs_lock();
+        const FRESULT res = create_log_file(ls, ext);
+        fs_unlock();
+
+        if (FR_OK == res) {
+                if (ls->preallocate)
+                        start_chunked_file();
+
+                return WRITING_ACTIVE;
+        }
+
+        pr_warning_int_msg(_LOG_PFX "Failed to create log file: ", res);
+
         /* We fail if here. Be sure to clean up name buffer.*/
         ls->name[0] = '\0';
         return WRITING_INACTIVE;
@@ -270,6 +721,15 @@ static enum writing_status open_new_log_file(struct logging_status *ls)
 
 static void close_log_file(struct logging_status *ls)
 {
+        /* Chunks and binary records are left buffered until full */
+        if (WRITING_ACTIVE == ls->writing_status) {
+                if (chunk.active) {
+                        finish_chunked_file();
+                } else if (LOG_FILE_FORMAT_BINARY == ls->format) {
+                        flush_file_buffer();
+                }
+        }
+
         ls->writing_status = WRITING_INACTIVE;
         fs_lock();
         f_close(g_logfile);
@@ -331,6 +791,8 @@ TESTABLE_STATIC int logging_start(struct logging_status *ls)
 {
         pr_info(_LOG_PFX "Start\r\n");
         ls->logging = true;
+        ls->format = getWorkingLoggerConfig()->logging_cfg.file_format;
+        ls->preallocate = getWorkingLoggerConfig()->logging_cfg.preallocate;
 
         /* Set this here because this is the start of the log stream */
         ls->rows_written = 0;
@@ -345,6 +807,7 @@ TESTABLE_STATIC int logging_stop(struct logging_status *ls)
         ls->logging = false;
 
         close_log_file(ls);
+        chunk.active = false;
 
         /* Prevent log file from being re-opened */
         ls->name[0] = '\0';
@@ -353,6 +816,48 @@ TESTABLE_STATIC int logging_stop(struct logging_status *ls)
         return 0;
 }
 
+/**
+ * Writes out whatever pre-trigger history the logger task kept for us.
+ * The history is decoded into a scratch copy of the live sample since
+ * that one still has to be written after it.
+ */
+static int write_history(struct logging_status *ls, const LoggerMessage *msg)
+{
+        const struct sample *live = msg->sample;
+        const size_t bytes = live->channel_count * sizeof(ChannelSample);
+
+        if (!sample_history_count())
+                return 0;
+
+        ChannelSample *cs = (ChannelSample *) portMalloc(bytes);
+        if (!cs) {
+                pr_warning(LOG_PFX "No memory for history.  Skipping...\r\n");
+                return 0;
+        }
+        memcpy(cs, live->channel_samples, bytes);
+
+        struct sample s = *live;
+        s.channel_samples = cs;
+
+        LoggerMessage hist_msg = *msg;
+        hist_msg.sample = &s;
+
+        const bool binary = LOG_FILE_FORMAT_BINARY == ls->format;
+        uint32_t tick;
+        int rc = 0;
+        while (0 == rc && sample_history_next(&s, &tick)) {
+                hist_msg.ticks = tick;
+                rc = binary ? write_binary_data(&hist_msg) :
+                        write_samples_data(&hist_msg);
+
+                if (0 == rc)
+                        ls->rows_written++;
+        }
+
+        portFree(cs);
+        return rc;
+}
+
 static int write_samples(struct logging_status *ls, const LoggerMessage *msg)
 {
         /* Ensure the LoggerMessage we are writing is valid */
@@ -369,21 +874,33 @@ static int write_samples(struct logging_status *ls, const LoggerMessage *msg)
         ls->last_sample_tick = msg->ticks;
 
         int rc = 0;
+        const bool binary = LOG_FILE_FORMAT_BINARY == ls->format;
+
+        /*
+         * If we haven't written to this file yet, start with the headers.
+         * Binary records are fixed width, so the binary log also needs a
+         * fresh header whenever the channel layout changes.
+         */
+        if (0 == ls->rows_written || (binary && msg->needs_meta)) {
+                const bool new_file = 0 == ls->rows_written;
 
-        /* If we haven't written to this file yet, start with the headers */
-        if (0 == ls->rows_written) {
-                rc = write_samples_header(msg);
+                rc = binary ? write_binary_header(msg) :
+                        write_samples_header(msg);
 
                 /* If headers written, then don't write them again */
                 if (0 == rc)
                         ls->rows_written++;
+
+                /* A new log gets the samples leading up to its start */
+                if (0 == rc && new_file)
+                        rc = write_history(ls, msg);
         }
 
         /* If the above write failed, then don't bother with the next */
         if (0 != rc)
                 return rc;
 
-        rc = write_samples_data(msg);
+        rc = binary ? write_binary_data(msg) : write_samples_data(msg);
 
         if (0 == rc)
                 ls->rows_written++;
@@ -446,6 +963,9 @@ TESTABLE_STATIC int flush_logfile(struct logging_status *ls)
                 return -2;
 
         pr_debug(_LOG_PFX "flush\r\n");
+        if (LOG_FILE_FORMAT_BINARY == ls->format)
+                flush_file_buffer();
+
         fs_lock();
         const int res = f_sync(g_logfile);
         fs_unlock();
@@ -505,6 +1025,9 @@ static void fileWriterTask(void *params)
                                    "type\r\n");
                 }
 
+                /* The sample is in the file buffer now, let it go */
+                release_logger_message(&msg, SAMPLE_HOLDER_FILE_WRITER);
+
                 /* Turns the LED on if things are bad, off otherwise. */
                 error_led(rc);
                 if (rc) {
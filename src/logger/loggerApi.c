@@ -27,6 +27,7 @@
 #include "cellular.h"
 #include "CAN.h"
 #include "CAN_aux_filterqueue.h"
+#include "CAN_stats.h"
 #include "cellular_api_status_keys.h"
 #include "channel_config.h"
 #include "constants.h"
@@ -57,6 +58,8 @@
 #include "mem_mang.h"
 #include "printk.h"
 #include "sampleRecord.h"
+#include "sample_meta.h"
+#include "sample_stream.h"
 #include "serial.h"
 #include "str_util.h"
 #include "task.h"
@@ -281,9 +284,13 @@ static void get_bt_status(struct Serial* serial, const bool more)
 
 static void get_logging_status(struct Serial* serial, const bool more)
 {
+        const struct sample_pool_stats *pool = get_sample_pool_stats();
+
         json_objStartString(serial, "logging");
         json_int(serial, "status", (int)logging_get_status(), 1);
-        json_int(serial, "dur", logging_active_time(), 0);
+        json_int(serial, "dur", logging_active_time(), 1);
+        json_uint(serial, "skip", pool->skipped, 1);
+        json_uint(serial, "shed", pool->shed, 0);
         json_objEnd(serial, more);
 }
 
@@ -549,8 +556,22 @@ static void json_channelConfig(struct Serial *serial, const ChannelConfig *cfg,
 }
 
 static void write_sample_meta(struct Serial *serial, const struct sample *sample,
-                              int sampleRateLimit, int more)
+                              const int mode, int more)
 {
+        const struct sample_meta *meta = sample_meta_acquire(sample);
+        if (meta) {
+                if (SAMPLE_META_HASH != mode) {
+                        serial_write_s(serial, "\"meta\":");
+                        serial_write_buff(serial, meta->json, meta->len);
+                        serial_write_c(serial, ',');
+                }
+
+                json_uint(serial, "mh", meta->hash, more);
+                sample_meta_release();
+                return;
+        }
+
+        /* No cached copy.  Build it as we go */
         json_arrayStart(serial, "meta");
         ChannelSample *channel_sample = sample->channel_samples;
 
@@ -566,6 +587,14 @@ static void write_sample_meta(struct Serial *serial, const struct sample *sample
         json_arrayEnd(serial, more);
 }
 
+void api_send_sample_meta(struct Serial *serial, const struct sample *sample,
+                          const enum sample_meta_mode mode)
+{
+        json_objStart(serial);
+        write_sample_meta(serial, sample, mode, 0);
+        json_objEnd(serial, 0);
+}
+
 int api_getMeta(struct Serial *serial, const jsmntok_t *json)
 {
         json_objStart(serial);
@@ -582,7 +611,7 @@ int api_getMeta(struct Serial *serial, const jsmntok_t *json)
         if (!size)
                 return API_ERROR_SEVERE;
 
-        write_sample_meta(serial, &s, getConnectivitySampleRateLimit(), 0);
+        write_sample_meta(serial, &s, SAMPLE_META_FULL, 0);
 
         free_sample_buffer(&s);
         json_objEnd(serial, 0);
@@ -601,8 +630,7 @@ void api_send_sample_record(struct Serial *serial,
         json_uint(serial,"t", tick, 1);
 
         if (sendMeta)
-                write_sample_meta(serial, sample,
-                                  getConnectivitySampleRateLimit(), 1);
+                write_sample_meta(serial, sample, sendMeta, 1);
 
         size_t channelBitmaskIndex = 0;
         unsigned int channelBitmask[MAX_BITMAPS];
@@ -666,6 +694,36 @@ void api_send_sample_record(struct Serial *serial,
         json_objEnd(serial, 0);
 }
 
+int api_set_stream_format(struct Serial *serial, const jsmntok_t *json)
+{
+        struct sample_stream *ss = sample_stream_find(serial);
+        if (!ss)
+                return API_ERROR_UNSUPPORTED;
+
+        int format;
+        if (!jsmn_exists_set_val_int(json, "fmt", &format))
+                return API_ERROR_PARAMETER;
+
+        if (!sample_stream_set_format(ss, format))
+                return API_ERROR_PARAMETER;
+
+        return API_SUCCESS;
+}
+
+int api_set_meta_hash(struct Serial *serial, const jsmntok_t *json)
+{
+        struct sample_stream *ss = sample_stream_find(serial);
+        if (!ss)
+                return API_ERROR_UNSUPPORTED;
+
+        uint32_t hash;
+        if (!jsmn_exists_set_val_uint32(json, "mh", &hash))
+                return API_ERROR_PARAMETER;
+
+        sample_stream_set_peer_meta(ss, hash);
+        return API_SUCCESS;
+}
+
 static const jsmntok_t * setChannelConfig(struct Serial *serial, const jsmntok_t *cfg,
                 ChannelConfig *channelCfg,
                 setExtField_func setExtField,
@@ -2222,6 +2280,38 @@ int api_set_auto_logger_cfg(struct Serial *serial, const jsmntok_t *json)
                API_SUCCESS : API_ERROR_UNSPECIFIED;
 }
 
+#if SDCARD_SUPPORT
+int api_get_sd_log_cfg(struct Serial *serial, const jsmntok_t *json)
+{
+        const struct logging_config *cfg =
+                &getWorkingLoggerConfig()->logging_cfg;
+
+        json_objStart(serial);
+        json_objStartString(serial, "sdLogCfg");
+        json_int(serial, "fmt", cfg->file_format, true);
+        json_bool(serial, "dirs", cfg->session_dirs, true);
+        json_bool(serial, "prealloc", cfg->preallocate, false);
+        json_objEnd(serial, false);
+        json_objEnd(serial, false);
+
+        return API_SUCCESS_NO_RETURN;
+}
+
+int api_set_sd_log_cfg(struct Serial *serial, const jsmntok_t *json)
+{
+        struct logging_config *cfg = &getWorkingLoggerConfig()->logging_cfg;
+
+        int format;
+        if (jsmn_exists_set_val_int(json, "fmt", &format))
+                cfg->file_format = filter_log_file_format(format);
+
+        jsmn_exists_set_val_bool(json, "dirs", &cfg->session_dirs);
+        jsmn_exists_set_val_bool(json, "prealloc", &cfg->preallocate);
+
+        return API_SUCCESS;
+}
+#endif
+
 #if CAMERA_CONTROL
 int api_get_camera_control_cfg(struct Serial *serial, const jsmntok_t *json)
 {
@@ -2384,3 +2474,60 @@ int api_rx_can(struct Serial *serial, const jsmntok_t *json)
 
         return API_SUCCESS_NO_RETURN;
 }
+
+/**
+ * CAN bus health and throughput.  Rates cover the last second.
+ * Request: {"getCanStats": null}
+ * Response: {"canStats":{"bus":[{"frames":1200,"bytes":9600,"fps":100,
+ *   "bps":800,"drop":[0,0,0],"rxErr":0,"txErr":0,"lec":0,"busOff":false,
+ *   "top":[{"id":1280,"rate":50}]}],"task":{"loops":98,"maxMs":1,
+ *   "maxBatch":3}}}
+ * drop counts frames lost by the receive, Lua rxCAN and API rxCan queues.
+ **/
+int api_get_can_stats(struct Serial *serial, const jsmntok_t *json)
+{
+        json_objStart(serial);
+        json_objStartString(serial, "canStats");
+        json_arrayStart(serial, "bus");
+
+        for (size_t i = 0; i < CONFIG_CAN_CHANNELS; i++) {
+                const struct can_bus_stats *bs = CAN_stats_get_bus(i);
+
+                json_objStart(serial);
+                json_uint(serial, "frames", bs->frames, true);
+                json_uint(serial, "bytes", bs->bytes, true);
+                json_uint(serial, "fps", bs->frame_rate, true);
+                json_uint(serial, "bps", bs->byte_rate, true);
+                json_arrayStart(serial, "drop");
+                for (size_t q = 0; q < CAN_STATS_QUEUES; q++)
+                        json_arrayElementInt(serial, bs->dropped[q],
+                                             q < CAN_STATS_QUEUES - 1);
+                json_arrayEnd(serial, true);
+                json_uint(serial, "rxErr", bs->rx_errors, true);
+                json_uint(serial, "txErr", bs->tx_errors, true);
+                json_uint(serial, "lec", bs->last_error, true);
+                json_bool(serial, "busOff", bs->bus_off, true);
+                json_arrayStart(serial, "top");
+                for (size_t t = 0; t < bs->top_count; t++) {
+                        json_objStart(serial);
+                        json_uint(serial, "id", bs->top[t].can_id, true);
+                        json_uint(serial, "rate", bs->top[t].rate, false);
+                        json_objEnd(serial, t < bs->top_count - 1);
+                }
+                json_arrayEnd(serial, false);
+                json_objEnd(serial, i < CONFIG_CAN_CHANNELS - 1);
+        }
+        json_arrayEnd(serial, true);
+
+        const struct can_task_stats *ts = CAN_stats_get_task();
+        json_objStartString(serial, "task");
+        json_uint(serial, "loops", ts->loops, true);
+        json_uint(serial, "maxMs", ts->max_loop_ms, true);
+        json_uint(serial, "maxBatch", ts->max_batch, false);
+        json_objEnd(serial, false);
+
+        json_objEnd(serial, false);
+        json_objEnd(serial, false);
+
+        return API_SUCCESS_NO_RETURN;
+}
@@ -393,6 +393,14 @@ uint8_t filter_background_streaming_mode(uint8_t mode)
         return mode == 0 ? 0 : 1;
 }
 
+enum log_file_format filter_log_file_format(int format)
+{
+        if (format < 0 || format >= __LOG_FILE_FORMAT_COUNT)
+                return LOG_FILE_FORMAT_CSV;
+
+        return (enum log_file_format) format;
+}
+
 #if TIMER_CHANNELS > 0
 unsigned short filterTimerDivider(unsigned short speed)
 {
@@ -39,6 +39,7 @@
 #include "loggerHardware.h"
 #include "loggerSampleData.h"
 #include "macros.h"
+#include "mem_mang.h"
 #include "predictive_timer_2.h"
 #include "printk.h"
 #include "sampleRecord.h"
@@ -48,8 +49,7 @@
 #include "virtual_channel.h"
 #include <math.h>
 #include <stdbool.h>
-
-#define SAMPLE_CB_REGISTRY_SIZE	8
+#include <string.h>
 
 struct sample_cb_registry {
         logger_sample_cb_t* cb;
@@ -249,6 +249,120 @@ static long long get_utc_time_helper(void)
         return (long long)GPS_get_UTC_time();
 }
 
+static bool is_always_sampled(const ChannelSample *cs)
+{
+        return cs->cfg->flags & ALWAYS_SAMPLED;
+}
+
+/*
+ * Appends the runs of consecutive channel samples matching the bucket to
+ * the schedule ranges.  Channels of the always bucket are matched by their
+ * flag, all others by their rate.
+ */
+static void fill_bucket(struct sample *s, struct sample_bucket *b,
+                        const bool always, size_t *range_count)
+{
+        struct sample_range *r = NULL;
+        const ChannelSample *cs = s->channel_samples;
+
+        b->populated = false;
+        b->range_first = *range_count;
+        b->range_count = 0;
+
+        for (size_t i = 0; i < s->channel_count; ++i, ++cs) {
+                const bool match = always ? is_always_sampled(cs) :
+                        !is_always_sampled(cs) && cs->cfg->sampleRate == b->rate;
+
+                if (!match) {
+                        r = NULL;
+                        continue;
+                }
+
+                if (!r) {
+                        r = s->schedule->ranges + (*range_count)++;
+                        r->first = i;
+                        r->count = 0;
+                        b->range_count++;
+                }
+                r->count++;
+        }
+}
+
+static void init_sample_schedule(struct sample *s)
+{
+        ChannelSample *cs = s->channel_samples;
+        size_t bucket_count = 0;
+        size_t range_count = 0;
+
+        /*
+         * Size the schedule first.  One range per run of channels sharing
+         * a slot, and one bucket per distinct rate.  This only runs when
+         * the configuration changes, so the quadratic scan is fine.
+         */
+        for (size_t i = 0; i < s->channel_count; ++i) {
+                cs[i].populated = false;
+
+                const bool always = is_always_sampled(cs + i);
+                if (0 == i || always != is_always_sampled(cs + i - 1) ||
+                    (!always && cs[i].cfg->sampleRate !=
+                     cs[i - 1].cfg->sampleRate))
+                        ++range_count;
+
+                size_t j = 0;
+                while (j < i && cs[j].cfg->sampleRate != cs[i].cfg->sampleRate)
+                        ++j;
+                if (j == i)
+                        ++bucket_count;
+        }
+
+        const size_t size = sizeof(struct sample_schedule) +
+                sizeof(struct sample_bucket[bucket_count]) +
+                sizeof(struct sample_range[range_count]);
+
+        /*
+         * Rate edits usually don't grow the schedule, so patch it in
+         * place when we can.  Saves both the heap and the arena.
+         */
+        struct sample_schedule *sched = s->schedule;
+        if (!sched || sched->size < size) {
+                sample_buffer_free(s, sched);
+                s->schedule = NULL;
+
+                sched = sample_buffer_alloc(s, size);
+                if (!sched)
+                        return;
+
+                sched->size = size;
+        }
+
+        sched->bucket_count = 0;
+        sched->buckets = (struct sample_bucket *) (sched + 1);
+        sched->ranges = (struct sample_range *) (sched->buckets + bucket_count);
+        s->schedule = sched;
+
+        /* Collect the distinct rates, fastest (smallest divisor) first */
+        for (size_t i = 0; i < s->channel_count; ++i) {
+                const unsigned short rate = cs[i].cfg->sampleRate;
+                size_t j = 0;
+                while (j < sched->bucket_count && sched->buckets[j].rate < rate)
+                        ++j;
+                if (j < sched->bucket_count && sched->buckets[j].rate == rate)
+                        continue;
+
+                memmove(sched->buckets + j + 1, sched->buckets + j,
+                        sizeof(struct sample_bucket[sched->bucket_count - j]));
+                sched->buckets[j].rate = rate;
+                sched->bucket_count++;
+        }
+
+        range_count = 0;
+        for (size_t i = 0; i < sched->bucket_count; ++i)
+                fill_bucket(s, sched->buckets + i, false, &range_count);
+
+        sched->always.rate = SAMPLE_DISABLED;
+        fill_bucket(s, &sched->always, true, &range_count);
+}
+
 void init_channel_sample_buffer(LoggerConfig *loggerConfig, struct sample *buff)
 {
         buff->ticks = 0;
@@ -385,6 +499,8 @@ void init_channel_sample_buffer(LoggerConfig *loggerConfig, struct sample *buff)
                         get_distance_getter(chanCfg));
         chanCfg = &(trackConfig->session_time_cfg);
         sample = processChannelSampleWithFloatGetterNoarg(sample, chanCfg, lapstats_session_time_minutes);
+
+        init_sample_schedule(buff);
 }
 
 static void populate_channel_sample(ChannelSample *sample)
@@ -423,40 +539,66 @@ static void populate_channel_sample(ChannelSample *sample)
         }
 }
 
+/*
+ * Takes or clears every channel sample of the bucket.
+ */
+static void update_bucket(struct sample *s, struct sample_bucket *b,
+                          const bool due)
+{
+        const struct sample_range *r = s->schedule->ranges + b->range_first;
+
+        for (size_t i = 0; i < b->range_count; ++i, ++r) {
+                ChannelSample *cs = s->channel_samples + r->first;
+
+                for (size_t j = 0; j < r->count; ++j, ++cs) {
+                        cs->populated = due;
+                        if (due)
+                                populate_channel_sample(cs);
+                }
+        }
+
+        b->populated = due;
+}
+
+bool is_sample_due(const struct sample *s, const size_t logTick)
+{
+        const struct sample_schedule *sched = s->schedule;
+
+        for (size_t i = 0; i < sched->bucket_count; ++i) {
+                if (logTick % sched->buckets[i].rate == 0)
+                        return true;
+        }
+
+        return false;
+}
+
 int populate_sample_buffer(struct sample *s, size_t logTick)
 {
         unsigned short highestRate = SAMPLE_DISABLED;
-        ChannelSample *samples = s->channel_samples;
-        const size_t count = s->channel_count;
+        struct sample_schedule *sched = s->schedule;
         s->ticks = logTick;
 
-        for (size_t i = 0; i < count; i++, samples++) {
-                const unsigned short sampleRate = samples->cfg->sampleRate;
+        for (size_t i = 0; i < sched->bucket_count; ++i) {
+                struct sample_bucket *b = sched->buckets + i;
 
-                if (logTick % sampleRate != 0) {
-                        samples->populated = false;
-                        continue;
+                if (logTick % b->rate == 0) {
+                        highestRate = getHigherSampleRate(b->rate, highestRate);
+                        update_bucket(s, b, true);
+                } else if (b->populated) {
+                        update_bucket(s, b, false);
                 }
-
-                highestRate = getHigherSampleRate(sampleRate, highestRate);
-                samples->populated = true;
-                populate_channel_sample(samples);
         }
 
         // Check if we got a sample.  If not, then bypass the rest as we are done.
-        if (highestRate == SAMPLE_DISABLED)
+        if (highestRate == SAMPLE_DISABLED) {
+                if (sched->always.populated)
+                        update_bucket(s, &sched->always, false);
+
                 return SAMPLE_DISABLED;
+        }
 
         // If there was a sample taken, now we fill in the always sampled fields.
-        samples = s->channel_samples;
-        for (size_t i = 0; i < count; i++, samples++) {
-                const int isAlwaysSampled = samples->cfg->flags & ALWAYS_SAMPLED;
-                if (!isAlwaysSampled)
-                        continue;
-
-                samples->populated = true;
-                populate_channel_sample(samples);
-        }
+        update_bucket(s, &sched->always, true);
 
         return highestRate;
 }
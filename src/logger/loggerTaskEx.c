@@ -20,6 +20,7 @@
  */
 
 #include "FreeRTOS.h"
+#include "arena.h"
 #include "led.h"
 #include "capabilities.h"
 #include "connectivityTask.h"
@@ -34,10 +35,13 @@
 #include "loggerSampleData.h"
 #include "loggerTaskEx.h"
 #include "macros.h"
+#include "mem_mang.h"
 #include <string.h>
 #include "panic.h"
 #include "printk.h"
 #include "sampleRecord.h"
+#include "sample_history.h"
+#include "sample_meta.h"
 #include "semphr.h"
 #include "serial.h"
 #include "task.h"
@@ -59,12 +63,36 @@ xSemaphoreHandle onTick;
 
 /* This should be 0'd out accroding to C standards */
 static struct sample g_sample_buffer[LOGGER_MESSAGE_BUFFER_SIZE] = {0};
+static volatile bool g_sample_holds[LOGGER_MESSAGE_BUFFER_SIZE][SAMPLE_HOLDER_COUNT];
+static struct sample_pool_stats g_sample_pool_stats;
+
+/*
+ * The sample buffers get rebuilt on every config change.  Their arena
+ * is sized for the enabled channels and only reallocated when a config
+ * needs more, so config pushes don't keep fragmenting the heap for
+ * everyone else (Lua).
+ */
+static void *g_sample_arena_buff;
+static size_t g_sample_arena_size;
+static struct arena g_sample_arena;
+
+/*
+ * Bumped for every config change that is patched into the pool instead
+ * of rebuilding it.  Each buffer catches up when it is next handed out.
+ */
+static uint32_t g_config_generation;
+static bool g_rebuild_samples;
 
 struct sample * get_current_sample(void)
 {
         return current_sample;
 }
 
+const struct sample_pool_stats* get_sample_pool_stats(void)
+{
+        return &g_sample_pool_stats;
+}
+
 static LoggerMessage getLogStartMessage()
 {
         return create_logger_message(LoggerMessageType_Start, 0, NULL, false);
@@ -86,6 +114,7 @@ void vApplicationTickHook(void)
 
 void configChanged()
 {
+        sample_meta_invalidate();
         g_config_changed = true;
 }
 
@@ -131,6 +160,33 @@ void startLoggerTaskEx(int priority)
                 panic(PANIC_CAUSE_TASK_CREATE);
 }
 
+/*
+ * Makes sure the arena holds every buffer of the pool.  If the heap
+ * can't spare a bigger one, the old arena stays and the pool gets
+ * fewer buffers.
+ */
+static void reserve_sample_arena(const size_t channel_count)
+{
+        const size_t size = LOGGER_MESSAGE_BUFFER_SIZE *
+                SAMPLE_BUFFER_ARENA_BYTES(channel_count);
+
+        if (size <= g_sample_arena_size)
+                return;
+
+        /* Nothing may point into the old arena once it is gone */
+        arena_init(&g_sample_arena, NULL, 0);
+        portFree(g_sample_arena_buff);
+        g_sample_arena_size = 0;
+
+        g_sample_arena_buff = portMalloc(size);
+        if (g_sample_arena_buff)
+                g_sample_arena_size = size;
+        else
+                pr_warning("Failed to allocate the sample arena\r\n");
+
+        arena_init(&g_sample_arena, g_sample_arena_buff, g_sample_arena_size);
+}
+
 static int init_sample_ring_buffer(LoggerConfig *loggerConfig)
 {
         const size_t channel_count = get_enabled_channel_count(loggerConfig);
@@ -138,19 +194,86 @@ static int init_sample_ring_buffer(LoggerConfig *loggerConfig)
         const struct sample * const end = s + LOGGER_MESSAGE_BUFFER_SIZE;
         int i;
 
-        for (i = 0; s < end; ++s, ++i) {
+        /*
+         * Whatever consumers still hold refers to the old layout.  Their
+         * messages are dropped by the ticks check, so start over clean.
+         */
+        memset((void *) g_sample_holds, 0, sizeof(g_sample_holds));
+
+        /* All of the old buffers lived in the arena */
+        reserve_sample_arena(channel_count);
+        arena_reset(&g_sample_arena);
+        for (; s < end; ++s) {
+                s->channel_samples = NULL;
+                s->schedule = NULL;
+                s->arena = &g_sample_arena;
+                s->config_generation = g_config_generation;
+        }
+        g_rebuild_samples = false;
+
+        for (i = 0, s = g_sample_buffer; s < end; ++s, ++i) {
+                s->holds = g_sample_holds[i];
                 const size_t bytes = init_sample_buffer(s, channel_count);
                 if (0 == bytes) {
-                        /* If here, then can't alloc memory for buffers */
-                        pr_error("Failed to allocate memory for sample buffers\r\n");
+                        /* If here, then the arena is full */
+                        pr_warning("Sample arena too small for all buffers\r\n");
                         break;
                 }
         }
 
         pr_debug_int_msg("Sample buffers allocated: ", i);
+        pr_debug_int_msg("Sample arena bytes used: ",
+                         arena_bytes_used(&g_sample_arena));
         return i;
 }
 
+#if SDCARD_SUPPORT
+/*
+ * Keeps the pre-trigger history sized for the current configuration.
+ * The auto logger settings are changed without a configChanged call,
+ * so we also watch for the history length changing on its own.  A
+ * patched pool keeps the history, the history itself drops records
+ * that no longer match the channels.
+ */
+static void update_sample_history(LoggerConfig *loggerConfig,
+                                  const int loggingSampleRate,
+                                  const bool rebuilt)
+{
+        static size_t history_seconds;
+        static int history_rate = SAMPLE_DISABLED;
+        const struct auto_logger_config *alc = &loggerConfig->auto_logger_cfg;
+        const size_t seconds = alc->enabled ? alc->pre_trigger : 0;
+
+        if (!rebuilt && seconds == history_seconds &&
+            loggingSampleRate == history_rate)
+                return;
+
+        history_seconds = seconds;
+        history_rate = loggingSampleRate;
+        sample_history_configure(g_sample_buffer, seconds, loggingSampleRate);
+}
+#endif
+
+/*
+ * Edits that keep the channel count (rates, precision, labels...) don't
+ * need new buffers, so logging and telemetry carry on through them.
+ * Anything else rebuilds the pool from scratch.
+ */
+static bool patch_sample_ring_buffer(LoggerConfig *loggerConfig,
+                                     const int buffer_size)
+{
+        if (g_rebuild_samples || 0 == buffer_size)
+                return false;
+
+        const size_t channel_count = get_enabled_channel_count(loggerConfig);
+        if (channel_count != g_sample_buffer[0].channel_count)
+                return false;
+
+        ++g_config_generation;
+        pr_info("Patching sample buffers for config change\r\n");
+        return true;
+}
+
 static int calcTelemetrySampleRate(LoggerConfig *config, int desiredSampleRate)
 {
         int maxRate = getConnectivitySampleRateLimit();
@@ -183,6 +306,7 @@ void loggerTaskEx(void *params)
         int loggingSampleRate = SAMPLE_DISABLED;
         int sampleRateTimebase = SAMPLE_DISABLED;
         int telemetrySampleRate = SAMPLE_DISABLED;
+        bool needs_meta = false;
 
         g_loggingShouldRun = 0;
         vSemaphoreCreateBinary(onTick);
@@ -195,35 +319,54 @@ void loggerTaskEx(void *params)
 #endif
 
         auto_logger_init(&loggerConfig->auto_logger_cfg);
+#if SDCARD_SUPPORT
+        sample_history_init();
+#endif
 
         while (1) {
                 xSemaphoreTake(onTick, portMAX_DELAY);
                 ++currentTicks;
 
+                bool rebuilt = false;
                 if (g_config_changed) {
-                        buffer_size = init_sample_ring_buffer(loggerConfig);
-                        if (!buffer_size) {
-                                pr_error("Failed to allocate any buffers!\r\n");
-                                led_enable(LED_ERROR);
-
-                                /*
-                                 * Do this to ensure the log message gets out
-                                 * and we give system time to recover.
-                                 */
-                                delayMs(10);
-                                continue;
+                        g_config_changed = false;
+
+                        if (!patch_sample_ring_buffer(loggerConfig,
+                                                      buffer_size)) {
+                                buffer_size = init_sample_ring_buffer(loggerConfig);
+                                if (!buffer_size) {
+                                        pr_error("Failed to allocate any buffers!\r\n");
+                                        led_enable(LED_ERROR);
+                                        g_config_changed = true;
+
+                                        /*
+                                         * Do this to ensure the log message gets out
+                                         * and we give system time to recover.
+                                         */
+                                        delayMs(10);
+                                        continue;
+                                }
+
+                                rebuilt = true;
+                                led_disable(LED_ERROR);
+                                resetLapCount();
+                                lapstats_reset_distance();
+                                currentTicks = 0;
                         }
 
-                        led_disable(LED_ERROR);
-
                         updateSampleRates(loggerConfig, &loggingSampleRate,
                                           &telemetrySampleRate,
                                           &sampleRateTimebase);
-                        resetLapCount();
-                        lapstats_reset_distance();
-                        currentTicks = 0;
+
+                        /* Consumers learn about it with the next sample */
+                        needs_meta = true;
                 }
 
+#if SDCARD_SUPPORT
+                update_sample_history(loggerConfig, loggingSampleRate,
+                                      rebuilt);
+#endif
+
                 /* Only reset the watchdog when we are configured and ready to rock */
                 watchdog_reset();
 
@@ -241,6 +384,8 @@ void loggerTaskEx(void *params)
                         logging_started();
                         const LoggerMessage logStartMsg = getLogStartMessage();
 #if SDCARD_SUPPORT
+                        /* The file writer logs the history up to here */
+                        sample_history_freeze();
                         queue_logfile_record(&logStartMsg);
 #endif
                         queueTelemetryRecord(&logStartMsg);
@@ -251,13 +396,35 @@ void loggerTaskEx(void *params)
                         const LoggerMessage logStopMsg = getLogStopMessage();
 #if SDCARD_SUPPORT
                         queue_logfile_record(&logStopMsg);
+                        sample_history_reset();
 #endif
                         queueTelemetryRecord(&logStopMsg);
                         logging_set_status(LOGGING_STATUS_IDLE);
                 }
 
-                /* Prepare a Sample */
-                struct sample *sample = g_sample_buffer + bufferIndex;
+                /*
+                 * Prepare a Sample.  If every buffer is still held (by the
+                 * file writer, telemetry or sample callbacks) we have to
+                 * skip this one.  sample_pool_share below keeps the others
+                 * from ever holding all of them.
+                 */
+                struct sample *sample = sample_pool_next(g_sample_buffer,
+                                                         buffer_size,
+                                                         bufferIndex,
+                                                         currentTicks,
+                                                         &g_sample_pool_stats);
+                if (!sample)
+                        continue;
+
+                if (sample->config_generation != g_config_generation) {
+                        if (!update_sample_buffer(sample)) {
+                                /* The schedule outgrew its space */
+                                g_rebuild_samples = true;
+                                g_config_changed = true;
+                                continue;
+                        }
+                        sample->config_generation = g_config_generation;
+                }
 
                 /* Check if we need to actually populate the buffer. */
                 const int sampledRate = populate_sample_buffer(sample,
@@ -265,9 +432,16 @@ void loggerTaskEx(void *params)
                 if (sampledRate == SAMPLE_DISABLED)
                         continue;
 
+                /*
+                 * Telemetry and callbacks drop their copy when they would
+                 * eat into the buffers kept for the file writer.
+                 */
+                sample_pool_share(g_sample_buffer, buffer_size, sample,
+                                  &g_sample_pool_stats);
+
                 /* If here, create the LoggerMessage to send with the sample */
                 const LoggerMessage msg = create_logger_message(
-                                                  LoggerMessageType_Sample, currentTicks, sample, g_config_changed);
+                                                  LoggerMessageType_Sample, currentTicks, sample, needs_meta);
 
                 /*
                  * We only log to file if the user has manually pushed the
@@ -281,6 +455,9 @@ void loggerTaskEx(void *params)
                                 logging_set_status(LOGGING_STATUS_OVERFLOW);
                         }
                 }
+
+                if (!is_logging && should_sample(currentTicks, loggingSampleRate))
+                        sample_history_add(sample, currentTicks);
 #endif
 
                 /*
@@ -293,11 +470,10 @@ void loggerTaskEx(void *params)
                 /* Process callback handlers for the samples */
                 logger_sample_process_callbacks(currentTicks, sample);
 
-                ++bufferIndex;
-                bufferIndex %= buffer_size;
+                bufferIndex = (sample - g_sample_buffer + 1) % buffer_size;
 
                 current_sample = sample;
-                g_config_changed = false;
+                needs_meta = false;
         }
 
         panic(PANIC_CAUSE_UNREACHABLE);
@@ -39,7 +39,7 @@ size_t init_sample_buffer(struct sample *s, const size_t count)
                 free_sample_buffer(s);
 
         const size_t size = sizeof(ChannelSample[count]);
-        s->channel_samples = (ChannelSample *) portMalloc(size);
+        s->channel_samples = (ChannelSample *) sample_buffer_alloc(s, size);
 
         if (NULL == s->channel_samples)
                 return 0;
@@ -48,13 +48,41 @@ size_t init_sample_buffer(struct sample *s, const size_t count)
         s->channel_count = count;
         init_channel_sample_buffer(getWorkingLoggerConfig(), s);
 
+        if (NULL == s->schedule) {
+                free_sample_buffer(s);
+                return 0;
+        }
+
         return size;
 }
 
+bool update_sample_buffer(struct sample *s)
+{
+        if (NULL == s->channel_samples)
+                return false;
+
+        /* Keeps the schedule if it still fits */
+        init_channel_sample_buffer(getWorkingLoggerConfig(), s);
+        return NULL != s->schedule;
+}
+
 void free_sample_buffer(struct sample *s)
 {
-        portFree(s->channel_samples);
+        sample_buffer_free(s, s->channel_samples);
         s->channel_samples = NULL;
+        sample_buffer_free(s, s->schedule);
+        s->schedule = NULL;
+}
+
+void* sample_buffer_alloc(struct sample *s, const size_t size)
+{
+        return s->arena ? arena_alloc(s->arena, size) : portMalloc(size);
+}
+
+void sample_buffer_free(struct sample *s, void *ptr)
+{
+        if (!s->arena)
+                portFree(ptr);
 }
 
 bool get_channel_value_by_name(const char * name, double *value, char ** units)
@@ -130,6 +158,107 @@ portBASE_TYPE send_logger_message(const xQueueHandle queue,
 }
 
 
+portBASE_TYPE send_held_logger_message(const xQueueHandle queue,
+                                       const LoggerMessage * const msg,
+                                       const enum sample_holder holder)
+{
+        if (NULL == queue)
+                return errQUEUE_EMPTY;
+
+        /* Hold first, the receiver may be done before we return */
+        if (!sample_hold(msg->sample, holder))
+                return errQUEUE_FULL;
+
+        const portBASE_TYPE res = xQueueSend(queue, msg, 0);
+        if (pdTRUE != res)
+                release_logger_message(msg, holder);
+
+        return res;
+}
+
+void release_logger_message(const LoggerMessage *lm,
+                            const enum sample_holder holder)
+{
+        sample_release(lm->sample, holder, lm->ticks);
+}
+
+bool sample_hold(const struct sample *s, const enum sample_holder holder)
+{
+        if (!s || !s->holds)
+                return true;
+
+        if (SAMPLE_HOLDER_FILE_WRITER != holder && !s->shareable)
+                return false;
+
+        s->holds[holder] = true;
+        return true;
+}
+
+void sample_release(const struct sample *s, const enum sample_holder holder,
+                    const size_t ticks)
+{
+        if (s && s->holds && s->ticks == ticks)
+                s->holds[holder] = false;
+}
+
+bool sample_is_held(const struct sample *s)
+{
+        for (size_t i = 0; s->holds && i < SAMPLE_HOLDER_COUNT; ++i) {
+                if (s->holds[i])
+                        return true;
+        }
+
+        return false;
+}
+
+struct sample* sample_pool_next(struct sample *pool, const size_t count,
+                                const size_t start, const size_t ticks,
+                                struct sample_pool_stats *stats)
+{
+        for (size_t i = 0; i < count; ++i) {
+                struct sample *s = pool + (start + i) % count;
+                if (!sample_is_held(s))
+                        return s;
+        }
+
+        /*
+         * Never take a buffer back from its holders, they may still be
+         * reading it.  Skip this sample instead and account for the
+         * shortage if we needed a buffer.
+         */
+        if (0 != count && is_sample_due(pool, ticks))
+                stats->skipped++;
+
+        return NULL;
+}
+
+static bool is_shared(const struct sample *s)
+{
+        for (size_t i = SAMPLE_HOLDER_TELEMETRY; i < SAMPLE_HOLDER_COUNT; ++i) {
+                if (s->holds[i])
+                        return true;
+        }
+
+        return false;
+}
+
+void sample_pool_share(const struct sample *pool, const size_t count,
+                       struct sample *s, struct sample_pool_stats *stats)
+{
+        const size_t reserved = MAX(count / 2, 1);
+        size_t shared = 0;
+
+        for (size_t i = 0; i < count; ++i) {
+                if (pool + i != s && pool[i].holds && is_shared(pool + i))
+                        ++shared;
+        }
+
+        /* Counting s, at most count - reserved buffers may be shared */
+        s->shareable = shared + reserved < count;
+        if (!s->shareable)
+                stats->shed++;
+}
+
 char receive_logger_message(xQueueHandle queue, LoggerMessage *lm,
                             portTickType timeout)
 {
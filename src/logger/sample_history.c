@@ -0,0 +1,259 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FreeRTOS.h"
+#include "binary_log.h"
+#include "capabilities.h"
+#include "loggerConfig.h"
+#include "macros.h"
+#include "printk.h"
+#include "ring_buffer.h"
+#include "sample_history.h"
+#include "semphr.h"
+#include <string.h>
+
+/*
+ * Every record starts with this, followed by the populated mask and the
+ * values of the populated channels.  len covers the whole record so
+ * that we can drop one without decoding it.
+ */
+struct history_record {
+        uint16_t len;
+        uint32_t tick;
+} __attribute__((__packed__));
+
+static struct {
+        xSemaphoreHandle lock;
+        struct ring_buff *ring;
+        /* Bytes the ring gets once it is first needed; 0 if disabled */
+        size_t size;
+        size_t count;
+        /* layout_of the samples the records were taken from */
+        uint32_t layout;
+        bool frozen;
+} history;
+
+/*
+ * Tells channel layouts apart.  The logger task patches its sample
+ * buffers in place for most config edits, which may change a channel
+ * type without changing the size of the records.
+ */
+static uint32_t layout_of(const struct sample *s)
+{
+        const ChannelSample *cs = s->channel_samples;
+        uint32_t layout = s->channel_count;
+
+        for (size_t i = 0; i < s->channel_count; ++i, ++cs)
+                layout = layout * 31 + binary_log_get_type(cs);
+
+        return layout;
+}
+
+static size_t values_size(const struct sample *s)
+{
+        const ChannelSample *cs = s->channel_samples;
+        size_t size = 0;
+
+        for (size_t i = 0; i < s->channel_count; ++i, ++cs) {
+                if (cs->populated)
+                        size += binary_log_type_size(binary_log_get_type(cs));
+        }
+
+        return size;
+}
+
+static void drop_oldest(void)
+{
+        struct history_record rec;
+
+        ring_buffer_peek(history.ring, &rec, sizeof(rec));
+        ring_buffer_get(history.ring, NULL, rec.len);
+        --history.count;
+}
+
+static void clear(void)
+{
+        if (history.ring)
+                ring_buffer_clear(history.ring);
+
+        history.count = 0;
+}
+
+static void put_record(const struct sample *s, const uint32_t tick)
+{
+        uint8_t mask[BINARY_LOG_MAX_MASK_LEN];
+        const size_t mask_len = binary_log_populated_mask(s, mask);
+        const struct history_record rec = {
+                .len = sizeof(rec) + mask_len + values_size(s),
+                .tick = tick,
+        };
+
+        if (rec.len > ring_buffer_capacity(history.ring))
+                return;
+
+        /* Older records can't be read back with these channels */
+        const uint32_t layout = layout_of(s);
+        if (layout != history.layout) {
+                clear();
+                history.layout = layout;
+        }
+
+        while (ring_buffer_bytes_free(history.ring) < rec.len)
+                drop_oldest();
+
+        ring_buffer_put(history.ring, &rec, sizeof(rec));
+        ring_buffer_put(history.ring, mask, mask_len);
+
+        const ChannelSample *cs = s->channel_samples;
+        for (size_t i = 0; i < s->channel_count; ++i, ++cs) {
+                if (!cs->populated)
+                        continue;
+
+                ring_buffer_put(history.ring, binary_log_value_ptr(cs),
+                                binary_log_type_size(binary_log_get_type(cs)));
+        }
+
+        ++history.count;
+}
+
+static bool get_record(struct sample *s, uint32_t *tick)
+{
+        uint8_t mask[BINARY_LOG_MAX_MASK_LEN];
+        const size_t mask_len = binary_log_mask_len(s);
+        struct history_record rec;
+
+        if (!history.count || mask_len > sizeof(mask))
+                return false;
+
+        if (layout_of(s) != history.layout) {
+                pr_warning("history: channels changed\r\n");
+                clear();
+                return false;
+        }
+
+        ring_buffer_get(history.ring, &rec, sizeof(rec));
+        ring_buffer_get(history.ring, mask, mask_len);
+        --history.count;
+
+        ChannelSample *cs = s->channel_samples;
+        for (size_t i = 0; i < s->channel_count; ++i, ++cs)
+                cs->populated = !!(mask[i / 8] & (1 << (i % 8)));
+
+        if (rec.len != sizeof(rec) + mask_len + values_size(s)) {
+                /* Not the layout it was taken with.  Toss it all */
+                pr_warning("history: record does not match channels\r\n");
+                clear();
+                return false;
+        }
+
+        cs = s->channel_samples;
+        for (size_t i = 0; i < s->channel_count; ++i, ++cs) {
+                if (!cs->populated)
+                        continue;
+
+                ring_buffer_get(history.ring,
+                                (void *) binary_log_value_ptr(cs),
+                                binary_log_type_size(binary_log_get_type(cs)));
+        }
+
+        *tick = rec.tick;
+        return true;
+}
+
+void sample_history_init(void)
+{
+        history.lock = xSemaphoreCreateMutex();
+}
+
+void sample_history_configure(const struct sample *s, const size_t seconds,
+                              const int sample_rate)
+{
+        xSemaphoreTake(history.lock, portMAX_DELAY);
+
+        if (history.ring)
+                ring_buffer_destroy(history.ring);
+
+        history.ring = NULL;
+        history.size = 0;
+        history.count = 0;
+        history.frozen = false;
+
+        if (seconds && SAMPLE_DISABLED != sample_rate) {
+                const size_t rec_size = sizeof(struct history_record) +
+                        binary_log_record_size(s);
+                const size_t size = seconds * decodeSampleRate(sample_rate) *
+                        rec_size;
+
+                history.size = MIN(size, SAMPLE_HISTORY_MAX_SIZE);
+        }
+
+        xSemaphoreGive(history.lock);
+}
+
+void sample_history_add(const struct sample *s, const uint32_t tick)
+{
+        /* Called from the logger task.  Don't hold it up */
+        if (!xSemaphoreTake(history.lock, 0))
+                return;
+
+        if (history.size && !history.ring && !history.frozen) {
+                history.ring = ring_buffer_create(history.size);
+                if (!history.ring) {
+                        /* Don't keep trying on every sample */
+                        pr_warning("history: failed to allocate\r\n");
+                        history.size = 0;
+                }
+        }
+
+        if (history.ring && !history.frozen)
+                put_record(s, tick);
+
+        xSemaphoreGive(history.lock);
+}
+
+void sample_history_freeze(void)
+{
+        xSemaphoreTake(history.lock, portMAX_DELAY);
+        history.frozen = true;
+        xSemaphoreGive(history.lock);
+}
+
+void sample_history_reset(void)
+{
+        xSemaphoreTake(history.lock, portMAX_DELAY);
+        clear();
+        history.frozen = false;
+        xSemaphoreGive(history.lock);
+}
+
+bool sample_history_next(struct sample *s, uint32_t *tick)
+{
+        xSemaphoreTake(history.lock, portMAX_DELAY);
+        const bool res = get_record(s, tick);
+        xSemaphoreGive(history.lock);
+
+        return res;
+}
+
+size_t sample_history_count(void)
+{
+        return history.count;
+}
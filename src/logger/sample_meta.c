@@ -0,0 +1,232 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FreeRTOS.h"
+#include "loggerConfig.h"
+#include "mem_mang.h"
+#include "modp_numtoa.h"
+#include "printk.h"
+#include "sample_meta.h"
+#include "semphr.h"
+#include <string.h>
+
+#define FNV_OFFSET_BASIS	2166136261u
+#define FNV_PRIME		16777619u
+
+/*
+ * Writes the meta JSON into buf.  A writer without a buffer only
+ * counts, which lets us size the blob before allocating it.
+ */
+struct meta_writer {
+        char *buf;
+        size_t len;
+};
+
+static struct {
+        xSemaphoreHandle lock;
+        volatile uint32_t generation;
+        uint32_t built_generation;
+        size_t channel_count;
+        char *json;
+        struct sample_meta meta;
+} cache;
+
+static void mw_put(struct meta_writer *mw, const char *str, const size_t len)
+{
+        if (mw->buf)
+                memcpy(mw->buf + mw->len, str, len);
+
+        mw->len += len;
+}
+
+static void mw_puts(struct meta_writer *mw, const char *str)
+{
+        mw_put(mw, str, strlen(str));
+}
+
+/* Same escaping as jsmn_encode_write_string */
+static void mw_put_escaped(struct meta_writer *mw, const char *str)
+{
+        const char *run = str;
+        for (; *str; ++str) {
+                const char *esc;
+                switch(*str) {
+                case '\b':
+                        esc = "\\b";
+                        break;
+                case '\f':
+                        esc = "\\f";
+                        break;
+                case '\n':
+                        esc = "\\n";
+                        break;
+                case '\r':
+                        esc = "\\r";
+                        break;
+                case '\t':
+                        esc = "\\t";
+                        break;
+                case '"':
+                        esc = "\\\"";
+                        break;
+                case '\\':
+                        esc = "\\\\";
+                        break;
+                default:
+                        continue;
+                }
+
+                mw_put(mw, run, str - run);
+                mw_puts(mw, esc);
+                run = str + 1;
+        }
+
+        mw_put(mw, run, str - run);
+}
+
+static void write_channel(struct meta_writer *mw, const ChannelConfig *cfg)
+{
+        char buf[30];
+
+        mw_puts(mw, "{\"nm\":\"");
+        mw_put_escaped(mw, cfg->label);
+        mw_puts(mw, "\",\"ut\":\"");
+        mw_put_escaped(mw, cfg->units);
+
+        mw_puts(mw, "\",\"min\":");
+        modp_ftoa(cfg->min, buf, cfg->precision);
+        mw_puts(mw, buf);
+
+        mw_puts(mw, ",\"max\":");
+        modp_ftoa(cfg->max, buf, cfg->precision);
+        mw_puts(mw, buf);
+
+        mw_puts(mw, ",\"prec\":");
+        modp_itoa10((int) cfg->precision, buf);
+        mw_puts(mw, buf);
+
+        mw_puts(mw, ",\"sr\":");
+        modp_itoa10(decodeSampleRate(cfg->sampleRate), buf);
+        mw_puts(mw, buf);
+
+        mw_puts(mw, "}");
+}
+
+static void write_meta(struct meta_writer *mw, const struct sample *s)
+{
+        mw_puts(mw, "[");
+
+        const ChannelSample *cs = s->channel_samples;
+        for (size_t i = 0; i < s->channel_count; ++i, ++cs) {
+                if (0 < i)
+                        mw_puts(mw, ",");
+
+                write_channel(mw, cs->cfg);
+        }
+
+        mw_puts(mw, "]");
+}
+
+/* 32 bit FNV-1a.  Cheap, and plenty to tell configurations apart */
+static uint32_t hash_of(const char *buf, const size_t len)
+{
+        uint32_t hash = FNV_OFFSET_BASIS;
+        for (size_t i = 0; i < len; ++i) {
+                hash ^= (uint8_t) buf[i];
+                hash *= FNV_PRIME;
+        }
+
+        return hash;
+}
+
+static bool cache_valid(const struct sample *s)
+{
+        return cache.json &&
+                cache.built_generation == cache.generation &&
+                cache.channel_count == s->channel_count;
+}
+
+static bool rebuild(const struct sample *s)
+{
+        /* Changes that land while we build will trigger another rebuild */
+        const uint32_t generation = cache.generation;
+
+        struct meta_writer mw;
+        memset(&mw, 0, sizeof(mw));
+        write_meta(&mw, s);
+
+        portFree(cache.json);
+        cache.json = portMalloc(mw.len);
+        if (!cache.json) {
+                pr_error("[sample_meta] Failed to allocate meta data\r\n");
+                return false;
+        }
+
+        mw.buf = cache.json;
+        mw.len = 0;
+        write_meta(&mw, s);
+
+        cache.meta.json = cache.json;
+        cache.meta.len = mw.len;
+        cache.meta.hash = hash_of(cache.json, mw.len);
+        cache.channel_count = s->channel_count;
+        cache.built_generation = generation;
+
+        return true;
+}
+
+void sample_meta_init(void)
+{
+        cache.lock = xSemaphoreCreateMutex();
+}
+
+void sample_meta_invalidate(void)
+{
+        cache.generation++;
+}
+
+const struct sample_meta* sample_meta_acquire(const struct sample *s)
+{
+        xSemaphoreTake(cache.lock, portMAX_DELAY);
+
+        if (!cache_valid(s) && !rebuild(s)) {
+                xSemaphoreGive(cache.lock);
+                return NULL;
+        }
+
+        return &cache.meta;
+}
+
+void sample_meta_release(void)
+{
+        xSemaphoreGive(cache.lock);
+}
+
+bool sample_meta_get_hash(const struct sample *s, uint32_t *hash)
+{
+        const struct sample_meta *meta = sample_meta_acquire(s);
+        if (!meta)
+                return false;
+
+        *hash = meta->hash;
+        sample_meta_release();
+        return true;
+}
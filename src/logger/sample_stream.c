@@ -0,0 +1,321 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "binary_log.h"
+#include "loggerApi.h"
+#include "macros.h"
+#include "mem_mang.h"
+#include "sample_stream.h"
+#include <math.h>
+#include <string.h>
+
+#define FRAME_CHUNK_SIZE	32
+
+/*
+ * Accumulates frame bytes into a small buffer so that the serial port
+ * is not hit once per byte.  A writer without a serial port only
+ * counts, which lets us size the payload before sending it.
+ */
+struct frame_writer {
+        struct Serial *serial;
+        size_t count;
+        uint8_t checksum;
+        size_t len;
+        char buf[FRAME_CHUNK_SIZE];
+};
+
+static struct sample_stream *streams[SAMPLE_STREAM_MAX_STREAMS];
+
+static void fw_flush(struct frame_writer *fw)
+{
+        if (fw->serial && fw->len)
+                serial_write_buff(fw->serial, fw->buf, fw->len);
+
+        fw->len = 0;
+}
+
+static void fw_put(struct frame_writer *fw, const uint8_t b)
+{
+        fw->count++;
+        fw->checksum ^= b;
+        if (!fw->serial)
+                return;
+
+        fw->buf[fw->len++] = b;
+        if (fw->len == sizeof(fw->buf))
+                fw_flush(fw);
+}
+
+static void fw_put_le(struct frame_writer *fw, const void *val,
+                      const size_t size)
+{
+        const uint8_t *p = val;
+        for (size_t i = 0; i < size; ++i)
+                fw_put(fw, p[i]);
+}
+
+static void fw_put_varint(struct frame_writer *fw, const int64_t val)
+{
+        uint64_t zz = ((uint64_t) val << 1) ^ (uint64_t) (val >> 63);
+
+        for (; zz >= 0x80; zz >>= 7)
+                fw_put(fw, (zz & 0x7f) | 0x80);
+
+        fw_put(fw, zz);
+}
+
+static int64_t scale_real(const double val, const uint8_t precision)
+{
+        static const double scales[] = {
+                1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+        };
+
+        if (isnan(val))
+                return 0;
+
+        const double scaled =
+                val * scales[MIN(precision, ARRAY_LEN(scales) - 1)];
+
+        if (scaled >= (double) INT64_MAX)
+                return INT64_MAX;
+        if (scaled <= (double) INT64_MIN)
+                return INT64_MIN;
+
+        return llround(scaled);
+}
+
+static int64_t scaled_value(const ChannelSample *cs)
+{
+        switch(binary_log_get_type(cs)) {
+        case BINARY_LOG_TYPE_INT64:
+                return cs->valueLongLong;
+        case BINARY_LOG_TYPE_FLOAT:
+                return scale_real(cs->valueFloat, cs->cfg->precision);
+        case BINARY_LOG_TYPE_DOUBLE:
+                return scale_real(cs->valueDouble, cs->cfg->precision);
+        case BINARY_LOG_TYPE_INT32:
+        default:
+                return cs->valueInt;
+        }
+}
+
+/*
+ * Writes the frame payload.  When commit is false nothing about the
+ * stream changes, so the same call can first be used to size the frame.
+ */
+static void write_payload(struct sample_stream *ss, struct frame_writer *fw,
+                          const struct sample *s, const uint32_t tick,
+                          const uint8_t flags, const bool commit)
+{
+        const uint16_t count = s->channel_count;
+
+        fw_put(fw, flags);
+        fw_put_le(fw, &tick, sizeof(tick));
+        fw_put_le(fw, &count, sizeof(count));
+
+        uint8_t mask[BINARY_LOG_MAX_MASK_LEN];
+        const size_t mask_len = binary_log_populated_mask(s, mask);
+        fw_put_le(fw, mask, mask_len);
+
+        const ChannelSample *cs = s->channel_samples;
+        for (size_t i = 0; i < s->channel_count; ++i, ++cs) {
+                if (!cs->populated) {
+                        /* Key frames restart the channels they skip from 0 */
+                        if (commit && (flags & SAMPLE_STREAM_FLAG_KEY))
+                                ss->last_values[i] = 0;
+                        continue;
+                }
+
+                if (!(flags & SAMPLE_STREAM_FLAG_VARINT)) {
+                        const size_t size = binary_log_type_size(
+                                binary_log_get_type(cs));
+                        fw_put_le(fw, binary_log_value_ptr(cs), size);
+                        continue;
+                }
+
+                const int64_t val = scaled_value(cs);
+                if (flags & SAMPLE_STREAM_FLAG_KEY) {
+                        fw_put_varint(fw, val);
+                } else {
+                        fw_put_varint(fw, val - ss->last_values[i]);
+                }
+
+                if (commit)
+                        ss->last_values[i] = val;
+        }
+}
+
+/*
+ * Makes sure we have room to remember the last value of every channel.
+ * @return false if the delta state could not be allocated.
+ */
+static bool prepare_delta(struct sample_stream *ss, const size_t count,
+                          bool *key)
+{
+        if (ss->last_values && ss->last_count == count)
+                return true;
+
+        portFree(ss->last_values);
+        ss->last_values = portMalloc(count * sizeof(int64_t));
+        ss->last_count = ss->last_values ? count : 0;
+        *key = true;
+
+        if (!ss->last_values)
+                return false;
+
+        memset(ss->last_values, 0, count * sizeof(int64_t));
+        return true;
+}
+
+static void send_frame(struct sample_stream *ss, const struct sample *s,
+                       const uint32_t tick, const bool send_meta)
+{
+        uint8_t flags = 0;
+
+        if (ss->format == SAMPLE_STREAM_FORMAT_BINARY_DELTA) {
+                bool key = send_meta ||
+                        ss->frames_since_key >= SAMPLE_STREAM_KEY_INTERVAL;
+
+                /* Without delta state fall back to a raw frame */
+                if (prepare_delta(ss, s->channel_count, &key)) {
+                        flags |= SAMPLE_STREAM_FLAG_VARINT;
+                        if (key) {
+                                flags |= SAMPLE_STREAM_FLAG_KEY;
+                                ss->frames_since_key = 0;
+                        }
+                        ss->frames_since_key++;
+                }
+        }
+
+        struct frame_writer sizer;
+        memset(&sizer, 0, sizeof(sizer));
+        write_payload(ss, &sizer, s, tick, flags, false);
+
+        struct frame_writer fw;
+        memset(&fw, 0, sizeof(fw));
+        fw.serial = ss->serial;
+
+        const uint16_t len = sizer.count;
+        fw_put(&fw, SAMPLE_STREAM_SYNC);
+        fw_put_le(&fw, &len, sizeof(len));
+
+        fw.checksum = 0;
+        write_payload(ss, &fw, s, tick, flags, true);
+        fw_put(&fw, fw.checksum);
+        fw_flush(&fw);
+}
+
+bool sample_stream_attach(struct sample_stream *ss, struct Serial *serial)
+{
+        memset(ss, 0, sizeof(struct sample_stream));
+        ss->serial = serial;
+
+        for (size_t i = 0; i < ARRAY_LEN(streams); ++i) {
+                if (!streams[i]) {
+                        streams[i] = ss;
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+void sample_stream_detach(struct sample_stream *ss)
+{
+        sample_stream_reset(ss);
+        for (size_t i = 0; i < ARRAY_LEN(streams); ++i) {
+                if (streams[i] == ss)
+                        streams[i] = NULL;
+        }
+}
+
+void sample_stream_reset(struct sample_stream *ss)
+{
+        ss->peer_has_meta = false;
+        sample_stream_set_format(ss, SAMPLE_STREAM_FORMAT_JSON);
+}
+
+struct sample_stream* sample_stream_find(const struct Serial *serial)
+{
+        for (size_t i = 0; i < ARRAY_LEN(streams); ++i) {
+                if (streams[i] && streams[i]->serial == serial)
+                        return streams[i];
+        }
+
+        return NULL;
+}
+
+bool sample_stream_set_format(struct sample_stream *ss,
+                              const enum sample_stream_format format)
+{
+        if ((unsigned int) format >= __SAMPLE_STREAM_FORMAT_COUNT)
+                return false;
+
+        /* Always restart from a key frame */
+        portFree(ss->last_values);
+        ss->last_values = NULL;
+        ss->last_count = 0;
+        ss->frames_since_key = 0;
+        ss->format = format;
+
+        return true;
+}
+
+void sample_stream_set_peer_meta(struct sample_stream *ss,
+                                 const uint32_t hash)
+{
+        ss->peer_has_meta = true;
+        ss->peer_meta_hash = hash;
+}
+
+static enum sample_meta_mode meta_mode(const struct sample_stream *ss,
+                                       const struct sample *s)
+{
+        uint32_t hash;
+        if (ss->peer_has_meta && sample_meta_get_hash(s, &hash) &&
+            hash == ss->peer_meta_hash)
+                return SAMPLE_META_HASH;
+
+        return SAMPLE_META_FULL;
+}
+
+void sample_stream_send(struct sample_stream *ss, const struct sample *s,
+                        const uint32_t tick, const bool send_meta)
+{
+        const enum sample_meta_mode meta = send_meta ?
+                meta_mode(ss, s) : SAMPLE_META_NONE;
+
+        serial_batch_begin(ss->serial);
+
+        if (ss->format == SAMPLE_STREAM_FORMAT_JSON) {
+                api_send_sample_record(ss->serial, s, tick, meta);
+                put_crlf(ss->serial);
+        } else {
+                if (send_meta) {
+                        api_send_sample_meta(ss->serial, s, meta);
+                        put_crlf(ss->serial);
+                }
+
+                send_frame(ss, s, tick, send_meta);
+        }
+
+        serial_batch_end(ss->serial);
+}
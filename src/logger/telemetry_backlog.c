@@ -0,0 +1,310 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "macros.h"
+#include "sdcard.h"
+#include "telemetry_backlog.h"
+#include <string.h>
+
+typedef uint32_t backlog_index_entry_t;
+
+static size_t next_seg(const size_t seg)
+{
+        return (seg + 1) % TELEMETRY_BACKLOG_SEGMENTS;
+}
+
+static uint32_t seg_base(const size_t seg)
+{
+        return seg * TELEMETRY_BACKLOG_SEGMENT_SIZE;
+}
+
+static bool has_unread(const struct telemetry_backlog *bl, const size_t seg)
+{
+        return bl->read_seg == seg &&
+                bl->read_offset < bl->segments[seg].used;
+}
+
+/**
+ * Empties a segment that is about to be overwritten.  If the reader had
+ * not finished with it then it moves on to the oldest segment left.
+ */
+static void drop_segment(struct telemetry_backlog *bl, const size_t seg)
+{
+        if (bl->read_seg == seg) {
+                if (has_unread(bl, seg))
+                        ++bl->dropped;
+
+                const size_t next = next_seg(seg);
+                bl->read_seg = bl->segments[next].seq ? next : seg;
+                bl->read_offset = 0;
+        }
+
+        memset(bl->segments + seg, 0, sizeof(struct telemetry_backlog_segment));
+}
+
+void telemetry_backlog_init(struct telemetry_backlog *bl, FIL *data,
+                            FIL *index)
+{
+        memset(bl, 0, sizeof(struct telemetry_backlog));
+        bl->data = data;
+        bl->index = index;
+}
+
+/**
+ * Picks where the record for the given tick goes, starting a new
+ * segment if the current one is full or the tick does not follow on
+ * from the last record.
+ * @return The offset in the data file to write the record at.
+ */
+uint32_t telemetry_backlog_begin_record(struct telemetry_backlog *bl,
+                                        const uint32_t tick)
+{
+        struct telemetry_backlog_segment *seg = bl->segments + bl->write_seg;
+
+        if (seg->seq &&
+            seg->used + TELEMETRY_BACKLOG_RECORD_MAX <= TELEMETRY_BACKLOG_SEGMENT_SIZE &&
+            seg->records < TELEMETRY_BACKLOG_SEGMENT_RECORDS &&
+            seg->first_tick + seg->records == tick)
+                return seg_base(bl->write_seg) + seg->used;
+
+        /* Start a new segment.  The very first one is segment 0 */
+        const size_t write_seg = seg->seq ? next_seg(bl->write_seg) : bl->write_seg;
+        const bool reader_caught_up = !has_unread(bl, bl->write_seg);
+
+        if (bl->segments[write_seg].seq)
+                drop_segment(bl, write_seg);
+
+        /* A caught up reader follows the writer into the new segment */
+        if (reader_caught_up && bl->read_seg == bl->write_seg) {
+                bl->read_seg = write_seg;
+                bl->read_offset = 0;
+        }
+
+        bl->write_seg = write_seg;
+        seg = bl->segments + write_seg;
+        seg->seq = ++bl->seq;
+        seg->first_tick = tick;
+
+        return seg_base(write_seg);
+}
+
+/**
+ * Commits the record started by #telemetry_backlog_begin_record.
+ * @param end The offset in the data file just past the record.
+ * @return The offset in the index file to store the record end at.
+ */
+uint32_t telemetry_backlog_end_record(struct telemetry_backlog *bl,
+                                      const uint32_t end)
+{
+        struct telemetry_backlog_segment *seg = bl->segments + bl->write_seg;
+        const uint32_t entry = bl->write_seg * TELEMETRY_BACKLOG_SEGMENT_RECORDS +
+                seg->records;
+
+        seg->used = end - seg_base(bl->write_seg);
+        ++seg->records;
+
+        /* Record ran past TELEMETRY_BACKLOG_RECORD_MAX into the next segment */
+        const size_t next = next_seg(bl->write_seg);
+        if (seg->used > TELEMETRY_BACKLOG_SEGMENT_SIZE && bl->segments[next].seq)
+                drop_segment(bl, next);
+
+        return entry * sizeof(backlog_index_entry_t);
+}
+
+/**
+ * Finds the next contiguous run of data for the reader.
+ * @param offset Set to the offset in the data file to read from.
+ * @param len Set to the amount of data available there.
+ * @return true if there is data to read, false otherwise.
+ */
+bool telemetry_backlog_next_read(struct telemetry_backlog *bl,
+                                 uint32_t *offset, uint32_t *len)
+{
+        for (size_t i = 0; i < TELEMETRY_BACKLOG_SEGMENTS; ++i) {
+                const struct telemetry_backlog_segment *seg =
+                        bl->segments + bl->read_seg;
+
+                if (bl->read_offset < seg->used) {
+                        *offset = seg_base(bl->read_seg) + bl->read_offset;
+                        *len = seg->used - bl->read_offset;
+                        return true;
+                }
+
+                if (bl->read_seg == bl->write_seg)
+                        break;
+
+                bl->read_seg = next_seg(bl->read_seg);
+                bl->read_offset = 0;
+        }
+
+        return false;
+}
+
+void telemetry_backlog_advance_read(struct telemetry_backlog *bl,
+                                    const uint32_t len)
+{
+        bl->read_offset += len;
+}
+
+/**
+ * Finds the index entry for the given tick.  Newer segments win since
+ * ticks start over when logging restarts.
+ * @param seg Set to the segment holding the tick.
+ * @param index_offset Set to the offset of its entry in the index file.
+ * @return true if the tick is still in the backlog, false otherwise.
+ */
+bool telemetry_backlog_find_tick(const struct telemetry_backlog *bl,
+                                 const uint32_t tick, size_t *seg,
+                                 uint32_t *index_offset)
+{
+        uint32_t best_seq = 0;
+
+        for (size_t i = 0; i < TELEMETRY_BACKLOG_SEGMENTS; ++i) {
+                const struct telemetry_backlog_segment *s = bl->segments + i;
+
+                if (s->seq <= best_seq || tick < s->first_tick ||
+                    tick - s->first_tick >= s->records)
+                        continue;
+
+                best_seq = s->seq;
+                *seg = i;
+                *index_offset = (i * TELEMETRY_BACKLOG_SEGMENT_RECORDS +
+                                 tick - s->first_tick) *
+                        sizeof(backlog_index_entry_t);
+        }
+
+        return best_seq != 0;
+}
+
+/**
+ * @return The number of bytes the reader has yet to send.
+ */
+uint32_t telemetry_backlog_pending(const struct telemetry_backlog *bl)
+{
+        uint32_t pending = 0;
+        size_t seg = bl->read_seg;
+
+        for (size_t i = 0; i < TELEMETRY_BACKLOG_SEGMENTS; ++i) {
+                const uint32_t used = bl->segments[seg].used;
+                const uint32_t start = seg == bl->read_seg ? bl->read_offset : 0;
+
+                if (used > start)
+                        pending += used - start;
+
+                if (seg == bl->write_seg)
+                        break;
+
+                seg = next_seg(seg);
+        }
+
+        return pending;
+}
+
+/**
+ * Appends a sample record to the backlog.  Caller must hold the fs lock.
+ */
+FRESULT telemetry_backlog_append(struct telemetry_backlog *bl,
+                                 const struct sample *sample,
+                                 const uint32_t tick, const bool send_meta)
+{
+        const uint32_t start = telemetry_backlog_begin_record(bl, tick);
+        FRESULT res = f_lseek(bl->data, start);
+        if (FR_OK != res)
+                return res;
+
+        fs_write_sample_record(bl->data, sample, tick, send_meta);
+
+        const backlog_index_entry_t end = f_tell(bl->data);
+        const uint32_t index_offset = telemetry_backlog_end_record(bl, end);
+        const backlog_index_entry_t entry = end - seg_base(bl->write_seg);
+
+        res = f_lseek(bl->index, index_offset);
+        if (FR_OK != res)
+                return res;
+
+        UINT written;
+        res = f_write(bl->index, &entry, sizeof(entry), &written);
+        if (FR_OK == res && written != sizeof(entry))
+                res = FR_DISK_ERR;
+
+        return res;
+}
+
+FRESULT telemetry_backlog_sync(struct telemetry_backlog *bl)
+{
+        const FRESULT res = f_sync(bl->data);
+        return FR_OK == res ? f_sync(bl->index) : res;
+}
+
+/**
+ * Reads the next block of backlog data.  The block never spans
+ * segments, so it may be shorter than len even if more is pending.
+ * Caller must hold the fs lock.
+ * @param read Set to the number of bytes read.  0 if nothing pending.
+ */
+FRESULT telemetry_backlog_read(struct telemetry_backlog *bl, char *buf,
+                               const size_t len, size_t *read)
+{
+        uint32_t offset;
+        uint32_t avail;
+
+        *read = 0;
+        if (!telemetry_backlog_next_read(bl, &offset, &avail))
+                return FR_OK;
+
+        FRESULT res = f_lseek(bl->data, offset);
+        if (FR_OK != res)
+                return res;
+
+        UINT br = 0;
+        res = f_read(bl->data, buf, MIN(avail, len), &br);
+        telemetry_backlog_advance_read(bl, br);
+        *read = br;
+
+        return res;
+}
+
+/**
+ * Moves the reader to just past the record with the given tick.
+ * Caller must hold the fs lock.
+ * @return true if the tick was found, false if it is no longer in the
+ * backlog (in which case the reader is left alone).
+ */
+bool telemetry_backlog_seek_tick(struct telemetry_backlog *bl,
+                                 const uint32_t tick)
+{
+        size_t seg;
+        uint32_t index_offset;
+
+        if (!telemetry_backlog_find_tick(bl, tick, &seg, &index_offset))
+                return false;
+
+        backlog_index_entry_t entry;
+        UINT br = 0;
+        if (FR_OK != f_lseek(bl->index, index_offset) ||
+            FR_OK != f_read(bl->index, &entry, sizeof(entry), &br) ||
+            br != sizeof(entry))
+                return false;
+
+        bl->read_seg = seg;
+        bl->read_offset = entry;
+        return true;
+}
@@ -22,6 +22,9 @@
 #include "ADC.h"
 #include "CAN.h"
 #include "CAN_aux_queue.h"
+#include "CAN_filters.h"
+#include "CAN_stats.h"
+#include "isotp.h"
 #include "FreeRTOS.h"
 #include "GPIO.h"
 #include "OBD2.h"
@@ -772,6 +775,9 @@ static int lua_rx_can_msg(lua_State *L)
                 can_bus = lua_tointeger(L, 1);
         }
 
+        /* Opens up the CAN filters the first time round */
+        CAN_filters_add_script_rx(can_bus);
+
         CAN_msg can_msg;
         if (!CAN_aux_queue_get_msg(can_bus, &can_msg, timeout))
                 return 0;
@@ -788,6 +794,91 @@ static int lua_rx_can_msg(lua_State *L)
         return 3;
 }
 
+/*
+ * Returns the frame rate, byte rate, total dropped frames and the receive
+ * and transmit error counters of a CAN bus, so a script can publish them
+ * as virtual channels.
+ */
+static int lua_get_can_stats(lua_State *L)
+{
+        lua_validate_args_count(L, 1, 1);
+        lua_validate_arg_number(L, 1);
+
+        const struct can_bus_stats *bs = CAN_stats_get_bus(lua_tointeger(L, 1));
+        if (!bs)
+                return 0;
+
+        uint32_t dropped = 0;
+        for (size_t i = 0; i < CAN_STATS_QUEUES; ++i)
+                dropped += bs->dropped[i];
+
+        lua_pushinteger(L, bs->frame_rate);
+        lua_pushinteger(L, bs->byte_rate);
+        lua_pushinteger(L, dropped);
+        lua_pushinteger(L, bs->rx_errors);
+        lua_pushinteger(L, bs->tx_errors);
+        return 5;
+}
+
+/*
+ * readIsoTp(bus, txId, rxId, ext, data, [timeout])
+ * Sends a single frame ISO-TP request and returns the whole response,
+ * reassembled from as many frames as the ECU sends, as a table of bytes.
+ * Returns nothing on timeout.
+ */
+static int lua_read_isotp(lua_State *L)
+{
+        /* too big for the Lua task stack */
+        static struct isotp_msg response;
+
+        lua_validate_args_count(L, 5, 6);
+
+        uint8_t request[CAN_MSG_SIZE];
+        size_t timeout = DEFAULT_CAN_TIMEOUT;
+
+        switch(lua_gettop(L)) {
+        default:
+                return lua_panic(L);
+        case 6:
+                lua_validate_arg_number(L, 6);
+                timeout = lua_tointeger(L, 6);
+        case 5:
+                lua_validate_arg_number(L, 1);
+                lua_validate_arg_number(L, 2);
+                lua_validate_arg_number(L, 3);
+                lua_validate_arg_number(L, 4);
+                lua_validate_arg_table(L, 5);
+        }
+
+        const size_t size = luaL_getn(L, 5);
+        if (size < 1 || size > CAN_MSG_SIZE - 1)
+                return luaL_error(L, "Request must be 1 to 7 bytes");
+
+        for (int i = 0; i < size; i++) {
+                lua_pushnumber(L, i + 1);
+                lua_gettable(L, 5);
+                request[i] = lua_tonumber(L, -1);
+                lua_pop(L, 1);
+        }
+
+        /* Lets the responses through the CAN filters from now on */
+        CAN_filters_add_script_isotp(lua_tointeger(L, 1), lua_tointeger(L, 3),
+                                     lua_tointeger(L, 4));
+
+        if (!isotp_request(lua_tointeger(L, 1), lua_tointeger(L, 2),
+                           lua_tointeger(L, 3), lua_tointeger(L, 4),
+                           request, size, &response, timeout))
+                return 0;
+
+        lua_newtable(L);
+        for (int i = 1; i <= response.length; i++) {
+                lua_pushnumber(L, i);
+                lua_pushnumber(L, response.data[i - 1]);
+                lua_rawset(L, -3);
+        }
+        return 1;
+}
+
 static int lua_obd2_read(lua_State *L)
 {
         lua_validate_args_count(L, 1, 2);
@@ -1325,6 +1416,7 @@ static int lua_sx_set_config(lua_State *L)
                 /* CAN bus */
                 lua_validate_arg_number(L, 3);
                 shiftx_config->can_bus = lua_tointeger(L, 3);
+                CAN_filters_stale();
         case 2:
                 /* ShiftX brightness (0 to 100; 0=automatic brightness)*/
                 lua_validate_arg_number(L, 2);
@@ -1433,6 +1525,8 @@ void registerLuaLoggerBindings(lua_State *L)
         lua_registerlight(L, "txCAN", lua_send_can_msg);
         lua_registerlight(L, "rxCAN", lua_rx_can_msg);
         lua_registerlight(L, "setCANfilter", lua_set_can_filter);
+        lua_registerlight(L, "getCANStats", lua_get_can_stats);
+        lua_registerlight(L, "readIsoTp", lua_read_isotp);
         lua_registerlight(L, "readOBD2", lua_obd2_read);
         lua_registerlight(L, "setOBD2Delay", lua_obd2_set_delay);
 
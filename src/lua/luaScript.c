@@ -19,6 +19,7 @@
  * this code. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "CAN_filters.h"
 #include "luaScript.h"
 #include "luaTask.h"
 #include "mem_mang.h"
@@ -166,6 +167,8 @@ enum script_add_result flashScriptPage(const unsigned int page,
         }
 
         pr_info("win!\r\n");
+        /* The new script registers its own CAN receivers as it runs */
+        CAN_filters_clear_script_rx();
         lua_task_start();
         return SCRIPT_ADD_RESULT_OK;
 }
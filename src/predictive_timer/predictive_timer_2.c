@@ -24,6 +24,9 @@
 #include "debug.h"
 #include "geopoint.h"
 #include "gps.h"
+#include "test.h"
+#include <float.h>
+#include <math.h>
 #include <string.h>
 #include "predictive_timer_2.h"
 
@@ -44,6 +47,20 @@
  */
 #define MIN_PREDICTED_TIME 10000
 
+/**
+ * Number of consecutive fast lap points covered by one entry of the
+ * segment index.  Used to skip whole stretches of track when we have
+ * to search for the closest point from scratch.
+ */
+#define PT_SEGMENT_SIZE 8
+#define PT_SEGMENT_COUNT ((PREDICTIVE_TIME_MAX_SAMPLES + PT_SEGMENT_SIZE - 1) / PT_SEGMENT_SIZE)
+
+/**
+ * How many sample spacings we may be away from the point the cursor
+ * settled on before we consider the cursor lost.
+ */
+#define PT_CURSOR_LOST_SPACINGS 2
+
 // A smaller TimeLoc value for space savings
 struct PtTimeLoc {
         GeoPoint point;
@@ -68,6 +85,20 @@ static int buffIndex;
 // Index to track high slot in fastLapTimer.  Its points to the next open slot there.
 static int fastLapIndex;
 
+// Bounding box of each PT_SEGMENT_SIZE run of points in the fastLap buffer.
+static struct PtSegment {
+        float minLat;
+        float maxLat;
+        float minLon;
+        float maxLon;
+} fastLapSegments[PT_SEGMENT_COUNT];
+
+// Longitude scale (cos of latitude) used for distance comparisons on the fast lap.
+static float fastLapLonScale;
+
+// Index of the last matched point in the fastLap buffer.  -1 if we have no idea.
+static int fastLapCursor = -1;
+
 // Time of the fast lap.
 static tiny_millis_t fastLapTime;
 
@@ -132,6 +163,67 @@ static bool insertTimeLocSample(const GeoPoint * point, tiny_millis_t time)
         return true;
 }
 
+/**
+ * Squared distance between two points on the fast lap.  Only useful for
+ * comparing distances against each other; the units are degrees squared.
+ */
+static float fastLapDist2(const GeoPoint *a, const GeoPoint *b)
+{
+        const float dLat = b->latitude - a->latitude;
+        const float dLon = (b->longitude - a->longitude) * fastLapLonScale;
+
+        return dLat * dLat + dLon * dLon;
+}
+
+/**
+ * Squared distance from a point to the bounding box of a segment.  This
+ * is a lower bound on the distance to any point within that segment.
+ */
+static float segmentDist2(const GeoPoint *p, const struct PtSegment *seg)
+{
+        float dLat = 0;
+        float dLon = 0;
+
+        if (p->latitude < seg->minLat)
+                dLat = seg->minLat - p->latitude;
+        else if (p->latitude > seg->maxLat)
+                dLat = p->latitude - seg->maxLat;
+
+        if (p->longitude < seg->minLon)
+                dLon = seg->minLon - p->longitude;
+        else if (p->longitude > seg->maxLon)
+                dLon = p->longitude - seg->maxLon;
+
+        dLon *= fastLapLonScale;
+        return dLat * dLat + dLon * dLon;
+}
+
+/**
+ * Builds the segment index over the fastLap buffer.  Done once per new
+ * fast lap so that lookups never have to do it.
+ */
+static void indexFastLap()
+{
+        fastLapLonScale = cosf(fastLap[0].point.latitude * ((float) M_PI / 180.0f));
+        fastLapCursor = -1;
+
+        for (int i = 0; i < fastLapIndex; ++i) {
+                const GeoPoint *p = &fastLap[i].point;
+                struct PtSegment *seg = fastLapSegments + i / PT_SEGMENT_SIZE;
+
+                if (i % PT_SEGMENT_SIZE == 0) {
+                        seg->minLat = seg->maxLat = p->latitude;
+                        seg->minLon = seg->maxLon = p->longitude;
+                        continue;
+                }
+
+                seg->minLat = fminf(seg->minLat, p->latitude);
+                seg->maxLat = fmaxf(seg->maxLat, p->latitude);
+                seg->minLon = fminf(seg->minLon, p->longitude);
+                seg->maxLon = fmaxf(seg->maxLon, p->longitude);
+        }
+}
+
 /**
  * Handles all the work done if a new hot Lap is set.
  * @param lapTime The time it took to complete the lap.
@@ -145,6 +237,8 @@ static void setNewFastLap(tiny_millis_t lapTime)
         fastLapIndex = buffIndex;
         fastLap = currLap;
         currLap = currLap == buff1 ? buff2 : buff1;
+
+        indexFastLap();
 }
 
 bool isPredictiveTimeAvailable()
@@ -229,6 +323,9 @@ void startLap(const GeoPoint *point, const tiny_millis_t time)
         lastPredictedTime = 0;
         buffIndex = 0;
 
+        // A new lap starts at the beginning of the fast lap.
+        fastLapCursor = isPredictiveTimeAvailable() ? 0 : -1;
+
         DEBUG("Starting new lap.  Status %d, buffIndex = %d, startTime = %ull\n",
               status, buffIndex, time);
 
@@ -295,34 +392,116 @@ static bool inBounds(float v)
 }
 
 /**
- * Finds the  closest point to the given point in the fastLap buffer.  Orders the output buffer
- * such that the lower time is always first.
+ * Walks the fastLap buffer from the given index towards the given point
+ * until we reach the closest point in that neighborhood.
+ * @param currPoint The current point of measurement.
+ * @param idx The index to start walking from.
+ * @param dist2 Output for the squared distance to the returned point.
+ * @return The index of the locally closest point.
+ */
+static int walkFastLapCursor(const GeoPoint *currPoint, int idx, float *dist2)
+{
+        float best = fastLapDist2(currPoint, &fastLap[idx].point);
+
+        // Forward first since that is the way we are usually moving.
+        while (idx + 1 < fastLapIndex) {
+                const float d = fastLapDist2(currPoint, &fastLap[idx + 1].point);
+                if (d >= best)
+                        break;
+
+                best = d;
+                ++idx;
+        }
+
+        while (idx > 0) {
+                const float d = fastLapDist2(currPoint, &fastLap[idx - 1].point);
+                if (d >= best)
+                        break;
+
+                best = d;
+                --idx;
+        }
+
+        *dist2 = best;
+        return idx;
+}
+
+/**
+ * Decides if the point the cursor settled on is believable.  If we are
+ * further away from it than a couple of sample spacings then we have
+ * likely jumped (GPS dropout, pit lane, etc) and need a full search.
+ */
+static bool isCursorLost(const int idx, const float dist2)
+{
+        const GeoPoint *p = &fastLap[idx].point;
+        float spacing2 = 0;
+
+        if (idx > 0)
+                spacing2 = fastLapDist2(p, &fastLap[idx - 1].point);
+        if (idx + 1 < fastLapIndex)
+                spacing2 = fmaxf(spacing2, fastLapDist2(p, &fastLap[idx + 1].point));
+
+        return dist2 > spacing2 * PT_CURSOR_LOST_SPACINGS * PT_CURSOR_LOST_SPACINGS;
+}
+
+/**
+ * Searches the whole fastLap buffer for the closest point using the
+ * segment index to skip segments that can't contain a better point.
+ */
+static int searchFastLap(const GeoPoint *currPoint)
+{
+        int bestIndex = 0;
+        float lowestDist2 = FLT_MAX;
+        const int segments = (fastLapIndex + PT_SEGMENT_SIZE - 1) / PT_SEGMENT_SIZE;
+
+        for (int s = 0; s < segments; ++s) {
+                if (segmentDist2(currPoint, fastLapSegments + s) >= lowestDist2)
+                        continue;
+
+                const int start = s * PT_SEGMENT_SIZE;
+                const int end = start + PT_SEGMENT_SIZE < fastLapIndex ?
+                        start + PT_SEGMENT_SIZE : fastLapIndex;
+
+                for (int i = start; i < end; ++i) {
+                        const float d = fastLapDist2(currPoint, &fastLap[i].point);
+                        if (d < lowestDist2) {
+                                lowestDist2 = d;
+                                bestIndex = i;
+                        }
+                }
+        }
+
+        return bestIndex;
+}
+
+/**
+ * Finds the  closest point to the given point in the fastLap buffer.  Starts from
+ * the last matched point and walks from there, only falling back to a search of
+ * the whole buffer when that point is no longer near us.
  * @param currPoint The current point of measurement.
  * @return The index of the closest point in the fastLap buffer to the current point, or -1 if
  * no closest point is available.
  */
-static int findClosestPt(const GeoPoint *currPoint)
+TESTABLE_STATIC int findClosestPt(const GeoPoint *currPoint)
 {
         if (!isPredictiveTimeAvailable())
                 return -1;
 
-        // First find the closest point.  Start with index 0 as your best.
-        int bestIndex = 0;
-        GeoPoint *fastLapPoint = &(fastLap[bestIndex].point);
-        float lowestDistance = distPythag(currPoint, fastLapPoint);
-
-        for (int i = 1; i < fastLapIndex; ++i) {
-                fastLapPoint = &(fastLap[i].point);
-                float distance = distPythag(currPoint, fastLapPoint);
+        if (fastLapCursor >= 0 && fastLapCursor < fastLapIndex) {
+                float dist2;
+                const int idx = walkFastLapCursor(currPoint, fastLapCursor, &dist2);
 
-                if (distance < lowestDistance) {
-                        lowestDistance = distance;
-                        bestIndex = i;
+                if (!isCursorLost(idx, dist2)) {
+                        DEVEL("Cursor moved from point %d to %d\n", fastLapCursor, idx);
+                        return fastLapCursor = idx;
                 }
+
+                DEBUG("Cursor lost at point %d.  Searching fast lap\n", idx);
         }
 
-        DEVEL("Smallest distance is %f from point %d\n", lowestDistance, bestIndex);
-        return bestIndex;
+        fastLapCursor = searchFastLap(currPoint);
+        DEVEL("Closest point is %d\n", fastLapCursor);
+        return fastLapCursor;
 }
 
 /**
@@ -464,6 +643,7 @@ void resetPredictiveTimer()
         status = DISABLED;
         buffIndex = 0;
         fastLapIndex = 0;
+        fastLapCursor = -1;
         fastLapTime = 0;
         lastPredictedTime = 0;
         lastPredictedDelta = 0;
@@ -32,6 +32,7 @@
 #include "diskio.h"
 #include "sdcard_device.h"
 #include "mem_mang.h"
+#include "sample_meta.h"
 #include "semphr.h"
 
 static FATFS *fat_fs = NULL;
@@ -273,6 +274,22 @@ void test_sd_interactive(struct Serial *serial, int lines, int doFlush, int quie
 static void fs_write_sample_meta(FIL *buffer_file, const struct sample *sample,
                                  int sampleRateLimit, char * buf, bool more)
 {
+        const struct sample_meta *meta = sample_meta_acquire(sample);
+        if (meta) {
+                UINT bw;
+                f_puts("\"meta\":", buffer_file);
+                f_write(buffer_file, meta->json, meta->len, &bw);
+                f_puts(",\"mh\":", buffer_file);
+                modp_uitoa10(meta->hash, buf);
+                f_puts(buf, buffer_file);
+                if (more)
+                        f_puts(",", buffer_file);
+
+                sample_meta_release();
+                return;
+        }
+
+        /* No cached copy.  Build it as we go */
         f_puts("\"meta\":[", buffer_file);
         ChannelSample *channel_sample = sample->channel_samples;
 
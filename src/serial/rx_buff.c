@@ -100,14 +100,9 @@ void rx_buff_destroy(struct rx_buff *rxb)
  */
 bool rx_buff_read(struct rx_buff *rxb, struct Serial *s, const bool echo)
 {
-        xQueueHandle h = serial_get_rx_queue(s);
-        if (!h)
-                return false;
-
         char c = INVALID_CHAR;
         while (rxb->idx < rxb->cap && !rxb->msg_ready) {
-                const bool rx_status = xQueueReceive(h, &c, 0);
-                if (!rx_status) {
+                if (1 != serial_read_c_wait(s, &c, 0)) {
                         /* If here, no more data to read for now */
                         return false;
                 }
@@ -170,8 +165,8 @@ bool rx_buff_read(struct rx_buff *rxb, struct Serial *s, const bool echo)
         }
 
         /* If there is a \n after the \r, remove it */
-        if ('\r' == c && xQueuePeek(h, &c, 0) && '\n' == c) {
-                xQueueReceive(h, &c, 0);
+        if ('\r' == c && serial_peek_c(s, &c) && '\n' == c) {
+                serial_read_c_wait(s, &c, 0);
                 if (rxb->echo)
                         serial_write_c(s, c);
         }
@@ -27,8 +27,11 @@
 #include "panic.h"
 #include "printk.h"
 #include "projdefs.h"
+#include "semphr.h"
 #include "serial.h"
+#include "spsc_ring_buff.h"
 #include "str_util.h"
+#include "task.h"
 #include "queue.h"
 #include "usart.h"
 #include "usb_comm.h"
@@ -37,18 +40,43 @@
 #include <stdio.h>
 #include <string.h>
 
-static const char invalid_char = INVALID_CHAR;
+#define SERIAL_BATCH_SIZE	256
 
 enum data_dir {
         DATA_DIR_RX,
         DATA_DIR_TX,
 };
 
+/*
+ * The tx and rx buffers are lock free single producer/single consumer
+ * rings.  The driver owns one end of each and the tasks using the device
+ * own the other.  Writers are serialized with tx_lock so that concurrent
+ * writers keep the single producer guarantee (and don't interleave their
+ * buffers).  A batch of writes only takes the lock to hand each chunk
+ * over; see #serial_batch_begin.  Tasks that need to block raise the
+ * matching waiting flag and then wait on the signal semaphore, which the
+ * driver gives only when it sees the flag.  This keeps the ISRs free of
+ * any queue operations in the common case.
+ */
 struct Serial {
         const char *name;
-        xQueueHandle tx_queue;
-        xQueueHandle rx_queue;
-        bool closed;
+        struct spsc_ring_buff *tx_buff;
+        struct spsc_ring_buff *rx_buff;
+        xSemaphoreHandle tx_lock;
+        xSemaphoreHandle tx_signal;
+        xSemaphoreHandle rx_signal;
+        bool tx_waiting;
+        bool rx_waiting;
+        volatile bool closed;
+
+        /*
+         * Write batching.  The batch is claimed and released while
+         * holding tx_lock; in between only batch_owner touches it.
+         */
+        xTaskHandle batch_owner;
+        size_t batch_depth;
+        size_t batch_len;
+        char *batch_buff;
 
         config_func_t *config_cb;
         void *config_cb_arg;
@@ -65,12 +93,17 @@ struct Serial {
 
 void serial_purge_rx_queue(struct Serial* s)
 {
-        xQueueReset(s->rx_queue);
+        spsc_ring_buff_clear(s->rx_buff);
 }
 
+/**
+ * Drops all data that the driver has not yet taken.  Note this is done
+ * from the producer side, so a driver with a transfer in flight will
+ * still finish sending the region it was handed.
+ */
 void serial_purge_tx_queue(struct Serial* s)
 {
-        xQueueReset(s->tx_queue);
+        spsc_ring_buff_clear(s->tx_buff);
 }
 
 /**
@@ -83,14 +116,64 @@ void serial_clear(struct Serial *s)
 }
 
 /**
- * Unblocks our Seral rx queue by putting an invalid character on the
- * front of the queue. This will unblock any task that is waiting on
- * the queue.  Its up to the rx handler below to ensure that we return
- * the correct status code.
+ * Gives the signal semaphore if, and only if, a task has said that it
+ * is waiting on it.
  */
-static void unblock_rx_queue(struct Serial *s)
+static void signal_waiter(xSemaphoreHandle signal, bool *waiting,
+                          portBASE_TYPE *woken)
 {
-        xQueueSendToFront(s->rx_queue, &invalid_char, 0);
+        if (!__atomic_exchange_n(waiting, false, __ATOMIC_SEQ_CST))
+                return;
+
+        if (woken)
+                xSemaphoreGiveFromISR(signal, woken);
+        else
+                xSemaphoreGive(signal);
+}
+
+/**
+ * Blocks until the driver signals that it has made progress on the
+ * buffer.  The waiting flag is raised before the final check of the
+ * buffer so that a signal can never be missed.
+ * @return true if there may be progress, false if we timed out.
+ */
+static bool wait_for_driver(xSemaphoreHandle signal, bool *waiting,
+                            const struct spsc_ring_buff *rb,
+                            size_t (*progress)(const struct spsc_ring_buff*),
+                            const size_t delay)
+{
+        __atomic_store_n(waiting, true, __ATOMIC_SEQ_CST);
+        if (progress(rb)) {
+                __atomic_store_n(waiting, false, __ATOMIC_SEQ_CST);
+                return true;
+        }
+
+        return pdTRUE == xSemaphoreTake(signal, delay);
+}
+
+static bool wait_rx_data(struct Serial *s, const size_t delay)
+{
+        return wait_for_driver(s->rx_signal, &s->rx_waiting, s->rx_buff,
+                               spsc_ring_buff_bytes_used, delay);
+}
+
+static bool wait_tx_space(struct Serial *s, const size_t delay)
+{
+        return wait_for_driver(s->tx_signal, &s->tx_waiting, s->tx_buff,
+                               spsc_ring_buff_bytes_free, delay);
+}
+
+/**
+ * Checks if the device has been closed.  If so the rx signal is passed
+ * on so that any other task waiting on the device will unblock as well.
+ */
+static bool rx_closed(struct Serial *s)
+{
+        if (!s->closed)
+                return false;
+
+        xSemaphoreGive(s->rx_signal);
+        return true;
 }
 
 /**
@@ -101,7 +184,10 @@ void serial_close(struct Serial* s)
 {
         s->closed = true;
         serial_clear(s);
-        unblock_rx_queue(s);
+
+        /* Unblock any task that is waiting on the device */
+        xSemaphoreGive(s->rx_signal);
+        xSemaphoreGive(s->tx_signal);
 }
 
 /**
@@ -119,8 +205,19 @@ void serial_reopen(struct Serial* s)
 
 void serial_destroy(struct Serial *s)
 {
-        vQueueDelete(s->tx_queue);
-        vQueueDelete(s->rx_queue);
+        if (s->tx_buff)
+                spsc_ring_buff_destroy(s->tx_buff);
+        if (s->rx_buff)
+                spsc_ring_buff_destroy(s->rx_buff);
+        if (s->tx_lock)
+                vQueueDelete(s->tx_lock);
+        if (s->tx_signal)
+                vQueueDelete(s->tx_signal);
+        if (s->rx_signal)
+                vQueueDelete(s->rx_signal);
+        if (s->batch_buff)
+                portFree(s->batch_buff);
+
         portFree(s);
 }
 
@@ -141,13 +238,15 @@ struct Serial* serial_create(const char *name, const size_t tx_cap,
         s->post_tx_cb = post_tx_cb;
         s->post_tx_cb_arg = post_tx_cb_arg;
 
-        const unsigned portBASE_TYPE c_size =
-                (unsigned portBASE_TYPE) sizeof(signed portCHAR);
-        s->tx_queue = xQueueCreate(tx_cap, c_size);
-        s->rx_queue = xQueueCreate(rx_cap, c_size);
+        s->tx_buff = spsc_ring_buff_create(tx_cap);
+        s->rx_buff = spsc_ring_buff_create(rx_cap);
+        s->tx_lock = xSemaphoreCreateMutex();
+        s->tx_signal = xSemaphoreCreateBinary();
+        s->rx_signal = xSemaphoreCreateBinary();
 
         /* If one of these is NULL, then alloc failure.  Handle */
-        if (!s->tx_queue || !s->rx_queue) {
+        if (!s->tx_buff || !s->rx_buff || !s->tx_lock ||
+            !s->tx_signal || !s->rx_signal) {
                 serial_destroy(s);
                 return NULL;
         }
@@ -232,9 +331,6 @@ static void _log(struct Serial *s,
                  const enum data_dir dir,
                  const char data)
 {
-        if (SERIAL_LOG_TYPE_NONE == s->log_type)
-                return;
-
         log_header_if_necessary(s, dir);
         size_t* cntr = NULL;
         switch (dir) {
@@ -259,14 +355,24 @@ static void _log(struct Serial *s,
         }
 }
 
-static void log_rx(struct Serial *s, const char data)
+static void log_buff(struct Serial *s, const enum data_dir dir,
+                     const char *data, const size_t len)
+{
+        if (SERIAL_LOG_TYPE_NONE == s->log_type)
+                return;
+
+        for (size_t i = 0; i < len; ++i)
+                _log(s, dir, data[i]);
+}
+
+static void log_rx(struct Serial *s, const char *data, const size_t len)
 {
-        _log(s, DATA_DIR_RX, data);
+        log_buff(s, DATA_DIR_RX, data, len);
 }
 
-static void log_tx(struct Serial *s, const char data)
+static void log_tx(struct Serial *s, const char *data, const size_t len)
 {
-        _log(s, DATA_DIR_TX, data);
+        log_buff(s, DATA_DIR_TX, data, len);
 }
 
 enum serial_log_type serial_logging(struct Serial *s,
@@ -313,23 +419,45 @@ void serial_flush(struct Serial *s)
         /* STIEG: TODO Figure out how to flush Tx sanely */
 }
 
-int serial_read_c_wait(struct Serial *s, char *c, const size_t delay)
+/**
+ * Looks at the next received character without consuming it.
+ * @return 1 if there was a character to look at, 0 otherwise.
+ */
+int serial_peek_c(struct Serial *s, char *c)
 {
-        if (s->closed)
-                return -1;
+        return spsc_ring_buff_peek(s->rx_buff, c, 1);
+}
 
-        if (pdFALSE == xQueueReceive(s->rx_queue, c, delay))
-                return 0;
+/**
+ * Reads whatever data is available from a serial device, up to len
+ * bytes, in one pass.  Only blocks if there is no data available.
+ * @param s The Serial device to read from.
+ * @param buf The buffer to put the data into.
+ * @param len The length of the buffer.
+ * @param delay The number of ticks to wait for data to arrive.
+ * @return Number of characters read, 0 if we timed out or -1 if the
+ * device is closed.
+ */
+int serial_read_buff_wait(struct Serial *s, char *buf, const size_t len,
+                          const size_t delay)
+{
+        while (!rx_closed(s)) {
+                const size_t read = spsc_ring_buff_get(s->rx_buff, buf, len);
+                if (read || !len) {
+                        log_rx(s, buf, read);
+                        return read;
+                }
 
-        /* Check & handle closure of serial device here */
-        if (*c == invalid_char && s->closed) {
-                /* Unblock the queue for other waiting tasks */
-                unblock_rx_queue(s);
-                return -1;
+                if (!wait_rx_data(s, delay))
+                        return 0;
         }
 
-        log_rx(s, *c);
-        return 1;
+        return -1;
+}
+
+int serial_read_c_wait(struct Serial *s, char *c, const size_t delay)
+{
+        return serial_read_buff_wait(s, c, 1, delay);
 }
 
 int serial_read_c(struct Serial *s, char* c)
@@ -350,21 +478,35 @@ int serial_read_c(struct Serial *s, char* c)
 int serial_read_line_wait(struct Serial *s, char *buff, const size_t len,
                           const size_t delay)
 {
-        int i = 0;
-        for (; i < len; ++i) {
-                switch(serial_read_c_wait(s, buff + i, delay)) {
-                default:
-                        panic(PANIC_CAUSE_UNREACHABLE);
-                        break;
-                case -1:
+        size_t i = 0;
+        while (i < len) {
+                if (rx_closed(s))
                         /* If partially read, return what was read. */
                         return i == 0 ? -1 : i;
-                case 0:
-                        return i;
-                case 1:
-                        if ('\n' == buff[i])
-                                return ++i;
+
+                size_t avail;
+                const char *data =
+                        spsc_ring_buff_dma_read_init(s->rx_buff, &avail);
+                if (!avail) {
+                        if (!wait_rx_data(s, delay))
+                                return i;
+
+                        continue;
                 }
+
+                /* Take everything up to and including the newline */
+                size_t chunk = MIN(avail, len - i);
+                const char *nl = memchr(data, '\n', chunk);
+                if (nl)
+                        chunk = nl - data + 1;
+
+                memcpy(buff + i, data, chunk);
+                spsc_ring_buff_dma_read_fini(s->rx_buff, chunk);
+                log_rx(s, buff + i, chunk);
+                i += chunk;
+
+                if (nl)
+                        break;
         }
 
         return i;
@@ -375,51 +517,203 @@ int serial_read_line(struct Serial *s, char *l, const size_t len)
         return serial_read_line_wait(s, l, len, portMAX_DELAY);
 }
 
+static void kick_tx(struct Serial *s)
+{
+        if (s->post_tx_cb)
+                s->post_tx_cb(s, s->post_tx_cb_arg);
+}
+
 int serial_write_c_wait(struct Serial *s, const char c, const size_t delay)
 {
+        return serial_write_buff_wait(s, &c, 1, delay);
+}
+
+int serial_write_c(struct Serial *s, const char c)
+{
+        return serial_write_c_wait(s, c, portMAX_DELAY);
+}
+
+/**
+ * Copies data into the tx buffer in bulk and kicks the driver once it
+ * is all in.  If the buffer fills up first then the driver is kicked
+ * with what we have and we wait for it to make room.  Caller must hold
+ * tx_lock.
+ */
+static int write_locked(struct Serial *s, const char *buf, const size_t len,
+                        const size_t delay)
+{
+        size_t sent = 0;
+        size_t unkicked = 0;
+        while (!s->closed) {
+                const size_t wrote = spsc_ring_buff_write(s->tx_buff,
+                                                          buf + sent,
+                                                          len - sent);
+                log_tx(s, buf + sent, wrote);
+                sent += wrote;
+                unkicked += wrote;
+
+                if (sent == len)
+                        break;
+
+                /* Full.  Get the driver draining before we wait on it */
+                if (unkicked) {
+                        kick_tx(s);
+                        unkicked = 0;
+                }
+
+                if (!wait_tx_space(s, delay))
+                        break;
+        }
+
+        /* Handle case where closing the device unblocked us */
         if (s->closed)
-                return -1;
+                /* If partially sent, then return what was sent. */
+                return sent == 0 ? -1 : sent;
 
-        if (pdFALSE == xQueueSend(s->tx_queue, &c, delay))
-                return 0;
+        if (unkicked)
+                kick_tx(s);
+
+        return sent;
+}
+
+static bool is_batch_owner(const struct Serial *s)
+{
+        return s->batch_depth &&
+                s->batch_owner == xTaskGetCurrentTaskHandle();
+}
 
-        /* Handle case where closing queue unblocks xQueueSend */
+/**
+ * Writes out what has been collected in the batch buffer.  Anything
+ * that could not be written stays at the front of the buffer.  Only
+ * the flush holds tx_lock, so other writers are not held up while the
+ * batch owner does anything else.
+ */
+static void batch_flush(struct Serial *s, const size_t delay)
+{
+        if (!s->batch_len)
+                return;
+
+        if (pdTRUE != xSemaphoreTake(s->tx_lock, delay))
+                return;
+
+        const int wrote = write_locked(s, s->batch_buff, s->batch_len, delay);
+        xSemaphoreGive(s->tx_lock);
+        if (wrote < 0) {
+                /* Closed.  Nowhere for the data to go */
+                s->batch_len = 0;
+                return;
+        }
+
+        s->batch_len -= wrote;
+        memmove(s->batch_buff, s->batch_buff + wrote, s->batch_len);
+}
+
+static int batch_write(struct Serial *s, const char *buf, const size_t len,
+                       const size_t delay)
+{
         if (s->closed)
                 return -1;
 
-        log_tx(s, c);
+        if (len > SERIAL_BATCH_SIZE - s->batch_len)
+                batch_flush(s, delay);
 
-        if (s->post_tx_cb)
-                s->post_tx_cb(s->tx_queue, s->post_tx_cb_arg);
+        /* Too big to be worth collecting.  Send it along directly */
+        if (len > SERIAL_BATCH_SIZE - s->batch_len) {
+                if (s->batch_len ||
+                    pdTRUE != xSemaphoreTake(s->tx_lock, delay))
+                        return 0;
+
+                const int res = write_locked(s, buf, len, delay);
+                xSemaphoreGive(s->tx_lock);
+                return res;
+        }
 
-        return 1;
+        memcpy(s->batch_buff + s->batch_len, buf, len);
+        s->batch_len += len;
+        return len;
 }
 
-int serial_write_c(struct Serial *s, const char c)
+/**
+ * Starts a batch of writes on a serial device.  Until the matching
+ * #serial_batch_end, writes from the calling task are collected into
+ * a scratch buffer owned by the device and handed to the tx buffer in
+ * large chunks instead of one small write at a time.  tx_lock is only
+ * held while a chunk is handed over, so writes from other tasks go out
+ * between chunks rather than waiting for the batch to end.  One task
+ * batches at a time; another task starting a batch while one is open
+ * writes straight through.  Batches may nest; only the outermost end
+ * flushes.
+ */
+void serial_batch_begin(struct Serial *s)
 {
-        return serial_write_c_wait(s, c, portMAX_DELAY);
+        if (is_batch_owner(s)) {
+                ++s->batch_depth;
+                return;
+        }
+
+        xSemaphoreTake(s->tx_lock, portMAX_DELAY);
+
+        if (!s->batch_buff)
+                s->batch_buff = portMalloc(SERIAL_BATCH_SIZE);
+
+        /* No scratch buffer just means we write straight through */
+        if (s->batch_buff && !s->batch_depth) {
+                s->batch_owner = xTaskGetCurrentTaskHandle();
+                s->batch_depth = 1;
+        }
+
+        xSemaphoreGive(s->tx_lock);
+}
+
+/**
+ * Ends a batch started by #serial_batch_begin, flushing the collected
+ * data when the outermost batch ends.
+ */
+void serial_batch_end(struct Serial *s)
+{
+        if (!is_batch_owner(s))
+                return;
+
+        if (s->batch_depth > 1) {
+                --s->batch_depth;
+                return;
+        }
+
+        /* Still ours until released, so no other task claims it mid flush */
+        batch_flush(s, portMAX_DELAY);
+
+        xSemaphoreTake(s->tx_lock, portMAX_DELAY);
+        s->batch_len = 0;
+        s->batch_depth = 0;
+        s->batch_owner = NULL;
+        xSemaphoreGive(s->tx_lock);
 }
 
+/**
+ * Writes a buffer to a serial device.
+ * @param s The Serial device to write to.
+ * @param buf The data to write.
+ * @param len The length of the data.
+ * @param delay The number of ticks to wait for room in the buffer.
+ * @return Number of characters written, or -1 if the device is closed
+ * and nothing was written.
+ */
 int serial_write_buff_wait(struct Serial *s, const char *buf, const size_t len,
                            const size_t delay)
 {
-        int i = 0;
-        for (; i < len; ++i) {
-                switch(serial_write_c_wait(s, buf[i], delay)) {
-                default:
-                        panic(PANIC_CAUSE_UNREACHABLE);
-                        break;
-                case -1:
-                        /* If partially sent, then return what was sent. */
-                        return i == 0 ? -1 : i;
-                case 0:
-                        return i;
-                case 1:
-                        break;
-                }
-        }
+        if (s->closed)
+                return -1;
 
-        return i;
+        /* Our own batch takes tx_lock only when it flushes */
+        if (is_batch_owner(s))
+                return batch_write(s, buf, len, delay);
+
+        if (pdTRUE != xSemaphoreTake(s->tx_lock, delay))
+                return 0;
+
+        const int res = write_locked(s, buf, len, delay);
+        xSemaphoreGive(s->tx_lock);
+        return res;
 }
 
 int serial_write_buff(struct Serial *s, const char *buf, const size_t len)
@@ -442,14 +736,68 @@ int serial_read_byte(struct Serial *serial, uint8_t *b, const size_t delay)
         return serial_read_c_wait(serial, (char*) b, delay);
 }
 
-xQueueHandle serial_get_rx_queue(struct Serial *s)
+/**
+ * Puts received data into the rx buffer.  Called by the driver.
+ * @return The amount of data that fit.  Anything beyond that is dropped.
+ */
+size_t serial_rx_put(struct Serial *s, const void *data, const size_t len,
+                     portBASE_TYPE *woken)
+{
+        const size_t put = spsc_ring_buff_write(s->rx_buff, data, len);
+        if (put)
+                signal_waiter(s->rx_signal, &s->rx_waiting, woken);
+
+        return put;
+}
+
+/**
+ * Takes up to len bytes of pending data out of the tx buffer.  Called
+ * by the driver.
+ * @return The amount of data taken.
+ */
+size_t serial_tx_get(struct Serial *s, void *data, const size_t len,
+                     portBASE_TYPE *woken)
+{
+        const size_t got = spsc_ring_buff_get(s->tx_buff, data, len);
+        if (got)
+                signal_waiter(s->tx_signal, &s->tx_waiting, woken);
+
+        return got;
+}
+
+/**
+ * @return The amount of data waiting to be sent.
+ */
+size_t serial_tx_pending(const struct Serial *s)
+{
+        return spsc_ring_buff_bytes_used(s->tx_buff);
+}
+
+/**
+ * Exposes the contiguous run of pending tx data so that the driver can
+ * hand it straight to DMA (or its own buffers) without copying it out
+ * byte by byte.  Release it with #serial_tx_dma_read_fini once sent.
+ * @param avail Set to the number of bytes available at the pointer.
+ * @return Where the pending data starts.
+ */
+const void* serial_tx_dma_read_init(struct Serial *s, size_t *avail)
 {
-        return s->rx_queue;
+        return spsc_ring_buff_dma_read_init(s->tx_buff, avail);
 }
 
-xQueueHandle serial_get_tx_queue(struct Serial *s)
+/**
+ * Releases tx data that was sent after #serial_tx_dma_read_init.
+ */
+void serial_tx_dma_read_fini(struct Serial *s, size_t read,
+                             portBASE_TYPE *woken)
 {
-        return s->tx_queue;
+        /* A purge may have dropped the region out from under us */
+        read = MIN(read, spsc_ring_buff_bytes_used(s->tx_buff));
+        if (!read)
+                return;
+
+        spsc_ring_buff_dma_read_fini(s->tx_buff, read);
+        signal_waiter(s->tx_signal, &s->tx_waiting, woken);
 }
 
 void serial_set_name(struct Serial *s, const char *name)
@@ -724,64 +1072,61 @@ void put_nameIndexString(struct Serial *serial, const char *s, int i, const char
         serial_write_s(serial, "\";");
 }
 
-void put_escapedString(struct Serial * serial, const char *v, int length)
+/**
+ * Writes a string with the escapes our legacy protocol needs.  Runs of
+ * characters that need no escaping are written in a single call.
+ */
+static void put_escaped(struct Serial *serial, const char *v, int length,
+                        const bool escape_space)
 {
+        const char *run = v;
         const char *value = v;
-        while (value - v < length) {
+        for (; value - v < length; ++value) {
+                const char *esc;
                 switch(*value) {
+                case ' ':
+                        if (!escape_space)
+                                continue;
+                        esc = "\\_";
+                        break;
                 case '\n':
-                        serial_write_s(serial, "\\n");
+                        esc = "\\n";
                         break;
                 case '\r':
-                        serial_write_s(serial, "\\r");
+                        esc = "\\r";
                         break;
                 case '"':
-                        serial_write_s(serial, "\\\"");
+                        esc = "\\\"";
                         break;
                 default:
-                        serial_write_c(serial, *value);
-                        break;
+                        continue;
                 }
-                value++;
+
+                serial_write_buff(serial, run, value - run);
+                serial_write_s(serial, esc);
+                run = value + 1;
         }
+
+        serial_write_buff(serial, run, value - run);
+}
+
+void put_escapedString(struct Serial * serial, const char *v, int length)
+{
+        put_escaped(serial, v, length, false);
 }
 
 void put_nameEscapedString(struct Serial *serial, const char *s, const char *v, int length)
 {
         serial_write_s(serial, s);
         serial_write_s(serial, "=\"");
-        const char *value = v;
-        while (value - v < length) {
-                switch(*value) {
-                case ' ':
-                        serial_write_s(serial, "\\_");
-                        break;
-                case '\n':
-                        serial_write_s(serial, "\\n");
-                        break;
-                case '\r':
-                        serial_write_s(serial, "\\r");
-                        break;
-                case '"':
-                        serial_write_s(serial, "\\\"");
-                        break;
-                default:
-                        serial_write_c(serial, *value);
-                        break;
-                }
-                value++;
-        }
+        put_escaped(serial, v, length, true);
         serial_write_s(serial, "\";");
 }
 
 
 void put_bytes(struct Serial *serial, char *data, unsigned int length)
 {
-        while (length > 0) {
-                serial_write_c(serial, *data);
-                data++;
-                length--;
-        }
+        serial_write_buff(serial, data, length);
 }
 
 void put_crlf(struct Serial *serial)
@@ -130,6 +130,7 @@ struct wifi_sample_data {
         struct Serial* serial;
         const struct sample* sample;
         size_t tick;
+        enum sample_holder holder;
 };
 
 struct wifi_camera_control {
@@ -217,6 +218,11 @@ static void wifi_sample_cb(const struct sample* sample,
 {
         struct Serial* const serial = data;
 
+        /* Not registered yet, so we can't hold the sample */
+        const struct connection* conn = find_connection(serial);
+        if (!conn || conn->ls_handle < 0)
+                return;
+
         /*
          * Gotta malloc a small buff b/c stuff to send. We will free this
          * in the event handler below.
@@ -225,6 +231,7 @@ static void wifi_sample_cb(const struct sample* sample,
                 .serial = serial,
                 .sample = sample,
                 .tick = tick,
+                .holder = SAMPLE_HOLDER_CALLBACK + conn->ls_handle,
         };
 
         struct wifi_event event = {
@@ -232,8 +239,13 @@ static void wifi_sample_cb(const struct sample* sample,
                 .data.sample = data_sample,
         };
 
+        /* The logger needs the buffer more than we do */
+        if (!sample_hold(sample, data_sample.holder))
+                return;
+
         /* Send the message here to wake the timer */
-        send_event(&event, "Sample CB", false);
+        if (!send_event(&event, "Sample CB", false))
+                sample_release(sample, data_sample.holder, tick);
 }
 
 void wifi_trigger_camera(bool enabled, uint8_t make_model)
@@ -681,9 +693,13 @@ static void process_sample(struct wifi_sample_data* data)
 
         /* Only try to send if our Serial device is connected */
         if (serial_is_connected(serial)) {
+                serial_batch_begin(serial);
                 api_send_sample_record(serial, sample, ticks, meta);
                 put_crlf(serial);
+                serial_batch_end(serial);
         }
+
+        sample_release(sample, data->holder, ticks);
 }
 
 static void process_wifi_api_event(struct wifi_api_event * data)
@@ -56,8 +56,10 @@ int flash_default_tracks(void)
         return status;
 }
 
-int flash_tracks(const Tracks *source, size_t rawSize)
+int flash_tracks(Tracks *source, size_t rawSize)
 {
+        tracks_build_index(source);
+
         int result = memory_flash_region((void *)&g_tracks, (void *)source, rawSize);
         if (result == 0) pr_info("win\r\n");
         else pr_info("fail\r\n");
@@ -187,3 +189,52 @@ int areGeoPointsEqual(const GeoPoint a, const GeoPoint b)
 {
         return a.latitude == b.latitude && a.longitude == b.longitude;
 }
+
+static float start_latitude(const Tracks *tracks, const size_t pos)
+{
+        const GeoPoint p = getStartPoint(tracks->tracks + tracks->index.order[pos]);
+        return p.latitude;
+}
+
+void tracks_build_index(Tracks *tracks)
+{
+        struct track_index *index = &tracks->index;
+        const size_t count = tracks->count < MAX_TRACK_COUNT ?
+                tracks->count : MAX_TRACK_COUNT;
+
+        /* Insertion sort.  Only done when flashing so keep it simple */
+        for (size_t i = 0; i < count; ++i) {
+                const float lat = getStartPoint(tracks->tracks + i).latitude;
+                size_t pos = i;
+
+                for (; pos > 0 && start_latitude(tracks, pos - 1) > lat; --pos)
+                        index->order[pos] = index->order[pos - 1];
+
+                index->order[pos] = i;
+        }
+
+        index->count = count;
+}
+
+bool tracks_index_valid(const Tracks *tracks)
+{
+        return tracks->index.count == tracks->count &&
+                tracks->count <= MAX_TRACK_COUNT;
+}
+
+size_t tracks_index_lower_bound(const Tracks *tracks, const float latitude)
+{
+        size_t lo = 0;
+        size_t hi = tracks->index.count;
+
+        while (lo < hi) {
+                const size_t mid = lo + (hi - lo) / 2;
+
+                if (start_latitude(tracks, mid) < latitude)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+
+        return lo;
+}
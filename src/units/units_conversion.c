@@ -21,126 +21,52 @@
 
 #include "units_conversion.h"
 
-static float no_conversion(float value)
-{
-        return value;
-}
-static float c_to_f(float value)
-{
-        return  value * 1.8f + 32;
-}
-
-static float f_to_c(float value)
-{
-        return (value - 32) * 0.555555556f;
-}
-
-static float bar_to_psi(float value)
-{
-        return value * 14.5037738f;
-}
-
-static float psi_to_bar(float value)
-{
-        return value * 0.0689475729f;
-}
-
-static float kph_to_mph(float value)
-{
-        return value * 0.6213711922f;
-}
-
-static float mph_to_kph(float value)
-{
-        return value * 1.609344f;
-}
-
-static float km_to_mi(float value)
-{
-        return value * 0.6213711922f;
-}
-
-static float mi_to_km(float value)
-{
-        return value * 1.609344f;
-}
-
-static float mm_to_inch(float value)
-{
-        return value * 0.0393700787f;
-}
-
-static float inch_to_mm(float value)
-{
-        return value * 25.4f;
-}
-
-static float l_to_gal(float value)
-{
-        return value * 0.2641720524f;
-}
-
-static float gal_to_l(float value)
-{
-        return value * 3.785411784f;
-}
-
-static float kg_to_lb(float value)
-{
-        return value * 2.2046226218f;
-}
-
-static float lb_to_kg(float value)
-{
-        return value * 0.45359237f;
-}
-
-static float nm_to_lbft(float value)
-{
-        return value * 0.7375621493f;
-}
+/*
+ * Every supported conversion is linear, so each one is described by a
+ * scale and offset.  This lets callers fold a conversion into their own
+ * scaling ahead of time.
+ */
+struct units_affine {
+        float scale;
+        float offset;
+};
 
-static float lbft_to_nm(float value)
-{
-        return value * 1.3558179483f;
-}
+static const struct units_affine units_converter[UNITS_CONVERSION_COUNT] = {
+        /* no conversion */ {1.0f, 0.0f},
+        /* c_to_f */        {1.8f, 32.0f},
+        /* f_to_c */        {0.555555556f, -17.777777778f},
+        /* bar_to_psi */    {14.5037738f, 0.0f},
+        /* psi_to_bar */    {0.0689475729f, 0.0f},
+        /* kph_to_mph */    {0.6213711922f, 0.0f},
+        /* mph_to_kph */    {1.609344f, 0.0f},
+        /* km_to_mi */      {0.6213711922f, 0.0f},
+        /* mi_to_km */      {1.609344f, 0.0f},
+        /* mm_to_inch */    {0.0393700787f, 0.0f},
+        /* inch_to_mm */    {25.4f, 0.0f},
+        /* l_to_gal */      {0.2641720524f, 0.0f},
+        /* gal_to_l */      {3.785411784f, 0.0f},
+        /* kg_to_lb */      {2.2046226218f, 0.0f},
+        /* lb_to_kg */      {0.45359237f, 0.0f},
+        /* nm_to_lbft */    {0.7375621493f, 0.0f},
+        /* lbft_to_nm */    {1.3558179483f, 0.0f},
+        /* w_to_hp */       {0.0013410221f, 0.0f},
+        /* hp_to_w */       {745.69987158f, 0.0f},
+};
 
-static float w_to_hp(float value)
+void units_conversion_affine(enum unit_conversions id, float *scale,
+                             float *offset)
 {
-        return value * 0.0013410221f;
-}
+        if (id >= UNITS_CONVERSION_COUNT)
+                id = UNIT_CONVERSION_NONE;
 
-static float hp_to_w(float value)
-{
-        return value * 745.69987158f;
+        *scale = units_converter[id].scale;
+        *offset = units_converter[id].offset;
 }
 
-static float(*units_converter[UNITS_CONVERSION_COUNT]) (float value) = {
-        no_conversion,
-        c_to_f,
-        f_to_c,
-        bar_to_psi,
-        psi_to_bar,
-        kph_to_mph,
-        mph_to_kph,
-        km_to_mi,
-        mi_to_km,
-        mm_to_inch,
-        inch_to_mm,
-        l_to_gal,
-        gal_to_l,
-        kg_to_lb,
-        lb_to_kg,
-        nm_to_lbft,
-        lbft_to_nm,
-        w_to_hp,
-        hp_to_w
-};
-
 float convert_units(enum unit_conversions id, const float value)
 {
         if (id >= UNITS_CONVERSION_COUNT )
                 return value;
 
-        return (*units_converter[id]) (value);
+        return value * units_converter[id].scale + units_converter[id].offset;
 }
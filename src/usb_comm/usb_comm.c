@@ -61,6 +61,7 @@ static void log_event_overflow(const char* event_name)
 struct usb_sample_data {
         const struct sample* sample;
         size_t tick;
+        enum sample_holder holder;
 };
 
 /**
@@ -93,9 +94,14 @@ static bool data_rx_isr_cb()
 static void usb_sample_cb(const struct sample* sample,
                           const int tick, void* data)
 {
+        /* Not registered yet, so we can't hold the sample */
+        if (usb_state.ls_handle < 0)
+                return;
+
         const struct usb_sample_data sample_data = {
                 .sample = sample,
                 .tick = tick,
+                .holder = SAMPLE_HOLDER_CALLBACK + usb_state.ls_handle,
         };
 
         struct usb_event event = {
@@ -103,9 +109,15 @@ static void usb_sample_cb(const struct sample* sample,
                 .data.sample = sample_data,
         };
 
+        /* The logger needs the buffer more than we do */
+        if (!sample_hold(sample, sample_data.holder))
+                return;
+
         /* Send the message here to wake the timer */
-        if (!xQueueSend(usb_state.event_queue, &event, 0))
+        if (!xQueueSend(usb_state.event_queue, &event, 0)) {
+                sample_release(sample, sample_data.holder, tick);
                 log_event_overflow("Sample CB");
+        }
 }
 
 static void usb_api_event_cb(const struct api_event *api_event, void* data)
@@ -222,8 +234,11 @@ static void process_sample(struct usb_sample_data* data)
                 return;
         }
 
+        serial_batch_begin(serial);
         api_send_sample_record(serial, sample, ticks, meta);
         put_crlf(serial);
+        serial_batch_end(serial);
+        sample_release(sample, data->holder, ticks);
 }
 
 static void process_usb_api_event(const struct api_event *event)
@@ -0,0 +1,59 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "arena.h"
+
+void arena_init(struct arena *a, void *buff, const size_t size)
+{
+        /* Trim the front so that every allocation ends up aligned */
+        const size_t pad = -(uintptr_t) buff & (ARENA_ALIGN - 1);
+
+        a->buff = (uint8_t *) buff + pad;
+        a->size = size > pad ? size - pad : 0;
+        a->used = 0;
+}
+
+void arena_reset(struct arena *a)
+{
+        a->used = 0;
+}
+
+void* arena_alloc(struct arena *a, const size_t size)
+{
+        const size_t aligned = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+        if (0 == size || aligned > arena_bytes_free(a))
+                return NULL;
+
+        void *ptr = a->buff + a->used;
+        a->used += aligned;
+        return ptr;
+}
+
+size_t arena_bytes_used(const struct arena *a)
+{
+        return a->used;
+}
+
+size_t arena_bytes_free(const struct arena *a)
+{
+        return a->size - a->used;
+}
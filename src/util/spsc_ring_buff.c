@@ -0,0 +1,252 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * A lock free variant of our ring_buff for the case where exactly one
+ * task (or ISR) puts data in and exactly one task (or ISR) takes data
+ * out.  The producer only ever moves the head and the consumer only
+ * ever moves the tail, so each index has a single writer.  The index
+ * stores use release semantics and the loads of the other side's index
+ * use acquire semantics so the data copies can never be observed out
+ * of order with the index updates.
+ *
+ * Unlike ring_buffer_put, writes never clobber old data since that
+ * would require the producer to move the tail.
+ */
+
+#include "macros.h"
+#include "mem_mang.h"
+#include "spsc_ring_buff.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+struct spsc_ring_buff {
+        char *buff;
+        size_t size;
+        size_t head;
+        size_t tail;
+};
+
+static size_t load_index(const size_t *idx)
+{
+        return __atomic_load_n(idx, __ATOMIC_ACQUIRE);
+}
+
+static void store_index(size_t *idx, const size_t val)
+{
+        __atomic_store_n(idx, val, __ATOMIC_RELEASE);
+}
+
+static size_t advance(const struct spsc_ring_buff *rb, const size_t idx,
+                      const size_t offset)
+{
+        return (idx + offset) % rb->size;
+}
+
+static size_t used_between(const struct spsc_ring_buff *rb,
+                           const size_t head, const size_t tail)
+{
+        return head >= tail ? head - tail : rb->size - tail + head;
+}
+
+void spsc_ring_buff_destroy(struct spsc_ring_buff *rb)
+{
+        if (rb->buff)
+                portFree(rb->buff);
+
+        portFree(rb);
+}
+
+/**
+ * Creates a new lock free ring buffer.
+ * @param cap The capacity of the ring buffer.  Note that this method
+ * will always allocate 1 extra byte to tell full from empty.
+ * @return An opaque pointer to the ring buffer struct.
+ */
+struct spsc_ring_buff* spsc_ring_buff_create(const size_t cap)
+{
+        struct spsc_ring_buff *rb = portMalloc(sizeof(struct spsc_ring_buff));
+        if (!rb)
+                return NULL;
+
+        rb->size = cap + 1;
+        rb->buff = portMalloc(rb->size);
+        if (!rb->buff) {
+                spsc_ring_buff_destroy(rb);
+                return NULL;
+        }
+
+        rb->head = rb->tail = 0;
+        return rb;
+}
+
+size_t spsc_ring_buff_capacity(const struct spsc_ring_buff *rb)
+{
+        return rb->size - 1;
+}
+
+size_t spsc_ring_buff_bytes_used(const struct spsc_ring_buff *rb)
+{
+        return used_between(rb, load_index(&rb->head), load_index(&rb->tail));
+}
+
+size_t spsc_ring_buff_bytes_free(const struct spsc_ring_buff *rb)
+{
+        return spsc_ring_buff_capacity(rb) - spsc_ring_buff_bytes_used(rb);
+}
+
+/**
+ * Removes all data from the buffer.  Must be called from the consumer
+ * since it works by moving the tail up to the head.
+ */
+void spsc_ring_buff_clear(struct spsc_ring_buff *rb)
+{
+        store_index(&rb->tail, load_index(&rb->head));
+}
+
+/**
+ * Exposes the contiguous free space at the head of the buffer so the
+ * producer can fill it directly (DMA, a driver FIFO, etc).  Report how
+ * much was filled with #spsc_ring_buff_dma_write_fini.
+ * @param avail Set to how many bytes may be written at the pointer.
+ * @return Where to start writing.
+ */
+void* spsc_ring_buff_dma_write_init(struct spsc_ring_buff *rb,
+                                    size_t *avail)
+{
+        const size_t head = rb->head;
+        const size_t tail = load_index(&rb->tail);
+        const size_t space = spsc_ring_buff_capacity(rb) -
+                used_between(rb, head, tail);
+
+        *avail = MIN(space, rb->size - head);
+        return rb->buff + head;
+}
+
+/**
+ * Publishes data written after #spsc_ring_buff_dma_write_init to the
+ * consumer.
+ */
+void spsc_ring_buff_dma_write_fini(struct spsc_ring_buff *rb,
+                                   const size_t written)
+{
+        store_index(&rb->head, advance(rb, rb->head, written));
+}
+
+/**
+ * Writes as much of the data as there is free space for.  Never
+ * clobbers data the consumer has not taken yet.
+ * @param data The data to put into the buffer.
+ * @param size The amount of data to put in from the buffer.
+ * @return The amount of data actually written to the buffer.
+ */
+size_t spsc_ring_buff_write(struct spsc_ring_buff *rb, const void *data,
+                            size_t size)
+{
+        const char *ptr = data;
+        size_t written = 0;
+
+        /* At most two passes; one before the wrap and one after */
+        while (written < size) {
+                size_t avail;
+                void *dst = spsc_ring_buff_dma_write_init(rb, &avail);
+                if (!avail)
+                        break;
+
+                const size_t len = MIN(avail, size - written);
+                memcpy(dst, ptr + written, len);
+                spsc_ring_buff_dma_write_fini(rb, len);
+                written += len;
+        }
+
+        return written;
+}
+
+/**
+ * Exposes the contiguous data at the tail of the buffer so the
+ * consumer can use it in place.  Works like #ring_buffer_dma_read_init.
+ * @param avail Set to how many bytes may be read at the pointer.
+ * @return Where to start reading.
+ */
+const void* spsc_ring_buff_dma_read_init(struct spsc_ring_buff *rb,
+                                         size_t *avail)
+{
+        const size_t head = load_index(&rb->head);
+        const size_t tail = rb->tail;
+
+        *avail = MIN(used_between(rb, head, tail), rb->size - tail);
+        return rb->buff + tail;
+}
+
+/**
+ * Releases data consumed after #spsc_ring_buff_dma_read_init back to
+ * the producer.
+ */
+void spsc_ring_buff_dma_read_fini(struct spsc_ring_buff *rb,
+                                  const size_t read)
+{
+        store_index(&rb->tail, advance(rb, rb->tail, read));
+}
+
+/**
+ * Copies up to size bytes out of the buffer without consuming them.
+ * @param buff Where to copy the data.  If NULL, nothing is copied but
+ * the amount that would have been is returned.
+ * @return The amount of data that was (or would have been) copied.
+ */
+size_t spsc_ring_buff_peek(const struct spsc_ring_buff *rb, void *buff,
+                           size_t size)
+{
+        const size_t head = load_index(&rb->head);
+        const size_t tail = rb->tail;
+        const size_t used = used_between(rb, head, tail);
+
+        if (used < size)
+                size = used;
+
+        if (!buff)
+                return size;
+
+        const size_t dist = rb->size - tail;
+        if (size <= dist) {
+                memcpy(buff, rb->buff + tail, size);
+        } else {
+                memcpy(buff, rb->buff + tail, dist);
+                memcpy((char *) buff + dist, rb->buff, size - dist);
+        }
+
+        return size;
+}
+
+/**
+ * Takes up to size bytes out of the buffer.
+ * @param buff Where to copy the data.  If NULL, the data is simply
+ * discarded from the buffer.
+ * @return The amount of data taken out of the buffer.
+ */
+size_t spsc_ring_buff_get(struct spsc_ring_buff *rb, void *buff,
+                          size_t size)
+{
+        const size_t bytes = spsc_ring_buff_peek(rb, buff, size);
+        spsc_ring_buff_dma_read_fini(rb, bytes);
+        return bytes;
+}
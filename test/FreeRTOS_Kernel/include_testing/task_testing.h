@@ -23,6 +23,7 @@
 
 #include "FreeRTOS.h"
 #include "cpp_guard.h"
+#include "task.h"
 
 CPP_GUARD_BEGIN
 
@@ -32,6 +33,9 @@ void reset_ticks( void );
 
 void increment_tick( void );
 
+/* Sets the handle xTaskGetCurrentTaskHandle() returns; NULL to start */
+void set_current_task(xTaskHandle task);
+
 CPP_GUARD_END
 
 #endif /* _TASK_TESTING_H_ */
@@ -56,6 +56,17 @@ FRESULT f_write (
         return FR_OK;
 }
 
+FRESULT f_read (
+        FIL* fp,		/* Pointer to the file object */
+        void* buff,		/* Pointer to data buffer */
+        UINT btr,		/* Number of bytes to read */
+        UINT* br		/* Pointer to number of bytes read */
+)
+{
+        *br = 0;
+        return FR_OK;
+}
+
 FRESULT f_lseek (
         FIL* fp,		/* Pointer to the file object */
         DWORD ofs		/* File pointer from top of file */
@@ -78,3 +89,24 @@ FRESULT f_truncate (FIL* fp )
         return FR_OK;
 }
 
+
+FRESULT f_opendir (DIR* dp, const TCHAR* path)
+{
+        return FR_OK;
+}
+
+FRESULT f_closedir (DIR* dp)
+{
+        return FR_OK;
+}
+
+FRESULT f_readdir (DIR* dp, FILINFO* fno)
+{
+        fno->fname[0] = '\0';
+        return FR_OK;
+}
+
+FRESULT f_mkdir (const TCHAR* path)
+{
+        return FR_OK;
+}
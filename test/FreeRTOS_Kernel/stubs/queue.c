@@ -29,25 +29,57 @@
 
 struct mock_queue {
         size_t item_size;
+        size_t length;
+        size_t count;
         struct ring_buff *rb;
 };
 
+#define MOCK_MUTEX	((xQueueHandle) 1)
+
 /*
  * Note that xQueueGenericSend and xQueueGenericReceive are also used for
- * mutexes.  We know this because the pvBuffer value will be NULL.  In that
- * case just return true for now to indicate that we have acquired the
- * mutex.  We may have to implement actual mutex capabilities in the future,
- * lets do that when its actually needed.
+ * mutexes and semaphores.  We know this because the pvBuffer value will be
+ * NULL.  Mutexes always succeed for now to indicate that we have acquired
+ * the mutex.  Semaphores keep a count so that a take without a matching
+ * give fails like it would after timing out on the target, since nothing
+ * here ever blocks.
  */
+static signed portBASE_TYPE semaphore_give(struct mock_queue *mc)
+{
+        /* Some tests never create the semaphores they use */
+        if (!mc)
+                return true;
+
+        if (mc->count >= mc->length)
+                return false;
+
+        ++mc->count;
+        return true;
+}
+
+static signed portBASE_TYPE semaphore_take(struct mock_queue *mc)
+{
+        if (!mc)
+                return true;
+
+        if (!mc->count)
+                return false;
+
+        --mc->count;
+        return true;
+}
 
 signed portBASE_TYPE xQueueGenericSend(xQueueHandle pxQueue,
                                        const void * const pvBuffer,
                                        portTickType xTicksToWait,
                                        portBASE_TYPE xCopyPosition )
 {
-        if (!pvBuffer)
+        if (MOCK_MUTEX == pxQueue)
                 return true;
 
+        if (!pvBuffer)
+                return semaphore_give(pxQueue);
+
 
         struct mock_queue *mc = pxQueue;
         return !!ring_buffer_write(mc->rb, pvBuffer, mc->item_size);
@@ -58,15 +90,21 @@ signed portBASE_TYPE xQueueGenericReceive(
         const pvBuffer, portTickType xTicksToWait,
         portBASE_TYPE xJustPeeking )
 {
-        if (!pvBuffer)
+        if (MOCK_MUTEX == pxQueue)
                 return true;
 
+        if (!pvBuffer)
+                return semaphore_take(pxQueue);
+
         struct mock_queue *mc = pxQueue;
         return !!ring_buffer_get(mc->rb, pvBuffer, mc->item_size);
 }
 
 void vQueueDelete(xQueueHandle pxQueue)
 {
+        if (MOCK_MUTEX == pxQueue)
+                return;
+
         struct mock_queue *mc = pxQueue;
         ring_buffer_destroy(mc->rb);
         portFree(mc);
@@ -77,6 +115,8 @@ xQueueHandle xQueueCreate(unsigned portBASE_TYPE uxQueueLength,
 {
         struct mock_queue *mc = portMalloc(sizeof(struct mock_queue));
         mc->item_size = (size_t) uxItemSize;
+        mc->length = (size_t) uxQueueLength;
+        mc->count = 0;
         mc->rb = ring_buffer_create(uxQueueLength * uxItemSize);
         return mc;
 }
@@ -84,7 +124,18 @@ xQueueHandle xQueueCreate(unsigned portBASE_TYPE uxQueueLength,
 xQueueHandle xQueueCreateMutex()
 {
         /* Can't return NULL b/c failure checks.  Wing it */
-        return (xQueueHandle) 1;
+        return MOCK_MUTEX;
+}
+
+portBASE_TYPE xQueueTakeMutexRecursive(xQueueHandle xMutex,
+                                       portTickType xBlockTime)
+{
+        return pdTRUE;
+}
+
+portBASE_TYPE xQueueGiveMutexRecursive(xQueueHandle xMutex)
+{
+        return pdTRUE;
 }
 
 signed portBASE_TYPE xQueueGenericSendFromISR(xQueueHandle pxQueue,
@@ -92,6 +143,9 @@ signed portBASE_TYPE xQueueGenericSendFromISR(xQueueHandle pxQueue,
                 signed portBASE_TYPE *pxHigherPriorityTaskWoken,
                 portBASE_TYPE xCopyPosition)
 {
+        if (!pvItemToQueue && MOCK_MUTEX != pxQueue)
+                return semaphore_give(pxQueue);
+
         return pdTRUE;
 }
 
@@ -26,6 +26,7 @@
 #include <unistd.h>
 
 static portTickType ticks;
+static xTaskHandle current_task;
 
 portTickType xTaskGetTickCount()
 {
@@ -47,6 +48,16 @@ void increment_tick()
         ticks++;
 }
 
+void set_current_task(xTaskHandle task)
+{
+        current_task = task;
+}
+
+xTaskHandle xTaskGetCurrentTaskHandle(void)
+{
+        return current_task;
+}
+
 void vTaskDelay(portTickType xTicksToDelay)
 {
         usleep((useconds_t)xTicksToDelay * 1000);
@@ -56,3 +56,23 @@ void JsmnTest::encodeWriteStringTest()
                              string(mock_getTxBuffer()));
 
 }
+
+void JsmnTest::resumeNoMemTest()
+{
+        char buff[] = "{\"a\":[1,2,3],\"b\":true}";
+        jsmntok_t tok[8];
+        jsmn_parser parser;
+
+        jsmn_init(&parser);
+        CPPUNIT_ASSERT_EQUAL(JSMN_ERROR_NOMEM,
+                             jsmn_parse(&parser, buff, tok, 4));
+
+        /* Same tokens, more room */
+        CPPUNIT_ASSERT_EQUAL(JSMN_SUCCESS,
+                             jsmn_parse(&parser, buff, tok, ARRAY_LEN(tok)));
+        CPPUNIT_ASSERT_EQUAL(8, (int) parser.toknext);
+        CPPUNIT_ASSERT_EQUAL(4, tok[0].size);
+        CPPUNIT_ASSERT_EQUAL(3, tok[2].size);
+        CPPUNIT_ASSERT_EQUAL(string("true"),
+                             string(jsmn_trimData(&tok[7])->data));
+}
@@ -29,11 +29,13 @@ class JsmnTest : public CppUnit::TestFixture
 	CPPUNIT_TEST_SUITE( JsmnTest );
 	CPPUNIT_TEST( decodeStringTest );
 	CPPUNIT_TEST( encodeWriteStringTest );
+	CPPUNIT_TEST( resumeNoMemTest );
 	CPPUNIT_TEST_SUITE_END();
 
 public:
 	void decodeStringTest();
 	void encodeWriteStringTest();
+	void resumeNoMemTest();
 };
 
 #endif /* _JSMNTEST_H_ */
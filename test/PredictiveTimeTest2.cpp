@@ -14,6 +14,7 @@
 #include "mock_serial.h"
 #include "predictive_timer_2.h"
 #include "rcp_cpp_unit.hh"
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -107,6 +108,70 @@ void PredictiveTimeTest2::testProjectedDistance()
         CPPUNIT_ASSERT_CLOSE_ENOUGH(expected, actual);
 }
 
+#define CIRCLE_POINTS 80
+#define CIRCLE_RADIUS 0.005f
+
+static GeoPoint circlePoint(float pos, float radius)
+{
+        const float rad = pos * 2 * (float) M_PI / CIRCLE_POINTS;
+        GeoPoint p = {
+                .latitude = 47.8f + radius * sinf(rad),
+                .longitude = -122.3f + radius * cosf(rad),
+        };
+
+        return p;
+}
+
+static int closestPtBruteForce(const GeoPoint *p)
+{
+        int best = 0;
+        for (int i = 1; i < CIRCLE_POINTS; ++i) {
+                const GeoPoint a = circlePoint(i, CIRCLE_RADIUS);
+                const GeoPoint b = circlePoint(best, CIRCLE_RADIUS);
+                if (distPythag(p, &a) < distPythag(p, &b))
+                        best = i;
+        }
+
+        return best;
+}
+
+void PredictiveTimeTest2::testClosestPointCursor()
+{
+        GpsSnapshot snap;
+        memset(&snap, 0, sizeof(snap));
+        snap.sample.quality = GPS_QUALITY_3D;
+        snap.sample.DOP = 1;
+
+        CPPUNIT_ASSERT_EQUAL(-1, findClosestPt(&snap.sample.point));
+
+        GeoPoint start = circlePoint(0, CIRCLE_RADIUS);
+        startLap(&start, 0);
+        for (int i = 1; i < CIRCLE_POINTS; ++i) {
+                snap.sample.point = circlePoint(i, CIRCLE_RADIUS);
+                snap.deltaFirstFix = i * 5000;
+                CPPUNIT_ASSERT(addGpsSample(&snap));
+        }
+        snap.sample.point = circlePoint(CIRCLE_POINTS - 0.5f, CIRCLE_RADIUS);
+        snap.deltaFirstFix = CIRCLE_POINTS * 5000;
+        finishLap(&snap);
+        CPPUNIT_ASSERT(isPredictiveTimeAvailable());
+
+        startLap(&start, 0);
+
+        /* Drive around slightly off the racing line */
+        for (int i = 0; i < (CIRCLE_POINTS - 1) * 4; ++i) {
+                const GeoPoint p = circlePoint(i / 4.0f, CIRCLE_RADIUS * 1.02f);
+                CPPUNIT_ASSERT_EQUAL(closestPtBruteForce(&p), findClosestPt(&p));
+        }
+
+        /* Jump to the other side of the track.  Cursor must recover */
+        GeoPoint p = circlePoint(CIRCLE_POINTS / 2 + 0.2f, CIRCLE_RADIUS);
+        CPPUNIT_ASSERT_EQUAL(CIRCLE_POINTS / 2, findClosestPt(&p));
+
+        p = circlePoint(10.4f, CIRCLE_RADIUS * 0.98f);
+        CPPUNIT_ASSERT_EQUAL(10, findClosestPt(&p));
+}
+
 void PredictiveTimeTest2::testPredictedTimeGpsFeed()
 {
         string log = readFile("predictive_time_test_lap.log");
@@ -34,12 +34,14 @@ using std::vector;
 
 //// HACK.  Exposing the testing methods here
 //float distPctBtwnTwoPoints(GeoPoint *s, GeoPoint *e, GeoPoint *m);
+extern "C" int findClosestPt(const GeoPoint *currPoint);
 
 class PredictiveTimeTest2 : public CppUnit::TestFixture
 {
         CPPUNIT_TEST_SUITE( PredictiveTimeTest2 );
         //	CPPUNIT_TEST( testPredictedTimeGpsFeed );
         CPPUNIT_TEST( testProjectedDistance );
+        CPPUNIT_TEST( testClosestPointCursor );
         CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -48,6 +50,7 @@ public:
         void tearDown();
         void testPredictedTimeGpsFeed();
         void testProjectedDistance();
+        void testClosestPointCursor();
 
 private:
         string readFile(string filename);
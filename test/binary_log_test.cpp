@@ -0,0 +1,143 @@
+/**
+ * Race Capture Pro Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture Pro fimrware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "binary_log.h"
+#include "binary_log_test.hh"
+#include "loggerConfig.h"
+#include "sample_fixture.h"
+#include <string.h>
+
+#define TEST_CHANNELS	10
+
+CPPUNIT_TEST_SUITE_REGISTRATION( BinaryLogTest );
+
+static ChannelConfig cfgs[TEST_CHANNELS];
+static ChannelSample samples[TEST_CHANNELS];
+static struct sample s;
+
+void BinaryLogTest::setUp()
+{
+        setup_test_sample(&s, samples, cfgs, TEST_CHANNELS);
+}
+
+void BinaryLogTest::tearDown() {}
+
+void BinaryLogTest::testTypes()
+{
+        ChannelSample cs;
+
+        cs.sampleData = SampleData_Int_Noarg;
+        CPPUNIT_ASSERT_EQUAL(BINARY_LOG_TYPE_INT32, binary_log_get_type(&cs));
+        cs.sampleData = SampleData_LongLong;
+        CPPUNIT_ASSERT_EQUAL(BINARY_LOG_TYPE_INT64, binary_log_get_type(&cs));
+        cs.sampleData = SampleData_Float_Noarg;
+        CPPUNIT_ASSERT_EQUAL(BINARY_LOG_TYPE_FLOAT, binary_log_get_type(&cs));
+        cs.sampleData = SampleData_Double;
+        CPPUNIT_ASSERT_EQUAL(BINARY_LOG_TYPE_DOUBLE, binary_log_get_type(&cs));
+
+        CPPUNIT_ASSERT_EQUAL((size_t) 4, binary_log_type_size(BINARY_LOG_TYPE_INT32));
+        CPPUNIT_ASSERT_EQUAL((size_t) 8, binary_log_type_size(BINARY_LOG_TYPE_INT64));
+        CPPUNIT_ASSERT_EQUAL((size_t) 4, binary_log_type_size(BINARY_LOG_TYPE_FLOAT));
+        CPPUNIT_ASSERT_EQUAL((size_t) 8, binary_log_type_size(BINARY_LOG_TYPE_DOUBLE));
+}
+
+void BinaryLogTest::testRecordSize()
+{
+        /* marker + 2 mask bytes + 10 floats */
+        CPPUNIT_ASSERT_EQUAL((size_t) 2, binary_log_mask_len(&s));
+        CPPUNIT_ASSERT_EQUAL((size_t) 43, binary_log_record_size(&s));
+
+        samples[0].sampleData = SampleData_LongLong_Noarg;
+        samples[1].sampleData = SampleData_Double;
+        CPPUNIT_ASSERT_EQUAL((size_t) 51, binary_log_record_size(&s));
+}
+
+void BinaryLogTest::testHeader()
+{
+        struct binary_log_header hdr;
+
+        CPPUNIT_ASSERT(binary_log_init_header(&hdr, &s));
+        CPPUNIT_ASSERT_EQUAL(0, memcmp(hdr.magic, BINARY_LOG_MAGIC,
+                                       BINARY_LOG_MAGIC_LEN));
+        CPPUNIT_ASSERT_EQUAL((uint8_t) BINARY_LOG_VERSION, hdr.version);
+        CPPUNIT_ASSERT_EQUAL((uint16_t) TEST_CHANNELS, hdr.channel_count);
+        CPPUNIT_ASSERT_EQUAL((uint16_t) 43, hdr.record_size);
+        CPPUNIT_ASSERT_EQUAL((size_t) 10, sizeof(hdr));
+}
+
+void BinaryLogTest::testHeaderTooManyChannels()
+{
+        struct binary_log_header hdr;
+
+        s.channel_count = BINARY_LOG_MAX_CHANNELS + 1;
+        CPPUNIT_ASSERT(!binary_log_init_header(&hdr, &s));
+}
+
+void BinaryLogTest::testChannel()
+{
+        struct binary_log_channel ch;
+
+        strcpy(cfgs[3].label, "RPM");
+        strcpy(cfgs[3].units, "rpm");
+        cfgs[3].min = 0;
+        cfgs[3].max = 8000;
+        cfgs[3].precision = 0;
+        cfgs[3].sampleRate = SAMPLE_50Hz;
+        samples[3].sampleData = SampleData_Int;
+
+        binary_log_init_channel(&ch, samples + 3);
+        CPPUNIT_ASSERT_EQUAL(std::string("RPM"), std::string(ch.label));
+        CPPUNIT_ASSERT_EQUAL(std::string("rpm"), std::string(ch.units));
+        CPPUNIT_ASSERT_EQUAL(0.0f, ch.min);
+        CPPUNIT_ASSERT_EQUAL(8000.0f, ch.max);
+        CPPUNIT_ASSERT_EQUAL((uint16_t) 50, ch.sample_rate);
+        CPPUNIT_ASSERT_EQUAL((uint8_t) 0, ch.precision);
+        CPPUNIT_ASSERT_EQUAL((uint8_t) BINARY_LOG_TYPE_INT32, ch.type);
+}
+
+void BinaryLogTest::testPopulatedMask()
+{
+        uint8_t mask[BINARY_LOG_MAX_MASK_LEN];
+
+        samples[0].populated = true;
+        samples[7].populated = true;
+        samples[9].populated = true;
+
+        CPPUNIT_ASSERT_EQUAL((size_t) 2, binary_log_populated_mask(&s, mask));
+        CPPUNIT_ASSERT_EQUAL((uint8_t) 0x81, mask[0]);
+        CPPUNIT_ASSERT_EQUAL((uint8_t) 0x02, mask[1]);
+}
+
+void BinaryLogTest::testValuePtr()
+{
+        samples[0].sampleData = SampleData_Int;
+        samples[0].valueInt = -42;
+        samples[1].sampleData = SampleData_Double;
+        samples[1].valueDouble = 1.5;
+
+        int i;
+        memcpy(&i, binary_log_value_ptr(samples), sizeof(i));
+        CPPUNIT_ASSERT_EQUAL(-42, i);
+
+        double d;
+        memcpy(&d, binary_log_value_ptr(samples + 1), sizeof(d));
+        CPPUNIT_ASSERT_EQUAL(1.5, d);
+}
@@ -0,0 +1,52 @@
+/**
+ * Race Capture Pro Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture Pro fimrware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BINARY_LOG_TEST_H_
+#define _BINARY_LOG_TEST_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class BinaryLogTest : public CppUnit::TestFixture
+{
+        CPPUNIT_TEST_SUITE( BinaryLogTest );
+        CPPUNIT_TEST( testTypes );
+        CPPUNIT_TEST( testRecordSize );
+        CPPUNIT_TEST( testHeader );
+        CPPUNIT_TEST( testHeaderTooManyChannels );
+        CPPUNIT_TEST( testChannel );
+        CPPUNIT_TEST( testPopulatedMask );
+        CPPUNIT_TEST( testValuePtr );
+        CPPUNIT_TEST_SUITE_END();
+
+public:
+        void setUp();
+        void tearDown();
+
+        void testTypes();
+        void testRecordSize();
+        void testHeader();
+        void testHeaderTooManyChannels();
+        void testChannel();
+        void testPopulatedMask();
+        void testValuePtr();
+};
+
+#endif /* _BINARY_LOG_TEST_H_ */
@@ -0,0 +1,234 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CAN_filters.h"
+#include "can_filters_test.h"
+#include "loggerConfig.h"
+#include "shiftx_drv.h"
+#include <cppunit/extensions/HelperMacros.h>
+#include <string.h>
+
+CPPUNIT_TEST_SUITE_REGISTRATION( CANFiltersTest );
+
+static bool accepts(const struct CAN_filter_plan *plan, uint32_t id,
+                    bool extended)
+{
+        CAN_msg msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.addressValue = id;
+        msg.isExtendedAddress = extended;
+        return CAN_filter_plan_accepts(plan, &msg);
+}
+
+void CANFiltersTest::plan_exact_test(void)
+{
+        struct CAN_filter_plan plan;
+        CAN_filter_plan_init(&plan);
+
+        CAN_filter_plan_add(&plan, 0x123, 0);
+        CAN_filter_plan_add(&plan, 0x18DAF110, 0);
+        CAN_filter_plan_add(&plan, 0x400, 0x700);
+        /* already covered by the masked filters */
+        CAN_filter_plan_add(&plan, 0x412, 0);
+
+        /* Small IDs also get the filters for extended frames */
+        CPPUNIT_ASSERT_EQUAL(5, (int) plan.count);
+        CPPUNIT_ASSERT(accepts(&plan, 0x123, false));
+        CPPUNIT_ASSERT(accepts(&plan, 0x123, true));
+        CPPUNIT_ASSERT(!accepts(&plan, 0x124, false));
+        CPPUNIT_ASSERT(!accepts(&plan, 0x800, true));
+        CPPUNIT_ASSERT(accepts(&plan, 0x18DAF110, true));
+        CPPUNIT_ASSERT(!accepts(&plan, 0x18DAF111, true));
+        CPPUNIT_ASSERT(accepts(&plan, 0x4FF, false));
+        CPPUNIT_ASSERT(!accepts(&plan, 0x500, false));
+
+        /* IDs known to be extended only get the extended filter */
+        CAN_filter_plan_init(&plan);
+        CAN_filter_plan_add_extended(&plan, 0x123, 0);
+        CPPUNIT_ASSERT_EQUAL(1, (int) plan.count);
+        CPPUNIT_ASSERT(accepts(&plan, 0x123, true));
+        CPPUNIT_ASSERT(!accepts(&plan, 0x123, false));
+        CPPUNIT_ASSERT(!accepts(&plan, 0x124, true));
+
+        CAN_filter_plan_accept_all(&plan);
+        CPPUNIT_ASSERT(accepts(&plan, 0x500, false));
+}
+
+void CANFiltersTest::plan_merge_test(void)
+{
+        struct CAN_filter_plan plan;
+        CAN_filter_plan_init(&plan);
+
+        /* More IDs than banks; neighbours get merged */
+        for (uint32_t i = 0; i < 3 * CAN_FILTER_BANKS; ++i)
+                CAN_filter_plan_add(&plan, 0x200 + i * 4, 0);
+
+        CPPUNIT_ASSERT(!plan.accept_all);
+        CPPUNIT_ASSERT(plan.count <= CAN_FILTER_BANKS);
+        for (uint32_t i = 0; i < 3 * CAN_FILTER_BANKS; ++i)
+                CPPUNIT_ASSERT(accepts(&plan, 0x200 + i * 4, false));
+
+        /* still selective */
+        CPPUNIT_ASSERT(!accepts(&plan, 0x600, false));
+}
+
+void CANFiltersTest::plan_range_test(void)
+{
+        struct CAN_filter_plan plan;
+        CAN_filter_plan_init(&plan);
+
+        CAN_filter_plan_add_range(&plan, 0x100, 0x10F);
+        CPPUNIT_ASSERT(accepts(&plan, 0x100, false));
+        CPPUNIT_ASSERT(accepts(&plan, 0x10F, false));
+        CPPUNIT_ASSERT(!accepts(&plan, 0x110, false));
+        CPPUNIT_ASSERT(accepts(&plan, 0x105, true));
+        CPPUNIT_ASSERT(!accepts(&plan, 0x110, true));
+
+        /* spans standard and extended IDs */
+        CAN_filter_plan_init(&plan);
+        CAN_filter_plan_add_range(&plan, 0x7F0, 0x900);
+        CPPUNIT_ASSERT(accepts(&plan, 0x7F5, false));
+        CPPUNIT_ASSERT(accepts(&plan, 0x850, true));
+        CPPUNIT_ASSERT(!accepts(&plan, 0x100, false));
+}
+
+void CANFiltersTest::build_test(void)
+{
+        static LoggerConfig lc;
+        struct CAN_filter_plan plans[CAN_CHANNELS];
+
+        memset(&lc, 0, sizeof(lc));
+        lc.can_channel_cfg.enabled = 1;
+        lc.can_channel_cfg.enabled_mappings = 2;
+        lc.can_channel_cfg.can_channels[0].mapping.can_channel = 0;
+        lc.can_channel_cfg.can_channels[0].mapping.can_id = 0x5F0;
+        lc.can_channel_cfg.can_channels[1].mapping.can_channel = 0;
+        lc.can_channel_cfg.can_channels[1].mapping.can_id = 0x360;
+
+        lc.OBD2Configs.enabled = 1;
+        lc.OBD2Configs.enabledPids = 1;
+        lc.OBD2Configs.pids[0].mapping.can_channel = 0;
+        lc.OBD2Configs.pids[0].mapping.can_id = 0x7E8;
+
+        CAN_filters_build(plans, &lc);
+        CPPUNIT_ASSERT(!plans[0].accept_all);
+        CPPUNIT_ASSERT(accepts(plans, 0x5F0, false));
+        CPPUNIT_ASSERT(accepts(plans, 0x360, false));
+        CPPUNIT_ASSERT(accepts(plans, 0x7E8, false));
+        CPPUNIT_ASSERT(accepts(plans, 0x7E8, true));
+        CPPUNIT_ASSERT(!accepts(plans, 0x361, false));
+
+        /* Nothing to listen for on the second bus, so take it all */
+        CPPUNIT_ASSERT(plans[1].accept_all);
+
+        /* Once the ShiftX is in use, its bus only takes its messages */
+        shiftx_update_config();
+        CPPUNIT_ASSERT(CAN_filters_is_stale());
+        CAN_filters_build(plans, &lc);
+        CPPUNIT_ASSERT(!plans[1].accept_all);
+        CPPUNIT_ASSERT(accepts(plans + 1, 0xE3600, true));
+        CPPUNIT_ASSERT(!accepts(plans + 1, 0x5F0, false));
+
+        /* a wildcard mapping needs everything on its bus */
+        lc.can_channel_cfg.can_channels[1].mapping.can_id = 0;
+        CAN_filters_build(plans, &lc);
+        CPPUNIT_ASSERT(plans[0].accept_all);
+}
+
+void CANFiltersTest::script_rx_test(void)
+{
+        static LoggerConfig lc;
+        struct CAN_filter_plan plans[CAN_CHANNELS];
+
+        memset(&lc, 0, sizeof(lc));
+        lc.can_channel_cfg.enabled = 1;
+        lc.can_channel_cfg.enabled_mappings = 1;
+        lc.can_channel_cfg.can_channels[0].mapping.can_channel = 0;
+        lc.can_channel_cfg.can_channels[0].mapping.can_id = 0x5F0;
+
+        CAN_filters_clear_script_rx();
+        CAN_filters_build(plans, &lc);
+        CPPUNIT_ASSERT(!accepts(plans, 0x7E8, false));
+
+        /* An ISO-TP read lets its responses through from then on */
+        CAN_filters_update(&lc);
+        CAN_filters_add_script_isotp(0, 0x7E8, false);
+        CAN_filters_add_script_isotp(0, 0x18DAF110, true);
+        CPPUNIT_ASSERT(CAN_filters_is_stale());
+        CAN_filters_build(plans, &lc);
+        CPPUNIT_ASSERT(!plans[0].accept_all);
+        CPPUNIT_ASSERT(accepts(plans, 0x7E8, false));
+        CPPUNIT_ASSERT(accepts(plans, 0x18DAF110, true));
+        CPPUNIT_ASSERT(accepts(plans, 0x5F0, false));
+        CPPUNIT_ASSERT(!accepts(plans, 0x7E9, false));
+
+        /* Reading the same ID again doesn't plan again */
+        CAN_filters_update(&lc);
+        CAN_filters_add_script_isotp(0, 0x7E8, false);
+        CPPUNIT_ASSERT(!CAN_filters_is_stale());
+
+        /* rxCAN can read anything on its bus */
+        CAN_filters_add_script_rx(0);
+        CPPUNIT_ASSERT(CAN_filters_is_stale());
+        CAN_filters_build(plans, &lc);
+        CPPUNIT_ASSERT(plans[0].accept_all);
+
+        /* A new script starts over */
+        CAN_filters_clear_script_rx();
+        CAN_filters_build(plans, &lc);
+        CPPUNIT_ASSERT(!plans[0].accept_all);
+        CPPUNIT_ASSERT(!accepts(plans, 0x7E8, false));
+}
+
+/*
+ * setCANfilter takes the ID and mask as the frame carries them, standard
+ * or extended.  The drivers program the controller from this layout.
+ */
+void CANFiltersTest::set_filter_layout_test(void)
+{
+        struct CAN_filter_plan plan;
+        CAN_filter_plan_init(&plan);
+        plan.count = 1;
+
+        plan.filters[0] = CAN_filter_layout(false, 0x100, 0x7FF);
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 0x100 << 18, plan.filters[0].id);
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 0x7FF << 18, plan.filters[0].mask);
+        CPPUNIT_ASSERT(accepts(&plan, 0x100, false));
+        CPPUNIT_ASSERT(!accepts(&plan, 0x101, false));
+
+        plan.filters[0] = CAN_filter_layout(false, 0x100, 0x700);
+        CPPUNIT_ASSERT(accepts(&plan, 0x1FF, false));
+        CPPUNIT_ASSERT(!accepts(&plan, 0x200, false));
+
+        plan.filters[0] = CAN_filter_layout(true, 0x18DAF110, 0x1FFFFFFF);
+        CPPUNIT_ASSERT(accepts(&plan, 0x18DAF110, true));
+        CPPUNIT_ASSERT(!accepts(&plan, 0x18DAF111, true));
+
+        /* The low ID bits of extended filters count too */
+        plan.filters[0] = CAN_filter_layout(true, 0x18DAF110, 0x1FFFFF00);
+        CPPUNIT_ASSERT(accepts(&plan, 0x18DAF1FF, true));
+        CPPUNIT_ASSERT(!accepts(&plan, 0x18DAF210, true));
+
+        /* A mask of 0 still takes everything */
+        plan.filters[0] = CAN_filter_layout(false, 0, 0);
+        CPPUNIT_ASSERT(accepts(&plan, 0x123, false));
+        CPPUNIT_ASSERT(accepts(&plan, 0x18DAF110, true));
+}
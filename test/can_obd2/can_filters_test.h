@@ -0,0 +1,47 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEST_CAN_OBD2_CAN_FILTERS_TEST_H_
+#define TEST_CAN_OBD2_CAN_FILTERS_TEST_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class CANFiltersTest : public CppUnit::TestFixture
+{
+        CPPUNIT_TEST_SUITE( CANFiltersTest );
+        CPPUNIT_TEST( plan_exact_test );
+        CPPUNIT_TEST( plan_merge_test );
+        CPPUNIT_TEST( plan_range_test );
+        CPPUNIT_TEST( build_test );
+        CPPUNIT_TEST( script_rx_test );
+        CPPUNIT_TEST( set_filter_layout_test );
+        CPPUNIT_TEST_SUITE_END();
+
+public:
+        void plan_exact_test(void);
+        void plan_merge_test(void);
+        void plan_range_test(void);
+        void build_test(void);
+        void script_rx_test(void);
+        void set_filter_layout_test(void);
+};
+
+#endif /* TEST_CAN_OBD2_CAN_FILTERS_TEST_H_ */
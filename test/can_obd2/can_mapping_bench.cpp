@@ -0,0 +1,141 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host benchmark of CAN signal decoding.  Times the uncompiled path
+ * (canmapping_map_value) against the compiled one (canmapping_compile
+ * once, then canmapping_match_id and canmapping_signal_value per
+ * frame) over the same random mappings and frames.  Build and run with
+ * "make bench && ./can_mapping_bench".
+ */
+
+#include "CAN.h"
+#include "can_mapping.h"
+#include "macros.h"
+#include "panic.h"
+#include "units_conversion.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_MAPPINGS	64
+#define BENCH_FRAMES	256
+#define BENCH_ROUNDS	2000
+
+/* Only reached on an invalid mapping type, which we never generate */
+void panic(const enum panic_cause cause)
+{
+        fprintf(stderr, "panic %d\n", cause);
+        exit(1);
+}
+
+static CANMapping mappings[BENCH_MAPPINGS];
+static struct can_signal signals[BENCH_MAPPINGS];
+static CAN_msg msgs[BENCH_FRAMES];
+
+static void setup(void)
+{
+        const enum CANMappingType types[] = {
+                CANMappingType_unsigned,
+                CANMappingType_signed,
+                CANMappingType_sign_magnitude,
+        };
+
+        /* Fixed seed, so that runs can be compared */
+        srand(12);
+
+        for (size_t i = 0; i < BENCH_MAPPINGS; ++i) {
+                CANMapping *mapping = mappings + i;
+
+                memset(mapping, 0, sizeof(*mapping));
+                mapping->can_id = 0x100 + i % 8;
+                mapping->sub_id = -1;
+                mapping->type = types[rand() % ARRAY_LEN(types)];
+                mapping->big_endian = rand() % 2;
+                mapping->bit_mode = rand() % 2;
+                if (mapping->bit_mode) {
+                        mapping->length = 1 + rand() % 24;
+                        mapping->offset = rand() % (64 - mapping->length + 1);
+                } else {
+                        mapping->length = 1 + rand() % 3;
+                        mapping->offset = rand() % (8 - mapping->length + 1);
+                }
+                mapping->multiplier = (rand() % 2000 - 1000) / 100.0f;
+                mapping->divider = rand() % 4;
+                mapping->adder = (rand() % 2000 - 1000) / 10.0f;
+                mapping->conversion_filter_id = rand() % UNITS_CONVERSION_COUNT;
+                canmapping_compile(signals + i, mapping);
+        }
+
+        for (size_t f = 0; f < BENCH_FRAMES; ++f) {
+                memset(msgs + f, 0, sizeof(msgs[f]));
+                msgs[f].addressValue = 0x100 + rand() % 8;
+                msgs[f].dataLength = 8;
+                for (size_t b = 0; b < 8; ++b)
+                        msgs[f].data[b] = rand();
+        }
+}
+
+/*
+ * Runs every frame against every mapping BENCH_ROUNDS times.
+ * @return nanoseconds per mapping checked
+ */
+template <typename F> static double time_per_signal(F decode, float *sum)
+{
+        const auto start = std::chrono::steady_clock::now();
+
+        for (size_t r = 0; r < BENCH_ROUNDS; ++r)
+                for (size_t f = 0; f < BENCH_FRAMES; ++f)
+                        for (size_t i = 0; i < BENCH_MAPPINGS; ++i)
+                                *sum += decode(msgs + f, i);
+
+        const std::chrono::duration<double, std::nano> elapsed =
+                std::chrono::steady_clock::now() - start;
+        return elapsed.count() / BENCH_ROUNDS / BENCH_FRAMES / BENCH_MAPPINGS;
+}
+
+int main(void)
+{
+        float legacy_sum = 0;
+        float compiled_sum = 0;
+
+        setup();
+
+        const double legacy = time_per_signal([](const CAN_msg *msg,
+                                                 const size_t i) {
+                float value = 0;
+                canmapping_map_value(&value, msg, mappings + i);
+                return value;
+        }, &legacy_sum);
+
+        const double compiled = time_per_signal([](const CAN_msg *msg,
+                                                   const size_t i) {
+                if (!canmapping_match_id(msg, mappings + i))
+                        return 0.0f;
+                return canmapping_signal_value(signals + i, msg->data64);
+        }, &compiled_sum);
+
+        /* The sums also keep the optimizer from dropping the work */
+        printf("legacy:   %6.2f ns/signal (sum %g)\n", legacy, legacy_sum);
+        printf("compiled: %6.2f ns/signal (sum %g)\n", compiled, compiled_sum);
+        return 0;
+}
@@ -19,12 +19,16 @@
  * this code. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "can_channels.h"
 #include "can_mapping.h"
 #include "can_mapping_test.h"
+#include "macros.h"
 #include <string.h>
 #include <string>
 #include <cppunit/extensions/HelperMacros.h>
 #include "byteswap.h"
+#include "units_conversion.h"
+#include <math.h>
 #include <stdlib.h>
 
 // Uncomment the below to see the output of the can mapping test
@@ -483,3 +487,299 @@ void CANMappingTest::mapping_test(void)
         CPPUNIT_ASSERT_EQUAL(true, result);
         CPPUNIT_ASSERT_EQUAL((float)MAPPING_FORMULA(0x0102, multiplier, divider, adder), value);
 }
+
+void CANMappingTest::compiled_signal_test(void)
+{
+        const enum CANMappingType types[] = {
+                CANMappingType_unsigned,
+                CANMappingType_signed,
+                CANMappingType_sign_magnitude,
+        };
+
+        srand(time(NULL));
+
+        for (size_t t = 0; t < ARRAY_LEN(types); ++t) {
+                for (size_t endian = 0; endian <= 1; ++endian) {
+                        /* lengths where the raw field is exact as a float */
+                        for (uint8_t length = 1; length <= 24; ++length) {
+                                CANMapping mapping;
+                                memset(&mapping, 0, sizeof(mapping));
+                                mapping.type = types[t];
+                                mapping.bit_mode = true;
+                                mapping.big_endian = endian;
+                                mapping.length = length;
+                                mapping.offset = rand() % (64 - length + 1);
+                                mapping.multiplier = (rand() % 2000 - 1000) / 100.0f;
+                                mapping.divider = rand() % 4;
+                                mapping.adder = (rand() % 2000 - 1000) / 10.0f;
+                                mapping.conversion_filter_id = rand() % UNITS_CONVERSION_COUNT;
+
+                                struct can_signal signal;
+                                canmapping_compile(&signal, &mapping);
+
+                                const uint64_t raw = ((uint64_t) rand() << 40) ^
+                                        ((uint64_t) rand() << 20) ^ rand();
+
+                                const float extracted = canmapping_extract_value(raw, &mapping);
+                                float expected = canmapping_apply_formula(extracted, &mapping);
+                                expected = convert_units((enum unit_conversions)
+                                                         mapping.conversion_filter_id,
+                                                         expected);
+
+                                /* folding reorders the float math; allow for that */
+                                float unit_scale;
+                                float unit_offset;
+                                units_conversion_affine((enum unit_conversions)
+                                                        mapping.conversion_filter_id,
+                                                        &unit_scale, &unit_offset);
+                                const double magnitude = (fabs(extracted * mapping.multiplier) +
+                                                          fabs(mapping.adder)) * unit_scale +
+                                        fabs(unit_offset);
+
+                                const float actual = canmapping_signal_value(&signal, raw);
+                                CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, actual,
+                                                             magnitude * 1e-5 + 1e-3);
+                        }
+                }
+        }
+
+        /* byte mode, IEEE754 floating point */
+        CANMapping mapping;
+        memset(&mapping, 0, sizeof(mapping));
+        mapping.type = CANMappingType_IEEE754;
+        mapping.offset = 2;
+        mapping.length = 4;
+        mapping.multiplier = 2;
+        mapping.conversion_filter_id = UNIT_CONVERSION_TEMPERATURE_C_TO_F;
+
+        CAN_msg msg;
+        memset(&msg, 0, sizeof(msg));
+        /* binary representation of 100.0 */
+        msg.data[4] = 0xC8;
+        msg.data[5] = 0x42;
+
+        struct can_signal signal;
+        canmapping_compile(&signal, &mapping);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(392.0f,
+                                     canmapping_signal_value(&signal, msg.data64),
+                                     1e-3);
+}
+
+static void set_dispatch_mapping(CANChannelConfig *cfg, size_t i,
+                                 uint8_t bus, uint32_t id, uint32_t mask,
+                                 int16_t sub_id)
+{
+        CANMapping *mapping = &cfg->can_channels[i].mapping;
+
+        memset(mapping, 0, sizeof(*mapping));
+        mapping->can_channel = bus;
+        mapping->can_id = id;
+        mapping->can_mask = mask;
+        mapping->sub_id = sub_id;
+        mapping->offset = 1;
+        mapping->length = 1;
+        mapping->multiplier = 1;
+        mapping->adder = i * 100;
+        mapping->type = CANMappingType_unsigned;
+}
+
+void CANMappingTest::dispatch_index_test(void)
+{
+        static CANChannelConfig cfg;
+        const uint16_t count = 6;
+
+        set_dispatch_mapping(&cfg, 0, 0, 0x100, 0, -1);
+        set_dispatch_mapping(&cfg, 1, 0, 0x200, 0x7F0, -1);
+        set_dispatch_mapping(&cfg, 2, 1, 0, 0, -1);
+        set_dispatch_mapping(&cfg, 3, 0, 0x300, 0, 2);
+        set_dispatch_mapping(&cfg, 4, 1, 0x100, 0, -1);
+        set_dispatch_mapping(&cfg, 5, 0, 0x100, 0, -1);
+
+        CPPUNIT_ASSERT(CAN_init_current_values(&cfg, count));
+        CPPUNIT_ASSERT(CAN_init_dispatch_index(&cfg, count));
+
+        CAN_msg msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.can_bus = 0;
+        msg.addressValue = 0x100;
+        msg.data[1] = 1;
+        update_can_channels(&msg, &cfg, count);
+        CPPUNIT_ASSERT_EQUAL(1.0f, CAN_get_current_channel_value(0));
+        CPPUNIT_ASSERT_EQUAL(501.0f, CAN_get_current_channel_value(5));
+        CPPUNIT_ASSERT_EQUAL(0.0f, CAN_get_current_channel_value(4));
+
+        /* masked ID */
+        msg.addressValue = 0x20A;
+        msg.data[1] = 2;
+        update_can_channels(&msg, &cfg, count);
+        CPPUNIT_ASSERT_EQUAL(102.0f, CAN_get_current_channel_value(1));
+
+        /* sub ID has to match the first data byte */
+        msg.addressValue = 0x300;
+        msg.data[0] = 1;
+        msg.data[1] = 3;
+        update_can_channels(&msg, &cfg, count);
+        CPPUNIT_ASSERT_EQUAL(0.0f, CAN_get_current_channel_value(3));
+        msg.data[0] = 2;
+        update_can_channels(&msg, &cfg, count);
+        CPPUNIT_ASSERT_EQUAL(303.0f, CAN_get_current_channel_value(3));
+
+        /* other bus gets both the wildcard and its own mapping */
+        msg.can_bus = 1;
+        msg.addressValue = 0x100;
+        msg.data[1] = 4;
+        update_can_channels(&msg, &cfg, count);
+        CPPUNIT_ASSERT_EQUAL(204.0f, CAN_get_current_channel_value(2));
+        CPPUNIT_ASSERT_EQUAL(404.0f, CAN_get_current_channel_value(4));
+        CPPUNIT_ASSERT_EQUAL(1.0f, CAN_get_current_channel_value(0));
+
+        CPPUNIT_ASSERT(CAN_init_dispatch_index(&cfg, 0));
+}
+
+void CANMappingTest::dispatch_linear_test(void)
+{
+        static CANChannelConfig cfg;
+        const uint16_t count = CONFIG_CAN_MAPPINGS;
+
+        /* One mask more than can be grouped */
+        for (size_t i = 0; i < count; ++i)
+                set_dispatch_mapping(&cfg, i, 0, 0x100 + i, 0x7FF | 0x800 << i, -1);
+
+        CPPUNIT_ASSERT(CAN_init_current_values(&cfg, count));
+        CPPUNIT_ASSERT(!CAN_init_dispatch_index(&cfg, count));
+
+        CAN_msg msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.can_bus = 0;
+        msg.addressValue = 0x102;
+        msg.data[1] = 7;
+        update_can_channels(&msg, &cfg, count);
+        CPPUNIT_ASSERT_EQUAL(207.0f, CAN_get_current_channel_value(2));
+        CPPUNIT_ASSERT_EQUAL(0.0f, CAN_get_current_channel_value(1));
+
+        /* still matched on bus */
+        msg.can_bus = 1;
+        msg.addressValue = 0x101;
+        update_can_channels(&msg, &cfg, count);
+        CPPUNIT_ASSERT_EQUAL(0.0f, CAN_get_current_channel_value(1));
+
+        CPPUNIT_ASSERT(CAN_init_dispatch_index(&cfg, 0));
+}
+
+#define EQUIVALENCE_FRAMES 1000
+
+/*
+ * Runs the same frames through the dispatch index with its compiled
+ * signals and through the plain walk over every mapping, which uses the
+ * uncompiled mappings.  Both have to come up with the same values.
+ */
+void CANMappingTest::dispatch_equivalence_test(void)
+{
+        static CANChannelConfig cfg;
+        static float indexed[EQUIVALENCE_FRAMES][CONFIG_CAN_MAPPINGS];
+        const uint32_t ids[] = {0, 0x100, 0x105, 0x200, 0x7E8, 0x18DAF110};
+        const enum CANMappingType types[] = {
+                CANMappingType_unsigned,
+                CANMappingType_signed,
+                CANMappingType_sign_magnitude,
+        };
+        const uint16_t count = CONFIG_CAN_MAPPINGS;
+
+        /* Fixed seed, so that a failure can be reproduced */
+        srand(12);
+
+        memset(&cfg, 0, sizeof(cfg));
+        for (size_t i = 0; i < count; ++i) {
+                CANMapping *mapping = &cfg.can_channels[i].mapping;
+
+                mapping->can_channel = rand() % 2;
+                mapping->can_id = ids[rand() % ARRAY_LEN(ids)];
+                mapping->can_mask = rand() % 3 ? 0 : 0x7F0;
+                mapping->sub_id = rand() % 3 ? -1 : rand() % 4;
+                mapping->type = types[rand() % ARRAY_LEN(types)];
+                mapping->big_endian = rand() % 2;
+                mapping->bit_mode = rand() % 2;
+                if (mapping->bit_mode) {
+                        mapping->length = 1 + rand() % 24;
+                        mapping->offset = rand() % (64 - mapping->length + 1);
+                } else {
+                        mapping->length = 1 + rand() % 3;
+                        mapping->offset = rand() % (8 - mapping->length + 1);
+                }
+                mapping->multiplier = (rand() % 2000 - 1000) / 100.0f;
+                mapping->divider = rand() % 4;
+                mapping->adder = (rand() % 2000 - 1000) / 10.0f;
+                mapping->conversion_filter_id = rand() % UNITS_CONVERSION_COUNT;
+        }
+
+        CAN_msg msgs[EQUIVALENCE_FRAMES];
+        for (size_t f = 0; f < EQUIVALENCE_FRAMES; ++f) {
+                CAN_msg *msg = msgs + f;
+                memset(msg, 0, sizeof(*msg));
+                msg->can_bus = rand() % 2;
+                /* mostly IDs that something is mapped to */
+                msg->addressValue = ids[1 + rand() % (ARRAY_LEN(ids) - 1)] +
+                        (rand() % 4 ? 0 : rand() % 16);
+                msg->isExtendedAddress = msg->addressValue > 0x7FF;
+                msg->dataLength = 8;
+                for (size_t b = 0; b < 8; ++b)
+                        msg->data[b] = rand();
+                msg->data[0] %= 5;
+        }
+
+        CPPUNIT_ASSERT(CAN_init_current_values(&cfg, count));
+        CPPUNIT_ASSERT(CAN_init_dispatch_index(&cfg, count));
+        for (size_t i = 0; i < count; ++i)
+                CAN_set_current_channel_value(i, 0);
+
+        for (size_t f = 0; f < EQUIVALENCE_FRAMES; ++f) {
+                update_can_channels(msgs + f, &cfg, count);
+                for (size_t i = 0; i < count; ++i)
+                        indexed[f][i] = CAN_get_current_channel_value(i);
+        }
+
+        /* Without an index every mapping is checked the old way */
+        CPPUNIT_ASSERT(CAN_init_dispatch_index(&cfg, 0));
+        for (size_t i = 0; i < count; ++i)
+                CAN_set_current_channel_value(i, 0);
+
+        for (size_t f = 0; f < EQUIVALENCE_FRAMES; ++f) {
+                update_can_channels(msgs + f, &cfg, count);
+                for (size_t i = 0; i < count; ++i) {
+                        const float expected = CAN_get_current_channel_value(i);
+
+                        /* folding reorders the float math; allow for that */
+                        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, indexed[f][i],
+                                                     fabs(expected) * 1e-5 + 1e-3);
+                }
+        }
+}
+
+void CANMappingTest::current_values_test(void)
+{
+        static CANChannelConfig cfg;
+
+        set_dispatch_mapping(&cfg, 0, 0, 0x100, 0, -1);
+        set_dispatch_mapping(&cfg, 1, 0, 0x200, 0, -1);
+        set_dispatch_mapping(&cfg, 2, 0, 0x300, 0, -1);
+
+        CPPUNIT_ASSERT(CAN_init_current_values(&cfg, 3));
+        for (int i = 0; i < 3; ++i)
+                CAN_set_current_channel_value(i, i + 1);
+
+        /* Only the slots whose mapping changed start over */
+        strcpy(cfg.can_channels[0].mapping.channel_cfg.label, "Renamed");
+        set_dispatch_mapping(&cfg, 1, 0, 0x201, 0, -1);
+        cfg.can_channels[2].mapping.multiplier = 2;
+        CPPUNIT_ASSERT(CAN_init_current_values(&cfg, 3));
+        CPPUNIT_ASSERT_EQUAL(1.0f, CAN_get_current_channel_value(0));
+        CPPUNIT_ASSERT_EQUAL(0.0f, CAN_get_current_channel_value(1));
+        CPPUNIT_ASSERT_EQUAL(0.0f, CAN_get_current_channel_value(2));
+
+        /* A slot that was dropped and comes back starts over too */
+        CAN_set_current_channel_value(2, 3);
+        CPPUNIT_ASSERT(CAN_init_current_values(&cfg, 2));
+        CPPUNIT_ASSERT(CAN_init_current_values(&cfg, 3));
+        CPPUNIT_ASSERT_EQUAL(1.0f, CAN_get_current_channel_value(0));
+        CPPUNIT_ASSERT_EQUAL(0.0f, CAN_get_current_channel_value(2));
+}
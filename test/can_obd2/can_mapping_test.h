@@ -19,6 +19,11 @@ class CANMappingTest : public CppUnit::TestFixture
         CPPUNIT_TEST( extract_test );
         CPPUNIT_TEST( extract_test_bit_mode );
         CPPUNIT_TEST( extract_type_test );
+        CPPUNIT_TEST( compiled_signal_test );
+        CPPUNIT_TEST( dispatch_index_test );
+        CPPUNIT_TEST( dispatch_linear_test );
+        CPPUNIT_TEST( dispatch_equivalence_test );
+        CPPUNIT_TEST( current_values_test );
         CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -28,6 +33,11 @@ public:
         void extract_test(void);
         void extract_test_bit_mode(void);
         void extract_type_test(void);
+        void compiled_signal_test(void);
+        void dispatch_index_test(void);
+        void dispatch_linear_test(void);
+        void dispatch_equivalence_test(void);
+        void current_values_test(void);
 };
 
 #endif /* TEST_CAN_OBD2_CAN_MAPPING_TEST_H_ */
@@ -0,0 +1,110 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CAN_stats.h"
+#include "can_stats_test.h"
+#include "taskUtil.h"
+#include <cppunit/extensions/HelperMacros.h>
+#include <string.h>
+
+CPPUNIT_TEST_SUITE_REGISTRATION( CANStatsTest );
+
+static void rx(uint8_t bus, uint32_t id, uint8_t len, size_t times)
+{
+        CAN_msg msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.can_bus = bus;
+        msg.addressValue = id;
+        msg.dataLength = len;
+
+        for (size_t i = 0; i < times; ++i)
+                CAN_stats_rx(&msg, 1);
+}
+
+void CANStatsTest::setUp()
+{
+        CAN_stats_init();
+}
+
+void CANStatsTest::rates_test(void)
+{
+        const size_t start = getCurrentTicks();
+        const struct can_bus_stats *bs = CAN_stats_get_bus(0);
+
+        rx(0, 0x100, 8, 100);
+        rx(1, 0x200, 4, 10);
+        rx(CAN_CHANNELS, 0x300, 8, 10);
+        CAN_stats_dropped(0, CAN_STATS_QUEUE_AUX);
+        CAN_stats_loop(16, 3);
+        CAN_stats_loop(1, 0);
+
+        /* Nothing is published until the window has passed */
+        CAN_stats_update(start + msToTicks(CAN_STATS_WINDOW_MS / 2));
+        CPPUNIT_ASSERT_EQUAL(0, (int) bs->frame_rate);
+        CPPUNIT_ASSERT_EQUAL(100, (int) bs->frames);
+
+        CAN_stats_update(start + msToTicks(2 * CAN_STATS_WINDOW_MS));
+        CPPUNIT_ASSERT_EQUAL(50, (int) bs->frame_rate);
+        CPPUNIT_ASSERT_EQUAL(400, (int) bs->byte_rate);
+        CPPUNIT_ASSERT_EQUAL(800, (int) bs->bytes);
+        CPPUNIT_ASSERT_EQUAL(1, (int) bs->dropped[CAN_STATS_QUEUE_AUX]);
+        CPPUNIT_ASSERT_EQUAL(5, (int) CAN_stats_get_bus(1)->frame_rate);
+        CPPUNIT_ASSERT(NULL == CAN_stats_get_bus(CAN_CHANNELS));
+
+        const struct can_task_stats *ts = CAN_stats_get_task();
+        CPPUNIT_ASSERT_EQUAL(2, (int) ts->loops);
+        CPPUNIT_ASSERT_EQUAL((int) ticksToMs(3), (int) ts->max_loop_ms);
+        CPPUNIT_ASSERT_EQUAL(16, (int) ts->max_batch);
+
+        /* A quiet window reports no traffic but keeps the totals */
+        CAN_stats_update(start + msToTicks(3 * CAN_STATS_WINDOW_MS));
+        CPPUNIT_ASSERT_EQUAL(0, (int) bs->frame_rate);
+        CPPUNIT_ASSERT_EQUAL(0, (int) bs->top_count);
+        CPPUNIT_ASSERT_EQUAL(100, (int) bs->frames);
+        CPPUNIT_ASSERT_EQUAL(0, (int) CAN_stats_get_task()->loops);
+}
+
+void CANStatsTest::top_ids_test(void)
+{
+        const size_t start = getCurrentTicks();
+
+        /* More IDs than are tracked, with a few busy ones among them */
+        for (size_t round = 0; round < 10; ++round) {
+                rx(0, 0x7E8, 8, 5);
+                for (uint32_t id = 0x400; id < 0x400 + 40; ++id)
+                        rx(0, id, 8, 1);
+                rx(0, 0x100, 8, 3);
+                rx(0, 0x200, 8, 2);
+        }
+
+        CAN_stats_update(start + msToTicks(CAN_STATS_WINDOW_MS));
+
+        const struct can_bus_stats *bs = CAN_stats_get_bus(0);
+        CPPUNIT_ASSERT_EQUAL(CAN_STATS_TOP_IDS, (int) bs->top_count);
+        CPPUNIT_ASSERT_EQUAL(0x7E8, (int) bs->top[0].can_id);
+        CPPUNIT_ASSERT_EQUAL(0x100, (int) bs->top[1].can_id);
+        CPPUNIT_ASSERT_EQUAL(0x200, (int) bs->top[2].can_id);
+
+        /* Counts are never under-estimated */
+        CPPUNIT_ASSERT(bs->top[0].rate >= 50);
+        for (size_t i = 1; i < bs->top_count; ++i)
+                CPPUNIT_ASSERT(bs->top[i - 1].rate >= bs->top[i].rate);
+}
@@ -0,0 +1,117 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CAN_device_mock.h"
+#include "isotp.h"
+#include "isotp_test.h"
+#include <cppunit/extensions/HelperMacros.h>
+#include <string.h>
+
+CPPUNIT_TEST_SUITE_REGISTRATION( IsotpTest );
+
+#define ECU_RX_ID 0x18DAF110
+#define ECU_TX_ID 0x18DA10F1
+
+static const struct isotp_msg* rx(uint32_t id, const uint8_t *data)
+{
+        CAN_msg msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.addressValue = id;
+        msg.isExtendedAddress = true;
+        msg.dataLength = CAN_MSG_SIZE;
+        memcpy(msg.data, data, CAN_MSG_SIZE);
+        return isotp_rx_frame(&msg);
+}
+
+void IsotpTest::setUp()
+{
+        isotp_clear_listeners();
+        isotp_listen(0, ECU_RX_ID, ECU_TX_ID);
+}
+
+void IsotpTest::reassembly_test(void)
+{
+        const CAN_msg *tx = CAN_device_mock_last_tx_msg();
+
+        /* single frames are left to the caller */
+        const uint8_t single[] = {0x03, 0x41, 0x0D, 0x64, 0, 0, 0, 0};
+        CPPUNIT_ASSERT(NULL == rx(ECU_RX_ID, single));
+
+        /* 22 bytes: a first frame and three consecutive frames */
+        const uint8_t first[] = {0x10, 22, 0x62, 0xF1, 0x90, 3, 4, 5};
+        CPPUNIT_ASSERT(NULL == rx(ECU_RX_ID, first));
+        CPPUNIT_ASSERT_EQUAL(ECU_TX_ID, (int) tx->addressValue);
+        CPPUNIT_ASSERT(tx->isExtendedAddress);
+        CPPUNIT_ASSERT_EQUAL(0x30, (int) tx->data[0]);
+
+        /* frames from other addresses don't interfere */
+        const uint8_t other[] = {0x21, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+        CPPUNIT_ASSERT(NULL == rx(ECU_RX_ID + 1, other));
+
+        const uint8_t cf1[] = {0x21, 6, 7, 8, 9, 10, 11, 12};
+        const uint8_t cf2[] = {0x22, 13, 14, 15, 16, 17, 18, 19};
+        const uint8_t cf3[] = {0x23, 20, 21, 22, 23, 24, 25, 26};
+        CPPUNIT_ASSERT(NULL == rx(ECU_RX_ID, cf1));
+        CPPUNIT_ASSERT(NULL == rx(ECU_RX_ID, cf2));
+
+        const struct isotp_msg *msg = rx(ECU_RX_ID, cf3);
+        CPPUNIT_ASSERT(msg);
+        CPPUNIT_ASSERT_EQUAL(ECU_RX_ID, (int) msg->can_id);
+        CPPUNIT_ASSERT_EQUAL(22, (int) msg->length);
+        CPPUNIT_ASSERT_EQUAL(0x62, (int) msg->data[0]);
+        for (size_t i = 3; i < msg->length; i++)
+                CPPUNIT_ASSERT_EQUAL((int) i, (int) msg->data[i]);
+
+        /* and the session is over */
+        CPPUNIT_ASSERT(NULL == rx(ECU_RX_ID, cf3));
+}
+
+void IsotpTest::sequence_error_test(void)
+{
+        const uint8_t first[] = {0x10, 10, 1, 2, 3, 4, 5, 6};
+        const uint8_t cf2[] = {0x22, 7, 8, 9, 10, 0, 0, 0};
+        const uint8_t cf1[] = {0x21, 7, 8, 9, 10, 0, 0, 0};
+
+        /* a missing frame spoils the message */
+        rx(ECU_RX_ID, first);
+        CPPUNIT_ASSERT(NULL == rx(ECU_RX_ID, cf2));
+        CPPUNIT_ASSERT(NULL == rx(ECU_RX_ID, cf1));
+
+        /* until it is sent again */
+        rx(ECU_RX_ID, first);
+        const struct isotp_msg *msg = rx(ECU_RX_ID, cf1);
+        CPPUNIT_ASSERT(msg);
+        CPPUNIT_ASSERT_EQUAL(10, (int) msg->length);
+        CPPUNIT_ASSERT_EQUAL(10, (int) msg->data[9]);
+}
+
+void IsotpTest::overflow_test(void)
+{
+        const CAN_msg *tx = CAN_device_mock_last_tx_msg();
+        const uint8_t first[] = {0x10 | (ISOTP_MAX_PAYLOAD + 1) >> 8,
+                                 (ISOTP_MAX_PAYLOAD + 1) & 0xFF,
+                                 1, 2, 3, 4, 5, 6};
+        const uint8_t cf1[] = {0x21, 7, 8, 9, 10, 11, 12, 13};
+
+        CPPUNIT_ASSERT(NULL == rx(ECU_RX_ID, first));
+        CPPUNIT_ASSERT_EQUAL(0x32, (int) tx->data[0]);
+        CPPUNIT_ASSERT(NULL == rx(ECU_RX_ID, cf1));
+}
@@ -0,0 +1,219 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CAN_device_mock.h"
+#include "OBD2.h"
+#include "isotp.h"
+#include "loggerConfig.h"
+#include "obd2_test.h"
+#include <cppunit/extensions/HelperMacros.h>
+#include <string.h>
+
+CPPUNIT_TEST_SUITE_REGISTRATION( OBD2Test );
+
+#define ECU_RESPONSE_ID 0x7E8
+
+static void add_pid(OBD2Config *cfg, uint8_t pid, uint8_t length,
+                    float divider, float adder)
+{
+        PidConfig *pid_cfg = cfg->pids + cfg->enabledPids++;
+        CANMapping *mapping = &pid_cfg->mapping;
+
+        pid_cfg->pid = pid;
+        pid_cfg->mode = 1;
+        mapping->channel_cfg.sampleRate = encodeSampleRate(10);
+        mapping->can_id = ECU_RESPONSE_ID;
+        mapping->offset = 3;
+        mapping->length = length;
+        mapping->big_endian = true;
+        mapping->multiplier = 1;
+        mapping->divider = divider;
+        mapping->adder = adder;
+        mapping->sub_id = -1;
+}
+
+static void setup_config(OBD2Config *cfg)
+{
+        memset(cfg, 0, sizeof(*cfg));
+        cfg->enabled = 1;
+        add_pid(cfg, 0x0C, 2, 4, 0);    /* RPM */
+        add_pid(cfg, 0x0D, 1, 1, 0);    /* speed */
+        add_pid(cfg, 0x05, 1, 1, -40);  /* coolant */
+        OBD2_init_current_values(cfg);
+}
+
+static void respond(OBD2Config *cfg, const uint8_t *data, size_t len)
+{
+        CAN_msg msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.addressValue = ECU_RESPONSE_ID;
+        msg.dataLength = 8;
+        memcpy(msg.data, data, len);
+        update_obd2_channels(&msg, cfg);
+}
+
+static float pid_value(uint16_t pid)
+{
+        float value = -1;
+        OBD2_get_value_for_pid(pid, &value);
+        return value;
+}
+
+void OBD2Test::packed_query_test(void)
+{
+        OBD2Config cfg;
+        setup_config(&cfg);
+        add_pid(&cfg, 0x12, 2, 1, 0);
+        cfg.pids[3].mode = 0x22;
+        cfg.pids[3].pid = 0x1234;
+        cfg.pids[3].mapping.offset = 4;
+        OBD2_init_current_values(&cfg);
+        const CAN_msg *tx = CAN_device_mock_last_tx_msg();
+
+        /* One PID at a time until the ECU has answered */
+        sequence_next_obd2_query(&cfg, cfg.enabledPids);
+        CPPUNIT_ASSERT_EQUAL(2, (int) tx->data[0]);
+        CPPUNIT_ASSERT_EQUAL(0x0C, (int) tx->data[2]);
+
+        sequence_next_obd2_query(&cfg, cfg.enabledPids);
+        CPPUNIT_ASSERT_EQUAL(0x0C, (int) tx->data[2]);
+
+        const uint8_t rpm[] = {4, 0x41, 0x0C, 0x1A, 0xF8};
+        respond(&cfg, rpm, sizeof(rpm));
+        CPPUNIT_ASSERT_EQUAL(1726.0f, pid_value(0x0C));
+
+        /* Now the due mode 01 PIDs share a request, most due first */
+        sequence_next_obd2_query(&cfg, cfg.enabledPids);
+        CPPUNIT_ASSERT_EQUAL(4, (int) tx->data[0]);
+        CPPUNIT_ASSERT_EQUAL(1, (int) tx->data[1]);
+        CPPUNIT_ASSERT_EQUAL(0x0D, (int) tx->data[2]);
+        CPPUNIT_ASSERT_EQUAL(0x05, (int) tx->data[3]);
+        CPPUNIT_ASSERT_EQUAL(0x0C, (int) tx->data[4]);
+
+        /* and a second request goes out before the first is answered */
+        sequence_next_obd2_query(&cfg, cfg.enabledPids);
+        CPPUNIT_ASSERT_EQUAL(3, (int) tx->data[0]);
+        CPPUNIT_ASSERT_EQUAL(0x22, (int) tx->data[1]);
+
+        /* but no more than the pipeline allows */
+        sequence_next_obd2_query(&cfg, cfg.enabledPids);
+        CPPUNIT_ASSERT_EQUAL(0x22, (int) tx->data[1]);
+
+        /* Answers are matched by PID, whatever order they come in */
+        const uint8_t enhanced[] = {5, 0x62, 0x12, 0x34, 0x01, 0xF4};
+        respond(&cfg, enhanced, sizeof(enhanced));
+        CPPUNIT_ASSERT_EQUAL(500.0f, pid_value(0x1234));
+
+        /* The packed answer needs two frames */
+        CAN_msg frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.addressValue = ECU_RESPONSE_ID;
+        frame.dataLength = 8;
+        const uint8_t first[] = {0x10, 0x09, 0x41, 0x05, 0x5A, 0x0D, 0x64, 0x0C};
+        memcpy(frame.data, first, sizeof(first));
+        CPPUNIT_ASSERT(NULL == isotp_rx_frame(&frame));
+        CPPUNIT_ASSERT_EQUAL(0x7E0, (int) tx->addressValue);
+        CPPUNIT_ASSERT_EQUAL(0x30, (int) tx->data[0]);
+
+        const uint8_t next[] = {0x21, 0x0F, 0xA0, 0x55, 0x55, 0x55, 0x55, 0x55};
+        memcpy(frame.data, next, sizeof(next));
+        const struct isotp_msg *tp = isotp_rx_frame(&frame);
+        CPPUNIT_ASSERT(tp);
+        update_obd2_isotp_channels(tp, &cfg);
+        CPPUNIT_ASSERT_EQUAL(100.0f, pid_value(0x0D));
+        CPPUNIT_ASSERT_EQUAL(50.0f, pid_value(0x05));
+        CPPUNIT_ASSERT_EQUAL(1000.0f, pid_value(0x0C));
+}
+
+void OBD2Test::partial_response_test(void)
+{
+        OBD2Config cfg;
+        setup_config(&cfg);
+        const CAN_msg *tx = CAN_device_mock_last_tx_msg();
+
+        sequence_next_obd2_query(&cfg, cfg.enabledPids);
+        const uint8_t rpm[] = {4, 0x41, 0x0C, 0x1A, 0xF8};
+        respond(&cfg, rpm, sizeof(rpm));
+
+        sequence_next_obd2_query(&cfg, cfg.enabledPids);
+        CPPUNIT_ASSERT_EQUAL(4, (int) tx->data[0]);
+
+        /* An ECU that only answers the first PID gets one PID at a time */
+        const uint8_t speed[] = {3, 0x41, 0x0D, 0x64};
+        respond(&cfg, speed, sizeof(speed));
+        CPPUNIT_ASSERT_EQUAL(100.0f, pid_value(0x0D));
+
+        for (size_t i = 0; i < 4; i++) {
+                sequence_next_obd2_query(&cfg, cfg.enabledPids);
+                CPPUNIT_ASSERT_EQUAL(2, (int) tx->data[0]);
+                respond(&cfg, rpm, sizeof(rpm));
+                const uint8_t single[] = {3, 0x41, tx->data[2], 0x64};
+                if (tx->data[2] != 0x0C)
+                        respond(&cfg, single, sizeof(single));
+        }
+}
+
+void OBD2Test::retained_values_test(void)
+{
+        OBD2Config cfg;
+        setup_config(&cfg);
+
+        for (int i = 0; i < 3; ++i)
+                OBD2_set_current_channel_value(i, i + 1);
+
+        /* Only PIDs queried and decoded exactly as before keep their value */
+        strcpy(cfg.pids[0].mapping.channel_cfg.label, "Renamed");
+        cfg.pids[1].mode = 0x22;
+        cfg.pids[2].mapping.can_id = ECU_RESPONSE_ID + 1;
+        OBD2_init_current_values(&cfg);
+        CPPUNIT_ASSERT_EQUAL(1.0f, OBD2_get_current_channel_value(0));
+        CPPUNIT_ASSERT_EQUAL(0.0f, OBD2_get_current_channel_value(1));
+        CPPUNIT_ASSERT_EQUAL(0.0f, OBD2_get_current_channel_value(2));
+}
+
+void OBD2Test::multi_frame_offset_test(void)
+{
+        OBD2Config cfg;
+        memset(&cfg, 0, sizeof(cfg));
+        cfg.enabled = 1;
+        add_pid(&cfg, 0, 2, 1, 0);
+        cfg.pids[0].mode = 0x22;
+        cfg.pids[0].pid = 0x1234;
+        cfg.pids[0].mapping.offset = 10;
+        OBD2_init_current_values(&cfg);
+        sequence_next_obd2_query(&cfg, cfg.enabledPids);
+
+        /* The value sits in the second frame, past the first 8 bytes */
+        CAN_msg frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.addressValue = ECU_RESPONSE_ID;
+        frame.dataLength = 8;
+        const uint8_t first[] = {0x10, 0x0C, 0x62, 0x12, 0x34, 0, 0, 0};
+        memcpy(frame.data, first, sizeof(first));
+        CPPUNIT_ASSERT(NULL == isotp_rx_frame(&frame));
+
+        const uint8_t next[] = {0x21, 0, 0, 0, 0x01, 0xF4, 0, 0x55};
+        memcpy(frame.data, next, sizeof(next));
+        const struct isotp_msg *tp = isotp_rx_frame(&frame);
+        CPPUNIT_ASSERT(tp);
+        update_obd2_isotp_channels(tp, &cfg);
+        CPPUNIT_ASSERT_EQUAL(500.0f, pid_value(0x1234));
+}
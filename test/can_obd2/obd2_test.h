@@ -0,0 +1,43 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEST_CAN_OBD2_OBD2_TEST_H_
+#define TEST_CAN_OBD2_OBD2_TEST_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class OBD2Test : public CppUnit::TestFixture
+{
+        CPPUNIT_TEST_SUITE( OBD2Test );
+        CPPUNIT_TEST( packed_query_test );
+        CPPUNIT_TEST( partial_response_test );
+        CPPUNIT_TEST( retained_values_test );
+        CPPUNIT_TEST( multi_frame_offset_test );
+        CPPUNIT_TEST_SUITE_END();
+
+public:
+        void packed_query_test(void);
+        void partial_response_test(void);
+        void retained_values_test(void);
+        void multi_frame_offset_test(void);
+};
+
+#endif /* TEST_CAN_OBD2_OBD2_TEST_H_ */
@@ -131,6 +131,7 @@ CPP_GUARD_BEGIN
 
 //logging
 #define LOG_BUFFER_SIZE			1024
+#define SAMPLE_HISTORY_MAX_SIZE		(1024 * 16)
 
 //system info
 #define DEVICE_NAME    "RCP_SIM"
@@ -32,6 +32,9 @@ int flush_logfile(struct logging_status *ls);
 int logging_stop(struct logging_status *ls);
 int logging_start(struct logging_status *ls);
 int logging_sample(struct logging_status *ls, LoggerMessage *msg);
+long log_name_index(const char *name, const char *prefix);
+bool parse_log_index(const char *str, struct log_index *li);
+uint32_t prealloc_size(const uint32_t alloc, const uint32_t need);
 
 CPP_GUARD_END
 
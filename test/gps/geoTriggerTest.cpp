@@ -22,6 +22,7 @@
 #include "geoTrigger.h"
 #include "geoTriggerTest.h"
 #include "geopoint.h"
+#include <math.h>
 
 // Registers the fixture into the 'registry'
 CPPUNIT_TEST_SUITE_REGISTRATION( GeoTriggerTest );
@@ -74,3 +75,28 @@ void GeoTriggerTest::testReset()
         resetGeoTrigger(&gt);
         CPPUNIT_ASSERT(!isGeoTriggerTripped(&gt));
 }
+
+void GeoTriggerTest::testGeoCircleBoundary()
+{
+        /* Nordschleife.  Far enough north that longitude scaling matters */
+        const GeoPoint center = { 50.3356f, 6.9475f };
+        const float radius = 20;
+        const struct GeoCircle gc = gc_createGeoCircle(center, radius);
+
+        for (int i = 0; i < 16; ++i) {
+                const float angle = i * (float) M_PI / 8;
+                const float dLat = sinf(angle) * radius / 111195.0f;
+                const float dLon = cosf(angle) * radius / 111195.0f /
+                        cosf(center.latitude * (float) M_PI / 180);
+
+                const GeoPoint in = { center.latitude + dLat * 0.95f,
+                                      center.longitude + dLon * 0.95f };
+                const GeoPoint out = { center.latitude + dLat * 1.05f,
+                                       center.longitude + dLon * 1.05f };
+
+                CPPUNIT_ASSERT(distPythag(&center, &in) <= radius);
+                CPPUNIT_ASSERT(gc_isPointInGeoCircle(&in, gc));
+                CPPUNIT_ASSERT(distPythag(&center, &out) > radius);
+                CPPUNIT_ASSERT(!gc_isPointInGeoCircle(&out, gc));
+        }
+}
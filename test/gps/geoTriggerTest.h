@@ -29,6 +29,7 @@ class GeoTriggerTest : public CppUnit::TestFixture
         CPPUNIT_TEST( testShouldTrigger );
         CPPUNIT_TEST( testNoTrigger );
         CPPUNIT_TEST( testReset );
+        CPPUNIT_TEST( testGeoCircleBoundary );
         CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -37,6 +38,7 @@ public:
         void testShouldTrigger();
         void testNoTrigger();
         void testReset();
+        void testGeoCircleBoundary();
 };
 
 
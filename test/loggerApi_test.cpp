@@ -174,6 +174,7 @@ void LoggerApiTest::setUp()
         LoggerConfig *config = getWorkingLoggerConfig();
         initApi();
         initialize_logger_config();
+        sample_meta_invalidate();
         setupMockSerial();
         imu_init(config);
         resetPredictiveTimer();
@@ -1132,6 +1133,41 @@ void LoggerApiTest::testSetLogLevel()
         testSetLogLevelFile("setLogLevel1.json", API_SUCCESS);
 }
 
+static string padded_log_level_msg(const int pad, const int level)
+{
+        string json = "{\"setLogfileLevel\":{\"pad\":[";
+        for (int i = 0; i < pad; ++i)
+                json += i ? ",0" : "0";
+        json += "],\"level\":" + std::to_string(level) + "}}";
+
+        return json;
+}
+
+void LoggerApiTest::testLargeMessage()
+{
+        /* 197 tokens, the most the API token pool parses */
+        string json = padded_log_level_msg(190, 7);
+        set_log_level(INFO);
+        mock_resetTxBuffer();
+        CPPUNIT_ASSERT_EQUAL((int) API_SUCCESS,
+                             process_api(getMockSerial(),
+                                         (char *) json.c_str(), json.size()));
+        CPPUNIT_ASSERT_EQUAL(7, (int)get_log_level());
+
+        /* Anything bigger is turned away, the pool never grows */
+        json = padded_log_level_msg(500, 5);
+        mock_resetTxBuffer();
+        CPPUNIT_ASSERT_EQUAL((int) API_ERROR_MALFORMED,
+                             process_api(getMockSerial(),
+                                         (char *) json.c_str(), json.size()));
+        CPPUNIT_ASSERT_EQUAL(7, (int)get_log_level());
+
+        /* And the leftovers of the big one don't confuse the next one */
+        json = "{\"setLogfileLevel\":{\"level\":5}}";
+        process_api(getMockSerial(), (char *) json.c_str(), json.size());
+        CPPUNIT_ASSERT_EQUAL(5, (int)get_log_level());
+}
+
 void LoggerApiTest::testGetCanCfg()
 {
         testGetCanCfgFile("getCanCfg1.json");
@@ -1747,6 +1783,8 @@ void LoggerApiTest::testGetAutoLoggerCfgDefault()
         Object stop_st = galc["stop"];
         CPPUNIT_ASSERT_EQUAL(alc.stop.time, (uint32_t)(Number)stop_st["time"]);
         CPPUNIT_ASSERT_EQUAL(alc.stop.threshold, (float)(Number)stop_st["thresh"]);
+
+        CPPUNIT_ASSERT_EQUAL((int) alc.pre_trigger, (int)(Number)galc["pretrig"]);
 }
 
 void LoggerApiTest::testSetAutoLoggerCfg()
@@ -1765,9 +1803,35 @@ void LoggerApiTest::testSetAutoLoggerCfg()
         CPPUNIT_ASSERT_EQUAL((float) 34.5, cfg->stop.threshold);
         CPPUNIT_ASSERT_EQUAL(false, cfg->stop.greater_than);
 
+        CPPUNIT_ASSERT_EQUAL((uint8_t) 4, cfg->pre_trigger);
+
         assertGenericResponse(response, "setSdLogCtrlCfg", API_SUCCESS);
 }
 
+void LoggerApiTest::testGetSdLogCfgDefault()
+{
+        const char *response = processApiGeneric("get_sd_log_cfg.json");
+
+        Object json;
+        stringToJson(response, json);
+
+        Object cfg = json["sdLogCfg"];
+        CPPUNIT_ASSERT_EQUAL((int) LOG_FILE_FORMAT_CSV, (int)(Number)cfg["fmt"]);
+        CPPUNIT_ASSERT_EQUAL(false, (bool)(Boolean)cfg["dirs"]);
+        CPPUNIT_ASSERT_EQUAL(false, (bool)(Boolean)cfg["prealloc"]);
+}
+
+void LoggerApiTest::testSetSdLogCfg()
+{
+        const LoggerConfig *lc = getWorkingLoggerConfig();
+        char *response = processApiGeneric("set_sd_log_cfg.json");
+
+        CPPUNIT_ASSERT_EQUAL(LOG_FILE_FORMAT_BINARY, lc->logging_cfg.file_format);
+        CPPUNIT_ASSERT_EQUAL(true, lc->logging_cfg.session_dirs);
+        CPPUNIT_ASSERT_EQUAL(true, lc->logging_cfg.preallocate);
+        assertGenericResponse(response, "setSdLogCfg", API_SUCCESS);
+}
+
 void LoggerApiTest::testGetCameraControlCfgDefault()
 {
         const char *response = processApiGeneric("get_camera_control_cfg.json");
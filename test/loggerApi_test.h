@@ -68,6 +68,7 @@ class LoggerApiTest : public CppUnit::TestFixture
         CPPUNIT_TEST( testCalibrateImu);
         CPPUNIT_TEST( testFlashConfig);
         CPPUNIT_TEST( testSetLogLevel);
+        CPPUNIT_TEST( testLargeMessage );
         CPPUNIT_TEST( testSetObd2Cfg);
         CPPUNIT_TEST( testSetObd2ConfigFile_fromIndex);
         CPPUNIT_TEST( testSetObd2ConfigFile_invalid);
@@ -92,6 +93,8 @@ class LoggerApiTest : public CppUnit::TestFixture
         CPPUNIT_TEST( setActiveTrackRadiusDegrees );
         CPPUNIT_TEST( testGetAutoLoggerCfgDefault );
         CPPUNIT_TEST( testSetAutoLoggerCfg );
+        CPPUNIT_TEST( testGetSdLogCfgDefault );
+        CPPUNIT_TEST( testSetSdLogCfg );
         CPPUNIT_TEST( testGetCameraControlCfgDefault );
         CPPUNIT_TEST( testSetCameraControlCfg );
         CPPUNIT_TEST( test_set_vchan );
@@ -145,6 +148,7 @@ public:
         void testCalibrateImu();
         void testFlashConfig();
         void testSetLogLevel();
+        void testLargeMessage();
         void testGetCanCfg();
         void testSetCanCfg();
         void testGetCanChanCfg();
@@ -166,6 +170,8 @@ public:
         void testSetGetWifiCfg();
         void testGetAutoLoggerCfgDefault();
         void testSetAutoLoggerCfg();
+        void testGetSdLogCfgDefault();
+        void testSetSdLogCfg();
         void testGetCameraControlCfgDefault();
         void testSetCameraControlCfg();
         void test_set_vchan();
@@ -94,6 +94,38 @@ void LoggerFileWriterTest::testLoggingSampleSkip()
         CPPUNIT_ASSERT_EQUAL(0, rc);
 }
 
+void LoggerFileWriterTest::testLogNameIndex()
+{
+        CPPUNIT_ASSERT_EQUAL(12L, log_name_index("rc_12.log", "rc_"));
+        CPPUNIT_ASSERT_EQUAL(7L, log_name_index("RC_7.RCB", "rc_"));
+        CPPUNIT_ASSERT_EQUAL(3L, log_name_index("SES_3", "ses_"));
+        CPPUNIT_ASSERT_EQUAL(-1L, log_name_index("RC_INDEX.TXT", "rc_"));
+        CPPUNIT_ASSERT_EQUAL(-1L, log_name_index("rc_12x.log", "rc_"));
+        CPPUNIT_ASSERT_EQUAL(-1L, log_name_index("foo.log", "rc_"));
+}
+
+void LoggerFileWriterTest::testParseLogIndex()
+{
+        struct log_index li;
+
+        CPPUNIT_ASSERT(parse_log_index("42 7\n", &li));
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 42, li.next_log);
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 7, li.next_session);
+
+        CPPUNIT_ASSERT(!parse_log_index("42", &li));
+        CPPUNIT_ASSERT(!parse_log_index("", &li));
+}
+
+void LoggerFileWriterTest::testPreallocSize()
+{
+        const uint32_t step = 4 * 1024 * 1024;
+
+        CPPUNIT_ASSERT_EQUAL(step, prealloc_size(0, 1));
+        CPPUNIT_ASSERT_EQUAL(step, prealloc_size(step, step));
+        CPPUNIT_ASSERT_EQUAL(2 * step, prealloc_size(step, step + 1));
+        CPPUNIT_ASSERT_EQUAL(3 * step, prealloc_size(step, 2 * step + 512));
+}
+
 /*
  * TODO: Build in tests for file open and close methods.
  */
@@ -30,6 +30,9 @@ class LoggerFileWriterTest : public CppUnit::TestFixture
         CPPUNIT_TEST( testLoggingStart );
         CPPUNIT_TEST( testLoggingStop );
         CPPUNIT_TEST( testLoggingSampleSkip );
+        CPPUNIT_TEST( testLogNameIndex );
+        CPPUNIT_TEST( testParseLogIndex );
+        CPPUNIT_TEST( testPreallocSize );
         CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -41,6 +44,9 @@ public:
         void testLoggingStart();
         void testLoggingStop();
         void testLoggingSampleSkip();
+        void testLogNameIndex();
+        void testParseLogIndex();
+        void testPreallocSize();
 };
 
 #endif /* _LOGGERFILEWRITER_TEST_H_ */
@@ -21,8 +21,11 @@
 
 
 #include "CAN_device.h"
+#include "CAN_device_mock.h"
 #include <stdbool.h>
 
+static CAN_msg last_tx_msg;
+
 int CAN_device_init(const uint8_t channel, const uint32_t baud, const bool termination_enabled)
 {
         return 1;
@@ -30,6 +33,7 @@ int CAN_device_init(const uint8_t channel, const uint32_t baud, const bool termi
 
 int CAN_device_tx_msg(const uint8_t channel, const CAN_msg *msg, unsigned int timeoutMs)
 {
+        last_tx_msg = *msg;
         return 1;
 }
 
@@ -38,8 +42,25 @@ int CAN_device_rx_msg(CAN_msg *msg, const unsigned int timeoutMs)
         return 1;
 }
 
+size_t CAN_device_rx_msgs(CAN_msg *msgs, const size_t max,
+                          const unsigned int timeoutMs)
+{
+        return 0;
+}
+
 int CAN_device_set_filter(const uint8_t channel, const uint8_t id, const uint8_t extended,
                           const uint32_t filter, const uint32_t mask, const bool enabled)
 {
         return 1;
 }
+
+int CAN_device_get_health(const uint8_t channel,
+                          struct CAN_device_health *health)
+{
+        return 0;
+}
+
+const CAN_msg* CAN_device_mock_last_tx_msg(void)
+{
+        return &last_tx_msg;
+}
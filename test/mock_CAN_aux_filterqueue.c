@@ -30,6 +30,10 @@ void CAN_aux_filterqueue_configure(uint8_t new_can_bus, uint32_t new_low_id_rang
 {
 }
 
+void CAN_aux_filterqueue_add_rx_filters(struct CAN_filter_plan *plans)
+{
+}
+
 bool CAN_aux_filterqueue_put_msg(CAN_msg * can_msg)
 {
         return false;
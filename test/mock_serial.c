@@ -24,6 +24,7 @@
 #include "serial.h"
 
 #include <stddef.h>
+#include <string.h>
 
 #define BUFF_SIZE	(1024 * 16)
 
@@ -31,9 +32,9 @@ static struct Serial *s;
 static char buff[BUFF_SIZE + 1];
 static char *ptr = buff;
 
-static void  _post_tx_cb(xQueueHandle q, void *arg)
+static void  _post_tx_cb(struct Serial *serial, void *arg)
 {
-        for(; ptr < buff + BUFF_SIZE && xQueueReceive(q, ptr, 0); ++ptr);
+        ptr += serial_tx_get(serial, ptr, buff + BUFF_SIZE - ptr, NULL);
         *ptr = 0;
 }
 
@@ -52,6 +53,11 @@ char* mock_getTxBuffer()
         return buff;
 }
 
+size_t mock_getTxBufferLen()
+{
+        return ptr - buff;
+}
+
 void mock_resetTxBuffer()
 {
         ptr = buff;
@@ -60,8 +66,7 @@ void mock_resetTxBuffer()
 
 void mock_appendRxBuffer(const char *src)
 {
-        xQueueHandle q = serial_get_rx_queue(s);
-        for (; *src && xQueueSend(q, src, 0); ++src);
+        serial_rx_put(s, src, strlen(src), NULL);
 }
 
 void mock_setRxBuffer(const char *src)
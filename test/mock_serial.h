@@ -25,6 +25,8 @@
 #include "cpp_guard.h"
 #include "serial.h"
 
+#include <stddef.h>
+
 CPP_GUARD_BEGIN
 
 void setupMockSerial();
@@ -36,6 +38,8 @@ void mock_setRxBuffer(const char *src);
 /* STIEG: Should be const */
 char* mock_getTxBuffer();
 
+size_t mock_getTxBufferLen();
+
 void mock_appendRxBuffer(const char *src);
 
 void mock_resetTxBuffer();
@@ -32,6 +32,7 @@
 #include "lap_stats.h"
 #include "loggerConfig.h"
 #include "loggerHardware.h"
+#include "loggerSampleData.h"
 #include "loggerSampleData.test.h"
 #include "mock_serial.h"
 #include "predictive_timer_2.h"
@@ -39,6 +40,7 @@
 #include "task.h"
 #include "task_testing.h"
 
+#include <string.h>
 #include <string>
 #include <stdio.h>
 
@@ -69,6 +71,7 @@ void SampleRecordTest::setUp()
 void SampleRecordTest::tearDown()
 {
         free_sample_buffer(&s);
+        s.holds = NULL;
 }
 
 
@@ -520,3 +523,275 @@ void SampleRecordTest::test_get_sample_value_by_name()
         result = get_sample_value_by_name(&s, "FooBar", &value, &units);
         CPPUNIT_ASSERT_EQUAL(false, result);
 }
+
+void SampleRecordTest::testSampleSchedule()
+{
+        const struct sample_schedule *sched = s.schedule;
+        CPPUNIT_ASSERT(sched != NULL);
+
+        /* Every channel is in exactly one range, buckets fastest first */
+        size_t scheduled = 0;
+        for (size_t i = 0; i < sched->bucket_count; ++i) {
+                const struct sample_bucket *b = sched->buckets + i;
+                if (i > 0)
+                        CPPUNIT_ASSERT(sched->buckets[i - 1].rate < b->rate);
+
+                for (size_t j = 0; j < b->range_count; ++j) {
+                        const struct sample_range *r =
+                                sched->ranges + b->range_first + j;
+                        for (size_t k = r->first; k < r->first + r->count; ++k) {
+                                const ChannelConfig *cfg =
+                                        s.channel_samples[k].cfg;
+                                CPPUNIT_ASSERT_EQUAL(b->rate, cfg->sampleRate);
+                                CPPUNIT_ASSERT(!(cfg->flags & ALWAYS_SAMPLED));
+                        }
+                        scheduled += r->count;
+                }
+        }
+
+        /* Interval, Utc and ElapsedTime lead the buffer */
+        CPPUNIT_ASSERT_EQUAL((uint16_t) 1, sched->always.range_count);
+        const struct sample_range *r = sched->ranges + sched->always.range_first;
+        CPPUNIT_ASSERT_EQUAL((uint16_t) 0, r->first);
+        CPPUNIT_ASSERT_EQUAL((uint16_t) 3, r->count);
+        scheduled += r->count;
+
+        CPPUNIT_ASSERT_EQUAL(s.channel_count, scheduled);
+}
+
+void SampleRecordTest::testPopulateOnlyDueChannels()
+{
+        for (size_t tick = 0; tick <= SAMPLE_1Hz; ++tick) {
+                const int rate = populate_sample_buffer(&s, tick);
+
+                int expected = SAMPLE_DISABLED;
+                for (size_t i = 0; i < s.channel_count; ++i) {
+                        const int sr = s.channel_samples[i].cfg->sampleRate;
+                        if (tick % sr == 0)
+                                expected = getHigherSampleRate(sr, expected);
+                }
+                CPPUNIT_ASSERT_EQUAL(expected, rate);
+
+                for (size_t i = 0; i < s.channel_count; ++i) {
+                        const ChannelSample *cs = s.channel_samples + i;
+                        const bool always = cs->cfg->flags & ALWAYS_SAMPLED;
+                        const bool due = tick % cs->cfg->sampleRate == 0 ||
+                                (always && rate != SAMPLE_DISABLED);
+                        CPPUNIT_ASSERT_EQUAL(due, cs->populated);
+                }
+        }
+}
+
+void SampleRecordTest::testSampleHolds()
+{
+        volatile bool holds[SAMPLE_HOLDER_COUNT] = {false};
+        s.holds = holds;
+        s.ticks = 10;
+        s.shareable = false;
+
+        CPPUNIT_ASSERT(!sample_is_held(&s));
+        CPPUNIT_ASSERT(sample_hold(&s, SAMPLE_HOLDER_FILE_WRITER));
+
+        /* Only the file writer may hold what is not shareable */
+        CPPUNIT_ASSERT(!sample_hold(&s, SAMPLE_HOLDER_TELEMETRY));
+        CPPUNIT_ASSERT(!holds[SAMPLE_HOLDER_TELEMETRY]);
+
+        s.shareable = true;
+        CPPUNIT_ASSERT(sample_hold(&s, SAMPLE_HOLDER_TELEMETRY));
+        CPPUNIT_ASSERT(sample_is_held(&s));
+
+        /* A release for another tick means the buffer was rebuilt */
+        sample_release(&s, SAMPLE_HOLDER_TELEMETRY, 9);
+        CPPUNIT_ASSERT(holds[SAMPLE_HOLDER_TELEMETRY]);
+
+        sample_release(&s, SAMPLE_HOLDER_TELEMETRY, 10);
+        CPPUNIT_ASSERT(sample_is_held(&s));
+        const LoggerMessage lm = create_logger_message(
+                LoggerMessageType_Sample, 10, &s, false);
+        release_logger_message(&lm, SAMPLE_HOLDER_FILE_WRITER);
+        CPPUNIT_ASSERT(!sample_is_held(&s));
+
+        /* Samples outside of the pool don't track holds */
+        s.holds = NULL;
+        sample_hold(&s, SAMPLE_HOLDER_FILE_WRITER);
+        CPPUNIT_ASSERT(!sample_is_held(&s));
+}
+
+void SampleRecordTest::testSamplePool()
+{
+        struct sample pool[3];
+        volatile bool holds[3][SAMPLE_HOLDER_COUNT];
+        struct sample_pool_stats stats = {0};
+
+        memset(pool, 0, sizeof(pool));
+        memset((void *) holds, 0, sizeof(holds));
+        for (size_t i = 0; i < 3; ++i) {
+                pool[i].holds = holds[i];
+                pool[i].shareable = true;
+                init_sample_buffer(pool + i, s.channel_count);
+                pool[i].ticks = i + 1;
+        }
+
+        /* Free buffers are handed out round robin from start */
+        CPPUNIT_ASSERT(pool + 1 == sample_pool_next(pool, 3, 1, 0, &stats));
+        sample_hold(pool + 1, SAMPLE_HOLDER_TELEMETRY);
+        CPPUNIT_ASSERT(pool + 2 == sample_pool_next(pool, 3, 1, 0, &stats));
+
+        sample_hold(pool + 0, SAMPLE_HOLDER_FILE_WRITER);
+        sample_hold(pool + 2, SAMPLE_HOLDER_CALLBACK);
+
+        /* Nothing free, but nothing due either */
+        size_t idle = 1;
+        while (is_sample_due(pool, idle))
+                ++idle;
+        CPPUNIT_ASSERT(NULL == sample_pool_next(pool, 3, 0, idle, &stats));
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 0, stats.skipped);
+
+        /* Held buffers are never taken back, the due sample is skipped */
+        CPPUNIT_ASSERT(NULL == sample_pool_next(pool, 3, 0, 0, &stats));
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 1, stats.skipped);
+        CPPUNIT_ASSERT(holds[1][SAMPLE_HOLDER_TELEMETRY]);
+        CPPUNIT_ASSERT(holds[2][SAMPLE_HOLDER_CALLBACK]);
+
+        /* A buffer becomes available once its holders let go */
+        sample_release(pool + 1, SAMPLE_HOLDER_TELEMETRY, pool[1].ticks);
+        CPPUNIT_ASSERT(pool + 1 == sample_pool_next(pool, 3, 0, 0, &stats));
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 1, stats.skipped);
+
+        for (size_t i = 0; i < 3; ++i)
+                free_sample_buffer(pool + i);
+}
+
+/*
+ * A telemetry link that never lets go of its samples must not cost the
+ * file writer a single one.
+ */
+void SampleRecordTest::testStalledTelemetry()
+{
+        struct sample pool[4];
+        volatile bool holds[4][SAMPLE_HOLDER_COUNT];
+        struct sample_pool_stats stats = {0};
+        size_t start = 0;
+        size_t telemetry = 0;
+
+        memset(pool, 0, sizeof(pool));
+        memset((void *) holds, 0, sizeof(holds));
+        for (size_t i = 0; i < 4; ++i) {
+                pool[i].holds = holds[i];
+                init_sample_buffer(pool + i, s.channel_count);
+        }
+
+        for (size_t tick = 0; tick < 100; ++tick) {
+                struct sample *sample = sample_pool_next(pool, 4, start,
+                                                         tick, &stats);
+                CPPUNIT_ASSERT(sample);
+
+                sample->ticks = tick;
+                sample_pool_share(pool, 4, sample, &stats);
+
+                /* The file writer gets it and is done with it next tick */
+                CPPUNIT_ASSERT(sample_hold(sample, SAMPLE_HOLDER_FILE_WRITER));
+                if (sample_hold(sample, SAMPLE_HOLDER_TELEMETRY))
+                        ++telemetry;
+                if (sample_hold(sample, SAMPLE_HOLDER_CALLBACK))
+                        CPPUNIT_ASSERT(holds[sample - pool][SAMPLE_HOLDER_TELEMETRY]);
+
+                for (size_t i = 0; i < 4; ++i) {
+                        if (pool + i != sample)
+                                sample_release(pool + i,
+                                               SAMPLE_HOLDER_FILE_WRITER,
+                                               pool[i].ticks);
+                }
+
+                start = (sample - pool + 1) % 4;
+        }
+
+        /* Telemetry got what it could until it had half of the pool */
+        CPPUNIT_ASSERT_EQUAL((size_t) 2, telemetry);
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 0, stats.skipped);
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 98, stats.shed);
+
+        for (size_t i = 0; i < 4; ++i)
+                free_sample_buffer(pool + i);
+}
+
+void SampleRecordTest::testSampleArena()
+{
+        static uint8_t buff[4096];
+        struct arena arena;
+        struct sample pool[2];
+
+        arena_init(&arena, buff, sizeof(buff));
+        memset(pool, 0, sizeof(pool));
+        for (size_t i = 0; i < 2; ++i) {
+                pool[i].arena = &arena;
+                CPPUNIT_ASSERT(init_sample_buffer(pool + i, s.channel_count));
+                CPPUNIT_ASSERT(pool[i].schedule);
+        }
+
+        const size_t used = arena_bytes_used(&arena);
+        CPPUNIT_ASSERT(used > 2 * sizeof(ChannelSample[s.channel_count]));
+        CPPUNIT_ASSERT((uint8_t *) pool[0].channel_samples >= buff);
+        CPPUNIT_ASSERT((uint8_t *) pool[1].schedule < buff + sizeof(buff));
+
+        /* Rebuilding after a reset lands in exactly the same place */
+        ChannelSample * const first = pool[0].channel_samples;
+        arena_reset(&arena);
+        for (size_t i = 0; i < 2; ++i) {
+                free_sample_buffer(pool + i);
+                CPPUNIT_ASSERT(init_sample_buffer(pool + i, s.channel_count));
+        }
+        CPPUNIT_ASSERT(first == pool[0].channel_samples);
+        CPPUNIT_ASSERT_EQUAL(used, arena_bytes_used(&arena));
+
+        /* The size the pool arena is planned with is enough */
+        arena_init(&arena, buff, SAMPLE_BUFFER_ARENA_BYTES(s.channel_count));
+        free_sample_buffer(pool);
+        pool[0].channel_samples = NULL;
+        pool[0].schedule = NULL;
+        CPPUNIT_ASSERT(init_sample_buffer(pool, s.channel_count));
+
+        /* Out of room is reported like a failed allocation */
+        arena_init(&arena, buff, sizeof(ChannelSample[s.channel_count]));
+        pool[0].channel_samples = NULL;
+        pool[0].schedule = NULL;
+        CPPUNIT_ASSERT_EQUAL((size_t) 0,
+                             init_sample_buffer(pool, s.channel_count));
+        CPPUNIT_ASSERT(NULL == pool[0].channel_samples);
+}
+
+void SampleRecordTest::testUpdateSampleBuffer()
+{
+        ChannelSample * const samples = s.channel_samples;
+        const size_t count = s.channel_count;
+        const struct sample_schedule *sched = s.schedule;
+
+        /* Nothing changed, so nothing moves */
+        CPPUNIT_ASSERT(update_sample_buffer(&s));
+        CPPUNIT_ASSERT(samples == s.channel_samples);
+        CPPUNIT_ASSERT(sched == s.schedule);
+
+        /* A rate edit gets patched into the schedule of the same buffer */
+        ChannelConfig *cfg = s.channel_samples[3].cfg;
+        CPPUNIT_ASSERT(!(cfg->flags & ALWAYS_SAMPLED));
+        cfg->sampleRate = SAMPLE_1Hz;
+        CPPUNIT_ASSERT(update_sample_buffer(&s));
+        CPPUNIT_ASSERT(samples == s.channel_samples);
+        CPPUNIT_ASSERT_EQUAL(count, s.channel_count);
+
+        sched = s.schedule;
+        bool found = false;
+        for (size_t i = 0; i < sched->bucket_count; ++i) {
+                const struct sample_bucket *b = sched->buckets + i;
+                if (b->rate != SAMPLE_1Hz)
+                        continue;
+
+                for (size_t j = 0; j < b->range_count; ++j) {
+                        const struct sample_range *r =
+                                sched->ranges + b->range_first + j;
+                        if (r->first <= 3 && 3 < r->first + r->count)
+                                found = true;
+                }
+        }
+        CPPUNIT_ASSERT(found);
+}
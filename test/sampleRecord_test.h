@@ -32,6 +32,13 @@ class SampleRecordTest : public CppUnit::TestFixture
         CPPUNIT_TEST( testIsValidLoggerMessage );
         CPPUNIT_TEST( testLoggerMessageAlwaysHasTime );
         CPPUNIT_TEST( test_get_sample_value_by_name );
+        CPPUNIT_TEST( testSampleSchedule );
+        CPPUNIT_TEST( testPopulateOnlyDueChannels );
+        CPPUNIT_TEST( testSampleHolds );
+        CPPUNIT_TEST( testSamplePool );
+        CPPUNIT_TEST( testStalledTelemetry );
+        CPPUNIT_TEST( testSampleArena );
+        CPPUNIT_TEST( testUpdateSampleBuffer );
         CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -43,6 +50,13 @@ public:
         void testIsValidLoggerMessage();
         void testLoggerMessageAlwaysHasTime();
         void test_get_sample_value_by_name();
+        void testSampleSchedule();
+        void testPopulateOnlyDueChannels();
+        void testSampleHolds();
+        void testSamplePool();
+        void testStalledTelemetry();
+        void testSampleArena();
+        void testUpdateSampleBuffer();
 
 private:
 
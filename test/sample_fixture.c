@@ -0,0 +1,44 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "loggerConfig.h"
+#include "sample_fixture.h"
+
+#include <string.h>
+
+void setup_test_sample(struct sample *s, ChannelSample *samples,
+                       ChannelConfig *cfgs, const size_t count)
+{
+        memset(s, 0, sizeof(*s));
+        memset(samples, 0, sizeof(ChannelSample[count]));
+        memset(cfgs, 0, sizeof(ChannelConfig[count]));
+
+        for (size_t i = 0; i < count; ++i) {
+                strcpy(cfgs[i].label, "Chan");
+                strcpy(cfgs[i].units, "U");
+                cfgs[i].sampleRate = SAMPLE_10Hz;
+                samples[i].cfg = cfgs + i;
+                samples[i].sampleData = SampleData_Float;
+        }
+
+        s->channel_count = count;
+        s->channel_samples = samples;
+}
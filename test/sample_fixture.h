@@ -0,0 +1,43 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SAMPLE_FIXTURE_H_
+#define _SAMPLE_FIXTURE_H_
+
+#include "channel_config.h"
+#include "cpp_guard.h"
+#include "sampleRecord.h"
+
+#include <stddef.h>
+
+CPP_GUARD_BEGIN
+
+/*
+ * Sets up s as a sample of count float channels, all sampled at 10Hz and
+ * none of them populated.  Each channel i uses samples[i] and cfgs[i],
+ * which must hold count entries.
+ */
+void setup_test_sample(struct sample *s, ChannelSample *samples,
+                       ChannelConfig *cfgs, const size_t count);
+
+CPP_GUARD_END
+
+#endif /* _SAMPLE_FIXTURE_H_ */
@@ -0,0 +1,169 @@
+/**
+ * Race Capture Pro Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture Pro fimrware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "loggerConfig.h"
+#include "sample_fixture.h"
+#include "sample_history.h"
+#include "sample_history_test.hh"
+#include <string.h>
+
+#define TEST_CHANNELS	10
+
+CPPUNIT_TEST_SUITE_REGISTRATION( SampleHistoryTest );
+
+static ChannelConfig cfgs[TEST_CHANNELS];
+static ChannelSample samples[TEST_CHANNELS];
+static struct sample s;
+
+static void fill_sample(const int val)
+{
+        for (int i = 0; i < TEST_CHANNELS; ++i) {
+                samples[i].populated = true;
+                samples[i].valueFloat = val + i;
+        }
+}
+
+void SampleHistoryTest::setUp()
+{
+        setup_test_sample(&s, samples, cfgs, TEST_CHANNELS);
+        sample_history_init();
+        sample_history_configure(&s, 1, SAMPLE_10Hz);
+}
+
+void SampleHistoryTest::tearDown()
+{
+        sample_history_configure(&s, 0, SAMPLE_DISABLED);
+}
+
+void SampleHistoryTest::testDisabled()
+{
+        uint32_t tick;
+
+        sample_history_configure(&s, 0, SAMPLE_10Hz);
+        fill_sample(1);
+        sample_history_add(&s, 1);
+
+        CPPUNIT_ASSERT_EQUAL((size_t) 0, sample_history_count());
+        CPPUNIT_ASSERT(!sample_history_next(&s, &tick));
+}
+
+void SampleHistoryTest::testRoundTrip()
+{
+        uint32_t tick;
+
+        fill_sample(100);
+        samples[3].populated = false;
+        sample_history_add(&s, 7);
+
+        fill_sample(200);
+        sample_history_add(&s, 8);
+        CPPUNIT_ASSERT_EQUAL((size_t) 2, sample_history_count());
+
+        memset(samples, 0xff, sizeof(samples));
+        for (int i = 0; i < TEST_CHANNELS; ++i) {
+                samples[i].cfg = cfgs + i;
+                samples[i].sampleData = SampleData_Float;
+        }
+
+        CPPUNIT_ASSERT(sample_history_next(&s, &tick));
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 7, tick);
+        CPPUNIT_ASSERT(!samples[3].populated);
+        CPPUNIT_ASSERT(samples[4].populated);
+        CPPUNIT_ASSERT_EQUAL(100.0f, samples[0].valueFloat);
+        CPPUNIT_ASSERT_EQUAL(104.0f, samples[4].valueFloat);
+
+        CPPUNIT_ASSERT(sample_history_next(&s, &tick));
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 8, tick);
+        CPPUNIT_ASSERT(samples[3].populated);
+        CPPUNIT_ASSERT_EQUAL(203.0f, samples[3].valueFloat);
+
+        CPPUNIT_ASSERT(!sample_history_next(&s, &tick));
+}
+
+void SampleHistoryTest::testDropsOldest()
+{
+        uint32_t tick;
+
+        /* One second at 10Hz holds at least 10 full samples */
+        for (int i = 0; i < 25; ++i) {
+                fill_sample(i);
+                sample_history_add(&s, i);
+        }
+
+        const size_t count = sample_history_count();
+        CPPUNIT_ASSERT(count >= 10);
+        CPPUNIT_ASSERT(count < 25);
+
+        CPPUNIT_ASSERT(sample_history_next(&s, &tick));
+        CPPUNIT_ASSERT_EQUAL((uint32_t) (25 - count), tick);
+        CPPUNIT_ASSERT_EQUAL((float) (25 - count), samples[0].valueFloat);
+}
+
+void SampleHistoryTest::testFreeze()
+{
+        fill_sample(1);
+        sample_history_add(&s, 1);
+        sample_history_freeze();
+        sample_history_add(&s, 2);
+        CPPUNIT_ASSERT_EQUAL((size_t) 1, sample_history_count());
+
+        sample_history_reset();
+        CPPUNIT_ASSERT_EQUAL((size_t) 0, sample_history_count());
+        sample_history_add(&s, 3);
+        CPPUNIT_ASSERT_EQUAL((size_t) 1, sample_history_count());
+}
+
+void SampleHistoryTest::testLayoutChanged()
+{
+        uint32_t tick;
+
+        fill_sample(1);
+        sample_history_add(&s, 1);
+        sample_history_add(&s, 2);
+
+        samples[0].sampleData = SampleData_Double;
+        CPPUNIT_ASSERT(!sample_history_next(&s, &tick));
+        CPPUNIT_ASSERT_EQUAL((size_t) 0, sample_history_count());
+}
+
+void SampleHistoryTest::testLayoutPatched()
+{
+        uint32_t tick;
+
+        fill_sample(1);
+        sample_history_add(&s, 1);
+        sample_history_add(&s, 2);
+
+        /* Same record size, but the old values would read back wrong */
+        samples[0].sampleData = SampleData_Int;
+        CPPUNIT_ASSERT(!sample_history_next(&s, &tick));
+        CPPUNIT_ASSERT_EQUAL((size_t) 0, sample_history_count());
+
+        /* Adding a sample with the new layout drops the old records */
+        samples[0].sampleData = SampleData_Float;
+        sample_history_add(&s, 3);
+        sample_history_add(&s, 4);
+        samples[0].sampleData = SampleData_Int;
+        sample_history_add(&s, 5);
+        CPPUNIT_ASSERT_EQUAL((size_t) 1, sample_history_count());
+        CPPUNIT_ASSERT(sample_history_next(&s, &tick));
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 5, tick);
+}
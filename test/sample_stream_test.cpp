@@ -0,0 +1,296 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "api.h"
+#include "loggerConfig.h"
+#include "mock_serial.h"
+#include "sample_fixture.h"
+#include "sample_meta.h"
+#include "sample_stream.h"
+#include "sample_stream_test.hh"
+#include <string.h>
+#include <string>
+
+#define TEST_CHANNELS	3
+
+CPPUNIT_TEST_SUITE_REGISTRATION( SampleStreamTest );
+
+static ChannelConfig cfgs[TEST_CHANNELS];
+static ChannelSample samples[TEST_CHANNELS];
+static struct sample s;
+static struct sample_stream stream;
+
+static const uint8_t* tx_bytes()
+{
+        return (const uint8_t*) mock_getTxBuffer();
+}
+
+static uint8_t xor_of(const uint8_t *buf, const size_t len)
+{
+        uint8_t x = 0;
+        for (size_t i = 0; i < len; ++i)
+                x ^= buf[i];
+
+        return x;
+}
+
+static void process(const char *json)
+{
+        char buf[64];
+        strcpy(buf, json);
+        mock_resetTxBuffer();
+        process_api(getMockSerial(), buf, strlen(buf));
+}
+
+void SampleStreamTest::setUp()
+{
+        setupMockSerial();
+        setup_test_sample(&s, samples, cfgs, TEST_CHANNELS);
+
+        samples[0].sampleData = SampleData_Int;
+        samples[0].valueInt = 1000;
+        samples[0].populated = true;
+
+        cfgs[1].precision = 2;
+        samples[1].sampleData = SampleData_Float;
+        samples[1].valueFloat = 12.34f;
+        samples[1].populated = true;
+
+        samples[2].sampleData = SampleData_Double;
+        samples[2].populated = false;
+
+        sample_meta_invalidate();
+        sample_stream_attach(&stream, getMockSerial());
+}
+
+void SampleStreamTest::tearDown()
+{
+        sample_stream_detach(&stream);
+}
+
+void SampleStreamTest::testAttach()
+{
+        CPPUNIT_ASSERT(&stream == sample_stream_find(getMockSerial()));
+        CPPUNIT_ASSERT_EQUAL(SAMPLE_STREAM_FORMAT_JSON, stream.format);
+
+        sample_stream_detach(&stream);
+        CPPUNIT_ASSERT(NULL == sample_stream_find(getMockSerial()));
+}
+
+void SampleStreamTest::testSetFormat()
+{
+        CPPUNIT_ASSERT(sample_stream_set_format(&stream,
+                                                SAMPLE_STREAM_FORMAT_BINARY));
+        CPPUNIT_ASSERT_EQUAL(SAMPLE_STREAM_FORMAT_BINARY, stream.format);
+        CPPUNIT_ASSERT(!sample_stream_set_format(&stream,
+                                                 __SAMPLE_STREAM_FORMAT_COUNT));
+        CPPUNIT_ASSERT_EQUAL(SAMPLE_STREAM_FORMAT_BINARY, stream.format);
+
+        sample_stream_reset(&stream);
+        CPPUNIT_ASSERT_EQUAL(SAMPLE_STREAM_FORMAT_JSON, stream.format);
+}
+
+void SampleStreamTest::testJsonDefault()
+{
+        sample_stream_send(&stream, &s, 7, false);
+        CPPUNIT_ASSERT_EQUAL(std::string("{\"s\":{\"t\":7,\"d\":[1000,12.34,3]}}\r\n"),
+                             std::string(mock_getTxBuffer()));
+}
+
+void SampleStreamTest::testBinaryFrame()
+{
+        sample_stream_set_format(&stream, SAMPLE_STREAM_FORMAT_BINARY);
+        sample_stream_send(&stream, &s, 7, false);
+
+        /* sync + length + 16 payload bytes + checksum */
+        const uint8_t *b = tx_bytes();
+        CPPUNIT_ASSERT_EQUAL((size_t) 20, mock_getTxBufferLen());
+        CPPUNIT_ASSERT_EQUAL((uint8_t) SAMPLE_STREAM_SYNC, b[0]);
+        CPPUNIT_ASSERT_EQUAL((uint8_t) 16, b[1]);
+        CPPUNIT_ASSERT_EQUAL((uint8_t) 0, b[2]);
+
+        const uint8_t *p = b + 3;
+        CPPUNIT_ASSERT_EQUAL((uint8_t) 0, p[0]);
+
+        uint32_t tick;
+        memcpy(&tick, p + 1, sizeof(tick));
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 7, tick);
+
+        uint16_t count;
+        memcpy(&count, p + 5, sizeof(count));
+        CPPUNIT_ASSERT_EQUAL((uint16_t) TEST_CHANNELS, count);
+        CPPUNIT_ASSERT_EQUAL((uint8_t) 0x03, p[7]);
+
+        int32_t ival;
+        memcpy(&ival, p + 8, sizeof(ival));
+        CPPUNIT_ASSERT_EQUAL((int32_t) 1000, ival);
+
+        float fval;
+        memcpy(&fval, p + 12, sizeof(fval));
+        CPPUNIT_ASSERT_EQUAL(12.34f, fval);
+
+        CPPUNIT_ASSERT_EQUAL(xor_of(p, 16), b[19]);
+}
+
+void SampleStreamTest::testDeltaFrames()
+{
+        sample_stream_set_format(&stream, SAMPLE_STREAM_FORMAT_BINARY_DELTA);
+        sample_stream_send(&stream, &s, 1, false);
+
+        /* The first frame is a key frame: zigzag(1000), zigzag(1234) */
+        const uint8_t key[] = {
+                SAMPLE_STREAM_SYNC, 12, 0,
+                SAMPLE_STREAM_FLAG_VARINT | SAMPLE_STREAM_FLAG_KEY,
+                1, 0, 0, 0, TEST_CHANNELS, 0, 0x03,
+                0xd0, 0x0f, 0xa4, 0x13,
+        };
+        CPPUNIT_ASSERT_EQUAL((size_t) sizeof(key) + 1, mock_getTxBufferLen());
+        CPPUNIT_ASSERT_EQUAL(0, memcmp(key, tx_bytes(), sizeof(key)));
+        CPPUNIT_ASSERT_EQUAL(xor_of(key + 3, 12), tx_bytes()[sizeof(key)]);
+
+        mock_resetTxBuffer();
+        samples[0].valueInt = 1001;
+        samples[1].valueFloat = 12.33f;
+        sample_stream_send(&stream, &s, 2, false);
+
+        /* Then +1 and -1 against the last values */
+        const uint8_t delta[] = {
+                SAMPLE_STREAM_SYNC, 10, 0,
+                SAMPLE_STREAM_FLAG_VARINT,
+                2, 0, 0, 0, TEST_CHANNELS, 0, 0x03,
+                0x02, 0x01,
+        };
+        CPPUNIT_ASSERT_EQUAL((size_t) sizeof(delta) + 1, mock_getTxBufferLen());
+        CPPUNIT_ASSERT_EQUAL(0, memcmp(delta, tx_bytes(), sizeof(delta)));
+
+        /* Meta forces a fresh key frame */
+        mock_resetTxBuffer();
+        sample_stream_send(&stream, &s, 3, true);
+        const uint8_t *frame = (const uint8_t*)
+                strchr(mock_getTxBuffer(), SAMPLE_STREAM_SYNC);
+        CPPUNIT_ASSERT(frame != NULL);
+        CPPUNIT_ASSERT_EQUAL((uint8_t) (SAMPLE_STREAM_FLAG_VARINT |
+                                        SAMPLE_STREAM_FLAG_KEY), frame[3]);
+}
+
+void SampleStreamTest::testDeltaKeyReset()
+{
+        sample_stream_set_format(&stream, SAMPLE_STREAM_FORMAT_BINARY_DELTA);
+        samples[2].valueDouble = 5;
+        samples[2].populated = true;
+        sample_stream_send(&stream, &s, 1, false);
+
+        /* A key frame without the channel forgets its last value */
+        samples[2].populated = false;
+        sample_stream_send(&stream, &s, 2, true);
+
+        mock_resetTxBuffer();
+        samples[2].valueDouble = 7;
+        samples[2].populated = true;
+        sample_stream_send(&stream, &s, 3, false);
+
+        /* So the next delta is against 0: zigzag(7), not zigzag(2) */
+        const uint8_t delta[] = {
+                SAMPLE_STREAM_SYNC, 11, 0,
+                SAMPLE_STREAM_FLAG_VARINT,
+                3, 0, 0, 0, TEST_CHANNELS, 0, 0x07,
+                0x00, 0x00, 0x0e,
+        };
+        CPPUNIT_ASSERT_EQUAL((size_t) sizeof(delta) + 1, mock_getTxBufferLen());
+        CPPUNIT_ASSERT_EQUAL(0, memcmp(delta, tx_bytes(), sizeof(delta)));
+}
+
+void SampleStreamTest::testMetaInBinary()
+{
+        sample_stream_set_format(&stream, SAMPLE_STREAM_FORMAT_BINARY);
+        sample_stream_send(&stream, &s, 0, true);
+
+        const std::string out(mock_getTxBuffer());
+        CPPUNIT_ASSERT_EQUAL((size_t) 0, out.find("{\"meta\":[{\"nm\":\"Chan\""));
+
+        const size_t frame = out.find("}\r\n") + 3;
+        CPPUNIT_ASSERT_EQUAL((uint8_t) SAMPLE_STREAM_SYNC, tx_bytes()[frame]);
+}
+
+void SampleStreamTest::testApiSetFormat()
+{
+        process("{\"setStreamFmt\":{\"fmt\":2}}");
+        CPPUNIT_ASSERT_EQUAL(std::string("{\"setStreamFmt\":{\"rc\":1}}\r\n"),
+                             std::string(mock_getTxBuffer()));
+        CPPUNIT_ASSERT_EQUAL(SAMPLE_STREAM_FORMAT_BINARY_DELTA, stream.format);
+
+        process("{\"setStreamFmt\":{\"fmt\":9}}");
+        CPPUNIT_ASSERT_EQUAL(std::string("{\"setStreamFmt\":{\"rc\":-1}}\r\n"),
+                             std::string(mock_getTxBuffer()));
+        CPPUNIT_ASSERT_EQUAL(SAMPLE_STREAM_FORMAT_BINARY_DELTA, stream.format);
+}
+
+void SampleStreamTest::testApiNotAttached()
+{
+        sample_stream_detach(&stream);
+        process("{\"setStreamFmt\":{\"fmt\":1}}");
+        CPPUNIT_ASSERT_EQUAL(std::string("{\"setStreamFmt\":{\"rc\":-3}}\r\n"),
+                             std::string(mock_getTxBuffer()));
+}
+
+void SampleStreamTest::testMetaHash()
+{
+        uint32_t hash;
+        CPPUNIT_ASSERT(sample_meta_get_hash(&s, &hash));
+
+        /* Full meta always carries the hash so the peer can cache it */
+        sample_stream_send(&stream, &s, 0, true);
+        const std::string mh = "\"mh\":" + std::to_string(hash);
+        std::string out(mock_getTxBuffer());
+        CPPUNIT_ASSERT(out.find("\"meta\":[{\"nm\":\"Chan\"") != std::string::npos);
+        CPPUNIT_ASSERT(out.find(mh) != std::string::npos);
+
+        const std::string req = "{\"setMetaHash\":{\"mh\":" +
+                std::to_string(hash) + "}}";
+        process(req.c_str());
+        CPPUNIT_ASSERT_EQUAL(std::string("{\"setMetaHash\":{\"rc\":1}}\r\n"),
+                             std::string(mock_getTxBuffer()));
+
+        /* Peer has it, so only the hash goes out */
+        mock_resetTxBuffer();
+        sample_stream_send(&stream, &s, 1, true);
+        CPPUNIT_ASSERT_EQUAL("{\"s\":{\"t\":1," + mh +
+                             ",\"d\":[1000,12.34,3]}}\r\n",
+                             std::string(mock_getTxBuffer()));
+
+        /* A config change means new meta the peer does not have */
+        strcpy(cfgs[0].label, "Renamed");
+        sample_meta_invalidate();
+        mock_resetTxBuffer();
+        sample_stream_send(&stream, &s, 2, true);
+        out = mock_getTxBuffer();
+        CPPUNIT_ASSERT(out.find("\"meta\":[{\"nm\":\"Renamed\"") != std::string::npos);
+        CPPUNIT_ASSERT(out.find(mh) == std::string::npos);
+
+        /* And a new peer has nothing cached */
+        strcpy(cfgs[0].label, "Chan");
+        sample_meta_invalidate();
+        sample_stream_reset(&stream);
+        mock_resetTxBuffer();
+        sample_stream_send(&stream, &s, 3, true);
+        out = mock_getTxBuffer();
+        CPPUNIT_ASSERT(out.find("\"meta\":[") != std::string::npos);
+}
@@ -0,0 +1,58 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SAMPLE_STREAM_TEST_H_
+#define _SAMPLE_STREAM_TEST_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class SampleStreamTest : public CppUnit::TestFixture
+{
+        CPPUNIT_TEST_SUITE( SampleStreamTest );
+        CPPUNIT_TEST( testAttach );
+        CPPUNIT_TEST( testSetFormat );
+        CPPUNIT_TEST( testJsonDefault );
+        CPPUNIT_TEST( testBinaryFrame );
+        CPPUNIT_TEST( testDeltaFrames );
+        CPPUNIT_TEST( testDeltaKeyReset );
+        CPPUNIT_TEST( testMetaInBinary );
+        CPPUNIT_TEST( testApiSetFormat );
+        CPPUNIT_TEST( testApiNotAttached );
+        CPPUNIT_TEST( testMetaHash );
+        CPPUNIT_TEST_SUITE_END();
+
+public:
+        void setUp();
+        void tearDown();
+
+        void testAttach();
+        void testSetFormat();
+        void testJsonDefault();
+        void testBinaryFrame();
+        void testDeltaFrames();
+        void testDeltaKeyReset();
+        void testMetaInBinary();
+        void testApiSetFormat();
+        void testApiNotAttached();
+        void testMetaHash();
+};
+
+#endif /* _SAMPLE_STREAM_TEST_H_ */
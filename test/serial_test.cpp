@@ -0,0 +1,277 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "serial.h"
+#include "serial_test.hh"
+#include "task_testing.h"
+#include <string.h>
+#include <string>
+
+using std::string;
+
+static struct Serial *serial;
+static size_t kicks;
+static bool drain;
+static string sent;
+
+static void post_tx_cb(struct Serial *s, void *arg)
+{
+        ++kicks;
+        if (!drain)
+                return;
+
+        char buf[16];
+        size_t len;
+        while ((len = serial_tx_get(s, buf, sizeof(buf), NULL)))
+                sent.append(buf, len);
+}
+
+static void create_serial(const size_t tx_cap, const size_t rx_cap)
+{
+        serial = serial_create("Test", tx_cap, rx_cap, NULL, NULL,
+                               post_tx_cb, NULL);
+        CPPUNIT_ASSERT(serial);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION( SerialTest );
+
+void SerialTest::setUp()
+{
+        serial = NULL;
+        kicks = 0;
+        drain = true;
+        sent.clear();
+}
+
+void SerialTest::tearDown()
+{
+        if (serial)
+                serial_destroy(serial);
+}
+
+void SerialTest::testWriteKicksOnce()
+{
+        create_serial(64, 64);
+        drain = false;
+
+        CPPUNIT_ASSERT_EQUAL(11, serial_write_s(serial, "Hello World"));
+        CPPUNIT_ASSERT_EQUAL((size_t) 1, kicks);
+        CPPUNIT_ASSERT_EQUAL((size_t) 11, serial_tx_pending(serial));
+}
+
+void SerialTest::testWriteLargerThanBuffer()
+{
+        const string msg = "0123456789abcdefghij";
+        create_serial(8, 8);
+
+        CPPUNIT_ASSERT_EQUAL((int) msg.size(),
+                             serial_write_s(serial, msg.c_str()));
+        CPPUNIT_ASSERT_EQUAL(msg, sent);
+        CPPUNIT_ASSERT_EQUAL((size_t) 3, kicks);
+}
+
+void SerialTest::testWriteFullTimesOut()
+{
+        create_serial(4, 4);
+        drain = false;
+
+        CPPUNIT_ASSERT_EQUAL(4, serial_write_s_wait(serial, "abcdefgh", 0));
+        CPPUNIT_ASSERT_EQUAL((size_t) 4, serial_tx_pending(serial));
+        CPPUNIT_ASSERT_EQUAL(0, serial_write_buff_wait(serial, "x", 1, 0));
+}
+
+void SerialTest::testTxDmaRegion()
+{
+        create_serial(8, 8);
+        drain = false;
+
+        /* Move the indexes so the next write wraps */
+        serial_write_s(serial, "abcdef");
+        serial_tx_get(serial, NULL, 6, NULL);
+        serial_write_s(serial, "ghijk");
+
+        size_t avail;
+        const char *data = (const char*) serial_tx_dma_read_init(serial,
+                                                                 &avail);
+        CPPUNIT_ASSERT_EQUAL((size_t) 3, avail);
+        CPPUNIT_ASSERT_EQUAL(string("ghi"), string(data, avail));
+        serial_tx_dma_read_fini(serial, avail, NULL);
+
+        data = (const char*) serial_tx_dma_read_init(serial, &avail);
+        CPPUNIT_ASSERT_EQUAL(string("jk"), string(data, avail));
+        serial_tx_dma_read_fini(serial, avail, NULL);
+        CPPUNIT_ASSERT_EQUAL((size_t) 0, serial_tx_pending(serial));
+
+        /* A purge must not let a stale transfer run past the data */
+        serial_write_s(serial, "lmn");
+        data = (const char*) serial_tx_dma_read_init(serial, &avail);
+        serial_purge_tx_queue(serial);
+        serial_tx_dma_read_fini(serial, avail, NULL);
+        CPPUNIT_ASSERT_EQUAL((size_t) 0, serial_tx_pending(serial));
+}
+
+void SerialTest::testReadLine()
+{
+        const char data[] = "foo\r\nbar\nbaz";
+        char line[16];
+
+        create_serial(8, 32);
+        CPPUNIT_ASSERT_EQUAL(strlen(data),
+                             serial_rx_put(serial, data, strlen(data), NULL));
+
+        int len = serial_read_line_wait(serial, line, sizeof(line), 0);
+        CPPUNIT_ASSERT_EQUAL(string("foo\r\n"), string(line, len));
+
+        len = serial_read_line_wait(serial, line, sizeof(line), 0);
+        CPPUNIT_ASSERT_EQUAL(string("bar\n"), string(line, len));
+
+        /* No newline, so we get what is there once we time out */
+        len = serial_read_line_wait(serial, line, sizeof(line), 0);
+        CPPUNIT_ASSERT_EQUAL(string("baz"), string(line, len));
+
+        /* And a line longer than the buffer is cut at the buffer size */
+        serial_rx_put(serial, "0123456789\n", 11, NULL);
+        len = serial_read_line_wait(serial, line, 4, 0);
+        CPPUNIT_ASSERT_EQUAL(string("0123"), string(line, len));
+}
+
+void SerialTest::testReadBuff()
+{
+        char buf[8];
+        char c;
+
+        create_serial(8, 8);
+        CPPUNIT_ASSERT_EQUAL(0, serial_read_buff_wait(serial, buf,
+                                                      sizeof(buf), 0));
+
+        /* Only what fits is accepted */
+        CPPUNIT_ASSERT_EQUAL((size_t) 8,
+                             serial_rx_put(serial, "abcdefghij", 10, NULL));
+        CPPUNIT_ASSERT_EQUAL(1, serial_peek_c(serial, &c));
+        CPPUNIT_ASSERT_EQUAL('a', c);
+        CPPUNIT_ASSERT_EQUAL(5, serial_read_buff_wait(serial, buf, 5, 0));
+        CPPUNIT_ASSERT_EQUAL(string("abcde"), string(buf, 5));
+        CPPUNIT_ASSERT_EQUAL(3, serial_read_buff_wait(serial, buf,
+                                                      sizeof(buf), 0));
+        CPPUNIT_ASSERT_EQUAL(string("fgh"), string(buf, 3));
+}
+
+void SerialTest::testClosed()
+{
+        char c;
+
+        create_serial(8, 8);
+        serial_rx_put(serial, "a", 1, NULL);
+        serial_close(serial);
+
+        CPPUNIT_ASSERT_EQUAL(false, serial_is_connected(serial));
+        CPPUNIT_ASSERT_EQUAL(-1, serial_read_c_wait(serial, &c, 0));
+        CPPUNIT_ASSERT_EQUAL(-1, serial_write_c(serial, 'a'));
+
+        serial_reopen(serial);
+        CPPUNIT_ASSERT_EQUAL(0, serial_read_c_wait(serial, &c, 0));
+        CPPUNIT_ASSERT_EQUAL(1, serial_write_c(serial, 'a'));
+}
+
+void SerialTest::testEscapedString()
+{
+        const char data[] = "a b\n\"c\"";
+
+        create_serial(64, 8);
+        put_escapedString(serial, data, strlen(data));
+        CPPUNIT_ASSERT_EQUAL(string("a b\\n\\\"c\\\""), sent);
+
+        sent.clear();
+        put_nameEscapedString(serial, "n", data, strlen(data));
+        CPPUNIT_ASSERT_EQUAL(string("n=\"a\\_b\\n\\\"c\\\"\";"), sent);
+}
+
+void SerialTest::testBatch()
+{
+        create_serial(64, 8);
+
+        serial_batch_begin(serial);
+        serial_write_s(serial, "{\"a\":");
+        serial_batch_begin(serial);
+        serial_write_c(serial, '1');
+        serial_batch_end(serial);
+        serial_write_s(serial, "}");
+
+        /* Nothing goes out until the outermost batch ends */
+        CPPUNIT_ASSERT_EQUAL((size_t) 0, kicks);
+        CPPUNIT_ASSERT_EQUAL((size_t) 0, serial_tx_pending(serial));
+
+        serial_batch_end(serial);
+        CPPUNIT_ASSERT_EQUAL((size_t) 1, kicks);
+        CPPUNIT_ASSERT_EQUAL(string("{\"a\":1}"), sent);
+
+        /* And writes go straight through again afterwards */
+        serial_write_c(serial, 'x');
+        CPPUNIT_ASSERT_EQUAL((size_t) 2, kicks);
+        CPPUNIT_ASSERT_EQUAL(string("{\"a\":1}x"), sent);
+}
+
+void SerialTest::testBatchLargeWrite()
+{
+        const string big(300, 'z');
+        create_serial(512, 8);
+
+        serial_batch_begin(serial);
+        serial_write_s(serial, "ab");
+
+        /* Larger than the scratch buffer, so it flushes what came before */
+        CPPUNIT_ASSERT_EQUAL((int) big.size(),
+                             serial_write_s(serial, big.c_str()));
+        CPPUNIT_ASSERT_EQUAL("ab" + big, sent);
+
+        serial_write_s(serial, "cd");
+        serial_batch_end(serial);
+        CPPUNIT_ASSERT_EQUAL("ab" + big + "cd", sent);
+}
+
+void SerialTest::testBatchOtherTask()
+{
+        int owner;
+        int other;
+        create_serial(64, 8);
+
+        set_current_task(&owner);
+        serial_batch_begin(serial);
+        serial_write_s(serial, "ab");
+
+        /* Another task's writes don't wait for the batch to end */
+        set_current_task(&other);
+        serial_write_s(serial, "xy");
+        CPPUNIT_ASSERT_EQUAL(string("xy"), sent);
+
+        /* nor do they land in it, even if that task batches too */
+        serial_batch_begin(serial);
+        serial_write_c(serial, 'z');
+        serial_batch_end(serial);
+        CPPUNIT_ASSERT_EQUAL(string("xyz"), sent);
+
+        set_current_task(&owner);
+        serial_write_s(serial, "cd");
+        serial_batch_end(serial);
+        CPPUNIT_ASSERT_EQUAL(string("xyzabcd"), sent);
+
+        set_current_task(NULL);
+}
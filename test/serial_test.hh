@@ -0,0 +1,59 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SERIAL_TEST_H_
+#define _SERIAL_TEST_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class SerialTest : public CppUnit::TestFixture
+{
+        CPPUNIT_TEST_SUITE( SerialTest );
+        CPPUNIT_TEST( testWriteKicksOnce );
+        CPPUNIT_TEST( testWriteLargerThanBuffer );
+        CPPUNIT_TEST( testWriteFullTimesOut );
+        CPPUNIT_TEST( testTxDmaRegion );
+        CPPUNIT_TEST( testReadLine );
+        CPPUNIT_TEST( testReadBuff );
+        CPPUNIT_TEST( testClosed );
+        CPPUNIT_TEST( testEscapedString );
+        CPPUNIT_TEST( testBatch );
+        CPPUNIT_TEST( testBatchLargeWrite );
+        CPPUNIT_TEST( testBatchOtherTask );
+        CPPUNIT_TEST_SUITE_END();
+
+public:
+        void setUp();
+        void tearDown();
+        void testWriteKicksOnce();
+        void testWriteLargerThanBuffer();
+        void testWriteFullTimesOut();
+        void testTxDmaRegion();
+        void testReadLine();
+        void testReadBuff();
+        void testClosed();
+        void testEscapedString();
+        void testBatch();
+        void testBatchLargeWrite();
+        void testBatchOtherTask();
+};
+
+#endif /* _SERIAL_TEST_H_ */
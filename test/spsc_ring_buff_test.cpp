@@ -0,0 +1,137 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "spsc_ring_buff.h"
+#include "spsc_ring_buff_test.hh"
+#include <string.h>
+#include <string>
+
+using std::string;
+
+#define RING_BUFF_CAP	((size_t) 8)
+
+static struct spsc_ring_buff *rb;
+
+CPPUNIT_TEST_SUITE_REGISTRATION( SpscRingBuffTest );
+
+void SpscRingBuffTest::setUp()
+{
+        rb = spsc_ring_buff_create(RING_BUFF_CAP);
+}
+
+void SpscRingBuffTest::tearDown()
+{
+        spsc_ring_buff_destroy(rb);
+        rb = NULL;
+}
+
+void SpscRingBuffTest::testSanity()
+{
+        CPPUNIT_ASSERT_EQUAL(RING_BUFF_CAP, spsc_ring_buff_capacity(rb));
+        CPPUNIT_ASSERT_EQUAL(RING_BUFF_CAP, spsc_ring_buff_bytes_free(rb));
+        CPPUNIT_ASSERT_EQUAL((size_t) 0, spsc_ring_buff_bytes_used(rb));
+        CPPUNIT_ASSERT_EQUAL((size_t) 0, spsc_ring_buff_peek(rb, NULL, 1));
+        CPPUNIT_ASSERT_EQUAL((size_t) 0, spsc_ring_buff_get(rb, NULL, 1));
+}
+
+void SpscRingBuffTest::testWriteGet()
+{
+        const char data[] = "abcde";
+        char out[8] = {};
+
+        CPPUNIT_ASSERT_EQUAL((size_t) 5, spsc_ring_buff_write(rb, data, 5));
+        CPPUNIT_ASSERT_EQUAL((size_t) 5, spsc_ring_buff_bytes_used(rb));
+        CPPUNIT_ASSERT_EQUAL((size_t) 3, spsc_ring_buff_bytes_free(rb));
+
+        CPPUNIT_ASSERT_EQUAL((size_t) 2, spsc_ring_buff_peek(rb, out, 2));
+        CPPUNIT_ASSERT_EQUAL(string("ab"), string(out));
+        CPPUNIT_ASSERT_EQUAL((size_t) 5, spsc_ring_buff_bytes_used(rb));
+
+        memset(out, 0, sizeof(out));
+        CPPUNIT_ASSERT_EQUAL((size_t) 5, spsc_ring_buff_get(rb, out, 7));
+        CPPUNIT_ASSERT_EQUAL(string(data), string(out));
+        CPPUNIT_ASSERT_EQUAL((size_t) 0, spsc_ring_buff_bytes_used(rb));
+}
+
+void SpscRingBuffTest::testNoClobber()
+{
+        const char data[] = "0123456789";
+        char out[16] = {};
+
+        CPPUNIT_ASSERT_EQUAL(RING_BUFF_CAP, spsc_ring_buff_write(rb, data, 10));
+        CPPUNIT_ASSERT_EQUAL((size_t) 0, spsc_ring_buff_write(rb, data, 1));
+        CPPUNIT_ASSERT_EQUAL(RING_BUFF_CAP, spsc_ring_buff_get(rb, out, 16));
+        CPPUNIT_ASSERT_EQUAL(string("01234567"), string(out));
+}
+
+void SpscRingBuffTest::testWrap()
+{
+        const char data[] = "0123456789";
+
+        /* Walk the head and tail around the buffer a few times */
+        for (size_t i = 0; i < 3 * RING_BUFF_CAP; ++i) {
+                char out[8] = {};
+                const size_t len = 1 + i % 6;
+
+                CPPUNIT_ASSERT_EQUAL(len, spsc_ring_buff_write(rb, data, len));
+                CPPUNIT_ASSERT_EQUAL(len, spsc_ring_buff_bytes_used(rb));
+                CPPUNIT_ASSERT_EQUAL(len, spsc_ring_buff_get(rb, out, len));
+                CPPUNIT_ASSERT_EQUAL(string(data, len), string(out));
+        }
+}
+
+void SpscRingBuffTest::testDma()
+{
+        char out[8] = {};
+        size_t avail;
+
+        /* Move the indexes to the middle so the regions wrap */
+        spsc_ring_buff_write(rb, "xxxxx", 5);
+        spsc_ring_buff_get(rb, NULL, 5);
+
+        char *dst = (char *) spsc_ring_buff_dma_write_init(rb, &avail);
+        CPPUNIT_ASSERT_EQUAL((size_t) 4, avail);
+        memcpy(dst, "abcd", 4);
+        spsc_ring_buff_dma_write_fini(rb, 4);
+
+        dst = (char *) spsc_ring_buff_dma_write_init(rb, &avail);
+        CPPUNIT_ASSERT_EQUAL((size_t) 4, avail);
+        memcpy(dst, "ef", 2);
+        spsc_ring_buff_dma_write_fini(rb, 2);
+        CPPUNIT_ASSERT_EQUAL((size_t) 6, spsc_ring_buff_bytes_used(rb));
+
+        const char *src = (const char *) spsc_ring_buff_dma_read_init(rb, &avail);
+        CPPUNIT_ASSERT_EQUAL((size_t) 4, avail);
+        CPPUNIT_ASSERT_EQUAL(string("abcd"), string(src, avail));
+        spsc_ring_buff_dma_read_fini(rb, 3);
+
+        CPPUNIT_ASSERT_EQUAL((size_t) 3, spsc_ring_buff_get(rb, out, 8));
+        CPPUNIT_ASSERT_EQUAL(string("def"), string(out));
+}
+
+void SpscRingBuffTest::testClear()
+{
+        spsc_ring_buff_write(rb, "abc", 3);
+        spsc_ring_buff_clear(rb);
+
+        CPPUNIT_ASSERT_EQUAL((size_t) 0, spsc_ring_buff_bytes_used(rb));
+        CPPUNIT_ASSERT_EQUAL(RING_BUFF_CAP, spsc_ring_buff_bytes_free(rb));
+}
@@ -0,0 +1,162 @@
+/*
+ * Race Capture Firmware
+ *
+ * Copyright (C) 2016 Autosport Labs
+ *
+ * This file is part of the Race Capture firmware suite
+ *
+ * This is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details. You should
+ * have received a copy of the GNU General Public License along with
+ * this code. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "telemetry_backlog.h"
+#include "telemetry_backlog_test.hh"
+
+#define RECORD_SIZE	100
+
+CPPUNIT_TEST_SUITE_REGISTRATION( TelemetryBacklogTest );
+
+static struct telemetry_backlog bl;
+
+/* Does the bookkeeping of an append without the file I/O */
+static uint32_t add_record(const uint32_t tick, const uint32_t size)
+{
+        const uint32_t start = telemetry_backlog_begin_record(&bl, tick);
+        telemetry_backlog_end_record(&bl, start + size);
+        return start;
+}
+
+/* Same for a read of everything that is contiguous */
+static uint32_t read_all(void)
+{
+        uint32_t total = 0;
+        uint32_t offset;
+        uint32_t len;
+
+        while (telemetry_backlog_next_read(&bl, &offset, &len)) {
+                telemetry_backlog_advance_read(&bl, len);
+                total += len;
+        }
+
+        return total;
+}
+
+void TelemetryBacklogTest::setUp()
+{
+        telemetry_backlog_init(&bl, NULL, NULL);
+}
+
+void TelemetryBacklogTest::testAppendAndRead()
+{
+        uint32_t offset;
+        uint32_t len;
+
+        CPPUNIT_ASSERT(!telemetry_backlog_next_read(&bl, &offset, &len));
+
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 0, add_record(0, RECORD_SIZE));
+        CPPUNIT_ASSERT_EQUAL((uint32_t) RECORD_SIZE, add_record(1, RECORD_SIZE));
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 2 * RECORD_SIZE,
+                             telemetry_backlog_pending(&bl));
+
+        CPPUNIT_ASSERT(telemetry_backlog_next_read(&bl, &offset, &len));
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 0, offset);
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 2 * RECORD_SIZE, len);
+
+        telemetry_backlog_advance_read(&bl, 50);
+        CPPUNIT_ASSERT(telemetry_backlog_next_read(&bl, &offset, &len));
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 50, offset);
+
+        telemetry_backlog_advance_read(&bl, len);
+        CPPUNIT_ASSERT(!telemetry_backlog_next_read(&bl, &offset, &len));
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 0, telemetry_backlog_pending(&bl));
+}
+
+void TelemetryBacklogTest::testNewSegmentOnTickGap()
+{
+        add_record(0, RECORD_SIZE);
+        add_record(1, RECORD_SIZE);
+
+        /* Logging restarted so the ticks start over */
+        CPPUNIT_ASSERT_EQUAL((uint32_t) TELEMETRY_BACKLOG_SEGMENT_SIZE,
+                             add_record(0, RECORD_SIZE));
+        CPPUNIT_ASSERT_EQUAL((size_t) 1, bl.write_seg);
+
+        /* The reader walks across the segments */
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 3 * RECORD_SIZE,
+                             telemetry_backlog_pending(&bl));
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 3 * RECORD_SIZE, read_all());
+}
+
+void TelemetryBacklogTest::testFindTick()
+{
+        size_t seg;
+        uint32_t index_offset;
+
+        for (uint32_t tick = 10; tick < 20; ++tick)
+                add_record(tick, RECORD_SIZE);
+
+        CPPUNIT_ASSERT(telemetry_backlog_find_tick(&bl, 15, &seg, &index_offset));
+        CPPUNIT_ASSERT_EQUAL((size_t) 0, seg);
+        CPPUNIT_ASSERT_EQUAL((uint32_t) (5 * sizeof(uint32_t)), index_offset);
+        CPPUNIT_ASSERT(!telemetry_backlog_find_tick(&bl, 9, &seg, &index_offset));
+        CPPUNIT_ASSERT(!telemetry_backlog_find_tick(&bl, 20, &seg, &index_offset));
+
+        /* After a restart the newest copy of a tick wins */
+        add_record(12, RECORD_SIZE);
+        add_record(13, RECORD_SIZE);
+        CPPUNIT_ASSERT(telemetry_backlog_find_tick(&bl, 13, &seg, &index_offset));
+        CPPUNIT_ASSERT_EQUAL((size_t) 1, seg);
+        CPPUNIT_ASSERT_EQUAL((uint32_t) ((TELEMETRY_BACKLOG_SEGMENT_RECORDS + 1) *
+                                         sizeof(uint32_t)), index_offset);
+}
+
+void TelemetryBacklogTest::testWrapDropsOldest()
+{
+        const uint32_t per_seg = TELEMETRY_BACKLOG_SEGMENT_RECORDS;
+        uint32_t tick = 0;
+
+        /* Fill every segment, then one more record to force a wrap */
+        for (size_t i = 0; i < TELEMETRY_BACKLOG_SEGMENTS * per_seg; ++i)
+                add_record(tick++, 10);
+
+        CPPUNIT_ASSERT_EQUAL((size_t) TELEMETRY_BACKLOG_SEGMENTS - 1, bl.write_seg);
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 0, bl.dropped);
+
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 0, add_record(tick++, 10));
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 1, bl.dropped);
+        CPPUNIT_ASSERT_EQUAL((size_t) 1, bl.read_seg);
+
+        size_t seg;
+        uint32_t index_offset;
+        CPPUNIT_ASSERT(!telemetry_backlog_find_tick(&bl, 0, &seg, &index_offset));
+        CPPUNIT_ASSERT(telemetry_backlog_find_tick(&bl, per_seg, &seg, &index_offset));
+
+        const uint32_t expected = ((TELEMETRY_BACKLOG_SEGMENTS - 1) * per_seg + 1) * 10;
+        CPPUNIT_ASSERT_EQUAL(expected, telemetry_backlog_pending(&bl));
+        CPPUNIT_ASSERT_EQUAL(expected, read_all());
+}
+
+void TelemetryBacklogTest::testOverflowDropsNext()
+{
+        /* One record per segment, then come back around to segment 0 */
+        for (size_t i = 0; i < TELEMETRY_BACKLOG_SEGMENTS; ++i)
+                add_record(i * 10, RECORD_SIZE);
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 0, add_record(1000, RECORD_SIZE));
+        CPPUNIT_ASSERT_EQUAL((size_t) 1, bl.read_seg);
+
+        /* A record bigger than TELEMETRY_BACKLOG_RECORD_MAX runs into segment 1 */
+        add_record(1001, TELEMETRY_BACKLOG_SEGMENT_SIZE);
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 0, bl.segments[1].seq);
+        CPPUNIT_ASSERT_EQUAL((uint32_t) 2, bl.dropped);
+        CPPUNIT_ASSERT_EQUAL((size_t) 2, bl.read_seg);
+}
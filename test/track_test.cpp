@@ -19,8 +19,11 @@
  * this code. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "auto_track.h"
 #include "tracks.h"
 #include "track_test.h"
+#include <stdlib.h>
+#include <string.h>
 
 CPPUNIT_TEST_SUITE_REGISTRATION( TrackTest );
 
@@ -118,3 +121,42 @@ void TrackTest::testGeoPointsValid()
         CPPUNIT_ASSERT(isValidPoint(&v2));
         CPPUNIT_ASSERT(!isValidPoint(&i));
 }
+
+void TrackTest::testTrackIndex()
+{
+        const Track defaultTrack = TEST_TRACK_VALID_CIRCUIT_TRACK;
+        Tracks *tracks = (Tracks *) calloc(1, sizeof(Tracks));
+
+        /* Spread the tracks 0.5 degrees apart, out of latitude order */
+        tracks->count = MAX_TRACK_COUNT;
+        for (int i = 0; i < MAX_TRACK_COUNT; ++i) {
+                Track *t = tracks->tracks + i;
+                t->trackId = i + 1;
+                t->circuit.startFinish.latitude = ((i * 37) % MAX_TRACK_COUNT) * 0.5f - 60;
+                t->circuit.startFinish.longitude = 10;
+        }
+
+        CPPUNIT_ASSERT_EQUAL(0, flash_tracks(tracks, sizeof(Tracks)));
+        const Tracks *flashed = get_tracks();
+        CPPUNIT_ASSERT(tracks_index_valid(flashed));
+
+        for (int i = 1; i < MAX_TRACK_COUNT; ++i)
+                CPPUNIT_ASSERT(getStartPoint(flashed->tracks + flashed->index.order[i - 1]).latitude <
+                               getStartPoint(flashed->tracks + flashed->index.order[i]).latitude);
+
+        for (int i = 0; i < MAX_TRACK_COUNT; ++i) {
+                GeoPoint p = getStartPoint(tracks->tracks + i);
+                p.latitude += 0.01f;
+                p.longitude -= 0.01f;
+                CPPUNIT_ASSERT_EQUAL(i + 1, (int) auto_configure_track(&defaultTrack, &p)->trackId);
+        }
+
+        GeoPoint far = { .latitude = -60.2f, .longitude = 10 };
+        CPPUNIT_ASSERT(&defaultTrack == auto_configure_track(&defaultTrack, &far));
+        far.latitude = -59.75f;
+        CPPUNIT_ASSERT(&defaultTrack == auto_configure_track(&defaultTrack, &far));
+
+        memset(tracks, 0, sizeof(Tracks));
+        flash_tracks(tracks, sizeof(Tracks));
+        free(tracks);
+}
@@ -104,6 +104,7 @@ class TrackTest : public CppUnit::TestFixture
         CPPUNIT_TEST( testGetSector );
         CPPUNIT_TEST( testGeoPointsEqual );
         CPPUNIT_TEST( testGeoPointsValid );
+        CPPUNIT_TEST( testTrackIndex );
         CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -114,6 +115,7 @@ public:
         void testGetSector();
         void testGeoPointsEqual();
         void testGeoPointsValid();
+        void testTrackIndex();
 
 };
 